@@ -0,0 +1,83 @@
+#ifndef ACCESS_POLICY_H
+#define ACCESS_POLICY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#define ACCESS_PREFETCH_DEFAULT_WINDOW 256
+#define ACCESS_PREFETCH_RECORD_SPAN 4096
+#define ACCESS_PREFETCH_MAX_RUN 1048576
+#define ACCESS_SPARSE_BYTES_PER_RECORD 65536
+
+/*
+   Tells the kernel how an input file is about to be read, so that its page
+   cache works for a pass rather than against it.
+
+   A scan reads a file from start to end, and is marked sequential, for a
+   deeper readahead and early reuse of the pages it has left behind. Writing
+   out a sample reads it again at the sampled offsets alone. A sparse sample
+   is marked random, so that a fault on one record does not read in the
+   pages around it that no record needs. A dense one is left to the default
+   read-around, which will fetch pages that later records need anyway, or,
+   if its offsets are sorted, marked sequential once more.
+
+   The random pass is then read ahead by hand: access_prefetch_hint() is
+   given the offset of each record a window ahead of the one being written
+   out. It asks for the pages there with MADV_WILLNEED on the mapping, or
+   POSIX_FADV_WILLNEED on the descriptor when there is no mapping. The
+   kernel starts those reads without waiting for them. Hints on the same or
+   neighbouring pages are merged into one call, of up to
+   ACCESS_PREFETCH_MAX_RUN bytes, and the run still open when the last
+   record has been hinted is sent with access_prefetch_flush().
+   access_prefetch_window() caps a window at the number of records, as a
+   window wider than the sample only costs memory.
+
+   access_policy_release() drops the file's clean pages from the page cache
+   once it is no longer mapped, so that sampling a large file does not push
+   out the cache of everything else on the host.
+
+   All of these are hints: a kernel that ignores them, or a descriptor that
+   cannot take them (a pipe), leaves the reads as they would have been.
+*/
+
+typedef enum access_pattern {
+    kAccessNormal = 0,
+    kAccessSequential,
+    kAccessRandom
+} access_pattern;
+
+typedef struct access_prefetch access_prefetch;
+
+struct access_prefetch {
+    const char *map;
+    int fd;
+    size_t size;
+    size_t page_size;
+    size_t run_start;
+    size_t run_stop;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void access_policy_apply(const char *map, const size_t size, const int fd, const access_pattern pattern);
+access_pattern access_policy_for_sample(const size_t size, const long num_records, const int sorted);
+void access_policy_release(const int fd);
+long access_prefetch_window(const long window, const long num_records);
+void access_prefetch_init(access_prefetch *pf, const char *map, const size_t size, const int fd);
+void access_prefetch_hint(access_prefetch *pf, const uint64_t offset);
+void access_prefetch_flush(access_prefetch *pf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef ALGORITHM_L_H
+#define ALGORITHM_L_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+
+#include "rng.h"
+
+/*
+   Li's Algorithm L, for a reservoir of k slots filled from a stream of
+   unknown length (cf. Li, "Reservoir-sampling algorithms of time
+   complexity O(n(1 + log(N/n)))", http://dx.doi.org/10.1145/198429.198435).
+
+   Once the reservoir is full, w is drawn with algorithm_l_initial_weight(),
+   and algorithm_l_next_index() gives the index of the next element to take,
+   the number of elements passed over being geometrically distributed with
+   success probability w. Each take replaces a uniformly chosen slot, and w
+   is then shrunk with algorithm_l_next_weight() before the next skip is
+   drawn.
+
+   algorithm_l_random_double() draws from the open interval (0, 1), as the
+   skip distribution takes logarithms. The skips are the same for a given
+   generator state wherever they are drawn, so that the command-line tool
+   and libsample draw the same sample from the same seed.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double algorithm_l_random_double(rng_state *state);
+double algorithm_l_initial_weight(rng_state *state, const long k);
+double algorithm_l_next_weight(rng_state *state, const double w, const long k);
+long algorithm_l_next_index(rng_state *state, const long idx, const double w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
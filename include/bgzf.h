@@ -0,0 +1,109 @@
+#ifndef BGZF_H
+#define BGZF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+/*
+   Reader for BGZF ("blocked gzip", as written by bgzip and samtools): a
+   series of gzip members of at most 64 KB of data apiece, each of which
+   records its own compressed size in a "BC" extra subfield, so that the
+   blocks can be found without inflating any of them. See the SAM/BAM
+   format specification (https://samtools.github.io/hts-specs/SAMv1.pdf),
+   section 4.1.
+
+   The file is mapped, and bgzf_open() walks the block headers to build a
+   table of every block's compressed offset and size, and its inflated size
+   (from the gzip trailer).
+
+   A position in the inflated data is a virtual offset: the compressed
+   offset of the block holding it, shifted up 16 bits, with the position
+   inside the inflated block in the low 16 bits. Virtual offsets sort in the
+   same order as the positions they stand for.
+
+   Blocks can be inflated from any number of threads at once, each with its
+   own bgzf_inflater. bgzf_block_data() goes through a small per-file cache
+   of inflated blocks, so that neighbouring reads inflate a block once; it
+   is not safe to call from more than one thread at a time.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set -- EINVAL for a file that is not BGZF, and EIO for a block
+   that fails to inflate or to match its checksum.
+*/
+
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_HEADER_SIZE 18
+#define BGZF_CACHE_BLOCKS 64
+
+typedef struct bgzf_block bgzf_block;
+typedef struct bgzf_inflater bgzf_inflater;
+typedef struct bgzf_cache_entry bgzf_cache_entry;
+typedef struct bgzf_file bgzf_file;
+
+struct bgzf_block {
+    uint64_t offset;
+    uint32_t compressed_size;
+    uint32_t inflated_size;
+};
+
+struct bgzf_inflater {
+    z_stream stream;
+    int initialized;
+};
+
+struct bgzf_cache_entry {
+    size_t block_idx;
+    char *data;
+    size_t length;
+    unsigned long last_used;
+};
+
+struct bgzf_file {
+    int fd;
+    size_t size;
+    char *map;
+    bgzf_block *blocks;
+    size_t num_blocks;
+    uint64_t inflated_size;
+    bgzf_inflater inflater;
+    bgzf_cache_entry cache[BGZF_CACHE_BLOCKS];
+    int num_cached;
+    unsigned long clock;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int bgzf_is_bgzf(const char *data, const size_t len);
+int bgzf_detect(const char *fn);
+bgzf_file * bgzf_open(const char *fn);
+void bgzf_close(bgzf_file **bgzf_ptr);
+int bgzf_inflater_init(bgzf_inflater *inflater);
+void bgzf_inflater_end(bgzf_inflater *inflater);
+int bgzf_inflate_block(bgzf_inflater *inflater, const bgzf_file *bgzf, const size_t block_idx, char *out, size_t *out_len);
+const char * bgzf_block_data(bgzf_file *bgzf, const size_t block_idx, size_t *len);
+size_t bgzf_block_index(const bgzf_file *bgzf, const uint64_t compressed_offset);
+size_t bgzf_next_data_block(const bgzf_file *bgzf, size_t block_idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint64_t bgzf_virtual_offset(const bgzf_file *bgzf, const size_t block_idx, const size_t in_block_offset)
+{
+    return (bgzf->blocks[block_idx].offset << 16) | (uint64_t) in_block_offset;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef EXTERNAL_SHUFFLE_H
+#define EXTERNAL_SHUFFLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "rng.h"
+#include "output_buffer.h"
+
+#define EXTERNAL_SHUFFLE_MINIMUM_MEMORY 1048576
+#define EXTERNAL_SHUFFLE_READ_SIZE 1048576
+#define EXTERNAL_SHUFFLE_BUCKET_BUFFER_SIZE 1048576
+#define EXTERNAL_SHUFFLE_BUCKET_BUFFER_MINIMUM 4096
+#define EXTERNAL_SHUFFLE_MAX_BUCKETS 256
+#define EXTERNAL_SHUFFLE_MAX_DEPTH 8
+
+/*
+   Whole-input shuffle of line-groupings within a memory budget, for inputs
+   whose index would not fit in memory.
+
+   The input is read sequentially. If all of its line-groupings, along with
+   8 bytes of bookkeeping apiece, fit in the budget, they are shuffled in
+   memory and written out. Otherwise, each line-grouping is appended to one
+   of a number of unlinked temporary bucket files, picked uniformly at
+   random, and each bucket is then shuffled in turn, the same way, and
+   written out -- so a bucket that turns out too big is itself split, up to
+   EXTERNAL_SHUFFLE_MAX_DEPTH levels. As the bucket of each line-grouping is
+   uniform and each bucket is shuffled uniformly, the concatenation is a
+   uniform shuffle of the input.
+
+   An eighth of the budget goes to bucket write buffers, and the remainder
+   to the line-groupings being shuffled. All input and bucket I/O is
+   sequential, in large blocks.
+
+   As with the other sampling paths, a final line-grouping without its last
+   newline is left out.
+
+   Calls return 0 on success, or -1 with errno set.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int external_shuffle(const int in_fd, output_buffer *ob, const int lines_per_offset, const size_t max_memory, const char *temp_dir, rng_state *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
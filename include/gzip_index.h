@@ -0,0 +1,135 @@
+#ifndef GZIP_INDEX_H
+#define GZIP_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+/*
+   Random access into ordinary, single-stream gzip input, after zlib's
+   examples/zran.c: a gzip file cannot be inflated from anywhere but its
+   start, unless inflation is resumed at the boundary of a deflate block
+   with the 32 KB of output that went before it (the "window") to resolve
+   back-references.
+
+   gzip_scan() inflates the whole file once, handing each piece of output
+   to a callback, and records a checkpoint -- inflated offset, compressed
+   offset and bit, and window -- at the first block boundary at least span
+   bytes past the one before, and at the start of every member of a
+   multi-member file. A gzip_reader then reaches any inflated offset by
+   inflating forward from the nearest checkpoint at or before it, or from
+   where it already is, when that is closer.
+
+   The checkpoints can be kept in a sidecar, written next to the input as
+   <input>.sgzi:
+
+     magic[8]          "SMPLGZI\0"
+     version           uint32_t
+     window_size       uint32_t, bytes of window per checkpoint
+     file_size         uint64_t, size of the compressed input
+     file_mtime_sec    int64_t, modification time of the compressed input
+     file_mtime_nsec   int64_t
+     inflated_size     uint64_t
+     span              uint64_t
+     num_checkpoints   uint64_t
+
+   followed by the checkpoints as they are laid out in memory. As with the
+   line index, a sidecar whose recorded size or modification time differs
+   from that of the input is stale, and integers are in host byte order.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set -- EINVAL for input that is not gzip, EIO for data that fails
+   to inflate or to match its checksum, and ESTALE for an out-of-date
+   sidecar.
+*/
+
+#define GZIP_INDEX_MAGIC "SMPLGZI"
+#define GZIP_INDEX_VERSION 1
+#define GZIP_INDEX_SUFFIX ".sgzi"
+#define GZIP_INDEX_WINDOW_SIZE 32768
+#define GZIP_INDEX_DEFAULT_SPAN 4194304
+#define GZIP_READER_BUFFER_SIZE 65536
+
+typedef struct gzip_checkpoint gzip_checkpoint;
+typedef struct gzip_index_header gzip_index_header;
+typedef struct gzip_file gzip_file;
+typedef struct gzip_reader gzip_reader;
+typedef void (*gzip_consumer)(void *arg, const uint64_t out, const char *data, const size_t len);
+
+/* bits is the number of bits of the byte before in that are still to be inflated */
+struct gzip_checkpoint {
+    uint64_t out;
+    uint64_t in;
+    uint32_t bits;
+    uint32_t reserved;
+    unsigned char window[GZIP_INDEX_WINDOW_SIZE];
+};
+
+struct gzip_index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t window_size;
+    uint64_t file_size;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t inflated_size;
+    uint64_t span;
+    uint64_t num_checkpoints;
+};
+
+struct gzip_file {
+    int fd;
+    size_t size;
+    char *map;
+    struct stat s;
+    gzip_checkpoint *checkpoints;
+    size_t num_checkpoints;
+    size_t checkpoint_capacity;
+    uint64_t inflated_size;
+    uint64_t span;
+};
+
+/* buf holds buf_len inflated bytes from buf_start; the stream resumes at out */
+struct gzip_reader {
+    const gzip_file *gz;
+    z_stream stream;
+    int initialized;
+    int positioned;
+    uint64_t out;
+    char *buf;
+    uint64_t buf_start;
+    size_t buf_len;
+    unsigned long restarts;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int gzip_is_gzip(const char *data, const size_t len);
+int gzip_detect(const char *fn);
+gzip_file * gzip_open(const char *fn);
+void gzip_close(gzip_file **gz_ptr);
+int gzip_scan(gzip_file *gz, const uint64_t span, gzip_consumer consume, void *arg);
+size_t gzip_checkpoint_index(const gzip_file *gz, const uint64_t out);
+char * gzip_index_sidecar_name(const char *in_fn);
+int gzip_index_write(const gzip_file *gz, const char *index_fn);
+int gzip_index_read(gzip_file *gz, const char *index_fn);
+int gzip_reader_init(gzip_reader *reader, const gzip_file *gz);
+void gzip_reader_end(gzip_reader *reader);
+int gzip_reader_data(gzip_reader *reader, const uint64_t offset, const char **data, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef LIBSAMPLE_H
+#define LIBSAMPLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "rng.h"
+#include "newline_scan.h"
+#include "record_arena.h"
+#include "radix_sort.h"
+
+#define SAMPLE_FEED_READ_SIZE 1048576
+
+/*
+   Embeddable sampling, for programs that would otherwise run sample as a
+   child process and pipe records through it.
+
+   Each sample_ctx holds its own generator, its own record reservoir and
+   its own input mappings, and no call touches global state, so that any
+   number of contexts can be used at once, from as many threads -- though
+   one context must not be used from two threads at the same time.
+
+   Input is pushed in pieces of any size with sample_feed() (or a whole
+   descriptor or file with sample_feed_fd() and sample_feed_file()), and
+   is sampled as it arrives, the way sample reads standard input: only the
+   records that are kept are copied. Records are then pulled, one at a
+   time, with sample_next_record(), which ends the input on its first
+   call. A record is a line-grouping of options.lines_per_offset lines,
+   with its newlines; as elsewhere, a final line-grouping without its last
+   newline is left out.
+
+   A context seeded like sample, and fed the same input, gives the same
+   records in the same order as sample reading that input from standard
+   input.
+
+   Calls return kSampleOk or another sample_status -- nothing exits or
+   prints. A context that fails to take input is left unusable, and
+   returns kSampleErrorState from then on.
+*/
+
+typedef enum sample_status {
+    kSampleOk = 0,
+    kSampleEnd = 1,
+    kSampleErrorArgument = -1,
+    kSampleErrorMemory = -2,
+    kSampleErrorIO = -3,
+    kSampleErrorState = -4
+} sample_status;
+
+typedef struct sample_options sample_options;
+typedef struct sample_ctx sample_ctx;
+
+/*
+   k is the sample size, where 0 asks for every line-grouping: a shuffle
+   without replacement, or as many draws as line-groupings with it; as
+   with the original Twister's own seeding, the low 32 bits of its seed
+   must not all be zero
+*/
+struct sample_options {
+    long k;
+    int lines_per_offset;
+    int with_replacement;
+    int preserve_order;
+    rng_kind rng;
+    uint64_t seed;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sample_options_init(sample_options *options);
+sample_ctx * new_sample_ctx(const sample_options *options, sample_status *status);
+void delete_sample_ctx(sample_ctx **ctx_ptr);
+sample_status sample_feed(sample_ctx *ctx, const char *buf, const size_t len);
+sample_status sample_feed_fd(sample_ctx *ctx, const int fd);
+sample_status sample_feed_file(sample_ctx *ctx, const char *filename);
+sample_status sample_finish(sample_ctx *ctx);
+sample_status sample_next_record(sample_ctx *ctx, const char **record, size_t *len);
+long sample_num_records(const sample_ctx *ctx);
+const char * sample_status_string(const sample_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
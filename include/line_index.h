@@ -0,0 +1,76 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+   Persistent line index ("sidecar"), written next to the input file as
+   <input>.sidx. The file is a fixed header followed by the start offset of
+   every newline-terminated line, as one uint64_t per line, in file order:
+
+     magic[8]          "SMPLIDX\0"
+     version           uint32_t
+     offset_width      uint32_t, bytes per stored offset
+     file_size         uint64_t, size of the indexed input
+     file_mtime_sec    int64_t, modification time of the indexed input
+     file_mtime_nsec   int64_t
+     num_lines         uint64_t
+
+   An index whose recorded size or modification time differs from that of
+   the input is considered stale and is not opened. Integers are stored in
+   host byte order, so an index is not portable across architectures.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set.
+*/
+
+#define LINE_INDEX_MAGIC "SMPLIDX"
+#define LINE_INDEX_VERSION 1
+#define LINE_INDEX_SUFFIX ".sidx"
+
+typedef struct line_index_header line_index_header;
+typedef struct line_index line_index;
+
+struct line_index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t offset_width;
+    uint64_t file_size;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t num_lines;
+};
+
+struct line_index {
+    int fd;
+    size_t size;
+    char *map;
+    const line_index_header *header;
+    const uint64_t *offsets;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char * line_index_sidecar_name(const char *in_fn);
+int line_index_build(const char *in_map, const size_t in_size, const struct stat *in_stat, const char *index_fn);
+line_index * line_index_open(const char *index_fn, const struct stat *in_stat);
+void line_index_close(line_index **idx_ptr);
+uint64_t line_index_num_lines(const line_index *idx);
+off_t line_index_offset(const line_index *idx, const uint64_t line_idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,8 +18,15 @@
 #define MT19937_SHIFT_T(y)  (y << 15)
 #define MT19937_SHIFT_L(y)  (y >> 18)
 
-extern unsigned long mt[MT19937_N]; /* the array for the state vector  */
-extern int mti; /* mti == N+1 means mt[N] is not initialized */
+typedef struct mt19937_state mt19937_state;
+
+struct mt19937_state {
+    unsigned long mt[MT19937_N]; /* the array for the state vector  */
+    int mti; /* mti == N+1 means mt[N] is not initialized */
+};
+
+/* the state behind the non-reentrant calls below */
+extern mt19937_state mt19937_global_state;
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,6 +35,9 @@ extern "C" {
 void mt19937_seed_rng(unsigned long seed);
 double mt19937_generate_random_double();
 unsigned long mt19937_generate_random_ulong();
+void mt19937_seed_rng_r(mt19937_state *state, unsigned long seed);
+double mt19937_generate_random_double_r(mt19937_state *state);
+unsigned long mt19937_generate_random_ulong_r(mt19937_state *state);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,32 @@
+#ifndef NEWLINE_SCAN_H
+#define NEWLINE_SCAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+   Record-boundary scanner: finds '\n' bytes in a buffer with SSE2, AVX2 or
+   AVX-512BW kernels, picked at runtime from the host CPU's feature flags, and
+   falls back to a portable scalar scanner elsewhere.
+
+   The SAMPLE_NEWLINE_SCAN environment variable ("scalar", "sse2", "avx2" or
+   "avx512") caps the kernel width, which is useful for checking that every
+   kernel gives identical results on the same host.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void newline_scan_init();
+const char * newline_scan_name();
+size_t newline_scan_positions(const char *buf, size_t len, size_t *positions, size_t capacity, size_t *scanned);
+const char * newline_scan_nth(const char *start, const char *stop, long n);
+size_t newline_scan_count(const char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef OFFSET_ARENA_H
+#define OFFSET_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#define OFFSET_ARENA_HUGE_PAGE_SIZE 2097152
+
+/*
+   Backing store for reservoir offset arrays. Blocks are anonymous private
+   mappings rather than heap allocations, so that:
+
+     - growing a block with offset_arena_resize() moves page table entries
+       (mremap(2)) instead of copying its contents, and pages past the part
+       in use are never touched, so a block can grow geometrically without
+       the cost in copies or resident memory;
+
+     - blocks of a huge page or more are marked for transparent huge pages,
+       which cuts TLB misses in the random accesses of a shuffle of a large
+       index.
+
+   Block sizes are rounded up to a whole number of pages, and a caller must
+   hand back the same byte count it asked for when resizing or releasing a
+   block. Calls return a non-NULL pointer on success, or NULL with errno
+   set.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void * offset_arena_reserve(const size_t bytes);
+void * offset_arena_resize(void *block, const size_t old_bytes, const size_t new_bytes);
+void offset_arena_release(void *block, const size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
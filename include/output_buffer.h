@@ -0,0 +1,79 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+
+#define OUTPUT_BUFFER_DEFAULT_CAPACITY 4194304
+#define OUTPUT_BUFFER_ALIGNMENT 4096
+
+/*
+   Bulk emitter: whole records are copied into one large, page-aligned
+   buffer, which is handed to write(2) when full. Records at least half the
+   size of the buffer skip the copy and are written straight from the
+   caller's memory (e.g., an input mapping).
+
+   Records can also be queued as byte ranges of an input file with
+   output_buffer_append_range(). After output_buffer_use_zero_copy(), ranges
+   move from the input file descriptor to the output without a userspace
+   copy, via splice(2) when the output is a pipe (or vmsplice(2) from the
+   mapping, if the file cannot be spliced) and via copy_file_range(2) when
+   it is a regular file. Adjacent ranges are coalesced into one call. Any
+   other output, or a kernel that refuses the call, falls back to write(2).
+   The source can be switched between records, e.g. from one input file to
+   the next.
+
+   Calls return 0 on success, or -1 with errno set.
+*/
+
+typedef enum output_backend {
+    kOutputBackendWrite = 0,
+    kOutputBackendSplice,
+    kOutputBackendVmsplice,
+    kOutputBackendCopyFileRange
+} output_backend;
+
+typedef struct output_buffer output_buffer;
+
+struct output_buffer {
+    int fd;
+    char *buf;
+    size_t capacity;
+    size_t length;
+    unsigned long long bytes_written;
+    unsigned long long records_written;
+    struct timeval start_time;
+    output_backend backend;
+    int in_fd;
+    const char *in_map;
+    off_t pending_offset;
+    size_t pending_length;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+output_buffer * new_output_buffer(const int fd, const size_t capacity);
+void delete_output_buffer(output_buffer **ob_ptr);
+int output_buffer_append(output_buffer *ob, const char *data, const size_t len);
+int output_buffer_append_range(output_buffer *ob, const off_t offset, const size_t len);
+int output_buffer_flush(output_buffer *ob);
+int output_buffer_set_source(output_buffer *ob, const int in_fd, const char *in_map);
+output_backend output_buffer_use_zero_copy(output_buffer *ob);
+const char * output_buffer_backend_name(const output_backend backend);
+double output_buffer_elapsed_seconds(const output_buffer *ob);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
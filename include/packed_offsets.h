@@ -0,0 +1,90 @@
+#ifndef PACKED_OFFSETS_H
+#define PACKED_OFFSETS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+/*
+   Bit-packed, frame-of-reference store for a long run of byte offsets,
+   such as the line start offsets of a whole-file index. Offsets are
+   appended in blocks of PACKED_OFFSETS_BLOCK_SIZE; each full block keeps
+   the smallest of its offsets as a base, and every offset as its distance
+   from that base, in just enough bits for the largest distance. Line start
+   offsets a block apart differ by a few kilobytes at most, so an offset
+   typically costs one to two bytes rather than eight.
+
+   Any offset can be read back in constant time with packed_offsets_get();
+   offsets of the last, partial block are held unpacked until it fills.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set.
+*/
+
+#define PACKED_OFFSETS_BLOCK_SHIFT 6
+#define PACKED_OFFSETS_BLOCK_SIZE (1 << PACKED_OFFSETS_BLOCK_SHIFT)
+
+typedef struct packed_offsets_block packed_offsets_block;
+typedef struct packed_offsets packed_offsets;
+
+/* a block's bit width is the distance to the next block's first bit, over the block size */
+struct packed_offsets_block {
+    uint64_t base;
+    uint64_t bit_start;
+};
+
+struct packed_offsets {
+    uint64_t *words;
+    size_t num_words;
+    size_t word_capacity;
+    packed_offsets_block *blocks;
+    size_t num_blocks;
+    size_t block_capacity;
+    uint64_t pending[PACKED_OFFSETS_BLOCK_SIZE];
+    size_t num_pending;
+    uint64_t num_values;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+packed_offsets * new_packed_offsets();
+void delete_packed_offsets(packed_offsets **po_ptr);
+int packed_offsets_append(packed_offsets *po, const uint64_t value);
+size_t packed_offsets_bytes(const packed_offsets *po);
+
+static inline uint64_t packed_offsets_get(const packed_offsets *po, const uint64_t idx)
+{
+    const uint64_t block_idx = idx >> PACKED_OFFSETS_BLOCK_SHIFT;
+    const packed_offsets_block *block = NULL;
+    uint64_t width = 0;
+    uint64_t bit = 0;
+    uint64_t shift = 0;
+    uint64_t value = 0;
+
+    if (block_idx >= po->num_blocks)
+        return po->pending[idx & (PACKED_OFFSETS_BLOCK_SIZE - 1)];
+
+    block = &po->blocks[block_idx];
+    width = (block[1].bit_start - block->bit_start) >> PACKED_OFFSETS_BLOCK_SHIFT;
+    if (width == 0)
+        return block->base;
+    bit = block->bit_start + (idx & (PACKED_OFFSETS_BLOCK_SIZE - 1)) * width;
+    shift = bit & 63;
+    value = po->words[bit >> 6] >> shift;
+    if (shift + width > 64)
+        value |= po->words[(bit >> 6) + 1] << (64 - shift);
+    if (width < 64)
+        value &= (UINT64_C(1) << width) - 1;
+
+    return block->base + value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define RADIX_SORT_DIGIT_BITS 8
+#define RADIX_SORT_NUM_BUCKETS (1 << RADIX_SORT_DIGIT_BITS)
+#define RADIX_SORT_PARALLEL_MINIMUM 1048576
+
+/*
+   Least-significant-digit radix sort of unsigned 32- and 64-bit keys, such
+   as reservoir offsets. Keys are sorted a byte at a time, from the lowest
+   byte up, by counting and then scattering into a scratch array of the same
+   size. A byte that is the same in every key -- which takes in all of the
+   high bytes of offsets into a file much smaller than the key type can
+   address -- is skipped without a pass, so offsets into a file of a few GB
+   need four or five passes, whatever the key width.
+
+   With num_threads > 1 (and at least RADIX_SORT_PARALLEL_MINIMUM keys), each
+   pass counts and scatters contiguous slices of the keys on separate
+   threads.
+
+   Calls return 0 on success, or -1 with errno set, in which case the keys
+   are left in some permutation of their original order.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int radix_sort_uint32(uint32_t *keys, const size_t num_keys, const int num_threads);
+int radix_sort_uint64(uint64_t *keys, const size_t num_keys, const int num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RECORD_ARENA_H
+#define RECORD_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define RECORD_ARENA_DEFAULT_CAPACITY 1048576
+#define RECORD_ARENA_DEFAULT_SLOTS 1024
+#define RECORD_ARENA_COMPACTION_MINIMUM 1048576
+
+/*
+   Content reservoir for streamed input. Record bytes live back-to-back in
+   one growable block of memory, and each reservoir slot refers to a byte
+   range of that block, so that no record gets its own allocation.
+
+   A record is built up at the tail of the block with record_arena_extend(),
+   a piece at a time if it spans several reads, and is then either
+   committed to a slot or discarded. A replacement record that fits in the
+   space of the record it replaces is copied over it in place; otherwise
+   the old space becomes garbage, which is reclaimed by sliding the live
+   records down (compaction) once garbage outweighs them.
+
+   Slots are numbered in the order they were first filled; sorting them by
+   sequence puts them back in input order.
+
+   Calls return 0 on success, or -1 with errno set.
+*/
+
+typedef struct record_slot record_slot;
+typedef struct record_arena record_arena;
+
+struct record_slot {
+    size_t offset;
+    size_t length;
+    size_t capacity;
+    uint64_t sequence;
+};
+
+struct record_arena {
+    char *data;
+    size_t size;
+    size_t capacity;
+    size_t pending_start;
+    size_t live_bytes;
+    size_t peak_capacity;
+    record_slot *slots;
+    long num_slots;
+    long slot_capacity;
+    unsigned long compactions;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+record_arena * new_record_arena(const size_t capacity, const long slot_capacity);
+void delete_record_arena(record_arena **arena_ptr);
+int record_arena_extend(record_arena *arena, const char *data, const size_t len);
+int record_arena_commit(record_arena *arena, const long slot_idx, const uint64_t sequence);
+void record_arena_discard(record_arena *arena);
+int record_arena_compact(record_arena *arena);
+void record_arena_sort_by_sequence(record_arena *arena);
+const char * record_arena_record(const record_arena *arena, const long slot_idx, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef RECORD_FIELDS_H
+#define RECORD_FIELDS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+/*
+   Columns of a tab-delimited record, as in BED, bedGraph, VCF and the like.
+   A record is read from its start to its first newline, or to stop if it
+   has none, and columns are numbered from 1.
+
+   record_field_double() reads a column as a finite number, which must take
+   up the whole column; it returns -1 with errno set to EINVAL for a column
+   that is missing, empty or not a number, and 0 otherwise.
+*/
+
+#define RECORD_FIELD_NUMBER_MAX_LENGTH 64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char * record_field(const char *record, const char *stop, const int column, size_t *field_len);
+int record_field_double(const char *record, const char *stop, const int column, double *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
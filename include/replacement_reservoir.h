@@ -0,0 +1,86 @@
+#ifndef REPLACEMENT_RESERVOIR_H
+#define REPLACEMENT_RESERVOIR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <errno.h>
+
+#include "rng.h"
+#include "radix_sort.h"
+
+#define REPLACEMENT_BLOCK_SIZE 65536
+
+/*
+   Sampling with replacement in one pass, in memory proportional to the
+   sample size rather than to the input.
+
+   A sample of k with replacement is k independent draws, and each draw is
+   a reservoir of one slot: the n-th record takes the slot with probability
+   1/n. The chance that a slot holding the n-th record keeps it through the
+   m-th is n/m, so the record that next takes the slot is floor(n/u) + 1,
+   for u uniform on (0, 1), and the records in between are passed over
+   without drawing for them.
+
+   The slots are kept in a min-heap on the number of the record that next
+   takes them, so that a scan asks replacement_reservoir_next() how far it
+   can skip, and hands the record it lands on to replacement_reservoir_take().
+   Records are numbered from 1, and every slot starts out waiting on the
+   first.
+
+   The heap costs a sift of log k steps for each of the k ln N takes, so it
+   is kept for samples that are small next to the input. A sample of a
+   sizeable fraction of the input, or a bootstrap of all of it, is drawn
+   once the N line-groupings are counted instead, a block of
+   REPLACEMENT_BLOCK_SIZE of them at a time: the block takes a binomial
+   share of the draws left, in proportion to its share of the line-groupings
+   left, with replacement_binomial(), and replacement_sorted_draws() spreads
+   that share uniformly over the block, in ascending order, so that a scan
+   of the block meets its draws in turn. Memory goes with a block's draws,
+   not with k.
+
+   Either way, the sample comes out as its offsets in ascending order, a
+   line-grouping drawn several times repeated as many times.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set.
+*/
+
+typedef struct replacement_slot replacement_slot;
+typedef struct replacement_reservoir replacement_reservoir;
+
+struct replacement_slot {
+    uint64_t next;
+    uint64_t offset;
+};
+
+struct replacement_reservoir {
+    replacement_slot *slots;
+    long k;
+    uint64_t num_taken;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+replacement_reservoir * new_replacement_reservoir(const long k);
+void delete_replacement_reservoir(replacement_reservoir **res_ptr);
+void replacement_reservoir_take(replacement_reservoir *res, rng_state *state, const uint64_t offset);
+uint64_t * replacement_reservoir_sorted_offsets(const replacement_reservoir *res);
+uint64_t replacement_binomial(rng_state *state, const uint64_t n, const double p);
+int replacement_sorted_draws(rng_state *state, const uint64_t num_groups, const uint64_t num_draws, uint64_t *draws);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint64_t replacement_reservoir_next(const replacement_reservoir *res)
+{
+    return res->slots[0].next;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mt19937.h"
+
+#define RNG_BUFFER_SIZE (MT19937_N / 2)
+
+/*
+   Pluggable pseudorandom number generators behind one interface:
+
+     - kRngMt19937 is the original Twister, drawn 32 bits at a time through
+       mt19937.c, and is the default. Its integer and real draws are made
+       the way sample has always made them (see below), so that a seed
+       gives the same sample it always has;
+
+     - kRngMt19937Block is the same Twister sequence, generated a whole
+       state vector (624 words) at a time with branch-free loops that the
+       compiler can vectorize, and handed out 64 bits at a time;
+
+     - kRngXoshiro256 is Blackman and Vigna's xoshiro256**;
+
+     - kRngPcg64 is O'Neill's PCG64 (XSL RR 128/64);
+
+     - kRngPhilox is Salmon et al.'s counter-based Philox4x32-10, whose
+       output is a pure function of a key (derived from the seed) and a
+       128-bit counter. Besides its sequential stream, it gives every
+       record a random key of its own with rng_record_key(), so that a
+       sample ranked by record keys is the same whichever thread, chunk or
+       order the records are visited in.
+
+   Every generator but kRngMt19937 fills a buffer of RNG_BUFFER_SIZE 64-bit
+   words at a time, so the inline draws below are a load and an increment
+   most of the time. Real draws from these take the top 53 bits, which
+   gives a double in [0, 1), and bounded integer draws use Lemire's
+   multiply-and-reject method ("Fast random integer generation in an
+   interval", http://dx.doi.org/10.1145/3230636), which is unbiased and
+   good for bounds up to 2^64.
+
+   The original Twister makes real draws in [0, 1] by dividing a 32-bit
+   draw by 2^32 - 1. Its bounded draws come in two flavours: rng_bounded()
+   scales a real draw, and rng_bounded_modulo() takes a 32-bit draw modulo
+   the bound. The flavour a caller uses is whichever it made before there
+   was a choice of generator. Both are slightly biased, and neither can
+   reach more than 2^32 values.
+
+   rng_split() seeds a child generator for a worker thread from a parent,
+   so that runs with the same seed and thread count are repeatable.
+
+   num_drawn counts the words a generator has put in its buffer, and the
+   draws the original Twister has made directly, so that rng_num_draws()
+   can tell how many draws have been taken from it, at the cost of an
+   addition per refill.
+*/
+
+typedef enum rng_kind {
+    kRngMt19937 = 0,
+    kRngMt19937Block,
+    kRngXoshiro256,
+    kRngPcg64,
+    kRngPhilox
+} rng_kind;
+
+typedef struct rng_state rng_state;
+
+struct rng_state {
+    rng_kind kind;
+    union {
+        mt19937_state mt;
+        uint32_t mt_block[MT19937_N];
+        uint64_t xoshiro[4];
+        struct {
+            uint64_t state_hi;
+            uint64_t state_lo;
+            uint64_t inc_hi;
+            uint64_t inc_lo;
+        } pcg;
+        struct {
+            uint64_t key;
+            uint64_t counter;
+        } philox;
+    } u;
+    uint64_t buffer[RNG_BUFFER_SIZE];
+    size_t length;
+    size_t next;
+    uint64_t num_drawn;
+};
+
+/* the state behind the program-wide draws */
+extern rng_state rng_global_state;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rng_seed(rng_state *state, const rng_kind kind, const uint64_t seed);
+void rng_split(rng_state *parent, rng_state *child);
+void rng_refill(rng_state *state);
+void rng_fill_u64(rng_state *state, uint64_t *values, size_t num_values);
+void rng_philox4x32(const uint64_t key, const uint64_t counter_hi, const uint64_t counter_lo, uint64_t *values);
+uint64_t rng_record_key(const rng_state *state, const uint64_t record_id);
+int rng_kind_from_name(const char *name, rng_kind *kind);
+const char * rng_name(const rng_kind kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* the high and low words of the 128-bit product of two 64-bit words */
+static inline uint64_t rng_multiply(const uint64_t a, const uint64_t b, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 rng_uint128;
+    rng_uint128 product = (rng_uint128) a * b;
+
+    *hi = (uint64_t) (product >> 64);
+
+    return (uint64_t) product;
+#else
+    uint64_t a_lo = a & 0xffffffff;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffff;
+    uint64_t b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+
+    *hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+
+    return (cross << 32) | (lo_lo & 0xffffffff);
+#endif
+}
+
+static inline uint64_t rng_next_u64(rng_state *state)
+{
+    if (state->next == state->length)
+        rng_refill(state);
+
+    return state->buffer[state->next++];
+}
+
+static inline double rng_double(rng_state *state)
+{
+    if (state->kind == kRngMt19937) {
+        state->num_drawn++;
+        return mt19937_generate_random_double_r(&state->u.mt);
+    }
+
+    return (double) (rng_next_u64(state) >> 11) * 0x1.0p-53;
+}
+
+static inline uint64_t rng_lemire(rng_state *state, const uint64_t bound)
+{
+    uint64_t hi = 0;
+    uint64_t lo = rng_multiply(rng_next_u64(state), bound, &hi);
+    uint64_t threshold = 0;
+
+    if (lo < bound) {
+        threshold = -bound % bound;
+        while (lo < threshold)
+            lo = rng_multiply(rng_next_u64(state), bound, &hi);
+    }
+
+    return hi;
+}
+
+/* a uniform integer in [0, bound), for bound > 0 */
+static inline uint64_t rng_bounded(rng_state *state, const uint64_t bound)
+{
+    uint64_t value = 0;
+
+    if (state->kind == kRngMt19937) {
+        state->num_drawn++;
+        value = (uint64_t) (mt19937_generate_random_double_r(&state->u.mt) * bound);
+        return (value < bound) ? value : bound - 1;
+    }
+
+    return rng_lemire(state, bound);
+}
+
+static inline uint64_t rng_bounded_modulo(rng_state *state, const uint64_t bound)
+{
+    if (state->kind == kRngMt19937) {
+        state->num_drawn++;
+        return mt19937_generate_random_ulong_r(&state->u.mt) % bound;
+    }
+
+    return rng_lemire(state, bound);
+}
+
+/* draws taken so far -- those refilled into the buffer, less those still waiting in it */
+static inline uint64_t rng_num_draws(const rng_state *state)
+{
+    return state->num_drawn - (uint64_t) (state->length - state->next);
+}
+
+#endif
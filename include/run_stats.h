@@ -0,0 +1,92 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/*
+   Where a run spends its time, for --stats.
+
+   A run is split into phases -- setup, scanning the input, shuffling,
+   sorting and emitting the sample -- and each phase is charged the wall
+   time, CPU time (user and system, over every thread) and page faults
+   that getrusage(2) sees pass while it is the current phase. A phase is
+   entered with run_stats_enter(), which hands back the phase it displaced
+   for run_stats_leave() to restore, so that a shuffle inside a scan is
+   charged to the shuffle alone.
+
+   The counters are plain fields for the caller to add to as it goes, by
+   way of run_stats_add() where worker threads share them.
+   When the stats are not enabled, entering and leaving a phase returns
+   at once, and nothing else is done but those additions.
+
+   run_stats_report() closes the current phase and writes everything out,
+   as aligned text or as one JSON object.
+*/
+
+typedef enum run_stats_phase {
+    kRunStatsSetup = 0,
+    kRunStatsScan,
+    kRunStatsShuffle,
+    kRunStatsSort,
+    kRunStatsEmit,
+    kRunStatsNumPhases
+} run_stats_phase;
+
+typedef struct run_stats_interval run_stats_interval;
+typedef struct run_stats run_stats;
+
+struct run_stats_interval {
+    double wall_seconds;
+    double cpu_seconds;
+    long minor_faults;
+    long major_faults;
+};
+
+struct run_stats {
+    int enabled;
+    int json;
+    run_stats_phase phase;
+    run_stats_interval mark;
+    run_stats_interval phases[kRunStatsNumPhases];
+    unsigned long long bytes_scanned;
+    unsigned long long records_seen;
+    unsigned long long rng_draws;
+    unsigned long long reallocations;
+    unsigned long long reservoir_bytes;
+    unsigned long long output_bytes;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void run_stats_init(run_stats *stats, const int enabled, const int json);
+run_stats_phase run_stats_enter(run_stats *stats, const run_stats_phase phase);
+void run_stats_leave(run_stats *stats, const run_stats_phase previous);
+const char * run_stats_phase_name(const run_stats_phase phase);
+void run_stats_report(run_stats *stats, FILE *out);
+
+/* adds to a counter that worker threads may add to at the same time */
+static inline void run_stats_add(unsigned long long *counter, const unsigned long long value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/* raises a high-water mark, such as reservoir_bytes, to value */
+static inline void run_stats_peak(unsigned long long *peak, const unsigned long long value)
+{
+    if (value > *peak)
+        *peak = value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -12,11 +13,38 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <getopt.h>
+#include <pthread.h>
+
+#include "mt19937.h"
+#include "line_index.h"
+#include "record_arena.h"
+#include "packed_offsets.h"
+#include "offset_arena.h"
+#include "radix_sort.h"
+#include "rng.h"
+#include "algorithm_l.h"
+#include "external_shuffle.h"
+#include "bgzf.h"
+#include "gzip_index.h"
+#include "record_fields.h"
+#include "stratum_table.h"
+#include "sample_state.h"
+#include "replacement_reservoir.h"
+#include "run_stats.h"
+#include "access_policy.h"
 
 #define RS_VERSION "1.0.2"
 #define DEFAULT_OFFSET_VALUE -1
 #define DEFAULT_SAMPLE_SIZE_INCREMENT 10000
 #define LINE_LENGTH_VALUE 65536
+#define NEWLINE_POSITION_BATCH_SIZE 4096
+#define MMAP_CHUNK_MINIMUM_SIZE 1048576
+#define STDIN_STREAM_BLOCK_SIZE 1048576
+#define LINE_ESTIMATE_WINDOW_SIZE 65536
+#define LINE_ESTIMATE_NUM_WINDOWS 16
+#define SEQUENTIAL_SAMPLER_ALPHA_INVERSE 13
+#define INPUT_SET_MAX_MAPPINGS 16
+#define REPLACEMENT_DENSE_RATIO 256
 
 typedef int boolean;
 extern const boolean kTrue;
@@ -27,10 +55,78 @@ const boolean kFalse = 0;
 
 typedef struct offset_reservoir offset_reservoir;
 typedef struct file_mmap file_mmap;
+typedef struct mmap_chunk mmap_chunk;
+typedef struct keyed_offset keyed_offset;
+typedef struct input_set input_set;
+typedef struct gzip_chunk_scan gzip_chunk_scan;
+typedef struct sequential_sampler sequential_sampler;
+typedef struct weight_spec weight_spec;
+typedef struct stratum_remainder stratum_remainder;
+
+/* 
+   writes out a reservoir's sample from one kind of input (a gzip_file, bgzf_file or 
+   input_set), in sample order or, if sorted, in the order of its offsets
+*/
+typedef void (*offset_reservoir_printer)(void *input_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads);
+
+/* 
+   reads the record at an offset into compressed input, handing back a pointer into the 
+   reader's own buffer or, for a record that runs past it, into a scratch buffer
+*/
+typedef const char * (*offset_record_reader)(void *reader_ptr, const uint64_t offset, const int lines_per_offset, char **scratch, size_t *scratch_capacity, size_t *record_len);
+
+/*
+   how a reservoir stores its offsets -- narrow offsets are 32-bit, for inputs
+   under 4 GB; a packed reservoir keeps a whole-file index in a packed_offsets
+   store, and its offsets array holds 32-bit ranks into that store (the rank
+   array is left unallocated, meaning ranks in file order, until the 
+   reservoir is first shuffled); the SAMPLE_OFFSET_ENCODING environment 
+   variable ("wide", "narrow" or "packed") forces an encoding where it can 
+   hold the input's offsets, so that make check covers each of them
+*/
+typedef enum offset_encoding {
+    kOffsetEncodingWide = 0,
+    kOffsetEncodingNarrow,
+    kOffsetEncodingPacked
+} offset_encoding;
+
+/*
+   what a line-grouping's weight is read from, in its first line -- a
+   column holding a number, or for BED, the length end - start of the
+   interval in its second and third columns
+*/
+typedef enum weight_kind {
+    kWeightNone = 0,
+    kWeightColumn,
+    kWeightLength
+} weight_kind;
+
+struct weight_spec {
+    weight_kind kind;
+    int column;
+};
+
+/*
+   how a stratified sample is shared out -- k line-groupings from every
+   stratum, or k in all, split in proportion to the strata's sizes
+*/
+typedef enum stratum_allocation {
+    kStratumAllocationFixed = 0,
+    kStratumAllocationProportional
+} stratum_allocation;
+
+/* a stratum's share of a proportional allocation, less the whole line-groupings it was given */
+struct stratum_remainder {
+    double remainder;
+    long stratum_idx;
+};
 
 struct offset_reservoir {
     long num_offsets;
-    off_t *offsets;
+    long capacity;
+    offset_encoding encoding;
+    void *offsets;
+    packed_offsets *packed;
 };
 
 struct file_mmap {
@@ -42,11 +138,149 @@ struct file_mmap {
     char *map;
 };
 
+/* 
+   a newline-aligned slice of a file_mmap, processed by one worker thread -- 
+   num_groups is -1 when the chunk's line-grouping count is not known ahead 
+   of the scan (i.e., when there is one line per offset); a chunk of BGZF
+   input is instead the range of blocks [start, stop) of bgzf, and a chunk
+   of gzip input the range [start, stop) of gzip's inflated data
+*/
+struct mmap_chunk {
+    const file_mmap *in_mmap;
+    off_t base;
+    size_t start;
+    size_t stop;
+    long lines_before;
+    long num_lines;
+    long skip_lines;
+    long num_groups;
+    int lines_per_offset;
+    offset_reservoir *res;
+    rng_state rng;
+    keyed_offset *keyed;
+    long num_keyed;
+    long max_keyed;
+    bgzf_file *bgzf;
+    gzip_file *gzip;
+    boolean fixed_k;
+    long next_grp_idx;
+    double w;
+    const weight_spec *weight;
+};
+
+/*
+   a scan over inflated gzip data, which arrives a piece at a time: chunk
+   takes each line-grouping that starts before chunk->stop, and a line
+   that runs into the chunk from before its start is left to the chunk
+   before
+*/
+struct gzip_chunk_scan {
+    mmap_chunk *chunk;
+    long k;
+    uint64_t group_start;
+    boolean have_start;
+    boolean done;
+    long ln_idx;
+    long grp_idx;
+};
+
+/*
+   several input files sampled as one population: a line-grouping's offset
+   is its byte offset in the concatenation of the files, which is the
+   offset in its own file plus the sizes of the files before it, so that
+   the reservoirs, sorts and merges apply as they are; no more than
+   max_mapped files are mapped at a time to write the sample out, and the
+   least recently used mapping is the one given up
+*/
+struct input_set {
+    int num_files;
+    char **filenames;
+    off_t *bases;
+    off_t *sizes;
+    off_t total_size;
+    file_mmap **mappings;
+    unsigned long *last_used;
+    unsigned long clock;
+    int *mapped;
+    int num_mapped;
+    int max_mapped;
+};
+
+/*
+   a line-grouping's offset, with the random key given to it by its offset
+   alone -- a sample of the k smallest keys is the same however the input
+   is split among threads, or whether it is read via an index
+*/
+struct keyed_offset {
+    uint64_t key;
+    off_t offset;
+};
+
+/*
+   state of a sequential draw of n of N line-groupings, which come out in
+   ascending order -- cf. Vitter, "An efficient algorithm for sequential
+   random sampling" (http://dx.doi.org/10.1145/23002.23003); Method D is
+   used while the sample is sparse, and Method A once n is large enough
+   relative to N that drawing skips by rejection no longer pays
+*/
+struct sequential_sampler {
+    long n;
+    long N;
+    double n_real;
+    double N_real;
+    double n_inv;
+    double v_prime;
+    long qu1;
+    double qu1_real;
+    long threshold;
+    boolean method_a;
+};
+
+static inline off_t offset_reservoir_get(const offset_reservoir *res, const long idx)
+{
+    switch (res->encoding) {
+    case kOffsetEncodingNarrow:
+        return (off_t) ((const uint32_t *) res->offsets)[idx];
+    case kOffsetEncodingPacked:
+        return (off_t) packed_offsets_get(res->packed, (res->offsets) ? ((const uint32_t *) res->offsets)[idx] : (uint64_t) idx);
+    default:
+        break;
+    }
+
+    return ((const off_t *) res->offsets)[idx];
+}
+
+/* packed reservoirs are filled with offset_reservoir_append() alone */
+static inline void offset_reservoir_set(offset_reservoir *res, const long idx, const off_t offset)
+{
+    if (res->encoding == kOffsetEncodingNarrow)
+        ((uint32_t *) res->offsets)[idx] = (uint32_t) offset;
+    else
+        ((off_t *) res->offsets)[idx] = offset;
+}
+
+static inline void offset_reservoir_swap(offset_reservoir *res, const long idx1, const long idx2)
+{
+    uint32_t temp_narrow = 0;
+    off_t temp_wide = 0;
+
+    if (res->encoding == kOffsetEncodingWide) {
+        temp_wide = ((off_t *) res->offsets)[idx1];
+        ((off_t *) res->offsets)[idx1] = ((off_t *) res->offsets)[idx2];
+        ((off_t *) res->offsets)[idx2] = temp_wide;
+    }
+    else {
+        temp_narrow = ((uint32_t *) res->offsets)[idx1];
+        ((uint32_t *) res->offsets)[idx1] = ((uint32_t *) res->offsets)[idx2];
+        ((uint32_t *) res->offsets)[idx2] = temp_narrow;
+    }
+}
+
 static const char *name = "sample";
 static const char *version = RS_VERSION;
 static const char *authors = "Alex Reynolds";
 static const char *usage = "\n" \
-    "Usage: sample [--sample-size=n] [--lines-per-offset=n] [--sample-without-replacement | --sample-with-replacement] [--shuffle | --preserve-order] [--hybrid | --mmap | --cstdio] [--rng-seed=n] <newline-delimited-file>\n" \
+    "Usage: sample [merge] [--sample-size=n] [--lines-per-offset=n] [--sample-without-replacement | --sample-with-replacement] [--shuffle | --preserve-order] [--hybrid | --mmap | --cstdio] [--threads=n] [--rng-seed=n] [--rng=name] [--max-memory=n] [--total-records=n] [--checkpoint-span=n] [--weight-column=n | --weight=length] [--stratify-column=n] [--allocation=name] [--byte-range=start:end] [--save-state=file] [--stats[=json]] [--prefetch=n] [--drop-cache] [--build-index | --ignore-index] <newline-delimited-file> [<newline-delimited-file> ...]\n" \
     "\n" \
     "  Performs reservoir sampling (http://dx.doi.org/10.1145/3147.3165) on very large input\n" \
     "  files that are delimited by newline characters. The approach used in this application\n" \
@@ -55,6 +289,26 @@ static const char *usage = "\n" \
     "  If the sample size (--sample-size) parameter is omitted, then the sample binary will shuffle\n" \
     "  the entire file.\n\n" \
     "  For text files delimited by multiples of lines, specify a --lines-per-offset value.\n\n" \
+    "  Specify - as the filename to sample records from standard input. Sampled records are kept\n" \
+    "  in memory, instead of their offsets, as the stream cannot be read a second time.\n\n" \
+    "  Several files are sampled as one population, as if they were concatenated; they are read\n" \
+    "  with --mmap, and --threads maps and scans that many files at a time.\n\n" \
+    "  BGZF-compressed input (bgzip, samtools) is sampled without decompressing it to disk; its\n" \
+    "  blocks are inflated in parallel with --threads. Other gzip input is inflated once to sample\n" \
+    "  it and again, from the nearest checkpoint, to write each record out.\n\n" \
+    "  With --weight-column or --weight, a fixed-size sample is drawn with probabilities\n" \
+    "  proportional to each line-grouping's weight, read from its first line; line-groupings\n" \
+    "  whose weight is missing, not a number or not positive are never sampled.\n\n" \
+    "  With --stratify-column, every stratum is sampled in the same scan, and written out in\n" \
+    "  turn, in the order its key is first seen, shuffled or in input order.\n\n" \
+    "  A shard of a file is sampled with --byte-range, and its sample kept with --save-state.\n" \
+    "  sample merge <state-file> [<state-file> ...] then writes out one sample of the shards\n" \
+    "  together, as if the file had been sampled in one process.\n\n" \
+    "  To sample the same file repeatedly, run with --build-index once to write a line index next\n" \
+    "  to it (<newline-delimited-file>.sidx). Later runs use an up-to-date index in place of the\n" \
+    "  indexing pass, and draw a sample of size n in O(n) time.\n";
+/* the flags are a string of their own, as ISO C99 compilers need only take strings of 4095 bytes */
+static const char *usage_flags = "\n" \
     "  Process Flags:\n\n" \
     "  --sample-size=n               | -k n    Number of samples to retrieve (n = positive integer; optional)\n" \
     "  --lines-per-offset=n          | -l n    Number of lines per offset (n = positive integer; optional, default=1)\n" \
@@ -65,7 +319,23 @@ static const char *usage = "\n" \
     "  --mmap                        | -m      Use memory mapping for handling input file (default)\n" \
     "  --cstdio                      | -c      Use C I/O routines for handling input file (optional)\n" \
     "  --hybrid                      | -y      Use hybrid of C I/O routines and memory mapping for handling input file (optional)\n" \
-    "  --rng-seed=n                  | -d n    Initialize the Twister RNG with a specific seed value (n = positive integer; optional)\n" \
+    "  --threads=n                   | -t n    Index the memory-mapped input file with n worker threads (n = positive integer; optional, default=1)\n" \
+    "  --rng-seed=n                  | -d n    Initialize the RNG with a specific seed value (n = positive integer; optional)\n" \
+    "  --rng=name                    | -g name Random number generator: mt19937 (the default, for reproducing past seeds), mt19937-block, xoshiro256, pcg64 or philox (optional)\n" \
+    "  --max-memory=n                | -M n    Shuffle the whole input within n bytes of memory, by way of temporary files (n = positive integer, with an optional K, M, G or T suffix; optional)\n" \
+    "  --total-records=n             | -N n    Number of line-groupings in the input, so that an ordered sample can be drawn in one pass (n = positive integer; optional)\n" \
+    "  --checkpoint-span=n           | -S n    Inflated bytes between the checkpoints set down in gzip input (n = positive integer, with an optional K, M, G or T suffix; optional, default=4M)\n" \
+    "  --weight-column=n             | -w n    Sample without replacement with probability proportional to the number in tab-delimited column n (n = positive integer; optional)\n" \
+    "  --weight=length               | -W length Sample without replacement with probability proportional to BED interval length, end - start (optional)\n" \
+    "  --stratify-column=n           | -f n    Sample each stratum, keyed by tab-delimited column n, on its own (n = positive integer; optional)\n" \
+    "  --allocation=name             | -A name Stratum sample sizes: fixed, for --sample-size from every stratum (the default), or proportional, for --sample-size in all (optional)\n" \
+    "  --byte-range=start:end        | -B start:end Sample only the line-groupings that start in bytes [start, end) of the input (start, end = byte counts, with an optional K, M, G or T suffix; end may be left out; optional)\n" \
+    "  --save-state=file             | -T file Write the sample's reservoir to file, for sample merge, in place of the sample (optional)\n" \
+    "  --stats[=json]                | -Q      Write per-phase times, page faults and counters to standard error, as text or JSON (optional)\n" \
+    "  --prefetch=n                  | -P n    Ask for the pages of the next n records ahead of writing out a sparse sample (n = integer; optional, default=256; 0 turns it off)\n" \
+    "  --drop-cache                  | -D      Drop the input's pages from the page cache when done (optional)\n" \
+    "  --build-index                 | -b      Write a line index sidecar for the input file (or a checkpoint sidecar for gzip input) and exit (optional)\n" \
+    "  --ignore-index                | -n      Do not use a line index sidecar, even if one is up to date (optional)\n" \
     "  --version                     | -v      Show binary version\n" \
     "  --help                        | -h      Show this usage message\n";
 
@@ -79,12 +349,36 @@ static struct sample_global_args_t {
     boolean sample_size_specified;
     long k;
     int lines_per_offset;
+    int num_threads;
+    boolean build_index;
+    boolean ignore_index;
     char **filenames;
     int num_filenames;
     int rng_seed_value;
     boolean rng_seed_specified;
+    long total_records;
+    boolean total_records_specified;
+    size_t max_memory;
+    boolean max_memory_specified;
+    size_t checkpoint_span;
+    weight_spec weight;
+    int stratify_column;
+    stratum_allocation allocation;
+    size_t byte_range_start;
+    size_t byte_range_stop;
+    boolean byte_range_specified;
+    char *state_filename;
+    boolean merge_states;
+    char *merged_filename;
+    boolean stats;
+    boolean stats_json;
+    long prefetch_window;
+    boolean drop_cache;
+    rng_kind rng;
 } sample_global_args;
 
+static run_stats sample_stats;
+
 static struct option sample_client_long_options[] = {
     { "sample-size",			optional_argument,	NULL,	'k' },
     { "lines-per-offset",		optional_argument,	NULL,	'l' },
@@ -95,42 +389,130 @@ static struct option sample_client_long_options[] = {
     { "hybrid",	        		no_argument,		NULL,	'y' },
     { "mmap",	        		no_argument,		NULL,	'm' },
     { "cstdio",	        		no_argument,		NULL,	'c' },
+    { "threads",			required_argument,	NULL,	't' },
     { "rng-seed",			required_argument,	NULL,	'd' },
+    { "rng",				required_argument,	NULL,	'g' },
+    { "max-memory",			required_argument,	NULL,	'M' },
+    { "total-records",			required_argument,	NULL,	'N' },
+    { "checkpoint-span",		required_argument,	NULL,	'S' },
+    { "weight-column",			required_argument,	NULL,	'w' },
+    { "weight",				required_argument,	NULL,	'W' },
+    { "stratify-column",		required_argument,	NULL,	'f' },
+    { "allocation",			required_argument,	NULL,	'A' },
+    { "byte-range",			required_argument,	NULL,	'B' },
+    { "save-state",			required_argument,	NULL,	'T' },
+    { "stats",				optional_argument,	NULL,	'Q' },
+    { "prefetch",			required_argument,	NULL,	'P' },
+    { "drop-cache",			no_argument,		NULL,	'D' },
+    { "build-index",			no_argument,		NULL,	'b' },
+    { "ignore-index",			no_argument,		NULL,	'n' },
     { "version",			no_argument,		NULL,	'v' },
     { "help",				no_argument,		NULL,	'h' },
     { NULL,				no_argument,		NULL,	 0  }
 }; 
 
-static const char *sample_client_opt_string = "k:l:orspymcd:vh?";
+static const char *sample_client_opt_string = "k:l:orspymct:d:g:N:M:S:w:W:f:A:B:T:Q::P:Dbnvh?";
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-    offset_reservoir * new_offset_reservoir_ptr(const long len);
+    offset_encoding select_offset_encoding(const off_t max_offset, const boolean whole_index);
+    offset_encoding offset_reservoir_element_encoding(const offset_reservoir *res);
+    offset_reservoir * new_offset_reservoir_ptr(const long len, const offset_encoding encoding);
     void delete_offset_reservoir_ptr(offset_reservoir **res_ptr);
+    void offset_reservoir_reserve(offset_reservoir *res, const long capacity);
+    void offset_reservoir_append(offset_reservoir *res, const off_t offset);
+    void offset_reservoir_rank(offset_reservoir *res);
+    size_t offset_reservoir_bytes(const offset_reservoir *res);
     void print_offset_reservoir_ptr(const offset_reservoir *res_ptr);
     void sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k(FILE *in_file_ptr, offset_reservoir **res_ptr, const int lines_per_offset);
-    void sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k(offset_reservoir **res_ptr, const int sample_size);
-    void sample_reservoir_offsets_with_replacement_via_cstdio_with_unspecified_k(offset_reservoir **res_ptr);
     void sample_reservoir_offsets_without_replacement_via_cstdio_with_unspecified_k(FILE *in_file_ptr, offset_reservoir **res_ptr, const int lines_per_offset);
     void sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset);
-    void sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(offset_reservoir **res_ptr, const int sample_size);
+    long estimate_mmap_line_groupings(const file_mmap *in_mmap, const size_t start, const size_t stop, const int lines_per_offset);
+    long estimate_cstdio_line_groupings(FILE *in_file_ptr, const off_t size, const int lines_per_offset);
+    mmap_chunk * new_mmap_chunks(const file_mmap *in_mmap, const int num_threads, const int lines_per_offset, int *num_chunks);
+    size_t align_mmap_record_start(const file_mmap *in_mmap, const size_t position);
+    mmap_chunk * new_mmap_range_chunks(const file_mmap *in_mmap, const size_t range_start, const size_t range_stop, const int num_threads, const int lines_per_offset, int *num_chunks);
+    void delete_mmap_chunks(mmap_chunk **chunks_ptr, const int num_chunks);
+    void run_mmap_chunk_workers(mmap_chunk *chunks, const int num_chunks, void * (*worker)(void *));
+    void * count_mmap_chunk_lines(void *chunk_ptr);
+    void * sample_mmap_chunk_offsets_with_fixed_k(void *chunk_ptr);
+    void * index_mmap_chunk_offsets(void *chunk_ptr);
+    void sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_fixed_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads);
+    void sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_unspecified_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads);
+    void sample_reservoir_offsets_without_replacement_via_keyed_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads);
+    double record_weight(const weight_spec *weight, const char *record, const char *stop);
+    uint64_t weighted_key_bits(const double key);
+    double weighted_key_value(const uint64_t bits);
+    void sample_reservoir_offsets_without_replacement_via_weighted_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const weight_spec *weight);
+    void * sample_mmap_chunk_offsets_by_weight(void *chunk_ptr);
+    void sample_strata_via_mmap(const file_mmap *in_mmap, stratum_table *table, const int lines_per_offset, const int column);
+    void allocate_stratum_quotas(stratum_table *table, const long k, const stratum_allocation allocation);
+    int stratum_remainder_compare(const void *remainder1, const void *remainder2);
+    offset_reservoir * new_stratified_offset_reservoir_ptr(stratum_table *table, const offset_encoding encoding, const boolean preserve_order, const int num_threads);
+    void sample_reservoir_offsets_without_replacement_via_keyed_line_index(const line_index *idx, offset_reservoir **res_ptr, const int lines_per_offset, const long k);
+    void * sample_mmap_chunk_offsets_by_key(void *chunk_ptr);
+    void keyed_offsets_offer(keyed_offset *heap, long *num_keyed, const long max_keyed, const uint64_t key, const off_t offset);
+    int keyed_offset_compare(const void *keyed1, const void *keyed2);
+    offset_reservoir * merge_keyed_offsets(keyed_offset **heaps, const long *heap_sizes, const int num_heaps, const long k, const offset_encoding encoding);
+    input_set * new_input_set(char **filenames, const int num_files);
+    void delete_input_set(input_set **set_ptr);
+    const file_mmap * input_set_mmap(input_set *set, const int file_idx);
+    int input_set_file_index(const input_set *set, const off_t offset);
+    void sample_reservoir_offsets_via_input_set(input_set *set, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample);
+    void print_offset_reservoir_sample_via_input_set(void *set_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean zero_copy, const int num_threads);
+    long sample_reservoir_offsets_via_byte_range(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const size_t range_start, const size_t range_stop, const boolean sample_size_specified, const boolean keyed_sample);
+    void save_offset_reservoir_state(const char *state_fn, const char *in_fn, const file_mmap *in_mmap, const offset_reservoir *res_ptr, const size_t range_start, const size_t range_stop, const long k, const long num_groups, const int lines_per_offset, const boolean keyed_sample);
+    void print_merged_sample_states(char **state_fns, const int num_states, const long k, const boolean sample_size_specified, const boolean preserve_order, const boolean rng_seed_specified, const int rng_seed_value, const int num_threads);
+    int sample_state_range_compare(const void *state1, const void *state2);
+    void sample_reservoir_offsets_via_chunk_workers(mmap_chunk *chunks, const int num_chunks, void * (*worker)(void *), offset_reservoir **res_ptr, const boolean sample_size_specified, const boolean keyed_sample);
+    void mmap_chunk_take_offset(mmap_chunk *chunk, const long k, const long grp_idx, const off_t offset);
+    void sample_reservoir_offsets_via_bgzf(bgzf_file *bgzf, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample);
+    void * count_bgzf_chunk_lines(void *chunk_ptr);
+    void * sample_bgzf_chunk_offsets(void *chunk_ptr);
+    void sample_reservoir_offsets_via_gzip(gzip_file *gz, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample);
+    void * sample_gzip_chunk_offsets(void *chunk_ptr);
+    void gzip_chunk_scan_piece(void *scan_ptr, const uint64_t out, const char *data, const size_t len);
+    const char * read_gzip_record(void *reader_ptr, const uint64_t offset, const int lines_per_offset, char **scratch, size_t *scratch_capacity, size_t *record_len);
+    const char * read_bgzf_record(void *bgzf_ptr, const uint64_t offset, const int lines_per_offset, char **scratch, size_t *scratch_capacity, size_t *record_len);
+    void print_offset_reservoir_records(void *reader_ptr, offset_record_reader reader, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads);
+    void print_offset_reservoir_sample_via_gzip(void *gz_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads);
+    void print_offset_reservoir_sample_via_bgzf(void *bgzf_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads);
+    offset_reservoir * merge_offset_reservoirs(offset_reservoir **reservoirs, const long *population_sizes, const int num_reservoirs, const long k, rng_state *state);
+    void sample_reservoir_offsets_via_line_index(const line_index *idx, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified, const boolean sample_with_replacement);
+    void finish_offset_reservoir_sample(offset_reservoir **res_ptr, offset_reservoir_printer printer, void *input_ptr, const long k, const int lines_per_offset, const boolean sample_size_specified, const boolean sample_with_replacement, const boolean preserve_order, const int num_threads);
+    void sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(offset_reservoir **res_ptr, const long sample_size);
     void sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k(offset_reservoir **res_ptr);
     void sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset);
-    void sample_reservoir_offsets_with_replacement_with_fixed_k(offset_reservoir **res_ptr, const int sample_size);
+    void sample_reservoir_offsets_with_replacement_with_fixed_k(offset_reservoir **res_ptr, const long sample_size);
+    uint64_t sample_replacement_block(uint64_t **draws_ptr, uint64_t *draws_capacity, const uint64_t block_groups, const uint64_t groups_left, const uint64_t draws_left);
+    void sample_reservoir_draws_with_replacement_via_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified);
+    void sample_reservoir_draws_with_replacement_via_cstdio(FILE *in_file_ptr, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified);
+    void print_offset_reservoir_draws(offset_reservoir *draws, const int lines_per_offset, const boolean preserve_order, const file_mmap *in_mmap, FILE *in_file_ptr);
+    void sequential_sampler_init(sequential_sampler *s, const long n, const long N, rng_state *state);
+    long sequential_sampler_next_skip(sequential_sampler *s, rng_state *state);
+    void print_sequential_sample_via_mmap(const file_mmap *in_mmap, const line_index *idx, const int lines_per_offset, const long k, const long num_groups);
+    void print_sequential_sample_via_stdin_stream(const int lines_per_offset, const long k, const long num_groups);
     void shuffle_reservoir_offsets_via_fisher_yates(offset_reservoir **res_ptr);
-    void sort_offset_reservoir_ptr_offsets(offset_reservoir **res_ptr);
-    int offset_compare(const void *off1, const void *off2);
-    void print_offset_reservoir_sample_via_mmap(const file_mmap *in_mmap, offset_reservoir *res_ptr, const int lines_per_offset);
+    void sort_offset_reservoir_ptr_offsets(offset_reservoir **res_ptr, const int num_threads);
+    void print_offset_reservoir_sample_via_mmap(const file_mmap *in_mmap, offset_reservoir *res_ptr, const int lines_per_offset, const boolean zero_copy);
     void print_sorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset);
     void print_unsorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset);
+    void sample_records_via_stdin_stream(record_arena *arena, const long k, const int lines_per_offset, const boolean keep_all);
+    offset_reservoir * new_record_arena_slot_reservoir_ptr(const record_arena *arena);
+    void print_record_arena_sample(const record_arena *arena, const offset_reservoir *res_ptr);
+    void shuffle_records_via_external_buckets(const int in_fd, const int lines_per_offset, const size_t max_memory);
     FILE * new_file_ptr(const char *in_fn);
     void delete_file_ptr(FILE **file_ptr);
     file_mmap * new_file_mmap(const char *in_fn);
     void delete_file_mmap(file_mmap **mmap_ptr);
+    size_t parse_byte_count(const char *arg);
+    int parse_byte_range(const char *arg, size_t *start, size_t *stop);
     void initialize_globals();
     void parse_command_line_options(int argc, char **argv);
+    void print_sample_stats();
+    void release_input_pages();
     void print_usage(FILE *stream);
     void print_version(FILE *stream);
 
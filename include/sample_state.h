@@ -0,0 +1,110 @@
+#ifndef SAMPLE_STATE_H
+#define SAMPLE_STATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "rng.h"
+
+/*
+   Saved reservoir of one shard of an input file -- the sample of the
+   line-groupings that start inside a byte range, written by --save-state
+   so that the samples of several shards, drawn anywhere, can be merged
+   into one sample of the whole file later. The file is:
+
+     magic[8]          "SMPLSTA\0"
+     version           uint32_t, SAMPLE_STATE_VERSION
+     rng_len           uint32_t, bytes of generator state
+     file_size         uint64_t, size of the sampled input
+     range_start       uint64_t, first byte of the shard
+     range_stop        uint64_t, byte past the shard, at most file_size
+     k                 int64_t, sample size, or -1 if every line-grouping was kept
+     num_groups        int64_t, line-groupings in the shard
+     num_offsets       int64_t, line-groupings in the sample
+     lines_per_offset  uint32_t
+     keyed             uint32_t, 1 if the sample is the smallest record keys
+     filename_len      uint64_t
+     encoded_len       uint64_t, bytes of encoded offsets
+
+   followed by the input's filename (without a terminating NUL), the
+   generator state as it was at the end of the shard's scan, and the
+   sampled offsets in ascending order, each stored as its difference from
+   the one before in a LEB128 varint -- a few bytes apiece, where offsets
+   are close, as they are when every line-grouping is kept.
+
+   The generator state is its kind (uint32_t), the fields of that kind --
+
+     mt19937           mti (uint32_t) and the 624 words of mt (uint32_t)
+     mt19937-block     the 624 words of mt_block (uint32_t)
+     xoshiro256        the 4 words of xoshiro (uint64_t)
+     pcg64             state_hi, state_lo, inc_hi and inc_lo (uint64_t)
+     philox            key and counter (uint64_t)
+
+   -- then num_drawn (uint64_t), and the number (uint32_t) and values
+   (uint64_t) of the words still waiting in its buffer, so that a merge
+   draws on from exactly where the shard's scan left off.
+
+   Every integer is little-endian, whatever the host, and each field is
+   written on its own rather than as a struct, so a state can be moved
+   between hosts and builds. The version is checked before anything else:
+   a layout change bumps SAMPLE_STATE_VERSION, and a state of another
+   version is refused with ENOTSUP, rather than misread.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set -- ENOTSUP for a state of another version, and EINVAL for a
+   file that is not a saved state, or is truncated or corrupt.
+*/
+
+#define SAMPLE_STATE_MAGIC "SMPLSTA"
+#define SAMPLE_STATE_VERSION 2
+#define SAMPLE_STATE_HEADER_LENGTH 88
+#define SAMPLE_STATE_RNG_MAX_LENGTH (4 + 4 + 4 * MT19937_N + 8 + 4 + 8 * RNG_BUFFER_SIZE)
+#define SAMPLE_STATE_VARINT_MAX_LENGTH 10
+
+typedef struct sample_state_header sample_state_header;
+typedef struct sample_state sample_state;
+
+struct sample_state_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t rng_len;
+    uint64_t file_size;
+    uint64_t range_start;
+    uint64_t range_stop;
+    int64_t k;
+    int64_t num_groups;
+    int64_t num_offsets;
+    uint32_t lines_per_offset;
+    uint32_t keyed;
+    uint64_t filename_len;
+    uint64_t encoded_len;
+};
+
+struct sample_state {
+    sample_state_header header;
+    char *filename;
+    rng_state rng;
+    uint64_t *offsets;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sample_state_header_init(sample_state_header *header);
+int sample_state_write(const char *state_fn, sample_state_header *header, const char *filename, const rng_state *rng, const uint64_t *offsets);
+sample_state * sample_state_read(const char *state_fn);
+void delete_sample_state(sample_state **state_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef STRATUM_TABLE_H
+#define STRATUM_TABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define STRATUM_TABLE_DEFAULT_SLOTS 1024
+#define STRATUM_OFFSETS_INITIAL_CAPACITY 16
+
+/*
+   Per-stratum offset reservoirs for a stratified sample, found by key in
+   an open-addressing hash table with linear probing.
+
+   A key is a byte range of the mapped input -- a column of a line-grouping's
+   first line -- and the table keeps the pointer and length as they are,
+   with no copy, so the mapping must outlive the table.
+
+   Strata are kept in one array, in the order their keys were first seen,
+   and the hash slots hold indices into it. Growing the slots then moves no
+   stratum, and an index taken for a stratum stays good, though a pointer
+   does not once another stratum is added. Each stratum's offsets start
+   small and grow as needed, up to the table's max_offsets, so that a table
+   of many small strata does not reserve max_offsets for every one.
+
+   The next_grp_idx and w fields belong to the caller's sampler, and quota
+   to its allocation of the sample among the strata.
+
+   Calls return 0 (or a non-NULL pointer) on success, or -1 (NULL) with
+   errno set.
+*/
+
+typedef struct stratum stratum;
+typedef struct stratum_table stratum_table;
+
+struct stratum {
+    const char *key;
+    size_t key_len;
+    uint64_t hash;
+    long num_groups;
+    uint64_t *offsets;
+    long num_offsets;
+    long capacity;
+    long next_grp_idx;
+    double w;
+    long quota;
+};
+
+struct stratum_table {
+    stratum *strata;
+    size_t num_strata;
+    size_t strata_capacity;
+    uint32_t *slots;
+    size_t num_slots;
+    long max_offsets;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+stratum_table * new_stratum_table(const long max_offsets);
+void delete_stratum_table(stratum_table **table_ptr);
+uint64_t stratum_key_hash(const char *key, const size_t key_len);
+long stratum_table_index(stratum_table *table, const char *key, const size_t key_len);
+int stratum_offsets_reserve(stratum_table *table, stratum *s, const long capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
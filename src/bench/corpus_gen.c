@@ -0,0 +1,198 @@
+/*
+   corpus_gen.c
+
+   Writes a synthetic corpus for benchmarking sample, in one of the shapes
+   it is run on: sorted BED intervals, 4-line FASTQ reads, VCF records
+   after a short header, or lines of widely varying length. The corpus is
+   written to standard output, or to a file, and stops at the end of the
+   first record at or past the requested size, so that every record is
+   whole. The same seed gives the same corpus.
+
+   Usage: corpus-gen [-f bed|fastq|vcf|varlen] [-d seed] [-o file] size
+
+   The size takes an optional K, M, G or T suffix.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "rng.h"
+
+#define CORPUS_BUFFER_SIZE 4194304
+#define CORPUS_MAX_RECORD_SIZE 16384
+#define CORPUS_NUM_CHROMOSOMES 24
+#define CORPUS_VCF_NUM_SAMPLES 8
+
+typedef enum corpus_format {
+    kCorpusBed = 0,
+    kCorpusFastq,
+    kCorpusVcf,
+    kCorpusVarlen
+} corpus_format;
+
+static const char corpus_bases[] = "ACGT";
+
+static uint64_t corpus_parse_size(const char *arg)
+{
+    char *suffix = NULL;
+    double size = strtod(arg, &suffix);
+
+    switch (*suffix) {
+    case 'K': case 'k': size *= 1024.0; break;
+    case 'M': case 'm': size *= 1048576.0; break;
+    case 'G': case 'g': size *= 1073741824.0; break;
+    case 'T': case 't': size *= 1099511627776.0; break;
+    case '\0': break;
+    default: return 0;
+    }
+
+    return (size > 0.0) ? (uint64_t) size : 0;
+}
+
+/* one record, in the shape of the format, into record; returns its length */
+static size_t corpus_record(rng_state *state, const corpus_format format, const uint64_t record_idx, uint64_t *position, char *record)
+{
+    size_t len = 0;
+    size_t read_len = 0;
+    size_t char_idx = 0;
+    int sample_idx = 0;
+
+    switch (format) {
+    case kCorpusBed:
+        /* intervals march up each chromosome in turn, as sort-bed would leave them */
+        *position += 1 + rng_bounded(state, 2000);
+        len = (size_t) sprintf(record, "chr%d\t%llu\t%llu\tid-%llu\t%d\t%c\n",
+                               (int) ((record_idx / 1000000) % CORPUS_NUM_CHROMOSOMES) + 1,
+                               (unsigned long long) *position,
+                               (unsigned long long) (*position + 50 + rng_bounded(state, 950)),
+                               (unsigned long long) record_idx,
+                               (int) rng_bounded(state, 1000),
+                               (rng_bounded(state, 2)) ? '+' : '-');
+        break;
+    case kCorpusFastq:
+        read_len = 100 + (size_t) rng_bounded(state, 51);
+        len = (size_t) sprintf(record, "@read-%llu/1\n", (unsigned long long) record_idx);
+        for (char_idx = 0; char_idx < read_len; ++char_idx)
+            record[len++] = corpus_bases[rng_bounded(state, 4)];
+        memcpy(record + len, "\n+\n", 3);
+        len += 3;
+        for (char_idx = 0; char_idx < read_len; ++char_idx)
+            record[len++] = (char) ('#' + rng_bounded(state, 40));
+        record[len++] = '\n';
+        break;
+    case kCorpusVcf:
+        *position += 1 + rng_bounded(state, 500);
+        len = (size_t) sprintf(record, "chr%d\t%llu\trs%llu\t%c\t%c\t%d\tPASS\tDP=%d;AF=%.3f\tGT:GQ",
+                               (int) ((record_idx / 1000000) % CORPUS_NUM_CHROMOSOMES) + 1,
+                               (unsigned long long) *position,
+                               (unsigned long long) record_idx,
+                               corpus_bases[rng_bounded(state, 4)],
+                               corpus_bases[rng_bounded(state, 4)],
+                               (int) rng_bounded(state, 100),
+                               (int) rng_bounded(state, 200),
+                               rng_double(state));
+        for (sample_idx = 0; sample_idx < CORPUS_VCF_NUM_SAMPLES; ++sample_idx)
+            len += (size_t) sprintf(record + len, "\t%d/%d:%d", (int) rng_bounded(state, 2), (int) rng_bounded(state, 2), (int) rng_bounded(state, 99));
+        record[len++] = '\n';
+        break;
+    case kCorpusVarlen:
+        /* lengths spread over three orders of magnitude, most of them short */
+        read_len = (size_t) (1 << rng_bounded(state, 13));
+        read_len += (size_t) rng_bounded(state, read_len);
+        for (char_idx = 0; char_idx < read_len; ++char_idx)
+            record[len++] = (char) (' ' + rng_bounded(state, 95));
+        record[len++] = '\n';
+        break;
+    }
+
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    corpus_format format = kCorpusBed;
+    rng_state state;
+    uint64_t seed = 12345;
+    uint64_t size = 0;
+    uint64_t written = 0;
+    uint64_t record_idx = 0;
+    uint64_t position = 0;
+    const char *out_fn = NULL;
+    FILE *out_file_ptr = stdout;
+    char *buffer = NULL;
+    size_t buffer_len = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "f:d:o:")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (strcmp(optarg, "bed") == 0)
+                format = kCorpusBed;
+            else if (strcmp(optarg, "fastq") == 0)
+                format = kCorpusFastq;
+            else if (strcmp(optarg, "vcf") == 0)
+                format = kCorpusVcf;
+            else if (strcmp(optarg, "varlen") == 0)
+                format = kCorpusVarlen;
+            else {
+                fprintf(stderr, "Error: Unknown corpus format [%s]\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            out_fn = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: corpus-gen [-f bed|fastq|vcf|varlen] [-d seed] [-o file] size\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if ((optind >= argc) || ((size = corpus_parse_size(argv[optind])) == 0)) {
+        fprintf(stderr, "Usage: corpus-gen [-f bed|fastq|vcf|varlen] [-d seed] [-o file] size\n");
+        return EXIT_FAILURE;
+    }
+    if ((out_fn) && (!(out_file_ptr = fopen(out_fn, "w")))) {
+        fprintf(stderr, "Error: Could not open corpus [%s] for writing\n", out_fn);
+        return EXIT_FAILURE;
+    }
+    buffer = malloc(CORPUS_BUFFER_SIZE + CORPUS_MAX_RECORD_SIZE);
+    if (!buffer) {
+        fprintf(stderr, "Error: Could not allocate corpus buffer\n");
+        return EXIT_FAILURE;
+    }
+    rng_seed(&state, kRngXoshiro256, seed);
+
+    if (format == kCorpusVcf)
+        buffer_len = (size_t) sprintf(buffer, "##fileformat=VCFv4.2\n##source=corpus-gen\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\tS3\tS4\tS5\tS6\tS7\tS8\n");
+    while (written + buffer_len < size) {
+        buffer_len += corpus_record(&state, format, record_idx++, &position, buffer + buffer_len);
+        if ((buffer_len >= CORPUS_BUFFER_SIZE) || (written + buffer_len >= size)) {
+            if (fwrite(buffer, 1, buffer_len, out_file_ptr) != buffer_len) {
+                fprintf(stderr, "Error: Could not write corpus\n");
+                return EXIT_FAILURE;
+            }
+            written += buffer_len;
+            buffer_len = 0;
+        }
+        if ((record_idx % 1000000) == 0)
+            position = 0;
+    }
+    if ((buffer_len > 0) && (fwrite(buffer, 1, buffer_len, out_file_ptr) != buffer_len)) {
+        fprintf(stderr, "Error: Could not write corpus\n");
+        return EXIT_FAILURE;
+    }
+
+    free(buffer);
+    if ((out_fn) && (fclose(out_file_ptr) != 0)) {
+        fprintf(stderr, "Error: Could not write corpus [%s]\n", out_fn);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
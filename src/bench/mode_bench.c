@@ -0,0 +1,271 @@
+/*
+   mode_bench.c
+
+   Runs sample in every mode -- --mmap, --cstdio and --hybrid input, without
+   and with replacement, shuffled and in input order, at each sample size --
+   and shuf(1) on the same input for comparison, and reports each run as a
+   line of CSV: wall time, input GB/s, user and system time, peak resident
+   set size, and minor and major page faults, as getrusage(2) gives them
+   for the child. Output goes to /dev/null, so the figures are for reading
+   the input and writing the sample out, not for a disk to take it.
+
+   Usage: mode-bench [-b sample] [-S shuf] [-k k,...] [-n repeats] [-t threads] [-H] corpus[@lines-per-offset] ...
+
+   A sample size of "all" shuffles (or, with replacement, bootstraps) the
+   whole input. shuf has no record groups or ordered output, so it is run
+   on corpora of one line per record, for shuffled samples only; -S "" leaves
+   it out. -H leaves out the CSV header, for appending to earlier results.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_MAX_ARGS 32
+#define BENCH_MAX_SAMPLE_SIZES 32
+#define BENCH_READ_SIZE 1048576
+
+typedef struct bench_result bench_result;
+
+struct bench_result {
+    int status;
+    double seconds;
+    double user_seconds;
+    double system_seconds;
+    long max_rss_kb;
+    long minor_faults;
+    long major_faults;
+};
+
+static const char *bench_io_flags[] = { "-m", "-c", "-y" };
+static const char *bench_io_names[] = { "mmap", "cstdio", "hybrid" };
+
+static double bench_seconds()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double) now.tv_sec + (double) now.tv_usec / 1e6;
+}
+
+static double bench_timeval_seconds(const struct timeval *tv)
+{
+    return (double) tv->tv_sec + (double) tv->tv_usec / 1e6;
+}
+
+/* the number of newlines in the corpus, which shuf needs for a bootstrap of it */
+static long bench_count_lines(const char *fn)
+{
+    char *buf = NULL;
+    ssize_t len = 0;
+    ssize_t buf_idx = 0;
+    long num_lines = 0;
+    int fd = -1;
+
+    fd = open(fn, O_RDONLY);
+    buf = malloc(BENCH_READ_SIZE);
+    if ((fd == -1) || (!buf)) {
+        free(buf);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    while ((len = read(fd, buf, BENCH_READ_SIZE)) > 0)
+        for (buf_idx = 0; buf_idx < len; ++buf_idx)
+            num_lines += (buf[buf_idx] == '\n');
+    free(buf);
+    close(fd);
+
+    return num_lines;
+}
+
+/* runs the command with its output thrown away, and takes its times and resource use */
+static void bench_run(char **args, bench_result *result)
+{
+    struct rusage usage;
+    double start = 0.0;
+    pid_t pid = 0;
+    int null_fd = -1;
+
+    memset(result, 0, sizeof(bench_result));
+    memset(&usage, 0, sizeof(struct rusage));
+    fflush(stdout);
+    start = bench_seconds();
+    pid = fork();
+    if (pid == 0) {
+        null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execvp(args[0], args);
+        _exit(127);
+    }
+    if ((pid == -1) || (wait4(pid, &result->status, 0, &usage) == -1)) {
+        result->status = -1;
+        return;
+    }
+    result->seconds = bench_seconds() - start;
+    result->status = (WIFEXITED(result->status)) ? WEXITSTATUS(result->status) : 128 + WTERMSIG(result->status);
+    result->user_seconds = bench_timeval_seconds(&usage.ru_utime);
+    result->system_seconds = bench_timeval_seconds(&usage.ru_stime);
+    result->max_rss_kb = usage.ru_maxrss;
+    result->minor_faults = usage.ru_minflt;
+    result->major_faults = usage.ru_majflt;
+}
+
+static void bench_report(const char *corpus, const off_t corpus_size, const int lines_per_offset, const char *tool, const char *io, const char *replacement, const char *order, const char *k, const int repeat, const bench_result *result)
+{
+    fprintf(stdout, "%s,%lld,%d,%s,%s,%s,%s,%s,%d,%d,%.6f,%.4f,%.6f,%.6f,%ld,%ld,%ld\n",
+            corpus, (long long) corpus_size, lines_per_offset, tool, io, replacement, order, k, repeat,
+            result->status, result->seconds, (result->seconds > 0.0) ? (double) corpus_size / 1e9 / result->seconds : 0.0,
+            result->user_seconds, result->system_seconds, result->max_rss_kb, result->minor_faults, result->major_faults);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *sample_path = "./sample";
+    const char *shuf_path = "shuf";
+    char *sample_sizes[BENCH_MAX_SAMPLE_SIZES];
+    char sample_size_list[1024] = "100,10000,1000000,all";
+    char lines_per_offset_arg[32];
+    char shuf_count_arg[32];
+    char corpus[4096];
+    char *args[BENCH_MAX_ARGS];
+    char *at = NULL;
+    char *token = NULL;
+    const char *num_threads = NULL;
+    struct stat corpus_stat;
+    bench_result result;
+    long num_lines = 0;
+    int num_sample_sizes = 0;
+    int num_repeats = 1;
+    int print_header = 1;
+    int lines_per_offset = 1;
+    int corpus_idx = 0;
+    int io_idx = 0;
+    int replacement_idx = 0;
+    int order_idx = 0;
+    int size_idx = 0;
+    int repeat = 0;
+    int num_args = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "b:S:k:n:t:H")) != -1) {
+        switch (opt) {
+        case 'b':
+            sample_path = optarg;
+            break;
+        case 'S':
+            shuf_path = optarg;
+            break;
+        case 'k':
+            snprintf(sample_size_list, sizeof(sample_size_list), "%s", optarg);
+            break;
+        case 'n':
+            num_repeats = atoi(optarg);
+            break;
+        case 't':
+            num_threads = optarg;
+            break;
+        case 'H':
+            print_header = 0;
+            break;
+        default:
+            fprintf(stderr, "Usage: mode-bench [-b sample] [-S shuf] [-k k,...] [-n repeats] [-t threads] [-H] corpus[@lines-per-offset] ...\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if ((optind >= argc) || (num_repeats < 1)) {
+        fprintf(stderr, "Usage: mode-bench [-b sample] [-S shuf] [-k k,...] [-n repeats] [-t threads] [-H] corpus[@lines-per-offset] ...\n");
+        return EXIT_FAILURE;
+    }
+    for (token = strtok(sample_size_list, ","); (token) && (num_sample_sizes < BENCH_MAX_SAMPLE_SIZES); token = strtok(NULL, ","))
+        sample_sizes[num_sample_sizes++] = token;
+
+    if (print_header)
+        fprintf(stdout, "corpus,bytes,lines_per_offset,tool,io,replacement,order,k,repeat,status,seconds,gb_per_second,user_seconds,system_seconds,max_rss_kb,minor_faults,major_faults\n");
+    for (corpus_idx = optind; corpus_idx < argc; ++corpus_idx) {
+        snprintf(corpus, sizeof(corpus), "%s", argv[corpus_idx]);
+        lines_per_offset = 1;
+        at = strrchr(corpus, '@');
+        if (at) {
+            *at = '\0';
+            lines_per_offset = atoi(at + 1);
+        }
+        if ((lines_per_offset < 1) || (stat(corpus, &corpus_stat) == -1)) {
+            fprintf(stderr, "Error: Could not open corpus [%s] (%s)\n", corpus, (lines_per_offset < 1) ? "bad lines-per-offset" : strerror(errno));
+            return EXIT_FAILURE;
+        }
+        snprintf(lines_per_offset_arg, sizeof(lines_per_offset_arg), "%d", lines_per_offset);
+        num_lines = ((*shuf_path) && (lines_per_offset == 1)) ? bench_count_lines(corpus) : -1;
+
+        /* every run starts from the same page cache state that the one before it left: warm */
+        for (repeat = 0; repeat < num_repeats; ++repeat) {
+            for (size_idx = 0; size_idx < num_sample_sizes; ++size_idx) {
+                for (io_idx = 0; io_idx < 3; ++io_idx) {
+                    for (replacement_idx = 0; replacement_idx < 2; ++replacement_idx) {
+                        for (order_idx = 0; order_idx < 2; ++order_idx) {
+                            num_args = 0;
+                            args[num_args++] = (char *) sample_path;
+                            args[num_args++] = (char *) bench_io_flags[io_idx];
+                            args[num_args++] = (replacement_idx) ? "-r" : "-o";
+                            args[num_args++] = (order_idx) ? "-p" : "-s";
+                            args[num_args++] = "-l";
+                            args[num_args++] = lines_per_offset_arg;
+                            args[num_args++] = "-d";
+                            args[num_args++] = "1";
+                            if (strcmp(sample_sizes[size_idx], "all") != 0) {
+                                args[num_args++] = "-k";
+                                args[num_args++] = sample_sizes[size_idx];
+                            }
+                            if ((num_threads) && (io_idx == 0)) {
+                                args[num_args++] = "-t";
+                                args[num_args++] = (char *) num_threads;
+                            }
+                            args[num_args++] = corpus;
+                            args[num_args] = NULL;
+                            bench_run(args, &result);
+                            bench_report(corpus, corpus_stat.st_size, lines_per_offset, "sample", bench_io_names[io_idx], (replacement_idx) ? "with" : "without", (order_idx) ? "preserve" : "shuffle", sample_sizes[size_idx], repeat, &result);
+                        }
+                    }
+                }
+                if (num_lines < 0)
+                    continue;
+                for (replacement_idx = 0; replacement_idx < 2; ++replacement_idx) {
+                    num_args = 0;
+                    args[num_args++] = (char *) shuf_path;
+                    if (replacement_idx)
+                        args[num_args++] = "-r";
+                    /* shuf -r runs forever without a count, so a bootstrap is asked for by size */
+                    if (strcmp(sample_sizes[size_idx], "all") != 0) {
+                        args[num_args++] = "-n";
+                        args[num_args++] = sample_sizes[size_idx];
+                    }
+                    else if (replacement_idx) {
+                        snprintf(shuf_count_arg, sizeof(shuf_count_arg), "%ld", num_lines);
+                        args[num_args++] = "-n";
+                        args[num_args++] = shuf_count_arg;
+                    }
+                    args[num_args++] = corpus;
+                    args[num_args] = NULL;
+                    bench_run(args, &result);
+                    bench_report(corpus, corpus_stat.st_size, lines_per_offset, "shuf", "stdio", (replacement_idx) ? "with" : "without", "shuffle", sample_sizes[size_idx], repeat, &result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*
+   sort_bench.c
+
+   Times the sorts behind --preserve-order: qsort(3) with a comparator (the
+   old path), against the radix sort on one thread and on several. Keys are
+   uniformly random offsets into a file of a given size, as 32-bit keys when
+   the file is under 4 GB (as the reservoir would hold them) and 64-bit keys
+   otherwise.
+
+   Usage: sort-bench [-s file-size] [-t threads] [-q max-qsort-keys] [k ...]
+
+   Each k defaults to the powers of ten from 1e4 to 1e9; a k whose keys do
+   not fit in memory is reported as skipped. Results go to standard output
+   as CSV.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "rng.h"
+#include "radix_sort.h"
+
+static int bench_compare_uint32(const void *key1, const void *key2)
+{
+    uint32_t k1 = *(const uint32_t *) key1;
+    uint32_t k2 = *(const uint32_t *) key2;
+
+    return (k1 > k2) - (k1 < k2);
+}
+
+static int bench_compare_uint64(const void *key1, const void *key2)
+{
+    uint64_t k1 = *(const uint64_t *) key1;
+    uint64_t k2 = *(const uint64_t *) key2;
+
+    return (k1 > k2) - (k1 < k2);
+}
+
+static double bench_seconds()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double) now.tv_sec + (double) now.tv_usec / 1e6;
+}
+
+static void bench_fill(void *keys, const size_t num_keys, const size_t key_bytes, const uint64_t file_size)
+{
+    rng_state state;
+    uint64_t block[RNG_BUFFER_SIZE];
+    uint64_t key = 0;
+    size_t key_idx = 0;
+    size_t block_idx = 0;
+    size_t block_len = 0;
+
+    /* keys are drawn in blocks, and scaled into the file by the high word of a 128-bit product */
+    rng_seed(&state, kRngXoshiro256, 12345);
+    for (key_idx = 0; key_idx < num_keys; key_idx += block_len) {
+        block_len = (num_keys - key_idx < RNG_BUFFER_SIZE) ? num_keys - key_idx : RNG_BUFFER_SIZE;
+        rng_fill_u64(&state, block, block_len);
+        for (block_idx = 0; block_idx < block_len; ++block_idx) {
+            rng_multiply(block[block_idx], file_size, &key);
+            if (key_bytes == sizeof(uint32_t))
+                ((uint32_t *) keys)[key_idx + block_idx] = (uint32_t) key;
+            else
+                ((uint64_t *) keys)[key_idx + block_idx] = key;
+        }
+    }
+}
+
+static int bench_run(const char *method, void *keys, void *reference, const size_t num_keys, const size_t key_bytes, const uint64_t file_size, const int num_threads)
+{
+    double start = 0.0;
+    double elapsed = 0.0;
+    int err = 0;
+
+    bench_fill(keys, num_keys, key_bytes, file_size);
+    start = bench_seconds();
+    if (strcmp(method, "qsort") == 0)
+        qsort(keys, num_keys, key_bytes, (key_bytes == sizeof(uint32_t)) ? bench_compare_uint32 : bench_compare_uint64);
+    else if (key_bytes == sizeof(uint32_t))
+        err = radix_sort_uint32(keys, num_keys, num_threads);
+    else
+        err = radix_sort_uint64(keys, num_keys, num_threads);
+    elapsed = bench_seconds() - start;
+    if (err == -1)
+        return -1;
+
+    /* every method must agree with the first one run at this size */
+    if ((reference) && (memcmp(keys, reference, num_keys * key_bytes) != 0)) {
+        fprintf(stderr, "Error: %s gave a different order for k = %zu\n", method, num_keys);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stdout, "%zu,%zu,%s,%d,%.6f,%.1f\n", num_keys, key_bytes * 8, method, num_threads, elapsed, num_keys / elapsed / 1e6);
+    fflush(stdout);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t file_size = UINT64_C(100) << 30;
+    size_t max_qsort_keys = 100000000;
+    size_t key_sizes[16];
+    size_t num_key_sizes = 0;
+    size_t key_size_idx = 0;
+    size_t num_keys = 0;
+    size_t key_bytes = 0;
+    int num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int opt = 0;
+    void *keys = NULL;
+    void *reference = NULL;
+
+    while ((opt = getopt(argc, argv, "s:t:q:")) != -1) {
+        switch (opt) {
+        case 's':
+            file_size = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'q':
+            max_qsort_keys = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: sort-bench [-s file-size] [-t threads] [-q max-qsort-keys] [k ...]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (; (optind < argc) && (num_key_sizes < 16); ++optind)
+        key_sizes[num_key_sizes++] = (size_t) strtod(argv[optind], NULL);
+    if (num_key_sizes == 0)
+        for (num_keys = 10000; num_keys <= 1000000000; num_keys *= 10)
+            key_sizes[num_key_sizes++] = num_keys;
+    if ((file_size < 2) || (num_threads < 1)) {
+        fprintf(stderr, "Error: File size and thread count must be positive\n");
+        return EXIT_FAILURE;
+    }
+    key_bytes = (file_size <= UINT32_MAX) ? sizeof(uint32_t) : sizeof(uint64_t);
+
+    fprintf(stdout, "k,key_bits,method,threads,seconds,million_keys_per_second\n");
+    for (key_size_idx = 0; key_size_idx < num_key_sizes; ++key_size_idx) {
+        num_keys = key_sizes[key_size_idx];
+        keys = malloc(num_keys * key_bytes);
+        reference = malloc(num_keys * key_bytes);
+        if ((!keys) || (!reference) || (bench_run("radix", keys, NULL, num_keys, key_bytes, file_size, 1) == -1)) {
+            fprintf(stdout, "%zu,%zu,skipped,0,,\n", num_keys, key_bytes * 8);
+            free(keys);
+            free(reference);
+            continue;
+        }
+        memcpy(reference, keys, num_keys * key_bytes);
+        if (num_threads > 1)
+            bench_run("radix", keys, reference, num_keys, key_bytes, file_size, num_threads);
+        if (num_keys <= max_qsort_keys)
+            bench_run("qsort", keys, reference, num_keys, key_bytes, file_size, 1);
+        free(keys);
+        free(reference);
+    }
+
+    return EXIT_SUCCESS;
+}
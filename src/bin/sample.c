@@ -1,5 +1,13 @@
 #include "sample.h"
 #include "mt19937.h"
+#include "rng.h"
+#include "newline_scan.h"
+#include "output_buffer.h"
+#include "line_index.h"
+#include "record_arena.h"
+#include "offset_arena.h"
+#include "radix_sort.h"
+#include "external_shuffle.h"
 
 int main(int argc, char** argv) 
 {
@@ -21,11 +29,61 @@ int main(int argc, char** argv)
     boolean sample_size_specified;
     int rng_seed_value;
     boolean rng_seed_specified;
+    rng_kind rng;
+    long total_records;
+    boolean total_records_specified;
+    boolean sequential_sample;
+    boolean keyed_sample;
+    size_t max_memory;
+    boolean external_shuffle_requested;
+    int in_fd = -1;
     int lines_per_offset;
+    int num_threads;
+    boolean build_index;
+    boolean ignore_index;
+    char *index_filename = NULL;
+    line_index *line_index_ptr = NULL;
+    struct stat in_file_stat;
+    int in_file_stat_status = -1;
+    boolean whole_index;
+    offset_encoding reservoir_encoding;
+    record_arena *record_arena_ptr = NULL;
+    int num_filenames;
+    int filename_idx;
+    input_set *in_set = NULL;
+    bgzf_file *in_bgzf = NULL;
+    gzip_file *in_gzip = NULL;
+    char *gzip_index_filename = NULL;
+    size_t checkpoint_span;
+    const weight_spec *weight;
+    int stratify_column;
+    stratum_table *stratum_table_ptr = NULL;
+    size_t byte_range_start;
+    size_t byte_range_stop;
+    boolean byte_range_specified;
+    char *state_filename;
+    long num_groups;
+
+    /* sample merge <state-file> ... combines saved shard samples, and takes options as sample does */
+    if ((argc > 1) && (strcmp(argv[1], "merge") == 0)) {
+        sample_global_args.merge_states = kTrue;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
 
     parse_command_line_options(argc, argv);
+
+    /* the stats are written however the run ends, from exit() as well as from here */
+    run_stats_init(&sample_stats, sample_global_args.stats, sample_global_args.stats_json);
+    if (sample_stats.enabled)
+        atexit(print_sample_stats);
+    if (sample_global_args.drop_cache)
+        atexit(release_input_pages);
+
     k = sample_global_args.k;
     in_filename = sample_global_args.filenames[0];
+    num_filenames = sample_global_args.num_filenames;
     mmap_in_file = sample_global_args.mmap;
     cstdio_in_file = sample_global_args.cstdio;
     hybrid_in_file = sample_global_args.hybrid;
@@ -34,20 +92,411 @@ int main(int argc, char** argv)
     sample_with_replacement = sample_global_args.sample_with_replacement;
     sample_size_specified = sample_global_args.sample_size_specified;
     lines_per_offset = sample_global_args.lines_per_offset;
+    num_threads = sample_global_args.num_threads;
+    build_index = sample_global_args.build_index;
+    ignore_index = sample_global_args.ignore_index;
     rng_seed_value = sample_global_args.rng_seed_value;
     rng_seed_specified = sample_global_args.rng_seed_specified;
+    rng = sample_global_args.rng;
+    total_records = sample_global_args.total_records;
+    total_records_specified = sample_global_args.total_records_specified;
+    max_memory = sample_global_args.max_memory;
+    checkpoint_span = sample_global_args.checkpoint_span;
+    weight = &sample_global_args.weight;
+    stratify_column = sample_global_args.stratify_column;
+    byte_range_start = sample_global_args.byte_range_start;
+    byte_range_stop = sample_global_args.byte_range_stop;
+    byte_range_specified = sample_global_args.byte_range_specified;
+    state_filename = sample_global_args.state_filename;
+    external_shuffle_requested = sample_global_args.max_memory_specified;
 
-    /* seed the Twister random number generator */
+    /* pick the widest newline scanner the host supports */
+    newline_scan_init();
+
+    /* seed the random number generator */
     if (rng_seed_specified)
-        mt19937_seed_rng(rng_seed_value);
+        rng_seed(&rng_global_state, rng, (uint64_t) rng_seed_value);
     else
-        mt19937_seed_rng(time(NULL));
+        rng_seed(&rng_global_state, rng, (uint64_t) time(NULL));
+    run_stats_enter(&sample_stats, kRunStatsScan);
+
+    if (sample_global_args.merge_states) {
+        print_merged_sample_states(sample_global_args.filenames, num_filenames, k, sample_size_specified, preserve_output_order, rng_seed_specified, rng_seed_value, num_threads);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       a standard input stream can be read only once, so sampled records are kept whole 
+       in an arena rather than as offsets, and the file-based modes do not apply
+    */
+    if (strcmp(in_filename, "-") == 0) {
+        if (build_index) {
+            fprintf(stderr, "Error: Cannot build an index for standard input\n");
+            exit(EXIT_FAILURE);
+        }
+        if (external_shuffle_requested) {
+            shuffle_records_via_external_buckets(STDIN_FILENO, lines_per_offset, max_memory);
+#ifdef DEBUG
+            fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+            return EXIT_SUCCESS;
+        }
+        if ((preserve_output_order) && (sample_size_specified) && (sample_without_replacement) && (total_records_specified)) {
+            print_sequential_sample_via_stdin_stream(lines_per_offset, k, total_records);
+#ifdef DEBUG
+            fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+            return EXIT_SUCCESS;
+        }
+        record_arena_ptr = new_record_arena(RECORD_ARENA_DEFAULT_CAPACITY, RECORD_ARENA_DEFAULT_SLOTS);
+        if (!record_arena_ptr) {
+            fprintf(stderr, "Error: Could not allocate memory for record arena\n");
+            exit(EXIT_FAILURE);
+        }
+        sample_records_via_stdin_stream(record_arena_ptr, k, lines_per_offset, ((!sample_size_specified) || (sample_with_replacement)) ? kTrue : kFalse);
+        if (preserve_output_order)
+            record_arena_sort_by_sequence(record_arena_ptr);
+        offset_reservoir_ptr = new_record_arena_slot_reservoir_ptr(record_arena_ptr);
+        if ((sample_with_replacement) && (offset_reservoir_ptr->num_offsets > 0))
+            sample_reservoir_offsets_with_replacement_with_fixed_k(&offset_reservoir_ptr, (sample_size_specified) ? k : offset_reservoir_ptr->num_offsets);
+        else if ((sample_without_replacement) && (!sample_size_specified))
+            shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
+        if (preserve_output_order)
+            sort_offset_reservoir_ptr_offsets(&offset_reservoir_ptr, num_threads);
+        print_record_arena_sample(record_arena_ptr, offset_reservoir_ptr);
+        delete_offset_reservoir_ptr(&offset_reservoir_ptr);
+        delete_record_arena(&record_arena_ptr);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* compressed input is read through a reader of its own, one file at a time */
+    if (num_filenames > 1) {
+        for (filename_idx = 0; filename_idx < num_filenames; ++filename_idx) {
+            if ((bgzf_detect(sample_global_args.filenames[filename_idx]) == 1) || (gzip_detect(sample_global_args.filenames[filename_idx]) == 1)) {
+                fprintf(stderr, "Error: Compressed input [%s] can only be sampled on its own\n", sample_global_args.filenames[filename_idx]);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (((weight->kind != kWeightNone) || (stratify_column > 0) || (byte_range_specified) || (state_filename)) && ((bgzf_detect(in_filename) == 1) || (gzip_detect(in_filename) == 1))) {
+        fprintf(stderr, "Error: A weighted, stratified, sharded or saved sample cannot be drawn from compressed input [%s]\n", in_filename);
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       BGZF input is sampled through its block table, a virtual offset standing for each 
+       line-grouping's place in the inflated data, so its blocks are inflated in parallel 
+       and only the blocks holding the sample are inflated again to write it out
+    */
+    if (bgzf_detect(in_filename) == 1) {
+        if (build_index) {
+            fprintf(stderr, "Error: Cannot build an index for BGZF input\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((cstdio_in_file) || (hybrid_in_file) || (sample_global_args.max_memory_specified)) {
+            fprintf(stderr, "Error: BGZF input can only be sampled with --mmap, and without --max-memory\n");
+            exit(EXIT_FAILURE);
+        }
+        in_bgzf = bgzf_open(in_filename);
+        if (!in_bgzf) {
+            fprintf(stderr, "Error: Could not read BGZF input [%s] (%s)\n", in_filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        whole_index = ((sample_with_replacement) || (!sample_size_specified)) ? kTrue : kFalse;
+        reservoir_encoding = select_offset_encoding((off_t) (in_bgzf->size << 16), whole_index);
+        offset_reservoir_ptr = new_offset_reservoir_ptr(k, reservoir_encoding);
+        sample_reservoir_offsets_via_bgzf(in_bgzf, &offset_reservoir_ptr, lines_per_offset, num_threads, ((sample_size_specified) && (sample_without_replacement)) ? kTrue : kFalse, (rng == kRngPhilox) ? kTrue : kFalse);
+        sample_stats.bytes_scanned += in_bgzf->size;
+        finish_offset_reservoir_sample(&offset_reservoir_ptr, print_offset_reservoir_sample_via_bgzf, in_bgzf, k, lines_per_offset, sample_size_specified, sample_with_replacement, preserve_output_order, num_threads);
+        bgzf_close(&in_bgzf);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       other gzip input can only be inflated from its start, so a first pass inflates all 
+       of it, sampling offsets into the inflated data and setting down checkpoints to 
+       resume inflation from, and the second inflates forward from the checkpoint before 
+       each sampled record -- with the checkpoints kept in a sidecar by --build-index, 
+       later runs also scan from them in parallel
+    */
+    if (gzip_detect(in_filename) == 1) {
+        if ((cstdio_in_file) || (hybrid_in_file) || (sample_global_args.max_memory_specified)) {
+            fprintf(stderr, "Error: gzip input can only be sampled with --mmap, and without --max-memory\n");
+            exit(EXIT_FAILURE);
+        }
+        in_gzip = gzip_open(in_filename);
+        gzip_index_filename = gzip_index_sidecar_name(in_filename);
+        if ((!in_gzip) || (!gzip_index_filename)) {
+            fprintf(stderr, "Error: Could not read gzip input [%s] (%s)\n", in_filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        in_gzip->span = checkpoint_span;
+        if (build_index) {
+            if (gzip_scan(in_gzip, checkpoint_span, NULL, NULL) == -1) {
+                fprintf(stderr, "Error: Could not inflate gzip input [%s] (%s)\n", in_filename, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            if (gzip_index_write(in_gzip, gzip_index_filename) == -1) {
+                fprintf(stderr, "Error: Could not write index [%s] (%s)\n", gzip_index_filename, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            free(gzip_index_filename);
+            gzip_close(&in_gzip);
+            return EXIT_SUCCESS;
+        }
+        if ((!ignore_index) && (gzip_index_read(in_gzip, gzip_index_filename) == -1) && (errno == ESTALE))
+            fprintf(stderr, "Warning: Ignoring out-of-date index [%s]\n", gzip_index_filename);
+        whole_index = ((sample_with_replacement) || (!sample_size_specified)) ? kTrue : kFalse;
+        reservoir_encoding = select_offset_encoding((in_gzip->num_checkpoints > 0) ? (off_t) in_gzip->inflated_size : (off_t) LLONG_MAX, whole_index);
+        offset_reservoir_ptr = new_offset_reservoir_ptr(k, reservoir_encoding);
+        sample_reservoir_offsets_via_gzip(in_gzip, &offset_reservoir_ptr, lines_per_offset, num_threads, ((sample_size_specified) && (sample_without_replacement)) ? kTrue : kFalse, (rng == kRngPhilox) ? kTrue : kFalse);
+        sample_stats.bytes_scanned += in_gzip->size;
+        finish_offset_reservoir_sample(&offset_reservoir_ptr, print_offset_reservoir_sample_via_gzip, in_gzip, k, lines_per_offset, sample_size_specified, sample_with_replacement, preserve_output_order, num_threads);
+        free(gzip_index_filename);
+        gzip_close(&in_gzip);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* write a line index sidecar and exit, if asked */
+    index_filename = line_index_sidecar_name(in_filename);
+    if (!index_filename) {
+        fprintf(stderr, "Error: Could not allocate memory for index filename\n");
+        exit(EXIT_FAILURE);
+    }
+    if (build_index) {
+        for (filename_idx = 0; filename_idx < num_filenames; ++filename_idx) {
+            if (filename_idx > 0) {
+                free(index_filename);
+                in_filename = sample_global_args.filenames[filename_idx];
+                index_filename = line_index_sidecar_name(in_filename);
+                if (!index_filename) {
+                    fprintf(stderr, "Error: Could not allocate memory for index filename\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            in_file_mmap_ptr = new_file_mmap(in_filename);
+            if (line_index_build(in_file_mmap_ptr->map, in_file_mmap_ptr->size, &(in_file_mmap_ptr->s), index_filename) == -1) {
+                fprintf(stderr, "Error: Could not write index [%s] (%s)\n", index_filename, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            delete_file_mmap(&in_file_mmap_ptr);
+        }
+        free(index_filename);
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       a weighted sample reads the weight of every line-grouping, so it is always drawn 
+       in a scan of the mapped file, with no use for an index
+    */
+    if (weight->kind != kWeightNone) {
+        in_file_mmap_ptr = new_file_mmap(in_filename);
+        offset_reservoir_ptr = new_offset_reservoir_ptr(k, select_offset_encoding((off_t) in_file_mmap_ptr->size, kFalse));
+        sample_reservoir_offsets_without_replacement_via_weighted_mmap(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, num_threads, weight);
+        /* the merged sample comes out in key order, which favours heavier line-groupings */
+        if (preserve_output_order)
+            sort_offset_reservoir_ptr_offsets(&offset_reservoir_ptr, num_threads);
+        else
+            shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
+        print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset, preserve_output_order);
+        delete_offset_reservoir_ptr(&offset_reservoir_ptr);
+        delete_file_mmap(&in_file_mmap_ptr);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       a stratified sample fills a reservoir for every stratum in one scan of the mapped 
+       file, keyed by the bytes of the mapping, which must then outlive the strata
+    */
+    if (stratify_column > 0) {
+        in_file_mmap_ptr = new_file_mmap(in_filename);
+        stratum_table_ptr = new_stratum_table(k);
+        if (!stratum_table_ptr) {
+            fprintf(stderr, "Error: Could not allocate memory for stratum table\n");
+            exit(EXIT_FAILURE);
+        }
+        sample_strata_via_mmap(in_file_mmap_ptr, stratum_table_ptr, lines_per_offset, stratify_column);
+        allocate_stratum_quotas(stratum_table_ptr, k, sample_global_args.allocation);
+        offset_reservoir_ptr = new_stratified_offset_reservoir_ptr(stratum_table_ptr, select_offset_encoding((off_t) in_file_mmap_ptr->size, kFalse), preserve_output_order, num_threads);
+        print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset, kFalse);
+        delete_offset_reservoir_ptr(&offset_reservoir_ptr);
+        delete_stratum_table(&stratum_table_ptr);
+        delete_file_mmap(&in_file_mmap_ptr);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       a shard of the file holds the line-groupings that start in its byte range, and is 
+       sampled in a scan of that range alone; its reservoir can be saved in place of the 
+       sample, to be merged with those of the other shards by sample merge
+    */
+    if ((byte_range_specified) || (state_filename)) {
+        in_file_mmap_ptr = new_file_mmap(in_filename);
+        if (byte_range_stop > in_file_mmap_ptr->size)
+            byte_range_stop = in_file_mmap_ptr->size;
+        if (byte_range_start > byte_range_stop)
+            byte_range_start = byte_range_stop;
+        reservoir_encoding = select_offset_encoding((off_t) in_file_mmap_ptr->size, (!sample_size_specified) ? kTrue : kFalse);
+        offset_reservoir_ptr = new_offset_reservoir_ptr(k, reservoir_encoding);
+        keyed_sample = ((rng == kRngPhilox) && (sample_size_specified)) ? kTrue : kFalse;
+        num_groups = sample_reservoir_offsets_via_byte_range(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, num_threads, byte_range_start, byte_range_stop, sample_size_specified, keyed_sample);
+        if (state_filename)
+            save_offset_reservoir_state(state_filename, in_filename, in_file_mmap_ptr, offset_reservoir_ptr, byte_range_start, byte_range_stop, (sample_size_specified) ? k : -1, num_groups, lines_per_offset, keyed_sample);
+        else {
+            if (!sample_size_specified)
+                shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
+            if (preserve_output_order)
+                sort_offset_reservoir_ptr_offsets(&offset_reservoir_ptr, num_threads);
+            print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset, preserve_output_order);
+        }
+        delete_offset_reservoir_ptr(&offset_reservoir_ptr);
+        delete_file_mmap(&in_file_mmap_ptr);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       several input files are sampled as one population, as if they had been concatenated, 
+       mapping a batch of files at a time to sample them and a bounded number to write out
+    */
+    if (num_filenames > 1) {
+        in_set = new_input_set(sample_global_args.filenames, num_filenames);
+        whole_index = ((sample_with_replacement) || (!sample_size_specified)) ? kTrue : kFalse;
+        reservoir_encoding = select_offset_encoding(in_set->total_size, whole_index);
+        offset_reservoir_ptr = new_offset_reservoir_ptr(k, reservoir_encoding);
+        sample_reservoir_offsets_via_input_set(in_set, &offset_reservoir_ptr, lines_per_offset, num_threads, ((sample_size_specified) && (sample_without_replacement)) ? kTrue : kFalse, (rng == kRngPhilox) ? kTrue : kFalse);
+        finish_offset_reservoir_sample(&offset_reservoir_ptr, print_offset_reservoir_sample_via_input_set, in_set, k, lines_per_offset, sample_size_specified, sample_with_replacement, preserve_output_order, num_threads);
+        delete_input_set(&in_set);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* 
+       a whole-file shuffle within a memory budget reads the input from start to end, 
+       and has no use for its mapping or an index
+    */
+    if (external_shuffle_requested) {
+        in_fd = open(in_filename, O_RDONLY);
+        if (in_fd == -1) {
+            fprintf(stderr, "Error: Could not open input file [%s] (%s)\n", in_filename, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        shuffle_records_via_external_buckets(in_fd, lines_per_offset, max_memory);
+        close(in_fd);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    /* use a current line index sidecar, if there is one, in place of the indexing pass */
+    in_file_stat_status = stat(in_filename, &in_file_stat);
+    if ((!ignore_index) && (in_file_stat_status == 0)) {
+        line_index_ptr = line_index_open(index_filename, &in_file_stat);
+        if ((!line_index_ptr) && (errno == ESTALE))
+            fprintf(stderr, "Warning: Ignoring out-of-date index [%s]\n", index_filename);
+    }
+
+    /* 
+       when the number of line-groupings is known, an ordered sample without replacement 
+       is drawn in ascending order and written out as the scan reaches each pick, with no 
+       reservoir to fill and sort
+    */
+    sequential_sample = ((preserve_output_order) && (sample_size_specified) && (sample_without_replacement) && (mmap_in_file) && ((line_index_ptr) || (total_records_specified)) && (rng != kRngPhilox)) ? kTrue : kFalse;
+
+    /* 
+       with the counter-based generator, a fixed-size sample without replacement is the k 
+       line-groupings with the smallest keys, which depend on their offsets alone -- so the 
+       sample is the same for any thread count, and with or without an index
+    */
+    keyed_sample = ((rng == kRngPhilox) && (sample_size_specified) && (sample_without_replacement) && ((line_index_ptr) || (mmap_in_file))) ? kTrue : kFalse;
+
+    /* 
+       without an index, a sample with replacement is drawn in one pass into k one-slot 
+       reservoirs -- or, for a bootstrap or a sample near the size of the input, once the 
+       line-groupings are counted -- and is held as its draws, in ascending order
+    */
+    if ((sample_with_replacement) && (!line_index_ptr)) {
+        if ((hybrid_in_file) || (cstdio_in_file)) {
+            in_file_ptr = new_file_ptr(in_filename);
+            sample_reservoir_draws_with_replacement_via_cstdio(in_file_ptr, &offset_reservoir_ptr, lines_per_offset, k, sample_size_specified);
+            if (hybrid_in_file)
+                in_file_mmap_ptr = new_file_mmap(in_filename);
+        }
+        else {
+            in_file_mmap_ptr = new_file_mmap(in_filename);
+            sample_reservoir_draws_with_replacement_via_mmap(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, k, sample_size_specified);
+        }
+        if (!preserve_output_order)
+            shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
+        if (offset_reservoir_ptr->num_offsets > 0)
+            print_offset_reservoir_draws(offset_reservoir_ptr, lines_per_offset, preserve_output_order, in_file_mmap_ptr, in_file_ptr);
+        delete_offset_reservoir_ptr(&offset_reservoir_ptr);
+        if (in_file_mmap_ptr)
+            delete_file_mmap(&in_file_mmap_ptr);
+        if (in_file_ptr)
+            delete_file_ptr(&in_file_ptr);
+        free(index_filename);
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> main()\n");
+#endif
+        return EXIT_SUCCESS;
+    }
 
-    /* set up a blank reservoir pool */
-    offset_reservoir_ptr = new_offset_reservoir_ptr(k);
+    /* 
+       set up a blank reservoir pool (the index path sizes its own), with offsets no wider 
+       than the input needs -- the paths that index every line-grouping can pack the index
+    */
+    whole_index = ((sample_without_replacement) && (!sample_size_specified)) ? kTrue : kFalse;
+    reservoir_encoding = select_offset_encoding((in_file_stat_status == 0) ? in_file_stat.st_size : (off_t) LLONG_MAX, whole_index);
+    offset_reservoir_ptr = new_offset_reservoir_ptr(((line_index_ptr) || (sequential_sample)) ? 1 : k, reservoir_encoding);
 
     /* sample and shuffle offsets */
-    if (sample_without_replacement) 
+    if (sequential_sample)
+        {
+            in_file_mmap_ptr = new_file_mmap(in_filename);
+            print_sequential_sample_via_mmap(in_file_mmap_ptr, line_index_ptr, lines_per_offset, k, (line_index_ptr) ? (long) (line_index_num_lines(line_index_ptr) / lines_per_offset) : total_records);
+        }
+    else if (line_index_ptr)
+        {
+            /* --hybrid writes its sample out of a mapping of the input */
+            if (cstdio_in_file)
+                in_file_ptr = new_file_ptr(in_filename);
+            else
+                in_file_mmap_ptr = new_file_mmap(in_filename);
+            if (keyed_sample)
+                sample_reservoir_offsets_without_replacement_via_keyed_line_index(line_index_ptr, &offset_reservoir_ptr, lines_per_offset, k);
+            else
+                sample_reservoir_offsets_via_line_index(line_index_ptr, &offset_reservoir_ptr, lines_per_offset, k, sample_size_specified, sample_with_replacement);
+        }
+    else if (sample_without_replacement) 
         {
             if ((hybrid_in_file) || (cstdio_in_file)) {
                 in_file_ptr = new_file_ptr(in_filename);
@@ -57,62 +506,54 @@ int main(int argc, char** argv)
                     sample_reservoir_offsets_without_replacement_via_cstdio_with_unspecified_k(in_file_ptr, &offset_reservoir_ptr, lines_per_offset);
                     shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
                 }
+                if (hybrid_in_file)
+                    in_file_mmap_ptr = new_file_mmap(in_filename);
             }
             else if (mmap_in_file) {
                 in_file_mmap_ptr = new_file_mmap(in_filename);
-                if (sample_size_specified)
+                if (keyed_sample)
+                    sample_reservoir_offsets_without_replacement_via_keyed_mmap(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, num_threads);
+                else if ((sample_size_specified) && (num_threads > 1))
+                    sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_fixed_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, num_threads);
+                else if (sample_size_specified)
                     sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset);
                 else {
-                    sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset);
+                    if (num_threads > 1)
+                        sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_unspecified_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset, num_threads);
+                    else
+                        sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset);
                     shuffle_reservoir_offsets_via_fisher_yates(&offset_reservoir_ptr);
                 }
             }
         }
-    else if (sample_with_replacement) 
-        {
-            if ((hybrid_in_file) || (cstdio_in_file)) {
-                in_file_ptr = new_file_ptr(in_filename);
-                sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k(in_file_ptr, &offset_reservoir_ptr, lines_per_offset);
-                if (sample_size_specified)
-                    sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k(&offset_reservoir_ptr, k);
-                else
-                    sample_reservoir_offsets_with_replacement_via_cstdio_with_unspecified_k(&offset_reservoir_ptr);
-            }
-            else if (mmap_in_file) {
-                in_file_mmap_ptr = new_file_mmap(in_filename);
-                sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k(in_file_mmap_ptr, &offset_reservoir_ptr, lines_per_offset);
-                if (sample_size_specified)
-                    sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(&offset_reservoir_ptr, k);
-                else
-                    sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k(&offset_reservoir_ptr);
-            }
-        }
 
+    if (!sequential_sample) {
 #ifdef DEBUG
-    /* print reservoir offsets */
-    print_offset_reservoir_ptr(offset_reservoir_ptr);
+        /* print reservoir offsets */
+        print_offset_reservoir_ptr(offset_reservoir_ptr);
+        fprintf(stderr, "Debug: Offset reservoir holds %ld offsets in %zu bytes\n", offset_reservoir_ptr->num_offsets, offset_reservoir_bytes(offset_reservoir_ptr));
 #endif
 
-    /* sort offsets, if needed */
-    if (preserve_output_order) {
-        sort_offset_reservoir_ptr_offsets(&offset_reservoir_ptr);
+        /* sort offsets, if needed */
+        if (preserve_output_order) {
+            sort_offset_reservoir_ptr_offsets(&offset_reservoir_ptr, num_threads);
 #ifdef DEBUG
-        print_offset_reservoir_ptr(offset_reservoir_ptr);
+            print_offset_reservoir_ptr(offset_reservoir_ptr);
 #endif
-    }
+        }
 
-    /* print reservoir offset line references */
-    if (hybrid_in_file)
-        print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset);    
-    else if (cstdio_in_file) {
-        if (preserve_output_order)
-            print_sorted_offset_reservoir_sample_via_cstdio(in_file_ptr, offset_reservoir_ptr, lines_per_offset);
-        else
-            print_unsorted_offset_reservoir_sample_via_cstdio(in_file_ptr, offset_reservoir_ptr, lines_per_offset);
+        /* print reservoir offset line references */
+        if (hybrid_in_file)
+            print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset, preserve_output_order);    
+        else if (cstdio_in_file) {
+            if (preserve_output_order)
+                print_sorted_offset_reservoir_sample_via_cstdio(in_file_ptr, offset_reservoir_ptr, lines_per_offset);
+            else
+                print_unsorted_offset_reservoir_sample_via_cstdio(in_file_ptr, offset_reservoir_ptr, lines_per_offset);
+        }
+        else if (mmap_in_file)
+            print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset, preserve_output_order);
     }
-    else if (mmap_in_file)
-        print_offset_reservoir_sample_via_mmap(in_file_mmap_ptr, offset_reservoir_ptr, lines_per_offset);
-
 
     /* clean up */
     if (offset_reservoir_ptr)
@@ -121,6 +562,9 @@ int main(int argc, char** argv)
         delete_file_mmap(&in_file_mmap_ptr);
     if (in_file_ptr)
         delete_file_ptr(&in_file_ptr);
+    if (line_index_ptr)
+        line_index_close(&line_index_ptr);
+    free(index_filename);
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> main()\n");
@@ -129,19 +573,79 @@ int main(int argc, char** argv)
     return EXIT_SUCCESS;
 }
 
-offset_reservoir * new_offset_reservoir_ptr(const long len)
+offset_encoding select_offset_encoding(const off_t max_offset, const boolean whole_index)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> select_offset_encoding()\n");
+#endif
+
+    const char *forced = getenv("SAMPLE_OFFSET_ENCODING");
+    offset_encoding encoding = kOffsetEncodingWide;
+
+    /* 
+       32-bit offsets halve the reservoir whenever they can hold every offset; past 4 GB, 
+       a whole-file index is packed instead, at a few bytes per line
+    */
+    if (max_offset <= (off_t) UINT32_MAX)
+        encoding = kOffsetEncodingNarrow;
+    else if (whole_index)
+        encoding = kOffsetEncodingPacked;
+
+    /* SAMPLE_OFFSET_ENCODING ("wide", "narrow" or "packed") overrides the choice, where it is safe to */
+    if (forced) {
+        if (strcmp(forced, "wide") == 0)
+            encoding = kOffsetEncodingWide;
+        else if ((strcmp(forced, "narrow") == 0) && (max_offset <= (off_t) UINT32_MAX))
+            encoding = kOffsetEncodingNarrow;
+        else if ((strcmp(forced, "packed") == 0) && (whole_index))
+            encoding = kOffsetEncodingPacked;
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Selected offset encoding [%d]\n", (int) encoding);
+    fprintf(stderr, "Debug: Leaving  --> select_offset_encoding()\n");
+#endif
+
+    return encoding;
+}
+
+offset_encoding offset_reservoir_element_encoding(const offset_reservoir *res)
+{
+    /* a sample drawn from a packed index gets an array of its own */
+    if (res->encoding != kOffsetEncodingPacked)
+        return res->encoding;
+
+    return ((res->packed->num_values == 0) || (packed_offsets_get(res->packed, res->packed->num_values - 1) <= UINT32_MAX)) ? kOffsetEncodingNarrow : kOffsetEncodingWide;
+}
+
+static size_t offset_encoding_element_size(const offset_encoding encoding)
+{
+    return (encoding == kOffsetEncodingWide) ? sizeof(off_t) : sizeof(uint32_t);
+}
+
+offset_reservoir * new_offset_reservoir_ptr(const long len, const offset_encoding encoding)
 {
 #ifdef DEBUG
     fprintf(stderr, "Debug: Entering --> new_offset_reservoir_ptr()\n");
 #endif
 
     offset_reservoir *res = NULL;
-    off_t *offsets = NULL;
+    void *offsets = NULL;
+    packed_offsets *packed = NULL;
     
-    offsets = malloc(sizeof(off_t) * len);
-    if (!offsets) {
-        fprintf(stderr, "Debug: offsets instance is NULL\n");
-        exit(EXIT_FAILURE);
+    if (encoding == kOffsetEncodingPacked) {
+        packed = new_packed_offsets();
+        if (!packed) {
+            fprintf(stderr, "Debug: packed offsets instance is NULL\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        offsets = offset_arena_reserve(offset_encoding_element_size(encoding) * len);
+        if (!offsets) {
+            fprintf(stderr, "Debug: offsets instance is NULL\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
     res = malloc(sizeof(offset_reservoir));
@@ -150,8 +654,11 @@ offset_reservoir * new_offset_reservoir_ptr(const long len)
         exit(EXIT_FAILURE);
     }
 
-    res->num_offsets = len;
+    res->num_offsets = (packed) ? 0 : len;
+    res->capacity = (packed) ? 0 : len;
+    res->encoding = encoding;
     res->offsets = offsets;
+    res->packed = packed;
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> new_offset_reservoir_ptr()\n");
@@ -172,10 +679,12 @@ void delete_offset_reservoir_ptr(offset_reservoir **res_ptr)
     }
 
     if ((*res_ptr)->offsets) {
-        free((*res_ptr)->offsets);
+        offset_arena_release((*res_ptr)->offsets, offset_encoding_element_size((*res_ptr)->encoding) * (*res_ptr)->capacity);
         (*res_ptr)->offsets = NULL;
         (*res_ptr)->num_offsets = 0;
     }
+    if ((*res_ptr)->packed)
+        delete_packed_offsets(&((*res_ptr)->packed));
 
     free(*res_ptr);
     *res_ptr = NULL;
@@ -185,6 +694,94 @@ void delete_offset_reservoir_ptr(offset_reservoir **res_ptr)
 #endif
 }
 
+void offset_reservoir_reserve(offset_reservoir *res, const long capacity)
+{
+    void *resized_offsets = NULL;
+
+    if ((res->encoding == kOffsetEncodingPacked) || (capacity <= res->capacity))
+        return;
+
+    resized_offsets = offset_arena_resize(res->offsets, offset_encoding_element_size(res->encoding) * res->capacity, offset_encoding_element_size(res->encoding) * capacity);
+    if (!resized_offsets) {
+        fprintf(stderr, "Error: Could not allocate memory for resized offset array\n");
+        exit(EXIT_FAILURE);
+    }
+    res->offsets = resized_offsets;
+    res->capacity = capacity;
+    run_stats_add(&sample_stats.reallocations, 1);
+}
+
+void offset_reservoir_append(offset_reservoir *res, const off_t offset)
+{
+    if (res->encoding == kOffsetEncodingPacked) {
+        if (packed_offsets_append(res->packed, (uint64_t) offset) == -1) {
+            fprintf(stderr, "Error: Could not allocate memory for packed offsets\n");
+            exit(EXIT_FAILURE);
+        }
+        res->num_offsets++;
+        return;
+    }
+
+    /* doubling keeps the number of resizes logarithmic, and a resize only remaps pages */
+    if (res->num_offsets == res->capacity)
+        offset_reservoir_reserve(res, (res->capacity < DEFAULT_SAMPLE_SIZE_INCREMENT) ? DEFAULT_SAMPLE_SIZE_INCREMENT : 2 * res->capacity);
+    offset_reservoir_set(res, res->num_offsets++, offset);
+}
+
+void offset_reservoir_rank(offset_reservoir *res)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> offset_reservoir_rank()\n");
+#endif
+
+    uint32_t *ranks = NULL;
+    offset_reservoir *unpacked_res = NULL;
+    long rank_idx = 0;
+
+    if ((res->encoding != kOffsetEncodingPacked) || (res->offsets)) 
+        return;
+
+    /* ranks are 32-bit, so an index of 4G line-groupings or more goes back to plain offsets */
+    if (res->num_offsets > (long) UINT32_MAX) {
+        unpacked_res = new_offset_reservoir_ptr(res->num_offsets, kOffsetEncodingWide);
+        for (rank_idx = 0; rank_idx < res->num_offsets; ++rank_idx)
+            offset_reservoir_set(unpacked_res, rank_idx, offset_reservoir_get(res, rank_idx));
+        delete_packed_offsets(&(res->packed));
+        res->encoding = kOffsetEncodingWide;
+        res->offsets = unpacked_res->offsets;
+        res->capacity = unpacked_res->capacity;
+        unpacked_res->offsets = NULL;
+        delete_offset_reservoir_ptr(&unpacked_res);
+        return;
+    }
+
+    ranks = offset_arena_reserve(sizeof(uint32_t) * res->num_offsets);
+    if (!ranks) {
+        fprintf(stderr, "Error: Could not allocate memory for offset ranks\n");
+        exit(EXIT_FAILURE);
+    }
+    for (rank_idx = 0; rank_idx < res->num_offsets; ++rank_idx)
+        ranks[rank_idx] = (uint32_t) rank_idx;
+    res->offsets = ranks;
+    res->capacity = res->num_offsets;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> offset_reservoir_rank()\n");
+#endif
+}
+
+size_t offset_reservoir_bytes(const offset_reservoir *res)
+{
+    size_t bytes = sizeof(offset_reservoir);
+
+    if (res->offsets)
+        bytes += offset_encoding_element_size(res->encoding) * res->capacity;
+    if (res->packed)
+        bytes += packed_offsets_bytes(res->packed);
+
+    return bytes;
+}
+
 void print_offset_reservoir_ptr(const offset_reservoir *res_ptr)
 {
 #ifdef DEBUG
@@ -194,7 +791,7 @@ void print_offset_reservoir_ptr(const offset_reservoir *res_ptr)
     int idx;
 
     for (idx = 0; idx < res_ptr->num_offsets; ++idx)
-        fprintf(stdout, "[%012d] %012lld\n", idx, (long long int) res_ptr->offsets[idx]);
+        fprintf(stdout, "[%012d] %012lld\n", idx, (long long int) offset_reservoir_get(res_ptr, idx));
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving --> print_offset_reservoir_ptr()\n");
@@ -211,14 +808,18 @@ void sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k(FILE *
     off_t start_offset = 0;
     off_t stop_offset = 0;
     long k = (*res_ptr)->num_offsets;
-    double p_replacement = 0.0;
+    double w = 0.0;
     unsigned long rand_idx = 0;
     long ln_idx = 0;
     long grp_idx = 0;
+    long next_grp_idx = 0;
 
     in_line[LINE_LENGTH_VALUE] = '1';
 
-    /* read offsets into reservoir, replacing random offsets when the line-grouping counter is greater than k */
+    /* 
+       fill the reservoir with the first k line-groupings, and thereafter only replace
+       a random offset at the line-grouping picked by the Algorithm L skip distribution
+    */
     while (fgets(in_line, LINE_LENGTH_VALUE + 1, in_file_ptr)) 
         {
             if ((++ln_idx) % lines_per_offset)
@@ -228,18 +829,16 @@ void sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k(FILE *
 #ifdef DEBUG
                 fprintf(stderr, "Debug: Adding node at idx %012ld with offset %012lld\n", grp_idx, (long long int) start_offset);
 #endif
-                (*res_ptr)->offsets[grp_idx] = start_offset;
+                offset_reservoir_set(*res_ptr, grp_idx, start_offset);
             }
-            else {
-                p_replacement = (double) k / (grp_idx + 1);
-                //rand_idx = rand() % k;
-                rand_idx = mt19937_generate_random_ulong() % k;
-                if (p_replacement > mt19937_generate_random_double()) {
+            else if (grp_idx == next_grp_idx) {
+                rand_idx = rng_bounded_modulo(&rng_global_state, k);
 #ifdef DEBUG
-                    fprintf(stderr, "Debug: Replacing random offset %012ld for line %012ld with probability %f\n", rand_idx, grp_idx, p_replacement);
+                fprintf(stderr, "Debug: Replacing random offset %012ld for line %012ld\n", rand_idx, grp_idx);
 #endif
-                    (*res_ptr)->offsets[rand_idx] = start_offset;
-                }
+                offset_reservoir_set(*res_ptr, rand_idx, start_offset);
+                w = algorithm_l_next_weight(&rng_global_state, w, k);
+                next_grp_idx = algorithm_l_next_index(&rng_global_state, grp_idx, w);
             }
             stop_offset = ftell(in_file_ptr);
 #ifdef DEBUG
@@ -247,48 +846,25 @@ void sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k(FILE *
 #endif
             start_offset = stop_offset;
             grp_idx++;
+
+            /* once the reservoir is full, draw the first skip */
+            if (grp_idx == k) {
+                w = algorithm_l_initial_weight(&rng_global_state, k);
+                next_grp_idx = algorithm_l_next_index(&rng_global_state, grp_idx - 1, w);
+            }
         }
 
     /* for when there are fewer line-groupings than the sample size */
     if (grp_idx < k)
         (*res_ptr)->num_offsets = grp_idx;
+    sample_stats.bytes_scanned += (unsigned long long) ftell(in_file_ptr);
+    sample_stats.records_seen += (unsigned long long) grp_idx;
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_cstdio_with_fixed_k()\n");
 #endif
 }
 
-void sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k(offset_reservoir **res_ptr, const int sample_size)
-{
-#ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k()\n");
-#endif
-
-    sample_reservoir_offsets_with_replacement_with_fixed_k(res_ptr, sample_size);
-
-#ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k()\n");
-#endif
-}
-
-void sample_reservoir_offsets_with_replacement_via_cstdio_with_unspecified_k(offset_reservoir **res_ptr)
-{
-#ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_cstdio_with_unspecified_k()\n");
-#endif
-
-    /* 
-       we sample with replacement using the original reservoir's offset count 
-       as the new reservoir's sample size (note that this temporarily doubles 
-       the application's memory usage)
-    */
-    sample_reservoir_offsets_with_replacement_via_cstdio_with_fixed_k(res_ptr, (*res_ptr)->num_offsets);
-
-#ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_cstdio_with_unspecified_k()\n");
-#endif
-}
-
 void sample_reservoir_offsets_without_replacement_via_cstdio_with_unspecified_k(FILE *in_file_ptr, offset_reservoir **res_ptr, const int lines_per_offset)
 {
 #ifdef DEBUG
@@ -298,36 +874,23 @@ void sample_reservoir_offsets_without_replacement_via_cstdio_with_unspecified_k(
     char in_line[LINE_LENGTH_VALUE + 1];
     off_t start_offset = 0;
     off_t stop_offset = 0;
-    long k = (*res_ptr)->num_offsets;
     long ln_idx = 0;
-    long grp_idx = 0;
-    off_t *resized_offsets = NULL;
 
     in_line[LINE_LENGTH_VALUE] = '1';
 
     /* read all offsets into reservoir, reallocating memory as needed */
+    (*res_ptr)->num_offsets = 0;
     while (fgets(in_line, LINE_LENGTH_VALUE + 1, in_file_ptr)) 
         {
             if ((++ln_idx) % lines_per_offset)
                 continue;
 
-            if (grp_idx == k) 
-                {
-                    k += DEFAULT_SAMPLE_SIZE_INCREMENT;
-                    resized_offsets = realloc((*res_ptr)->offsets, sizeof(off_t) * k);
-                    if (!resized_offsets) {
-                        fprintf(stderr, "Error: Could not allocate memory for resized offset array\n");
-                        exit(EXIT_FAILURE);
-                    }
-                    (*res_ptr)->offsets = resized_offsets;
-                }
-            (*res_ptr)->offsets[grp_idx] = start_offset;
+            offset_reservoir_append(*res_ptr, start_offset);
             stop_offset = ftell(in_file_ptr);
             start_offset = stop_offset;
-            grp_idx++;
         }
-
-    (*res_ptr)->num_offsets = grp_idx;
+    sample_stats.bytes_scanned += (unsigned long long) ftell(in_file_ptr);
+    sample_stats.records_seen += (unsigned long long) (*res_ptr)->num_offsets;
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_cstdio_with_unspecified_k()\n");
@@ -340,42 +903,70 @@ void sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k(file_mma
     fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k()\n");
 #endif
 
-    size_t offset_idx;
-    off_t start_offset = 0;
-    off_t stop_offset = 0;
+    const char *map_start = in_mmap->map;
+    const char *map_stop = in_mmap->map + in_mmap->size;
+    const char *cursor = map_start;
+    const char *grp_stop = NULL;
     long k = (*res_ptr)->num_offsets;
-    long ln_idx = 0;
     long grp_idx = 0;
-    double p_replacement = 0.0;
+    long skip_length = 0;
+    double w = 0.0;
     long rand_idx = 0;
 
-    for (offset_idx = 0; offset_idx < in_mmap->size; ++offset_idx) 
+    /* fill the reservoir with the first k line-groupings */
+    while (grp_idx < k) 
         {
-            if (in_mmap->map[offset_idx] == '\n') 
-                {
-                    if ((++ln_idx) % lines_per_offset)
-                        continue;
-                    
-                    if (grp_idx < k) {
+            grp_stop = newline_scan_nth(cursor, map_stop, lines_per_offset);
+            if (!grp_stop)
+                break;
 #ifdef DEBUG
-                        fprintf(stderr, "Debug: Adding offset at idx %012ld with offset value %012lld\n", grp_idx, (long long int) start_offset);
+            fprintf(stderr, "Debug: Adding offset at idx %012ld with offset value %012lld\n", grp_idx, (long long int) (cursor - map_start));
 #endif
-                        (*res_ptr)->offsets[grp_idx] = start_offset;
-                    }
-                    else {
-                        p_replacement = (double) k / (grp_idx + 1);
-                        rand_idx = mt19937_generate_random_ulong() % k;
-                        if (p_replacement > mt19937_generate_random_double())
-                            (*res_ptr)->offsets[rand_idx] = start_offset;
-                    }
-                    stop_offset = offset_idx;
-                    start_offset = stop_offset + 1;
-                    grp_idx++;
-                }
+            offset_reservoir_set(*res_ptr, grp_idx++, cursor - map_start);
+            cursor = grp_stop + 1;
         }
 
-    if (grp_idx < k)
+    /* for when there are fewer line-groupings than the sample size */
+    if (grp_idx < k) {
         (*res_ptr)->num_offsets = grp_idx;
+        sample_stats.bytes_scanned += in_mmap->size;
+        sample_stats.records_seen += (unsigned long long) grp_idx;
+#ifdef DEBUG
+        fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k()\n");
+#endif
+        return;
+    }
+
+    /* 
+       jump over the line-groupings that Algorithm L says will not enter the reservoir, 
+       so that the RNG is only consulted at replacements
+    */
+    w = algorithm_l_initial_weight(&rng_global_state, k);
+    while (cursor < map_stop) 
+        {
+            skip_length = algorithm_l_next_index(&rng_global_state, 0, w) - 1;
+            if (skip_length > 0) {
+                grp_stop = newline_scan_nth(cursor, map_stop, (skip_length < LONG_MAX / lines_per_offset) ? skip_length * lines_per_offset : LONG_MAX);
+                if (!grp_stop)
+                    break;
+                cursor = grp_stop + 1;
+                grp_idx += skip_length;
+            }
+            grp_stop = newline_scan_nth(cursor, map_stop, lines_per_offset);
+            if (!grp_stop)
+                break;
+            rand_idx = rng_bounded_modulo(&rng_global_state, k);
+            offset_reservoir_set(*res_ptr, rand_idx, cursor - map_start);
+            cursor = grp_stop + 1;
+            grp_idx++;
+            w = algorithm_l_next_weight(&rng_global_state, w, k);
+        }
+
+    /* the last skip runs off the end of the input, past line-groupings that are only counted for --stats */
+    sample_stats.bytes_scanned += in_mmap->size;
+    sample_stats.records_seen += (unsigned long long) grp_idx;
+    if ((sample_stats.enabled) && (cursor < map_stop))
+        sample_stats.records_seen += (unsigned long long) (newline_scan_count(cursor, (size_t) (map_stop - cursor)) / lines_per_offset);
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_mmap_with_fixed_k()\n");
@@ -388,268 +979,3495 @@ void sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k(fi
     fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k()\n");
 #endif
 
-    size_t offset_idx;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
     off_t start_offset = 0;
-    off_t stop_offset = 0;
-    long k = (*res_ptr)->num_offsets;
     long ln_idx = 0;
-    long grp_idx = 0;
-    off_t *resized_offsets = NULL;
 
-    for (offset_idx = 0; offset_idx < in_mmap->size; ++offset_idx) 
+    /* pull newline positions from the scanner in bulk, and record an offset at the end of each line-grouping */
+    (*res_ptr)->num_offsets = 0;
+    offset_reservoir_reserve(*res_ptr, estimate_mmap_line_groupings(in_mmap, 0, in_mmap->size, lines_per_offset));
+    while (scan_offset < in_mmap->size) 
         {
-            if (in_mmap->map[offset_idx] == '\n') 
+            num_positions = newline_scan_positions(in_mmap->map + scan_offset, in_mmap->size - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+            for (position_idx = 0; position_idx < num_positions; ++position_idx) 
                 {
                     if ((++ln_idx) % lines_per_offset)
                         continue;
                     
-                    if (grp_idx == k) 
-                        {
-                            k += DEFAULT_SAMPLE_SIZE_INCREMENT;
-                            resized_offsets = realloc((*res_ptr)->offsets, sizeof(off_t) * k);
-                            if (!resized_offsets) {
-                                fprintf(stderr, "Error: Could not allocate memory for resized offset array\n");
-                                exit(EXIT_FAILURE);
-                            }
-                            (*res_ptr)->offsets = resized_offsets;
-                        }
-                    (*res_ptr)->offsets[grp_idx] = start_offset;
-                    stop_offset = offset_idx;
-                    start_offset = stop_offset + 1;
-                    grp_idx++;
+                    offset_reservoir_append(*res_ptr, start_offset);
+                    start_offset = scan_offset + newline_positions[position_idx] + 1;
                 }
+            scan_offset += scanned;
         }
-    (*res_ptr)->num_offsets = grp_idx;
+    sample_stats.bytes_scanned += in_mmap->size;
+    sample_stats.records_seen += (unsigned long long) (*res_ptr)->num_offsets;
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_mmap_with_unspecified_k()\n");
 #endif
 }
 
-void sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(offset_reservoir **res_ptr, const int sample_size)
+long estimate_mmap_line_groupings(const file_mmap *in_mmap, const size_t start, const size_t stop, const int lines_per_offset)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k()\n");
+    fprintf(stderr, "Debug: Entering --> estimate_mmap_line_groupings()\n");
 #endif
 
-    sample_reservoir_offsets_with_replacement_with_fixed_k(res_ptr, sample_size);
+    size_t window_start = 0;
+    size_t sampled_bytes = 0;
+    size_t sampled_lines = 0;
+    double estimate = 0.0;
+    int window_idx = 0;
+
+    /* 
+       a small range is cheaper to count than to estimate; otherwise, the newline density of 
+       a few evenly-spaced windows gives the line count to within a few percent on all but 
+       very irregular files, and a short estimate only costs a remap or two later on
+    */
+    if (stop - start <= LINE_ESTIMATE_WINDOW_SIZE * LINE_ESTIMATE_NUM_WINDOWS) {
+        estimate = (double) newline_scan_count(in_mmap->map + start, stop - start);
+    }
+    else {
+        for (window_idx = 0; window_idx < LINE_ESTIMATE_NUM_WINDOWS; ++window_idx) {
+            window_start = start + (stop - start - LINE_ESTIMATE_WINDOW_SIZE) / (LINE_ESTIMATE_NUM_WINDOWS - 1) * window_idx;
+            sampled_lines += newline_scan_count(in_mmap->map + window_start, LINE_ESTIMATE_WINDOW_SIZE);
+            sampled_bytes += LINE_ESTIMATE_WINDOW_SIZE;
+        }
+        estimate = 1.05 * (double) sampled_lines / sampled_bytes * (stop - start);
+    }
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k()\n");
+    fprintf(stderr, "Debug: Estimated %.0f lines in [%zu, %zu)\n", estimate, start, stop);
+    fprintf(stderr, "Debug: Leaving  --> estimate_mmap_line_groupings()\n");
 #endif
+
+    return (long) (estimate / lines_per_offset) + 1;
 }
 
-void sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k(offset_reservoir **res_ptr)
+long estimate_cstdio_line_groupings(FILE *in_file_ptr, const off_t size, const int lines_per_offset)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k()\n");
+    fprintf(stderr, "Debug: Entering --> estimate_cstdio_line_groupings()\n");
 #endif
 
-    /* 
-       we sample with replacement using the original reservoir's offset count 
-       as the new reservoir's sample size (note that this temporarily doubles 
-       the application's memory usage)
-    */
-    sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(res_ptr, (*res_ptr)->num_offsets);
+    char *window = NULL;
+    size_t window_len = 0;
+    size_t sampled_bytes = 0;
+    size_t sampled_lines = 0;
+    double estimate = 0.0;
+    int window_idx = 0;
+
+    /* the windows of estimate_mmap_line_groupings(), read in and the stream rewound */
+    window = malloc(LINE_ESTIMATE_WINDOW_SIZE);
+    if (!window) {
+        fprintf(stderr, "Error: Could not allocate memory for line estimate\n");
+        exit(EXIT_FAILURE);
+    }
+    for (window_idx = 0; window_idx < LINE_ESTIMATE_NUM_WINDOWS; ++window_idx) {
+        if ((size > LINE_ESTIMATE_WINDOW_SIZE * LINE_ESTIMATE_NUM_WINDOWS) && (fseeko(in_file_ptr, (size - LINE_ESTIMATE_WINDOW_SIZE) / (LINE_ESTIMATE_NUM_WINDOWS - 1) * window_idx, SEEK_SET) == -1))
+            break;
+        window_len = fread(window, 1, LINE_ESTIMATE_WINDOW_SIZE, in_file_ptr);
+        sampled_lines += newline_scan_count(window, window_len);
+        sampled_bytes += window_len;
+    }
+    free(window);
+    if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
+        fprintf(stderr, "Error: Could not rewind input file pointer\n");
+        exit(EXIT_FAILURE);
+    }
+    if (size <= LINE_ESTIMATE_WINDOW_SIZE * LINE_ESTIMATE_NUM_WINDOWS)
+        estimate = (double) sampled_lines;
+    else if (sampled_bytes > 0)
+        estimate = 1.05 * (double) sampled_lines / sampled_bytes * size;
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k()\n");
+    fprintf(stderr, "Debug: Estimated %.0f lines\n", estimate);
+    fprintf(stderr, "Debug: Leaving  --> estimate_cstdio_line_groupings()\n");
 #endif
+
+    return (long) (estimate / lines_per_offset) + 1;
+}
+
+mmap_chunk * new_mmap_chunks(const file_mmap *in_mmap, const int num_threads, const int lines_per_offset, int *num_chunks)
+{
+    return new_mmap_range_chunks(in_mmap, 0, in_mmap->size, num_threads, lines_per_offset, num_chunks);
+}
+
+size_t align_mmap_record_start(const file_mmap *in_mmap, const size_t position)
+{
+    const char *nl = NULL;
+
+    /* a record starts at the start of the file, or just past a newline */
+    if (position == 0)
+        return 0;
+    if (position >= in_mmap->size)
+        return in_mmap->size;
+    nl = newline_scan_nth(in_mmap->map + position - 1, in_mmap->map + in_mmap->size, 1);
+
+    return (nl) ? (size_t) (nl + 1 - in_mmap->map) : in_mmap->size;
 }
 
-void sample_reservoir_offsets_with_replacement_with_fixed_k(offset_reservoir **res_ptr, const int sample_size)
+mmap_chunk * new_mmap_range_chunks(const file_mmap *in_mmap, const size_t range_start, const size_t range_stop, const int num_threads, const int lines_per_offset, int *num_chunks)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_with_fixed_k()\n");
+    fprintf(stderr, "Debug: Entering --> new_mmap_range_chunks()\n");
 #endif
 
-    offset_reservoir *original_offset_reservoir_ptr = *res_ptr;
-    offset_reservoir *sample_offset_reservoir_ptr = NULL;
-    long original_sample_size = original_offset_reservoir_ptr->num_offsets;
-    long sample_offset_idx = 0;
-    long original_random_idx = 0;
+    mmap_chunk *chunks = NULL;
+    const size_t start = align_mmap_record_start(in_mmap, range_start);
+    const size_t stop = align_mmap_record_start(in_mmap, range_stop);
+    const boolean whole_file = ((start == 0) && (stop == in_mmap->size)) ? kTrue : kFalse;
+    int chunk_idx = 0;
+    int n = num_threads;
+    size_t nominal_start = 0;
+    long lines_before = 0;
+    long lines_after = 0;
+    long total_groups = 0;
+    long first_grp_idx = 0;
+    long stop_grp_idx = 0;
 
-    /* build a new reservoir of size k */
-    sample_offset_reservoir_ptr = new_offset_reservoir_ptr(sample_size);
+    /* don't bother splitting small files into lots of tiny chunks */
+    if ((stop > start) && ((size_t) n > (stop - start) / MMAP_CHUNK_MINIMUM_SIZE))
+        n = (int) ((stop - start) / MMAP_CHUNK_MINIMUM_SIZE);
+    if (n < 1)
+        n = 1;
+
+    chunks = calloc(n, sizeof(mmap_chunk));
+    if (!chunks) {
+        fprintf(stderr, "Error: Could not allocate memory for mmap chunks\n");
+        exit(EXIT_FAILURE);
+    }
 
     /* 
-       pick random integers between 0..(original_sample_size - 1) and 
-       copy original offset values to sample reservoir's offsets array 
+       each chunk starts just past a newline, so that no line is split across two workers; 
+       a byte range holds the records that start inside it, whichever side they end on
     */
-    for (sample_offset_idx = 0; sample_offset_idx < sample_size - 1; ++sample_offset_idx) {
-        original_random_idx = mt19937_generate_random_double() * original_sample_size;
-        sample_offset_reservoir_ptr->offsets[sample_offset_idx] = original_offset_reservoir_ptr->offsets[original_random_idx];
+    for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+        chunks[chunk_idx].in_mmap = in_mmap;
+        chunks[chunk_idx].lines_per_offset = lines_per_offset;
+        chunks[chunk_idx].num_groups = -1;
+        chunks[chunk_idx].start = start;
+        chunks[chunk_idx].stop = stop;
+        if (chunk_idx == 0)
+            continue;
+        nominal_start = start + ((stop - start) / n) * chunk_idx;
+        chunks[chunk_idx].start = align_mmap_record_start(in_mmap, nominal_start);
+        if (chunks[chunk_idx].start < chunks[chunk_idx - 1].start)
+            chunks[chunk_idx].start = chunks[chunk_idx - 1].start;
+        if (chunks[chunk_idx].start > stop)
+            chunks[chunk_idx].start = stop;
+        chunks[chunk_idx - 1].stop = chunks[chunk_idx].start;
     }
 
-    /* clean up the original reservoir */
-    delete_offset_reservoir_ptr(&original_offset_reservoir_ptr);
-    original_offset_reservoir_ptr = NULL;
+    /* 
+       multi-line groupings can straddle chunk boundaries, so we count each chunk's lines 
+       up front -- a chunk then owns the groupings whose first line falls inside it; the 
+       lines on either side of a byte range are counted too, as groupings are numbered 
+       from the start of the file, and the last may be cut short by its end
+    */
+    if ((lines_per_offset > 1) && ((n > 1) || (!whole_file))) {
+        run_mmap_chunk_workers(chunks, n, count_mmap_chunk_lines);
+        lines_before = (long) newline_scan_count(in_mmap->map, start);
+        lines_after = (long) newline_scan_count(in_mmap->map + stop, in_mmap->size - stop);
+        for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+            chunks[chunk_idx].lines_before = lines_before;
+            lines_before += chunks[chunk_idx].num_lines;
+        }
+        total_groups = (lines_before + lines_after) / lines_per_offset;
+        for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+            first_grp_idx = (chunks[chunk_idx].lines_before + lines_per_offset - 1) / lines_per_offset;
+            stop_grp_idx = (chunks[chunk_idx].lines_before + chunks[chunk_idx].num_lines + lines_per_offset - 1) / lines_per_offset;
+            if (stop_grp_idx > total_groups)
+                stop_grp_idx = total_groups;
+            chunks[chunk_idx].skip_lines = first_grp_idx * lines_per_offset - chunks[chunk_idx].lines_before;
+            chunks[chunk_idx].num_groups = (stop_grp_idx > first_grp_idx) ? stop_grp_idx - first_grp_idx : 0;
+        }
+    }
 
-    /* point the current reservoir pointer at the new sample reservoir */
-    *res_ptr = sample_offset_reservoir_ptr;
+    *num_chunks = n;
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_with_fixed_k()\n");
+    fprintf(stderr, "Debug: Leaving  --> new_mmap_range_chunks()\n");
 #endif
+
+    return chunks;
 }
 
-void shuffle_reservoir_offsets_via_fisher_yates(offset_reservoir **res_ptr)
+void delete_mmap_chunks(mmap_chunk **chunks_ptr, const int num_chunks)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> shuffle_reservoir_offsets_via_fisher_yates()\n");
+    fprintf(stderr, "Debug: Entering --> delete_mmap_chunks()\n");
 #endif
 
-    long ln_idx = (*res_ptr)->num_offsets;
-    long shuf_idx = 0;
-    long rand_idx = 0;
-    off_t temp_offset = 0;
-    
-    /* cf. http://blog.codinghorror.com/the-danger-of-naivete/ for an interesting discussion about Fisher-Yates */
-    for (shuf_idx = ln_idx - 1; shuf_idx > 0; --shuf_idx) {
-        rand_idx = mt19937_generate_random_double() * (shuf_idx + 1);
-        temp_offset = (*res_ptr)->offsets[shuf_idx];
-        (*res_ptr)->offsets[shuf_idx] = (*res_ptr)->offsets[rand_idx];
-        (*res_ptr)->offsets[rand_idx] = temp_offset;
-    }
+    int chunk_idx;
+
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+        if ((*chunks_ptr)[chunk_idx].res)
+            delete_offset_reservoir_ptr(&((*chunks_ptr)[chunk_idx].res));
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+        free((*chunks_ptr)[chunk_idx].keyed);
+    free(*chunks_ptr);
+    *chunks_ptr = NULL;
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> shuffle_reservoir_offsets_via_fisher_yates()\n");
-#endif    
+    fprintf(stderr, "Debug: Leaving  --> delete_mmap_chunks()\n");
+#endif
 }
 
-void sort_offset_reservoir_ptr_offsets(offset_reservoir **res_ptr) 
+void run_mmap_chunk_workers(mmap_chunk *chunks, const int num_chunks, void * (*worker)(void *))
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> sort_offset_reservoir_ptr_offsets()\n");
+    fprintf(stderr, "Debug: Entering --> run_mmap_chunk_workers()\n");
 #endif
 
-    qsort( (*res_ptr)->offsets, (*res_ptr)->num_offsets, sizeof(off_t), offset_compare );
+    pthread_t *threads = NULL;
+    int chunk_idx;
+
+    if (num_chunks == 1)
+        worker(&chunks[0]);
+    else {
+        threads = malloc(sizeof(pthread_t) * num_chunks);
+        if (!threads) {
+            fprintf(stderr, "Error: Could not allocate memory for worker threads\n");
+            exit(EXIT_FAILURE);
+        }
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            if (pthread_create(&threads[chunk_idx], NULL, worker, &chunks[chunk_idx]) != 0) {
+                fprintf(stderr, "Error: Could not start worker thread\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+            pthread_join(threads[chunk_idx], NULL);
+        free(threads);
+    }
+
+    /* 
+       a mapped chunk is scanned from start to stop, and a chunk's line-groupings are counted 
+       once it has been sampled (the line-counting pass leaves them unknown, at -1)
+    */
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        if ((chunks[chunk_idx].in_mmap) && (chunks[chunk_idx].stop > chunks[chunk_idx].start))
+            sample_stats.bytes_scanned += chunks[chunk_idx].stop - chunks[chunk_idx].start;
+        if (chunks[chunk_idx].num_groups > 0)
+            sample_stats.records_seen += (unsigned long long) chunks[chunk_idx].num_groups;
+        sample_stats.rng_draws += rng_num_draws(&chunks[chunk_idx].rng);
+    }
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> sort_offset_reservoir_ptr_offsets()\n");
+    fprintf(stderr, "Debug: Leaving  --> run_mmap_chunk_workers()\n");
 #endif
 }
 
-int offset_compare(const void *off1, const void *off2)
+void * count_mmap_chunk_lines(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+
+    chunk->num_lines = newline_scan_count(chunk->in_mmap->map + chunk->start, chunk->stop - chunk->start);
+
+    return NULL;
+}
+
+void * sample_mmap_chunk_offsets_with_fixed_k(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    const char *map_start = chunk->in_mmap->map;
+    const char *map_stop = map_start + chunk->in_mmap->size;
+    const char *chunk_stop = map_start + chunk->stop;
+    const char *cursor = map_start + chunk->start;
+    const char *grp_stop = NULL;
+    const int lines_per_offset = chunk->lines_per_offset;
+    const boolean num_groups_known = (chunk->num_groups >= 0);
+    const long num_groups = (num_groups_known) ? chunk->num_groups : LONG_MAX;
+    offset_reservoir *res = chunk->res;
+    long k = res->num_offsets;
+    long grp_idx = 0;
+    long skip_length = 0;
+    double w = 0.0;
+
+    /* 
+       with one line per offset, groupings end inside the chunk and we can bound every search by
+       the end of the chunk; otherwise, we walk the precounted number of groupings, which may run
+       on into the next chunk 
+    */
+    if ((num_groups_known) && (num_groups > 0) && (chunk->skip_lines > 0))
+        cursor = newline_scan_nth(cursor, map_stop, chunk->skip_lines) + 1;
+
+    while ((grp_idx < k) && (grp_idx < num_groups) && (cursor < chunk_stop)) {
+        grp_stop = newline_scan_nth(cursor, (num_groups_known) ? map_stop : chunk_stop, lines_per_offset);
+        if (!grp_stop)
+            break;
+        offset_reservoir_set(res, grp_idx++, chunk->base + (cursor - map_start));
+        cursor = grp_stop + 1;
+    }
+
+    if (grp_idx < k) {
+        res->num_offsets = grp_idx;
+        chunk->num_groups = grp_idx;
+        return NULL;
+    }
+
+    w = algorithm_l_initial_weight(&chunk->rng, k);
+    while (grp_idx < num_groups) {
+        skip_length = algorithm_l_next_index(&chunk->rng, 0, w) - 1;
+        if (num_groups_known) {
+            if (skip_length >= num_groups - grp_idx) {
+                grp_idx = num_groups;
+                break;
+            }
+            if (skip_length > 0)
+                cursor = newline_scan_nth(cursor, map_stop, skip_length * lines_per_offset) + 1;
+            grp_idx += skip_length;
+            grp_stop = newline_scan_nth(cursor, map_stop, lines_per_offset);
+        }
+        else {
+            if (skip_length > 0) {
+                grp_stop = newline_scan_nth(cursor, chunk_stop, (skip_length < LONG_MAX / lines_per_offset) ? skip_length * lines_per_offset : LONG_MAX);
+                if (!grp_stop) {
+                    grp_idx += newline_scan_count(cursor, chunk_stop - cursor) / lines_per_offset;
+                    break;
+                }
+                cursor = grp_stop + 1;
+                grp_idx += skip_length;
+            }
+            grp_stop = newline_scan_nth(cursor, chunk_stop, lines_per_offset);
+            if (!grp_stop)
+                break;
+        }
+        offset_reservoir_set(res, rng_bounded_modulo(&chunk->rng, k), chunk->base + (cursor - map_start));
+        cursor = grp_stop + 1;
+        grp_idx++;
+        w = algorithm_l_next_weight(&chunk->rng, w, k);
+    }
+    chunk->num_groups = grp_idx;
+
+    return NULL;
+}
+
+void * index_mmap_chunk_offsets(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scanned = 0;
+    const boolean num_groups_known = (chunk->num_groups >= 0);
+    const long num_groups = (num_groups_known) ? chunk->num_groups : LONG_MAX;
+    const int lines_per_offset = chunk->lines_per_offset;
+    size_t scan_offset = chunk->start;
+    size_t scan_stop = (num_groups_known) ? chunk->in_mmap->size : chunk->stop;
+    off_t start_offset = 0;
+    offset_reservoir *res = chunk->res;
+    long ln_idx = 0;
+    long grp_idx = 0;
+
+    res->num_offsets = 0;
+    offset_reservoir_reserve(res, (num_groups_known) ? num_groups : estimate_mmap_line_groupings(chunk->in_mmap, chunk->start, chunk->stop, lines_per_offset));
+
+    if ((num_groups_known) && (num_groups > 0) && (chunk->skip_lines > 0))
+        scan_offset = newline_scan_nth(chunk->in_mmap->map + scan_offset, chunk->in_mmap->map + scan_stop, chunk->skip_lines) + 1 - chunk->in_mmap->map;
+    start_offset = scan_offset;
+
+    while ((scan_offset < scan_stop) && (grp_idx < num_groups)) {
+        num_positions = newline_scan_positions(chunk->in_mmap->map + scan_offset, scan_stop - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; (position_idx < num_positions) && (grp_idx < num_groups); ++position_idx) {
+            if ((++ln_idx) % lines_per_offset)
+                continue;
+            offset_reservoir_append(res, chunk->base + start_offset);
+            grp_idx++;
+            start_offset = scan_offset + newline_positions[position_idx] + 1;
+        }
+        scan_offset += scanned;
+    }
+    chunk->num_groups = grp_idx;
+
+    return NULL;
+}
+
+void sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_fixed_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> offset_compare()\n");
-    fprintf(stderr, "Debug: Comparing: %012lld and %012lld\n", (long long int) *(off_t *)off1, (long long int) *(off_t *)off2);
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_fixed_k()\n");
 #endif
 
-    long long int off_diff = (long long int)((*(off_t *)off1) - (*(off_t *)off2));
+    mmap_chunk *chunks = NULL;
+    offset_reservoir **reservoirs = NULL;
+    long *population_sizes = NULL;
+    long k = (*res_ptr)->num_offsets;
+    int num_chunks = 0;
+    int chunk_idx;
+
+    chunks = new_mmap_chunks(in_mmap, num_threads, lines_per_offset, &num_chunks);
+    reservoirs = malloc(sizeof(offset_reservoir *) * num_chunks);
+    population_sizes = calloc(num_chunks, sizeof(long));
+    if ((!reservoirs) || (!population_sizes)) {
+        fprintf(stderr, "Error: Could not allocate memory for per-thread reservoirs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* each worker runs its own reservoir, with a stream seeded from the main Twister */
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        chunks[chunk_idx].res = new_offset_reservoir_ptr(k, (*res_ptr)->encoding);
+        rng_split(&rng_global_state, &chunks[chunk_idx].rng);
+    }
+    run_mmap_chunk_workers(chunks, num_chunks, sample_mmap_chunk_offsets_with_fixed_k);
+
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        reservoirs[chunk_idx] = chunks[chunk_idx].res;
+        population_sizes[chunk_idx] = chunks[chunk_idx].num_groups;
+    }
+    delete_offset_reservoir_ptr(res_ptr);
+    *res_ptr = merge_offset_reservoirs(reservoirs, population_sizes, num_chunks, k, &rng_global_state);
+
+    free(population_sizes);
+    free(reservoirs);
+    delete_mmap_chunks(&chunks, num_chunks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_fixed_k()\n");
+#endif
+}
 
+void sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_unspecified_k(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads)
+{
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> offset_compare()\n");
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_unspecified_k()\n");
 #endif
 
-    return (off_diff > 0) ? 1 : -1;
-} 
+    mmap_chunk *chunks = NULL;
+    offset_reservoir *chunk_res = NULL;
+    long num_offsets = 0;
+    long offset_idx = 0;
+    int num_chunks = 0;
+    int chunk_idx;
 
-void print_offset_reservoir_sample_via_mmap(const file_mmap *in_mmap, offset_reservoir *res_ptr, const int lines_per_offset)
+    /* each chunk indexes into a reservoir of the same kind as the one it feeds */
+    chunks = new_mmap_chunks(in_mmap, num_threads, lines_per_offset, &num_chunks);
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+        chunks[chunk_idx].res = new_offset_reservoir_ptr(((*res_ptr)->encoding == kOffsetEncodingPacked) ? 0 : DEFAULT_SAMPLE_SIZE_INCREMENT, (*res_ptr)->encoding);
+    run_mmap_chunk_workers(chunks, num_chunks, index_mmap_chunk_offsets);
+
+    /* the chunks are in file order, so concatenating their indices gives the single-threaded index */
+    (*res_ptr)->num_offsets = 0;
+    if ((*res_ptr)->encoding == kOffsetEncodingPacked) {
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            chunk_res = chunks[chunk_idx].res;
+            for (offset_idx = 0; offset_idx < chunk_res->num_offsets; ++offset_idx)
+                offset_reservoir_append(*res_ptr, offset_reservoir_get(chunk_res, offset_idx));
+            delete_offset_reservoir_ptr(&(chunks[chunk_idx].res));
+        }
+    }
+    else {
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+            num_offsets += chunks[chunk_idx].res->num_offsets;
+        offset_reservoir_reserve(*res_ptr, num_offsets);
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            chunk_res = chunks[chunk_idx].res;
+            memcpy((char *) (*res_ptr)->offsets + offset_encoding_element_size((*res_ptr)->encoding) * (*res_ptr)->num_offsets, chunk_res->offsets, offset_encoding_element_size((*res_ptr)->encoding) * chunk_res->num_offsets);
+            (*res_ptr)->num_offsets += chunk_res->num_offsets;
+        }
+    }
+
+    delete_mmap_chunks(&chunks, num_chunks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_threaded_mmap_with_unspecified_k()\n");
+#endif
+}
+
+void sample_reservoir_offsets_without_replacement_via_keyed_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_sample_via_mmap()\n");
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_keyed_mmap()\n");
 #endif
 
-    int res_idx;
-    off_t mmap_idx;
-    off_t current_offset;
-    long ln_idx = 0;
-    
-    for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
-        current_offset = res_ptr->offsets[res_idx];
-        for (mmap_idx = current_offset; mmap_idx < current_offset + LINE_LENGTH_VALUE; ++mmap_idx) {
-            fprintf(stdout, "%c", in_mmap->map[mmap_idx]);
-            if ((in_mmap->map[mmap_idx] == '\n') && ((++ln_idx) % lines_per_offset == 0))
-                break;
+    mmap_chunk *chunks = NULL;
+    keyed_offset **heaps = NULL;
+    long *heap_sizes = NULL;
+    long k = (*res_ptr)->num_offsets;
+    offset_encoding encoding = (*res_ptr)->encoding;
+    int num_chunks = 0;
+    int chunk_idx;
+
+    chunks = new_mmap_chunks(in_mmap, num_threads, lines_per_offset, &num_chunks);
+    heaps = malloc(sizeof(keyed_offset *) * num_chunks);
+    heap_sizes = calloc(num_chunks, sizeof(long));
+    if ((!heaps) || (!heap_sizes)) {
+        fprintf(stderr, "Error: Could not allocate memory for per-thread keyed samples\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* each worker keeps the k smallest keys of its chunk; no worker draws from a stream */
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        chunks[chunk_idx].keyed = malloc(sizeof(keyed_offset) * (k > 0 ? k : 1));
+        if (!chunks[chunk_idx].keyed) {
+            fprintf(stderr, "Error: Could not allocate memory for per-thread keyed samples\n");
+            exit(EXIT_FAILURE);
         }
+        chunks[chunk_idx].max_keyed = k;
+    }
+    run_mmap_chunk_workers(chunks, num_chunks, sample_mmap_chunk_offsets_by_key);
+
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        heaps[chunk_idx] = chunks[chunk_idx].keyed;
+        heap_sizes[chunk_idx] = chunks[chunk_idx].num_keyed;
     }
+    delete_offset_reservoir_ptr(res_ptr);
+    *res_ptr = merge_keyed_offsets(heaps, heap_sizes, num_chunks, k, encoding);
+
+    free(heap_sizes);
+    free(heaps);
+    delete_mmap_chunks(&chunks, num_chunks);
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_sample_via_mmap()\n");
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_keyed_mmap()\n");
 #endif
 }
 
-void print_sorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset)
+void sample_reservoir_offsets_without_replacement_via_keyed_line_index(const line_index *idx, offset_reservoir **res_ptr, const int lines_per_offset, const long k)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> print_sorted_offset_reservoir_sample_via_cstdio()\n");
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_keyed_line_index()\n");
 #endif
 
-    int idx;
-    char in_line[LINE_LENGTH_VALUE + 1];
-    char temp_line[LINE_LENGTH_VALUE + 1];
-    off_t previous_offset = 0;
-    size_t previous_line_length = 0;
+    long num_groups = (long) (line_index_num_lines(idx) / lines_per_offset);
+    long grp_idx = 0;
+    long num_keyed = 0;
+    off_t offset = 0;
+    keyed_offset *heap = NULL;
+
+    heap = malloc(sizeof(keyed_offset) * (k > 0 ? k : 1));
+    if (!heap) {
+        fprintf(stderr, "Error: Could not allocate memory for keyed sample\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the keys are those the scanning path gives the same line-groupings, so the sample is too */
+    for (grp_idx = 0; grp_idx < num_groups; ++grp_idx) {
+        offset = line_index_offset(idx, (uint64_t) grp_idx * lines_per_offset);
+        keyed_offsets_offer(heap, &num_keyed, k, rng_record_key(&rng_global_state, (uint64_t) offset), offset);
+    }
+    delete_offset_reservoir_ptr(res_ptr);
+    *res_ptr = merge_keyed_offsets(&heap, &num_keyed, 1, k, select_offset_encoding((off_t) idx->header->file_size, kFalse));
+
+    free(heap);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_keyed_line_index()\n");
+#endif
+}
+
+void * sample_mmap_chunk_offsets_by_key(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scanned = 0;
+    const boolean num_groups_known = (chunk->num_groups >= 0);
+    const long num_groups = (num_groups_known) ? chunk->num_groups : LONG_MAX;
+    const int lines_per_offset = chunk->lines_per_offset;
+    size_t scan_offset = chunk->start;
+    size_t scan_stop = (num_groups_known) ? chunk->in_mmap->size : chunk->stop;
+    off_t start_offset = 0;
     long ln_idx = 0;
-    int temp_length = 0;
+    long grp_idx = 0;
 
-    /* position the file pointer at the start of the file */
-    if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
-        fprintf(stderr, "Error: Could not rewind input file pointer\n");
+    chunk->num_keyed = 0;
+
+    /* line-groupings are walked as they are when indexing, and each is keyed by where it starts */
+    if ((num_groups_known) && (num_groups > 0) && (chunk->skip_lines > 0))
+        scan_offset = newline_scan_nth(chunk->in_mmap->map + scan_offset, chunk->in_mmap->map + scan_stop, chunk->skip_lines) + 1 - chunk->in_mmap->map;
+    start_offset = scan_offset;
+
+    while ((scan_offset < scan_stop) && (grp_idx < num_groups)) {
+        num_positions = newline_scan_positions(chunk->in_mmap->map + scan_offset, scan_stop - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; (position_idx < num_positions) && (grp_idx < num_groups); ++position_idx) {
+            if ((++ln_idx) % lines_per_offset)
+                continue;
+            keyed_offsets_offer(chunk->keyed, &(chunk->num_keyed), chunk->max_keyed, rng_record_key(&rng_global_state, (uint64_t) (chunk->base + start_offset)), chunk->base + start_offset);
+            grp_idx++;
+            start_offset = scan_offset + newline_positions[position_idx] + 1;
+        }
+        scan_offset += scanned;
+    }
+    chunk->num_groups = grp_idx;
+
+    return NULL;
+}
+
+double record_weight(const weight_spec *weight, const char *record, const char *stop)
+{
+    double value = 0.0;
+    double interval_start = 0.0;
+
+    /* a weight that cannot be read counts as zero, so that header and track lines are passed over */
+    if (weight->kind == kWeightLength) {
+        if ((record_field_double(record, stop, 2, &interval_start) == -1) || (record_field_double(record, stop, 3, &value) == -1))
+            return 0.0;
+        value -= interval_start;
+    }
+    else if (record_field_double(record, stop, weight->column, &value) == -1)
+        return 0.0;
+
+    return (value > 0.0) ? value : 0.0;
+}
+
+uint64_t weighted_key_bits(const double key)
+{
+    uint64_t bits = 0;
+
+    /* non-negative doubles sort the same as their bit patterns, so the keyed heaps take them as they are */
+    memcpy(&bits, &key, sizeof(bits));
+
+    return bits;
+}
+
+double weighted_key_value(const uint64_t bits)
+{
+    double key = 0.0;
+
+    memcpy(&key, &bits, sizeof(key));
+
+    return key;
+}
+
+void sample_reservoir_offsets_without_replacement_via_weighted_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const weight_spec *weight)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_without_replacement_via_weighted_mmap()\n");
+#endif
+
+    mmap_chunk *chunks = NULL;
+    keyed_offset **heaps = NULL;
+    long *heap_sizes = NULL;
+    long k = (*res_ptr)->num_offsets;
+    offset_encoding encoding = (*res_ptr)->encoding;
+    int num_chunks = 0;
+    int chunk_idx;
+
+    chunks = new_mmap_chunks(in_mmap, num_threads, lines_per_offset, &num_chunks);
+    heaps = malloc(sizeof(keyed_offset *) * num_chunks);
+    heap_sizes = calloc(num_chunks, sizeof(long));
+    if ((!heaps) || (!heap_sizes)) {
+        fprintf(stderr, "Error: Could not allocate memory for per-thread weighted samples\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       each worker keeps the k smallest keys of its chunk, as with the counter-based generator, 
+       so the per-chunk samples merge the same way
+    */
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        chunks[chunk_idx].keyed = malloc(sizeof(keyed_offset) * k);
+        if (!chunks[chunk_idx].keyed) {
+            fprintf(stderr, "Error: Could not allocate memory for per-thread weighted samples\n");
+            exit(EXIT_FAILURE);
+        }
+        chunks[chunk_idx].max_keyed = k;
+        chunks[chunk_idx].weight = weight;
+        if (rng_global_state.kind != kRngPhilox)
+            rng_split(&rng_global_state, &chunks[chunk_idx].rng);
+    }
+    run_mmap_chunk_workers(chunks, num_chunks, sample_mmap_chunk_offsets_by_weight);
+
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        heaps[chunk_idx] = chunks[chunk_idx].keyed;
+        heap_sizes[chunk_idx] = chunks[chunk_idx].num_keyed;
+    }
+    delete_offset_reservoir_ptr(res_ptr);
+    *res_ptr = merge_keyed_offsets(heaps, heap_sizes, num_chunks, k, encoding);
+
+    free(heap_sizes);
+    free(heaps);
+    delete_mmap_chunks(&chunks, num_chunks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_without_replacement_via_weighted_mmap()\n");
+#endif
+}
+
+void * sample_mmap_chunk_offsets_by_weight(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scanned = 0;
+    const boolean num_groups_known = (chunk->num_groups >= 0);
+    const long num_groups = (num_groups_known) ? chunk->num_groups : LONG_MAX;
+    const int lines_per_offset = chunk->lines_per_offset;
+    const char *map_stop = chunk->in_mmap->map + chunk->in_mmap->size;
+    const boolean keyed_by_offset = (rng_global_state.kind == kRngPhilox);
+    size_t scan_offset = chunk->start;
+    size_t scan_stop = (num_groups_known) ? chunk->in_mmap->size : chunk->stop;
+    off_t start_offset = 0;
+    long ln_idx = 0;
+    long grp_idx = 0;
+    double weight = 0.0;
+    double threshold = 0.0;
+    double jump = 0.0;
+    double key = 0.0;
+
+    chunk->num_keyed = 0;
+
+    /* 
+       cf. Efraimidis and Spirakis, "Weighted random sampling with a reservoir" 
+       (http://dx.doi.org/10.1016/j.ipl.2005.11.003) -- a line-grouping of weight w gets 
+       the key E / w, for E exponentially distributed, and the sample is the k smallest 
+       keys; this is their A-Res with keys u^(1/w) taken to -log(u) / w, which keeps the 
+       k largest of those. Once the reservoir is full, A-ExpJ jumps over as much weight 
+       as an exponential draw at the rate of the largest kept key, as no line-grouping 
+       within it would have beaten that key, and draws the key of the one it lands on 
+       from below the largest kept key -- so there are O(k log(n / k)) draws in all. With 
+       the counter-based generator, each key is instead derived from the line-grouping's 
+       offset, so that the sample is the same for any thread count.
+    */
+    if ((num_groups_known) && (num_groups > 0) && (chunk->skip_lines > 0))
+        scan_offset = newline_scan_nth(chunk->in_mmap->map + scan_offset, chunk->in_mmap->map + scan_stop, chunk->skip_lines) + 1 - chunk->in_mmap->map;
+    start_offset = scan_offset;
+
+    while ((scan_offset < scan_stop) && (grp_idx < num_groups)) {
+        num_positions = newline_scan_positions(chunk->in_mmap->map + scan_offset, scan_stop - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; (position_idx < num_positions) && (grp_idx < num_groups); ++position_idx) {
+            if ((++ln_idx) % lines_per_offset)
+                continue;
+            weight = record_weight(chunk->weight, chunk->in_mmap->map + start_offset, map_stop);
+            if (weight > 0.0) {
+                if (keyed_by_offset) {
+                    key = -log(((double) (rng_record_key(&rng_global_state, (uint64_t) (chunk->base + start_offset)) >> 11) + 0.5) * 0x1.0p-53) / weight;
+                    keyed_offsets_offer(chunk->keyed, &(chunk->num_keyed), chunk->max_keyed, weighted_key_bits(key), chunk->base + start_offset);
+                }
+                else if (chunk->num_keyed < chunk->max_keyed) {
+                    key = -log(algorithm_l_random_double(&chunk->rng)) / weight;
+                    keyed_offsets_offer(chunk->keyed, &(chunk->num_keyed), chunk->max_keyed, weighted_key_bits(key), chunk->base + start_offset);
+                    if (chunk->num_keyed == chunk->max_keyed) {
+                        threshold = weighted_key_value(chunk->keyed[0].key);
+                        jump = -log(algorithm_l_random_double(&chunk->rng)) / threshold;
+                    }
+                }
+                else if ((jump -= weight) <= 0.0) {
+                    key = -log1p(algorithm_l_random_double(&chunk->rng) * expm1(-weight * threshold)) / weight;
+                    keyed_offsets_offer(chunk->keyed, &(chunk->num_keyed), chunk->max_keyed, weighted_key_bits(key), chunk->base + start_offset);
+                    threshold = weighted_key_value(chunk->keyed[0].key);
+                    jump = -log(algorithm_l_random_double(&chunk->rng)) / threshold;
+                }
+            }
+            grp_idx++;
+            start_offset = scan_offset + newline_positions[position_idx] + 1;
+        }
+        scan_offset += scanned;
+    }
+    chunk->num_groups = grp_idx;
+
+    return NULL;
+}
+
+void sample_strata_via_mmap(const file_mmap *in_mmap, stratum_table *table, const int lines_per_offset, const int column)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_strata_via_mmap()\n");
+#endif
+
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scanned = 0;
+    const char *map_stop = in_mmap->map + in_mmap->size;
+    const long k = table->max_offsets;
+    size_t scan_offset = 0;
+    off_t start_offset = 0;
+    const char *key = NULL;
+    size_t key_len = 0;
+    long stratum_idx = 0;
+    stratum *s = NULL;
+    long ln_idx = 0;
+
+    /* 
+       every stratum runs Algorithm L on its own count of line-groupings, so one scan fills 
+       them all; a line-grouping whose first line has no such column belongs to no stratum
+    */
+    while (scan_offset < in_mmap->size) {
+        num_positions = newline_scan_positions(in_mmap->map + scan_offset, in_mmap->size - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; position_idx < num_positions; ++position_idx) {
+            if ((++ln_idx) % lines_per_offset)
+                continue;
+            key = record_field(in_mmap->map + start_offset, map_stop, column, &key_len);
+            if (key) {
+                stratum_idx = stratum_table_index(table, key, key_len);
+                if (stratum_idx == -1) {
+                    fprintf(stderr, "Error: Could not allocate memory for stratum table (%s)\n", strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+                s = &table->strata[stratum_idx];
+                if (s->num_groups < k) {
+                    if ((s->num_offsets == s->capacity) && (stratum_offsets_reserve(table, s, s->num_offsets + 1) == -1)) {
+                        fprintf(stderr, "Error: Could not allocate memory for stratum reservoir\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    s->offsets[s->num_offsets++] = (uint64_t) start_offset;
+                    if (s->num_groups + 1 == k) {
+                        s->w = algorithm_l_initial_weight(&rng_global_state, k);
+                        s->next_grp_idx = algorithm_l_next_index(&rng_global_state, s->num_groups, s->w);
+                    }
+                }
+                else if (s->num_groups == s->next_grp_idx) {
+                    s->offsets[rng_bounded_modulo(&rng_global_state, k)] = (uint64_t) start_offset;
+                    s->w = algorithm_l_next_weight(&rng_global_state, s->w, k);
+                    s->next_grp_idx = algorithm_l_next_index(&rng_global_state, s->num_groups, s->w);
+                }
+                s->num_groups++;
+            }
+            start_offset = scan_offset + newline_positions[position_idx] + 1;
+        }
+        scan_offset += scanned;
+    }
+    sample_stats.bytes_scanned += in_mmap->size;
+    sample_stats.records_seen += (unsigned long long) (ln_idx / lines_per_offset);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Sampled %zu strata\n", table->num_strata);
+    fprintf(stderr, "Debug: Leaving  --> sample_strata_via_mmap()\n");
+#endif
+}
+
+void allocate_stratum_quotas(stratum_table *table, const long k, const stratum_allocation allocation)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> allocate_stratum_quotas()\n");
+#endif
+
+    stratum_remainder *remainders = NULL;
+    stratum *s = NULL;
+    size_t stratum_idx = 0;
+    long total_groups = 0;
+    long allocated = 0;
+    double share = 0.0;
+
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx) {
+        table->strata[stratum_idx].quota = table->strata[stratum_idx].num_offsets;
+        total_groups += table->strata[stratum_idx].num_groups;
+    }
+    if ((allocation == kStratumAllocationFixed) || (k >= total_groups))
+        return;
+
+    /* 
+       a proportional allocation gives each stratum the whole part of its share of k, and 
+       the line-groupings left over to the strata with the largest fractional parts (the 
+       largest remainder method), earlier strata first on a tie
+    */
+    remainders = malloc(sizeof(stratum_remainder) * table->num_strata);
+    if (!remainders) {
+        fprintf(stderr, "Error: Could not allocate memory for stratum allocation\n");
+        exit(EXIT_FAILURE);
+    }
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx) {
+        s = &table->strata[stratum_idx];
+        share = (double) k * s->num_groups / total_groups;
+        s->quota = (long) floor(share);
+        if (s->quota > s->num_offsets)
+            s->quota = s->num_offsets;
+        allocated += s->quota;
+        remainders[stratum_idx].remainder = share - s->quota;
+        remainders[stratum_idx].stratum_idx = (long) stratum_idx;
+    }
+    qsort(remainders, table->num_strata, sizeof(stratum_remainder), stratum_remainder_compare);
+    for (stratum_idx = 0; (stratum_idx < table->num_strata) && (allocated < k); ++stratum_idx) {
+        s = &table->strata[remainders[stratum_idx].stratum_idx];
+        if (s->quota < s->num_offsets) {
+            s->quota++;
+            allocated++;
+        }
+    }
+
+    free(remainders);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> allocate_stratum_quotas()\n");
+#endif
+}
+
+int stratum_remainder_compare(const void *remainder1, const void *remainder2)
+{
+    const stratum_remainder *entry1 = remainder1;
+    const stratum_remainder *entry2 = remainder2;
+
+    if (entry1->remainder != entry2->remainder)
+        return (entry1->remainder < entry2->remainder) - (entry1->remainder > entry2->remainder);
+
+    return (entry1->stratum_idx > entry2->stratum_idx) - (entry1->stratum_idx < entry2->stratum_idx);
+}
+
+offset_reservoir * new_stratified_offset_reservoir_ptr(stratum_table *table, const offset_encoding encoding, const boolean preserve_order, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_stratified_offset_reservoir_ptr()\n");
+#endif
+
+    offset_reservoir *res = NULL;
+    stratum *s = NULL;
+    size_t stratum_idx = 0;
+    long total_quota = 0;
+    long offset_idx = 0;
+    long rand_idx = 0;
+    long res_idx = 0;
+    uint64_t temp_offset = 0;
+
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx)
+        total_quota += table->strata[stratum_idx].quota;
+    res = new_offset_reservoir_ptr((total_quota > 0) ? total_quota : 1, encoding);
+
+    /* 
+       strata go out in the order they were first seen; a partial Fisher-Yates shuffle picks 
+       each one's quota from its reservoir, in random order, to be sorted back into input 
+       order if asked
+    */
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx) {
+        s = &table->strata[stratum_idx];
+        for (offset_idx = 0; offset_idx < s->quota; ++offset_idx) {
+            rand_idx = offset_idx + (long) rng_bounded(&rng_global_state, s->num_offsets - offset_idx);
+            temp_offset = s->offsets[offset_idx];
+            s->offsets[offset_idx] = s->offsets[rand_idx];
+            s->offsets[rand_idx] = temp_offset;
+        }
+        if ((preserve_order) && (s->quota > 1) && (radix_sort_uint64(s->offsets, s->quota, num_threads) == -1)) {
+            fprintf(stderr, "Error: Could not sort stratum sample (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (offset_idx = 0; offset_idx < s->quota; ++offset_idx)
+            offset_reservoir_set(res, res_idx++, (off_t) s->offsets[offset_idx]);
+    }
+    res->num_offsets = total_quota;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_stratified_offset_reservoir_ptr()\n");
+#endif
+
+    return res;
+}
+
+void keyed_offsets_offer(keyed_offset *heap, long *num_keyed, const long max_keyed, const uint64_t key, const off_t offset)
+{
+    keyed_offset entry;
+    long idx = 0;
+    long child_idx = 0;
+
+    entry.key = key;
+    entry.offset = offset;
+
+    /* the heap has its largest key at the root, which is the one to give up for a smaller key */
+    if (*num_keyed < max_keyed) {
+        for (idx = (*num_keyed)++; (idx > 0) && (keyed_offset_compare(&heap[(idx - 1) / 2], &entry) < 0); idx = (idx - 1) / 2)
+            heap[idx] = heap[(idx - 1) / 2];
+        heap[idx] = entry;
+        return;
+    }
+    if ((max_keyed == 0) || (keyed_offset_compare(&entry, &heap[0]) >= 0))
+        return;
+    for (idx = 0; (child_idx = 2 * idx + 1) < max_keyed; idx = child_idx) {
+        if ((child_idx + 1 < max_keyed) && (keyed_offset_compare(&heap[child_idx], &heap[child_idx + 1]) < 0))
+            child_idx++;
+        if (keyed_offset_compare(&heap[child_idx], &entry) <= 0)
+            break;
+        heap[idx] = heap[child_idx];
+    }
+    heap[idx] = entry;
+}
+
+int keyed_offset_compare(const void *keyed1, const void *keyed2)
+{
+    const keyed_offset *entry1 = keyed1;
+    const keyed_offset *entry2 = keyed2;
+
+    /* ties between keys, which are all but impossible, go to the earlier offset */
+    if (entry1->key != entry2->key)
+        return (entry1->key > entry2->key) - (entry1->key < entry2->key);
+
+    return (entry1->offset > entry2->offset) - (entry1->offset < entry2->offset);
+}
+
+offset_reservoir * merge_keyed_offsets(keyed_offset **heaps, const long *heap_sizes, const int num_heaps, const long k, const offset_encoding encoding)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> merge_keyed_offsets()\n");
+#endif
+
+    offset_reservoir *merged_res = NULL;
+    keyed_offset *all_keyed = NULL;
+    long num_keyed = 0;
+    long merged_k = 0;
+    long keyed_idx = 0;
+    int heap_idx = 0;
+
+    for (heap_idx = 0; heap_idx < num_heaps; ++heap_idx)
+        num_keyed += heap_sizes[heap_idx];
+    all_keyed = malloc(sizeof(keyed_offset) * (num_keyed > 0 ? num_keyed : 1));
+    if (!all_keyed) {
+        fprintf(stderr, "Error: Could not allocate memory for keyed sample merge\n");
+        exit(EXIT_FAILURE);
+    }
+    for (heap_idx = 0, num_keyed = 0; heap_idx < num_heaps; num_keyed += heap_sizes[heap_idx++])
+        memcpy(all_keyed + num_keyed, heaps[heap_idx], sizeof(keyed_offset) * heap_sizes[heap_idx]);
+
+    /* 
+       the k smallest keys of the whole file are among the k smallest of each chunk; taken 
+       in key order, they are a uniform sample in random order
+    */
+    qsort(all_keyed, num_keyed, sizeof(keyed_offset), keyed_offset_compare);
+    merged_k = (num_keyed < k) ? num_keyed : k;
+    merged_res = new_offset_reservoir_ptr(merged_k > 0 ? merged_k : 1, (encoding == kOffsetEncodingPacked) ? kOffsetEncodingWide : encoding);
+    for (keyed_idx = 0; keyed_idx < merged_k; ++keyed_idx)
+        offset_reservoir_set(merged_res, keyed_idx, all_keyed[keyed_idx].offset);
+    merged_res->num_offsets = merged_k;
+
+    free(all_keyed);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> merge_keyed_offsets()\n");
+#endif
+
+    return merged_res;
+}
+
+offset_reservoir * merge_offset_reservoirs(offset_reservoir **reservoirs, const long *population_sizes, const int num_reservoirs, const long k, rng_state *state)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> merge_offset_reservoirs()\n");
+#endif
+
+    offset_reservoir *merged_res = NULL;
+    long *remaining_population = NULL;
+    long *remaining_offsets = NULL;
+    long total_population = 0;
+    long merged_k = 0;
+    long merged_idx = 0;
+    long rand_idx = 0;
+    int res_idx = 0;
+
+    remaining_population = malloc(sizeof(long) * num_reservoirs);
+    remaining_offsets = malloc(sizeof(long) * num_reservoirs);
+    if ((!remaining_population) || (!remaining_offsets)) {
+        fprintf(stderr, "Error: Could not allocate memory for reservoir merge\n");
+        exit(EXIT_FAILURE);
+    }
+    for (res_idx = 0; res_idx < num_reservoirs; ++res_idx) {
+        remaining_population[res_idx] = population_sizes[res_idx];
+        remaining_offsets[res_idx] = reservoirs[res_idx]->num_offsets;
+        total_population += population_sizes[res_idx];
+    }
+    merged_k = (total_population < k) ? total_population : k;
+    merged_res = new_offset_reservoir_ptr(merged_k > 0 ? merged_k : 1, (num_reservoirs > 0) ? offset_reservoir_element_encoding(reservoirs[0]) : kOffsetEncodingWide);
+    merged_res->num_offsets = merged_k;
+
+    /* 
+       draw k elements one at a time from the union of the populations: a reservoir is picked
+       with probability proportional to its unsampled population, and then gives up a uniformly
+       random offset that it has not yet given up -- each reservoir is itself a uniform sample
+       of its population, so this yields a uniform sample (in random order) of the whole file
+    */
+    for (merged_idx = 0; merged_idx < merged_k; ++merged_idx) {
+        rand_idx = rng_bounded(state, total_population);
+        for (res_idx = 0; rand_idx >= remaining_population[res_idx]; ++res_idx)
+            rand_idx -= remaining_population[res_idx];
+        remaining_population[res_idx]--;
+        total_population--;
+        rand_idx = rng_bounded(state, remaining_offsets[res_idx]);
+        offset_reservoir_swap(reservoirs[res_idx], rand_idx, --remaining_offsets[res_idx]);
+        offset_reservoir_set(merged_res, merged_idx, offset_reservoir_get(reservoirs[res_idx], remaining_offsets[res_idx]));
+    }
+
+    free(remaining_offsets);
+    free(remaining_population);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> merge_offset_reservoirs()\n");
+#endif
+
+    return merged_res;
+}
+
+void sample_reservoir_offsets_via_line_index(const line_index *idx, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified, const boolean sample_with_replacement)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_line_index()\n");
+#endif
+
+    long num_groups = (long) (line_index_num_lines(idx) / lines_per_offset);
+    long sample_size = (sample_size_specified) ? k : num_groups;
+    long grp_idx = 0;
+    long res_idx = 0;
+    long rand_idx = 0;
+    long *picked = NULL;
+    long picked_mask = 0;
+    long slot = 0;
+    offset_encoding encoding = select_offset_encoding((off_t) idx->header->file_size, kFalse);
+
+    delete_offset_reservoir_ptr(res_ptr);
+
+    if ((!sample_with_replacement) && (sample_size >= num_groups)) {
+        /* 
+           every line-grouping is in the sample -- as with the scanning paths, a whole-file 
+           shuffle is shuffled, while an oversized k leaves the groupings in file order
+        */
+        *res_ptr = new_offset_reservoir_ptr(num_groups > 0 ? num_groups : 1, encoding);
+        for (grp_idx = 0; grp_idx < num_groups; ++grp_idx)
+            offset_reservoir_set(*res_ptr, grp_idx, line_index_offset(idx, (uint64_t) grp_idx * lines_per_offset));
+        (*res_ptr)->num_offsets = num_groups;
+        if (!sample_size_specified)
+            shuffle_reservoir_offsets_via_fisher_yates(res_ptr);
+    }
+    else if (sample_with_replacement) {
+        *res_ptr = new_offset_reservoir_ptr(sample_size > 0 ? sample_size : 1, encoding);
+        (*res_ptr)->num_offsets = (num_groups > 0) ? sample_size : 0;
+        for (res_idx = 0; res_idx < (*res_ptr)->num_offsets; ++res_idx) {
+            rand_idx = rng_bounded(&rng_global_state, num_groups);
+            offset_reservoir_set(*res_ptr, res_idx, line_index_offset(idx, (uint64_t) rand_idx * lines_per_offset));
+        }
+    }
+    else {
+        /* 
+           Floyd's algorithm draws k distinct line-groupings with k random numbers, using
+           an open-addressed set of the groupings picked so far; the picks come out in a
+           biased order, so they are shuffled afterwards
+        */
+        for (picked_mask = 1; picked_mask < 2 * sample_size; picked_mask <<= 1)
+            ;
+        picked = malloc(sizeof(long) * picked_mask);
+        if (!picked) {
+            fprintf(stderr, "Error: Could not allocate memory for sampled line-grouping set\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(picked, 0xff, sizeof(long) * picked_mask);
+        picked_mask--;
+        *res_ptr = new_offset_reservoir_ptr(sample_size, encoding);
+        for (grp_idx = num_groups - sample_size; grp_idx < num_groups; ++grp_idx) {
+            rand_idx = rng_bounded(&rng_global_state, grp_idx + 1);
+            for (slot = (long) (((unsigned long) rand_idx * 0x9E3779B97F4A7C15UL) >> 16) & picked_mask; (picked[slot] != -1) && (picked[slot] != rand_idx); slot = (slot + 1) & picked_mask)
+                ;
+            if (picked[slot] == rand_idx)
+                for (rand_idx = grp_idx, slot = (long) (((unsigned long) rand_idx * 0x9E3779B97F4A7C15UL) >> 16) & picked_mask; picked[slot] != -1; slot = (slot + 1) & picked_mask)
+                    ;
+            picked[slot] = rand_idx;
+            offset_reservoir_set(*res_ptr, res_idx++, line_index_offset(idx, (uint64_t) rand_idx * lines_per_offset));
+        }
+        free(picked);
+        shuffle_reservoir_offsets_via_fisher_yates(res_ptr);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_line_index()\n");
+#endif
+}
+
+void sample_reservoir_offsets_via_input_set(input_set *set, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_input_set()\n");
+#endif
+
+    mmap_chunk *chunks = NULL;
+    file_mmap **batch_mmaps = NULL;
+    offset_reservoir **reservoirs = NULL;
+    offset_reservoir *merged_res = NULL;
+    offset_reservoir *chunk_res = NULL;
+    long *population_sizes = NULL;
+    keyed_offset *heap = NULL;
+    long num_keyed = 0;
+    long k = (*res_ptr)->num_offsets;
+    long population = 0;
+    long offset_idx = 0;
+    offset_encoding encoding = (*res_ptr)->encoding;
+    int file_idx = 0;
+    int next_file_idx = 0;
+    int num_chunks = 0;
+    int chunk_idx = 0;
+
+    chunks = calloc(num_threads, sizeof(mmap_chunk));
+    batch_mmaps = calloc(num_threads, sizeof(file_mmap *));
+    reservoirs = malloc(sizeof(offset_reservoir *) * (num_threads + 1));
+    population_sizes = calloc(num_threads + 1, sizeof(long));
+    if ((keyed_sample) && (sample_size_specified))
+        heap = malloc(sizeof(keyed_offset) * (k > 0 ? k : 1));
+    if ((!chunks) || (!batch_mmaps) || (!reservoirs) || (!population_sizes) || ((keyed_sample) && (sample_size_specified) && (!heap))) {
+        fprintf(stderr, "Error: Could not allocate memory for per-file samples\n");
+        exit(EXIT_FAILURE);
+    }
+    (*res_ptr)->num_offsets = 0;
+
+    /* 
+       files are mapped and scanned a batch at a time, one worker to a file, and each 
+       batch's samples are folded into the running sample before the next batch is mapped
+    */
+    for (file_idx = 0; file_idx < set->num_files; file_idx = next_file_idx) {
+        for (num_chunks = 0, next_file_idx = file_idx; (next_file_idx < set->num_files) && (num_chunks < num_threads); ++next_file_idx) {
+            if (set->sizes[next_file_idx] == 0)
+                continue;
+            batch_mmaps[num_chunks] = new_file_mmap(set->filenames[next_file_idx]);
+            memset(&chunks[num_chunks], 0, sizeof(mmap_chunk));
+            chunks[num_chunks].in_mmap = batch_mmaps[num_chunks];
+            chunks[num_chunks].base = set->bases[next_file_idx];
+            chunks[num_chunks].stop = batch_mmaps[num_chunks]->size;
+            chunks[num_chunks].num_groups = -1;
+            chunks[num_chunks].lines_per_offset = lines_per_offset;
+            if ((keyed_sample) && (sample_size_specified)) {
+                chunks[num_chunks].keyed = malloc(sizeof(keyed_offset) * (k > 0 ? k : 1));
+                chunks[num_chunks].max_keyed = k;
+                if (!chunks[num_chunks].keyed) {
+                    fprintf(stderr, "Error: Could not allocate memory for per-file samples\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if (sample_size_specified) {
+                chunks[num_chunks].res = new_offset_reservoir_ptr(k, encoding);
+                rng_split(&rng_global_state, &chunks[num_chunks].rng);
+            }
+            else
+                chunks[num_chunks].res = new_offset_reservoir_ptr((encoding == kOffsetEncodingPacked) ? 0 : DEFAULT_SAMPLE_SIZE_INCREMENT, encoding);
+            num_chunks++;
+        }
+        if (num_chunks == 0)
+            continue;
+
+        if ((keyed_sample) && (sample_size_specified)) {
+            run_mmap_chunk_workers(chunks, num_chunks, sample_mmap_chunk_offsets_by_key);
+            for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+                for (offset_idx = 0; offset_idx < chunks[chunk_idx].num_keyed; ++offset_idx)
+                    keyed_offsets_offer(heap, &num_keyed, k, chunks[chunk_idx].keyed[offset_idx].key, chunks[chunk_idx].keyed[offset_idx].offset);
+        }
+        else if (sample_size_specified) {
+            /* the running sample is a uniform sample of the files so far, so it merges like one more chunk */
+            run_mmap_chunk_workers(chunks, num_chunks, sample_mmap_chunk_offsets_with_fixed_k);
+            reservoirs[0] = *res_ptr;
+            population_sizes[0] = population;
+            for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+                reservoirs[chunk_idx + 1] = chunks[chunk_idx].res;
+                population_sizes[chunk_idx + 1] = chunks[chunk_idx].num_groups;
+                population += chunks[chunk_idx].num_groups;
+            }
+            merged_res = merge_offset_reservoirs(reservoirs, population_sizes, num_chunks + 1, k, &rng_global_state);
+            delete_offset_reservoir_ptr(res_ptr);
+            *res_ptr = merged_res;
+        }
+        else {
+            /* files are taken in order, so appending their indices gives the index of the concatenation */
+            run_mmap_chunk_workers(chunks, num_chunks, index_mmap_chunk_offsets);
+            for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+                chunk_res = chunks[chunk_idx].res;
+                offset_reservoir_reserve(*res_ptr, (*res_ptr)->num_offsets + chunk_res->num_offsets);
+                for (offset_idx = 0; offset_idx < chunk_res->num_offsets; ++offset_idx)
+                    offset_reservoir_append(*res_ptr, offset_reservoir_get(chunk_res, offset_idx));
+            }
+        }
+
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            if (chunks[chunk_idx].res)
+                delete_offset_reservoir_ptr(&(chunks[chunk_idx].res));
+            free(chunks[chunk_idx].keyed);
+            chunks[chunk_idx].keyed = NULL;
+            delete_file_mmap(&batch_mmaps[chunk_idx]);
+        }
+    }
+
+    if ((keyed_sample) && (sample_size_specified)) {
+        delete_offset_reservoir_ptr(res_ptr);
+        *res_ptr = merge_keyed_offsets(&heap, &num_keyed, 1, k, encoding);
+        free(heap);
+    }
+
+    free(population_sizes);
+    free(reservoirs);
+    free(batch_mmaps);
+    free(chunks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_input_set()\n");
+#endif
+}
+
+long sample_reservoir_offsets_via_byte_range(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const size_t range_start, const size_t range_stop, const boolean sample_size_specified, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_byte_range()\n");
+#endif
+
+    mmap_chunk *chunks = NULL;
+    void * (*worker)(void *) = index_mmap_chunk_offsets;
+    long num_groups = 0;
+    int num_chunks = 0;
+    int chunk_idx = 0;
+
+    /* 
+       a shard is split among the workers as a whole file is, and each worker samples its 
+       chunk the way it would in a whole-file run
+    */
+    if ((keyed_sample) && (sample_size_specified))
+        worker = sample_mmap_chunk_offsets_by_key;
+    else if (sample_size_specified)
+        worker = sample_mmap_chunk_offsets_with_fixed_k;
+    chunks = new_mmap_range_chunks(in_mmap, range_start, range_stop, num_threads, lines_per_offset, &num_chunks);
+    sample_reservoir_offsets_via_chunk_workers(chunks, num_chunks, worker, res_ptr, sample_size_specified, keyed_sample);
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+        num_groups += chunks[chunk_idx].num_groups;
+    delete_mmap_chunks(&chunks, num_chunks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Shard [%zu, %zu) holds %ld line-groupings\n", range_start, range_stop, num_groups);
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_byte_range()\n");
+#endif
+
+    return num_groups;
+}
+
+void save_offset_reservoir_state(const char *state_fn, const char *in_fn, const file_mmap *in_mmap, const offset_reservoir *res_ptr, const size_t range_start, const size_t range_stop, const long k, const long num_groups, const int lines_per_offset, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> save_offset_reservoir_state()\n");
+#endif
+
+    sample_state_header header;
+    uint64_t *offsets = NULL;
+    long offset_idx = 0;
+
+    offsets = malloc(sizeof(uint64_t) * (res_ptr->num_offsets > 0 ? res_ptr->num_offsets : 1));
+    if (!offsets) {
+        fprintf(stderr, "Error: Could not allocate memory for sample state\n");
+        exit(EXIT_FAILURE);
+    }
+    for (offset_idx = 0; offset_idx < res_ptr->num_offsets; ++offset_idx)
+        offsets[offset_idx] = (uint64_t) offset_reservoir_get(res_ptr, offset_idx);
+    if ((res_ptr->num_offsets > 1) && (radix_sort_uint64(offsets, res_ptr->num_offsets, 1) == -1)) {
+        fprintf(stderr, "Error: Could not sort sample state (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    sample_state_header_init(&header);
+    header.file_size = in_mmap->size;
+    header.range_start = range_start;
+    header.range_stop = range_stop;
+    header.k = k;
+    header.num_groups = num_groups;
+    header.num_offsets = res_ptr->num_offsets;
+    header.lines_per_offset = (uint32_t) lines_per_offset;
+    header.keyed = (keyed_sample) ? 1 : 0;
+    if (sample_state_write(state_fn, &header, in_fn, &rng_global_state, offsets) == -1) {
+        fprintf(stderr, "Error: Could not write sample state [%s] (%s)\n", state_fn, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    free(offsets);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> save_offset_reservoir_state()\n");
+#endif
+}
+
+void print_merged_sample_states(char **state_fns, const int num_states, const long k, const boolean sample_size_specified, const boolean preserve_order, const boolean rng_seed_specified, const int rng_seed_value, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_merged_sample_states()\n");
+#endif
+
+    sample_state **states = NULL;
+    sample_state **ranges = NULL;
+    offset_reservoir **reservoirs = NULL;
+    keyed_offset **heaps = NULL;
+    long *population_sizes = NULL;
+    offset_reservoir *merged_res = NULL;
+    file_mmap *in_mmap = NULL;
+    offset_encoding encoding = kOffsetEncodingWide;
+    long merged_k = -1;
+    long max_k = LONG_MAX;
+    long offset_idx = 0;
+    int state_idx = 0;
+
+    states = calloc(num_states, sizeof(sample_state *));
+    ranges = calloc(num_states, sizeof(sample_state *));
+    reservoirs = calloc(num_states, sizeof(offset_reservoir *));
+    heaps = calloc(num_states, sizeof(keyed_offset *));
+    population_sizes = calloc(num_states, sizeof(long));
+    if ((!states) || (!ranges) || (!reservoirs) || (!heaps) || (!population_sizes)) {
+        fprintf(stderr, "Error: Could not allocate memory for sample states\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       the shards must be of one file, cut into line-groupings the same way, and sampled the 
+       same way; a shard's sample bounds the merged sample size, unless it is all of its shard
+    */
+    for (state_idx = 0; state_idx < num_states; ++state_idx) {
+        states[state_idx] = sample_state_read(state_fns[state_idx]);
+        if ((!states[state_idx]) && (errno == ENOTSUP)) {
+            fprintf(stderr, "Error: Sample state [%s] was saved by another version of sample; save it again with --save-state\n", state_fns[state_idx]);
+            exit(EXIT_FAILURE);
+        }
+        if (!states[state_idx]) {
+            fprintf(stderr, "Error: Could not read sample state [%s] (%s)\n", state_fns[state_idx], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if ((states[state_idx]->header.file_size != states[0]->header.file_size) ||
+            (states[state_idx]->header.lines_per_offset != states[0]->header.lines_per_offset) ||
+            (states[state_idx]->header.keyed != states[0]->header.keyed)) {
+            fprintf(stderr, "Error: Sample state [%s] was not saved from the same input, or in the same way, as [%s]\n", state_fns[state_idx], state_fns[0]);
+            exit(EXIT_FAILURE);
+        }
+        if ((states[state_idx]->header.k >= 0) && ((merged_k == -1) || (states[state_idx]->header.k < merged_k)))
+            merged_k = (long) states[state_idx]->header.k;
+        if ((states[state_idx]->header.num_offsets < states[state_idx]->header.num_groups) && (states[state_idx]->header.num_offsets < max_k))
+            max_k = (long) states[state_idx]->header.num_offsets;
+        population_sizes[state_idx] = (long) states[state_idx]->header.num_groups;
+        ranges[state_idx] = states[state_idx];
+    }
+    qsort(ranges, num_states, sizeof(sample_state *), sample_state_range_compare);
+    for (state_idx = 1; state_idx < num_states; ++state_idx) {
+        if (ranges[state_idx]->header.range_start < ranges[state_idx - 1]->header.range_stop) {
+            fprintf(stderr, "Error: Sample states of bytes [%llu, %llu) and [%llu, %llu) overlap\n", (unsigned long long) ranges[state_idx - 1]->header.range_start, (unsigned long long) ranges[state_idx - 1]->header.range_stop, (unsigned long long) ranges[state_idx]->header.range_start, (unsigned long long) ranges[state_idx]->header.range_stop);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (sample_size_specified)
+        merged_k = k;
+    if ((merged_k == -1) || (merged_k > max_k)) {
+        if ((sample_size_specified) || (merged_k != -1) || (max_k != LONG_MAX)) {
+            fprintf(stderr, "Error: The saved samples are too small to merge into a sample of size %ld\n", (merged_k == -1) ? LONG_MAX : merged_k);
+            exit(EXIT_FAILURE);
+        }
+        merged_k = LONG_MAX;
+    }
+
+    /* the merge draws from the first shard's generator where it left off, unless it is given a seed */
+    if (rng_seed_specified)
+        rng_seed(&rng_global_state, states[0]->rng.kind, (uint64_t) rng_seed_value);
+    else
+        rng_global_state = states[0]->rng;
+
+    /* 
+       keyed shards are merged by the keys of their offsets, as chunks are, so that the merged 
+       sample is the one a whole-file run with the same seed would draw; other shards are 
+       merged as per-thread reservoirs are, in proportion to the shards' populations
+    */
+    encoding = select_offset_encoding((off_t) states[0]->header.file_size, kFalse);
+    if (states[0]->header.keyed) {
+        for (state_idx = 0; state_idx < num_states; ++state_idx) {
+            population_sizes[state_idx] = (long) states[state_idx]->header.num_offsets;
+            heaps[state_idx] = malloc(sizeof(keyed_offset) * (population_sizes[state_idx] > 0 ? population_sizes[state_idx] : 1));
+            if (!heaps[state_idx]) {
+                fprintf(stderr, "Error: Could not allocate memory for keyed sample merge\n");
+                exit(EXIT_FAILURE);
+            }
+            for (offset_idx = 0; offset_idx < population_sizes[state_idx]; ++offset_idx) {
+                heaps[state_idx][offset_idx].key = rng_record_key(&states[state_idx]->rng, states[state_idx]->offsets[offset_idx]);
+                heaps[state_idx][offset_idx].offset = (off_t) states[state_idx]->offsets[offset_idx];
+            }
+        }
+        merged_res = merge_keyed_offsets(heaps, population_sizes, num_states, merged_k, encoding);
+    }
+    else {
+        for (state_idx = 0; state_idx < num_states; ++state_idx) {
+            reservoirs[state_idx] = new_offset_reservoir_ptr((states[state_idx]->header.num_offsets > 0) ? (long) states[state_idx]->header.num_offsets : 1, kOffsetEncodingWide);
+            for (offset_idx = 0; offset_idx < states[state_idx]->header.num_offsets; ++offset_idx)
+                offset_reservoir_set(reservoirs[state_idx], offset_idx, (off_t) states[state_idx]->offsets[offset_idx]);
+            reservoirs[state_idx]->num_offsets = (long) states[state_idx]->header.num_offsets;
+        }
+        merged_res = merge_offset_reservoirs(reservoirs, population_sizes, num_states, merged_k, &rng_global_state);
+    }
+    if (preserve_order)
+        sort_offset_reservoir_ptr_offsets(&merged_res, num_threads);
+
+    /* --drop-cache lets go of the input's pages at exit, not those of the state files */
+    sample_global_args.merged_filename = strdup(states[0]->filename);
+    in_mmap = new_file_mmap(states[0]->filename);
+    if (in_mmap->size != states[0]->header.file_size) {
+        fprintf(stderr, "Error: Input [%s] is not the size it was when its sample states were saved\n", states[0]->filename);
+        exit(EXIT_FAILURE);
+    }
+    print_offset_reservoir_sample_via_mmap(in_mmap, merged_res, states[0]->header.lines_per_offset, preserve_order);
+
+    delete_file_mmap(&in_mmap);
+    delete_offset_reservoir_ptr(&merged_res);
+    for (state_idx = 0; state_idx < num_states; ++state_idx) {
+        if (reservoirs[state_idx])
+            delete_offset_reservoir_ptr(&reservoirs[state_idx]);
+        free(heaps[state_idx]);
+        delete_sample_state(&states[state_idx]);
+    }
+    free(population_sizes);
+    free(heaps);
+    free(reservoirs);
+    free(ranges);
+    free(states);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_merged_sample_states()\n");
+#endif
+}
+
+int sample_state_range_compare(const void *state1, const void *state2)
+{
+    const sample_state *entry1 = *(sample_state * const *) state1;
+    const sample_state *entry2 = *(sample_state * const *) state2;
+
+    return (entry1->header.range_start > entry2->header.range_start) - (entry1->header.range_start < entry2->header.range_start);
+}
+
+void sample_reservoir_offsets_via_chunk_workers(mmap_chunk *chunks, const int num_chunks, void * (*worker)(void *), offset_reservoir **res_ptr, const boolean sample_size_specified, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_chunk_workers()\n");
+#endif
+
+    keyed_offset **heaps = NULL;
+    offset_reservoir **reservoirs = NULL;
+    offset_reservoir *chunk_res = NULL;
+    long *population_sizes = NULL;
+    long k = (*res_ptr)->num_offsets;
+    long offset_idx = 0;
+    offset_encoding encoding = (*res_ptr)->encoding;
+    int chunk_idx = 0;
+
+    heaps = malloc(sizeof(keyed_offset *) * num_chunks);
+    reservoirs = malloc(sizeof(offset_reservoir *) * num_chunks);
+    population_sizes = calloc(num_chunks, sizeof(long));
+    if ((!heaps) || (!reservoirs) || (!population_sizes)) {
+        fprintf(stderr, "Error: Could not allocate memory for per-thread samples\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+        if ((keyed_sample) && (sample_size_specified)) {
+            chunks[chunk_idx].keyed = malloc(sizeof(keyed_offset) * (k > 0 ? k : 1));
+            chunks[chunk_idx].max_keyed = k;
+            if (!chunks[chunk_idx].keyed) {
+                fprintf(stderr, "Error: Could not allocate memory for per-thread keyed samples\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (sample_size_specified) {
+            chunks[chunk_idx].res = new_offset_reservoir_ptr(k, encoding);
+            chunks[chunk_idx].fixed_k = kTrue;
+            rng_split(&rng_global_state, &chunks[chunk_idx].rng);
+        }
+        else
+            chunks[chunk_idx].res = new_offset_reservoir_ptr((encoding == kOffsetEncodingPacked) ? 0 : DEFAULT_SAMPLE_SIZE_INCREMENT, encoding);
+    }
+    run_mmap_chunk_workers(chunks, num_chunks, worker);
+
+    if ((keyed_sample) && (sample_size_specified)) {
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            heaps[chunk_idx] = chunks[chunk_idx].keyed;
+            population_sizes[chunk_idx] = chunks[chunk_idx].num_keyed;
+        }
+        delete_offset_reservoir_ptr(res_ptr);
+        *res_ptr = merge_keyed_offsets(heaps, population_sizes, num_chunks, k, encoding);
+    }
+    else if (sample_size_specified) {
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            reservoirs[chunk_idx] = chunks[chunk_idx].res;
+            population_sizes[chunk_idx] = chunks[chunk_idx].num_groups;
+        }
+        delete_offset_reservoir_ptr(res_ptr);
+        *res_ptr = merge_offset_reservoirs(reservoirs, population_sizes, num_chunks, k, &rng_global_state);
+    }
+    else {
+        /* offsets rise from one chunk to the next, so the chunks' indices append in order */
+        (*res_ptr)->num_offsets = 0;
+        for (chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx) {
+            chunk_res = chunks[chunk_idx].res;
+            offset_reservoir_reserve(*res_ptr, (*res_ptr)->num_offsets + chunk_res->num_offsets);
+            for (offset_idx = 0; offset_idx < chunk_res->num_offsets; ++offset_idx)
+                offset_reservoir_append(*res_ptr, offset_reservoir_get(chunk_res, offset_idx));
+        }
+    }
+
+    free(population_sizes);
+    free(reservoirs);
+    free(heaps);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_chunk_workers()\n");
+#endif
+}
+
+void mmap_chunk_take_offset(mmap_chunk *chunk, const long k, const long grp_idx, const off_t offset)
+{
+    offset_reservoir *res = chunk->res;
+
+    if (chunk->keyed) {
+        keyed_offsets_offer(chunk->keyed, &(chunk->num_keyed), chunk->max_keyed, rng_record_key(&rng_global_state, (uint64_t) offset), offset);
+        return;
+    }
+    if (!chunk->fixed_k) {
+        offset_reservoir_append(res, offset);
+        return;
+    }
+
+    /* Algorithm L, a line-grouping at a time, as for a stream */
+    if (grp_idx < k)
+        offset_reservoir_set(res, grp_idx, offset);
+    else if (grp_idx == chunk->next_grp_idx) {
+        offset_reservoir_set(res, rng_bounded_modulo(&chunk->rng, k), offset);
+        chunk->w = algorithm_l_next_weight(&chunk->rng, chunk->w, k);
+        chunk->next_grp_idx = algorithm_l_next_index(&chunk->rng, grp_idx, chunk->w);
+    }
+    if (grp_idx + 1 == k) {
+        chunk->w = algorithm_l_initial_weight(&chunk->rng, k);
+        chunk->next_grp_idx = algorithm_l_next_index(&chunk->rng, grp_idx, chunk->w);
+    }
+}
+
+void sample_reservoir_offsets_via_bgzf(bgzf_file *bgzf, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_bgzf()\n");
+#endif
+
+    mmap_chunk *chunks = NULL;
+    int n = num_threads;
+    int chunk_idx = 0;
+    long lines_before = 0;
+
+    if ((size_t) n > bgzf->size / MMAP_CHUNK_MINIMUM_SIZE)
+        n = (int) (bgzf->size / MMAP_CHUNK_MINIMUM_SIZE);
+    if (n < 1)
+        n = 1;
+
+    chunks = calloc(n, sizeof(mmap_chunk));
+    if (!chunks) {
+        fprintf(stderr, "Error: Could not allocate memory for BGZF chunks\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* chunks are runs of whole blocks of about the same compressed size */
+    for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+        chunks[chunk_idx].bgzf = bgzf;
+        chunks[chunk_idx].lines_per_offset = lines_per_offset;
+        chunks[chunk_idx].stop = bgzf->num_blocks;
+        if (chunk_idx > 0) {
+            chunks[chunk_idx].start = bgzf_block_index(bgzf, (uint64_t) (bgzf->size / n) * chunk_idx);
+            chunks[chunk_idx - 1].stop = chunks[chunk_idx].start;
+        }
+    }
+
+    /* 
+       a line-grouping of several lines may run on through any number of blocks, so, as 
+       for a mapped file, the lines of each chunk are counted first, in a pass of their own, 
+       for a chunk to know where the first line-grouping starting inside it begins
+    */
+    if ((lines_per_offset > 1) && (n > 1)) {
+        run_mmap_chunk_workers(chunks, n, count_bgzf_chunk_lines);
+        for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+            chunks[chunk_idx].lines_before = lines_before;
+            lines_before += chunks[chunk_idx].num_lines;
+        }
+    }
+    sample_reservoir_offsets_via_chunk_workers(chunks, n, sample_bgzf_chunk_offsets, res_ptr, sample_size_specified, keyed_sample);
+    delete_mmap_chunks(&chunks, n);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_bgzf()\n");
+#endif
+}
+
+void * count_bgzf_chunk_lines(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    const bgzf_file *bgzf = chunk->bgzf;
+    bgzf_inflater inflater;
+    char *block = NULL;
+    size_t block_len = 0;
+    size_t block_idx = 0;
+
+    block = malloc(BGZF_MAX_BLOCK_SIZE);
+    if ((!block) || (bgzf_inflater_init(&inflater) == -1)) {
+        fprintf(stderr, "Error: Could not allocate memory for BGZF inflation\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->num_lines = 0;
+    for (block_idx = chunk->start; block_idx < chunk->stop; ++block_idx) {
+        if (bgzf_inflate_block(&inflater, bgzf, block_idx, block, &block_len) == -1) {
+            fprintf(stderr, "Error: Could not inflate BGZF block at offset %llu (%s)\n", (unsigned long long) bgzf->blocks[block_idx].offset, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        chunk->num_lines += (long) newline_scan_count(block, block_len);
+    }
+
+    bgzf_inflater_end(&inflater);
+    free(block);
+
+    return NULL;
+}
+
+void * sample_bgzf_chunk_offsets(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    const bgzf_file *bgzf = chunk->bgzf;
+    bgzf_inflater inflater;
+    char *block = NULL;
+    size_t block_len = 0;
+    size_t block_idx = 0;
+    size_t prev_block_idx = 0;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t newline_position = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+    size_t start_block_idx = 0;
+    uint64_t start_offset = 0;
+    boolean have_start = kTrue;
+    boolean done = kFalse;
+    const int lines_per_offset = chunk->lines_per_offset;
+    offset_reservoir *res = chunk->res;
+    const long k = (chunk->fixed_k) ? res->num_offsets : 0;
+    long ln_idx = chunk->lines_before;
+    long grp_idx = 0;
+
+    block = malloc(BGZF_MAX_BLOCK_SIZE);
+    if ((!block) || (bgzf_inflater_init(&inflater) == -1)) {
+        fprintf(stderr, "Error: Could not allocate memory for BGZF inflation\n");
+        exit(EXIT_FAILURE);
+    }
+    chunk->num_keyed = 0;
+    if ((res) && (!chunk->fixed_k))
+        res->num_offsets = 0;
+
+    /* 
+       a line that runs into the chunk from the block before belongs to the chunk before, 
+       which reads on past its last block to finish it
+    */
+    for (prev_block_idx = chunk->start; (prev_block_idx > 0) && (bgzf->blocks[prev_block_idx - 1].inflated_size == 0); --prev_block_idx)
+        ;
+    if (prev_block_idx > 0) {
+        if (bgzf_inflate_block(&inflater, bgzf, prev_block_idx - 1, block, &block_len) == -1) {
+            fprintf(stderr, "Error: Could not inflate BGZF block at offset %llu (%s)\n", (unsigned long long) bgzf->blocks[prev_block_idx - 1].offset, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        have_start = (block[block_len - 1] == '\n') ? kTrue : kFalse;
+    }
+    /* a chunk that starts partway through a line-grouping leaves it to the chunk before */
+    if (ln_idx % lines_per_offset)
+        have_start = kFalse;
+    start_block_idx = bgzf_next_data_block(bgzf, chunk->start);
+    if (start_block_idx < bgzf->num_blocks)
+        start_offset = bgzf_virtual_offset(bgzf, start_block_idx, 0);
+    if (start_block_idx >= chunk->stop)
+        done = kTrue;
+
+    for (block_idx = chunk->start; (block_idx < bgzf->num_blocks) && (!done); ++block_idx) {
+        if ((block_idx >= chunk->stop) && (!have_start))
+            break;
+        if (bgzf_inflate_block(&inflater, bgzf, block_idx, block, &block_len) == -1) {
+            fprintf(stderr, "Error: Could not inflate BGZF block at offset %llu (%s)\n", (unsigned long long) bgzf->blocks[block_idx].offset, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (scan_offset = 0; (scan_offset < block_len) && (!done); scan_offset += scanned) {
+            num_positions = newline_scan_positions(block + scan_offset, block_len - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+            for (position_idx = 0; (position_idx < num_positions) && (!done); ++position_idx) {
+                newline_position = scan_offset + newline_positions[position_idx];
+                if ((++ln_idx) % lines_per_offset)
+                    continue;
+                if (have_start)
+                    mmap_chunk_take_offset(chunk, k, grp_idx++, (off_t) start_offset);
+
+                /* the next line-grouping starts just past this newline, which may be in the next block */
+                if (newline_position + 1 < block_len) {
+                    start_block_idx = block_idx;
+                    start_offset = bgzf_virtual_offset(bgzf, block_idx, newline_position + 1);
+                }
+                else {
+                    start_block_idx = bgzf_next_data_block(bgzf, block_idx + 1);
+                    start_offset = (start_block_idx < bgzf->num_blocks) ? bgzf_virtual_offset(bgzf, start_block_idx, 0) : 0;
+                }
+                have_start = kTrue;
+                if (start_block_idx >= chunk->stop)
+                    done = kTrue;
+            }
+        }
+    }
+    if (chunk->fixed_k)
+        res->num_offsets = (grp_idx < k) ? grp_idx : k;
+    chunk->num_groups = grp_idx;
+
+    bgzf_inflater_end(&inflater);
+    free(block);
+
+    return NULL;
+}
+
+void sample_reservoir_offsets_via_gzip(gzip_file *gz, offset_reservoir **res_ptr, const int lines_per_offset, const int num_threads, const boolean sample_size_specified, const boolean keyed_sample)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_via_gzip()\n");
+#endif
+
+    mmap_chunk *chunks = NULL;
+    int n = num_threads;
+    int chunk_idx = 0;
+
+    /* 
+       without checkpoints, the one way into the data is from its start, so a single worker 
+       inflates it all and lays down the checkpoints as it goes; with them, each worker 
+       starts at a checkpoint of its own
+    */
+    if (gz->num_checkpoints == 0)
+        n = 1;
+    if ((size_t) n > gz->num_checkpoints)
+        n = (int) gz->num_checkpoints;
+    if ((uint64_t) n > gz->inflated_size / MMAP_CHUNK_MINIMUM_SIZE)
+        n = (int) (gz->inflated_size / MMAP_CHUNK_MINIMUM_SIZE);
+    if ((n < 1) || (lines_per_offset > 1))
+        n = 1;
+
+    chunks = calloc(n, sizeof(mmap_chunk));
+    if (!chunks) {
+        fprintf(stderr, "Error: Could not allocate memory for gzip chunks\n");
+        exit(EXIT_FAILURE);
+    }
+    for (chunk_idx = 0; chunk_idx < n; ++chunk_idx) {
+        chunks[chunk_idx].gzip = gz;
+        chunks[chunk_idx].lines_per_offset = lines_per_offset;
+        chunks[chunk_idx].stop = SIZE_MAX;
+        if (chunk_idx > 0) {
+            chunks[chunk_idx].start = (size_t) gz->checkpoints[gzip_checkpoint_index(gz, (gz->inflated_size / n) * chunk_idx)].out;
+            chunks[chunk_idx - 1].stop = chunks[chunk_idx].start;
+        }
+    }
+    sample_reservoir_offsets_via_chunk_workers(chunks, n, sample_gzip_chunk_offsets, res_ptr, sample_size_specified, keyed_sample);
+    delete_mmap_chunks(&chunks, n);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_via_gzip()\n");
+#endif
+}
+
+void * sample_gzip_chunk_offsets(void *chunk_ptr)
+{
+    mmap_chunk *chunk = chunk_ptr;
+    gzip_file *gz = chunk->gzip;
+    gzip_chunk_scan scan;
+    gzip_reader reader;
+    const gzip_checkpoint *checkpoint = NULL;
+    const char *data = NULL;
+    size_t data_len = 0;
+    uint64_t position = 0;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.chunk = chunk;
+    scan.k = (chunk->fixed_k) ? chunk->res->num_offsets : 0;
+    scan.group_start = chunk->start;
+    scan.have_start = kTrue;
+    scan.done = (chunk->start >= chunk->stop) ? kTrue : kFalse;
+    chunk->num_keyed = 0;
+    if ((chunk->res) && (!chunk->fixed_k))
+        chunk->res->num_offsets = 0;
+
+    if (gz->num_checkpoints == 0) {
+        if (gzip_scan(gz, gz->span, gzip_chunk_scan_piece, &scan) == -1) {
+            fprintf(stderr, "Error: Could not inflate gzip input (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    else {
+        /* a chunk starts at a checkpoint, whose window ends with the byte before the chunk */
+        if (chunk->start > 0) {
+            checkpoint = &gz->checkpoints[gzip_checkpoint_index(gz, chunk->start)];
+            scan.have_start = (checkpoint->window[GZIP_INDEX_WINDOW_SIZE - 1] == '\n') ? kTrue : kFalse;
+        }
+        if (gzip_reader_init(&reader, gz) == -1) {
+            fprintf(stderr, "Error: Could not allocate memory for gzip inflation\n");
+            exit(EXIT_FAILURE);
+        }
+        for (position = chunk->start; !scan.done; position += data_len) {
+            if (gzip_reader_data(&reader, position, &data, &data_len) == -1) {
+                fprintf(stderr, "Error: Could not inflate gzip input (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            if (data_len == 0)
+                break;
+            gzip_chunk_scan_piece(&scan, position, data, data_len);
+            if ((!scan.have_start) && (position + data_len >= chunk->stop))
+                break;
+        }
+        gzip_reader_end(&reader);
+    }
+
+    if (chunk->fixed_k)
+        chunk->res->num_offsets = (scan.grp_idx < scan.k) ? scan.grp_idx : scan.k;
+    chunk->num_groups = scan.grp_idx;
+
+    return NULL;
+}
+
+void gzip_chunk_scan_piece(void *scan_ptr, const uint64_t out, const char *data, const size_t len)
+{
+    gzip_chunk_scan *scan = scan_ptr;
+    mmap_chunk *chunk = scan->chunk;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+
+    /* line-groupings are walked as they are in a mapped file, with offsets into the inflated data */
+    for (scan_offset = 0; (scan_offset < len) && (!scan->done); scan_offset += scanned) {
+        num_positions = newline_scan_positions(data + scan_offset, len - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; (position_idx < num_positions) && (!scan->done); ++position_idx) {
+            if (scan->have_start) {
+                if ((++scan->ln_idx) % chunk->lines_per_offset)
+                    continue;
+                mmap_chunk_take_offset(chunk, scan->k, scan->grp_idx++, (off_t) scan->group_start);
+            }
+            scan->group_start = out + scan_offset + newline_positions[position_idx] + 1;
+            scan->have_start = kTrue;
+            if (scan->group_start >= chunk->stop)
+                scan->done = kTrue;
+        }
+    }
+}
+
+void finish_offset_reservoir_sample(offset_reservoir **res_ptr, offset_reservoir_printer printer, void *input_ptr, const long k, const int lines_per_offset, const boolean sample_size_specified, const boolean sample_with_replacement, const boolean preserve_order, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> finish_offset_reservoir_sample()\n");
+#endif
+
+    /* 
+       a reader that indexes every line-grouping leaves the draw with replacement, the 
+       shuffle and the sort to be done here, the same way for every kind of input
+    */
+    if ((sample_with_replacement) && (sample_size_specified))
+        sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(res_ptr, k);
+    else if (sample_with_replacement)
+        sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k(res_ptr);
+    else if (!sample_size_specified)
+        shuffle_reservoir_offsets_via_fisher_yates(res_ptr);
+    if (preserve_order)
+        sort_offset_reservoir_ptr_offsets(res_ptr, num_threads);
+    printer(input_ptr, *res_ptr, lines_per_offset, preserve_order, num_threads);
+    delete_offset_reservoir_ptr(res_ptr);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> finish_offset_reservoir_sample()\n");
+#endif
+}
+
+void sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(offset_reservoir **res_ptr, const long sample_size)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k()\n");
+#endif
+
+    sample_reservoir_offsets_with_replacement_with_fixed_k(res_ptr, sample_size);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k()\n");
+#endif
+}
+
+void sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k(offset_reservoir **res_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k()\n");
+#endif
+
+    /* 
+       we sample with replacement using the original reservoir's offset count 
+       as the new reservoir's sample size (note that this temporarily doubles 
+       the application's memory usage)
+    */
+    sample_reservoir_offsets_with_replacement_via_mmap_with_fixed_k(res_ptr, (*res_ptr)->num_offsets);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_via_mmap_with_unspecified_k()\n");
+#endif
+}
+
+void sample_reservoir_offsets_with_replacement_with_fixed_k(offset_reservoir **res_ptr, const long sample_size)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_offsets_with_replacement_with_fixed_k()\n");
+#endif
+
+    offset_reservoir *original_offset_reservoir_ptr = *res_ptr;
+    offset_reservoir *sample_offset_reservoir_ptr = NULL;
+    long original_sample_size = original_offset_reservoir_ptr->num_offsets;
+    long sample_offset_idx = 0;
+    long original_random_idx = 0;
+
+    /* build a new reservoir of size k */
+    sample_offset_reservoir_ptr = new_offset_reservoir_ptr(sample_size, offset_reservoir_element_encoding(original_offset_reservoir_ptr));
+
+    /* 
+       pick random integers between 0..(original_sample_size - 1) and 
+       copy original offset values to sample reservoir's offsets array 
+    */
+    for (sample_offset_idx = 0; sample_offset_idx < sample_size; ++sample_offset_idx) {
+        original_random_idx = rng_bounded(&rng_global_state, original_sample_size);
+        offset_reservoir_set(sample_offset_reservoir_ptr, sample_offset_idx, offset_reservoir_get(original_offset_reservoir_ptr, original_random_idx));
+    }
+
+    /* clean up the original reservoir */
+    delete_offset_reservoir_ptr(&original_offset_reservoir_ptr);
+    original_offset_reservoir_ptr = NULL;
+
+    /* point the current reservoir pointer at the new sample reservoir */
+    *res_ptr = sample_offset_reservoir_ptr;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_offsets_with_replacement_with_fixed_k()\n");
+#endif
+}
+
+uint64_t sample_replacement_block(uint64_t **draws_ptr, uint64_t *draws_capacity, const uint64_t block_groups, const uint64_t groups_left, const uint64_t draws_left)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_replacement_block()\n");
+#endif
+
+    uint64_t *resized_draws = NULL;
+    uint64_t block_draws = 0;
+
+    /* the last block takes every draw left */
+    block_draws = (block_groups == groups_left) ? draws_left : replacement_binomial(&rng_global_state, draws_left, (double) block_groups / (double) groups_left);
+    if (block_draws > *draws_capacity) {
+        resized_draws = realloc(*draws_ptr, sizeof(uint64_t) * block_draws);
+        if (!resized_draws) {
+            fprintf(stderr, "Error: Could not allocate memory for sample with replacement\n");
+            exit(EXIT_FAILURE);
+        }
+        *draws_ptr = resized_draws;
+        *draws_capacity = block_draws;
+    }
+    if (replacement_sorted_draws(&rng_global_state, block_groups, block_draws, *draws_ptr) == -1) {
+        fprintf(stderr, "Error: Could not sort sample with replacement (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_replacement_block()\n");
+#endif
+
+    return block_draws;
+}
+
+void sample_reservoir_draws_with_replacement_via_mmap(file_mmap *in_mmap, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_draws_with_replacement_via_mmap()\n");
+#endif
+
+    const char *map_start = in_mmap->map;
+    const char *map_stop = in_mmap->map + in_mmap->size;
+    const char *cursor = map_start;
+    const char *grp_stop = NULL;
+    replacement_reservoir *res = NULL;
+    uint64_t *offsets = NULL;
+    uint64_t grp_num = 1;
+    uint64_t skip_length = 0;
+    uint64_t num_groups = 0;
+    uint64_t num_draws = 0;
+    uint64_t *draws = NULL;
+    uint64_t draws_capacity = 0;
+    uint64_t block_start = 0;
+    uint64_t block_groups = 0;
+    uint64_t block_draws = 0;
+    uint64_t draw_idx = 0;
+    long offset_idx = 0;
+
+    /* the draws come out in ascending order, so past 4 GB they pack as an index does */
+    *res_ptr = new_offset_reservoir_ptr(1, select_offset_encoding((off_t) in_mmap->size, kTrue));
+    (*res_ptr)->num_offsets = 0;
+
+    if ((sample_size_specified) && ((double) k * REPLACEMENT_DENSE_RATIO < (double) estimate_mmap_line_groupings(in_mmap, 0, in_mmap->size, lines_per_offset))) {
+        res = new_replacement_reservoir(k);
+        if (!res) {
+            fprintf(stderr, "Error: Could not allocate memory for sample with replacement\n");
+            exit(EXIT_FAILURE);
+        }
+
+        /* jump from one line-grouping that a slot takes to the next, counting lines alone in between */
+        while (cursor < map_stop) 
+            {
+                skip_length = replacement_reservoir_next(res) - grp_num;
+                if (skip_length > 0) {
+                    grp_stop = newline_scan_nth(cursor, map_stop, (skip_length < (uint64_t) (LONG_MAX / lines_per_offset)) ? (long) skip_length * lines_per_offset : LONG_MAX);
+                    if (!grp_stop)
+                        break;
+                    cursor = grp_stop + 1;
+                    grp_num += skip_length;
+                }
+                grp_stop = newline_scan_nth(cursor, map_stop, lines_per_offset);
+                if (!grp_stop)
+                    break;
+                replacement_reservoir_take(res, &rng_global_state, (uint64_t) (cursor - map_start));
+                cursor = grp_stop + 1;
+                grp_num++;
+            }
+        sample_stats.bytes_scanned += in_mmap->size;
+        sample_stats.records_seen += grp_num - 1;
+        if ((sample_stats.enabled) && (cursor < map_stop))
+            sample_stats.records_seen += newline_scan_count(cursor, (size_t) (map_stop - cursor)) / lines_per_offset;
+        if (res->num_taken > 0) {
+            offsets = replacement_reservoir_sorted_offsets(res);
+            if (!offsets) {
+                fprintf(stderr, "Error: Could not allocate memory for sample with replacement\n");
+                exit(EXIT_FAILURE);
+            }
+            offset_reservoir_reserve(*res_ptr, k);
+            for (offset_idx = 0; offset_idx < k; ++offset_idx)
+                offset_reservoir_append(*res_ptr, (off_t) offsets[offset_idx]);
+        }
+        run_stats_peak(&sample_stats.reservoir_bytes, (sizeof(replacement_slot) + sizeof(uint64_t)) * k + offset_reservoir_bytes(*res_ptr));
+        free(offsets);
+        delete_replacement_reservoir(&res);
+    }
+    else {
+        /* 
+           a bootstrap, or a sample that is a sizeable fraction of the input, counts the 
+           line-groupings first, then draws them a block at a time, jumping from one drawn 
+           line-grouping to the next
+        */
+        num_groups = newline_scan_count(map_start, in_mmap->size) / lines_per_offset;
+        num_draws = ((sample_size_specified) && (num_groups > 0)) ? (uint64_t) k : num_groups;
+        offset_reservoir_reserve(*res_ptr, (long) num_draws);
+        grp_num = 0;
+        while (num_draws > 0) 
+            {
+                block_start = grp_num;
+                block_groups = (num_groups - block_start < REPLACEMENT_BLOCK_SIZE) ? num_groups - block_start : REPLACEMENT_BLOCK_SIZE;
+                block_draws = sample_replacement_block(&draws, &draws_capacity, block_groups, num_groups - block_start, num_draws);
+                for (draw_idx = 0; draw_idx < block_draws; ++draw_idx) {
+                    skip_length = block_start + draws[draw_idx] - grp_num;
+                    if (skip_length > 0) {
+                        cursor = newline_scan_nth(cursor, map_stop, (long) skip_length * lines_per_offset) + 1;
+                        grp_num += skip_length;
+                    }
+                    offset_reservoir_append(*res_ptr, (off_t) (cursor - map_start));
+                }
+                num_draws -= block_draws;
+                skip_length = block_start + block_groups - grp_num;
+                if ((num_draws > 0) && (skip_length > 0)) {
+                    cursor = newline_scan_nth(cursor, map_stop, (long) skip_length * lines_per_offset) + 1;
+                    grp_num += skip_length;
+                }
+            }
+        free(draws);
+        sample_stats.bytes_scanned += in_mmap->size + (cursor - map_start);
+        sample_stats.records_seen += num_groups;
+        run_stats_peak(&sample_stats.reservoir_bytes, sizeof(uint64_t) * draws_capacity + offset_reservoir_bytes(*res_ptr));
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Sample with replacement holds %ld draws\n", (*res_ptr)->num_offsets);
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_draws_with_replacement_via_mmap()\n");
+#endif
+}
+
+void sample_reservoir_draws_with_replacement_via_cstdio(FILE *in_file_ptr, offset_reservoir **res_ptr, const int lines_per_offset, const long k, const boolean sample_size_specified)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_reservoir_draws_with_replacement_via_cstdio()\n");
+#endif
+
+    char in_line[LINE_LENGTH_VALUE + 1];
+    struct stat in_stat;
+    replacement_reservoir *res = NULL;
+    uint64_t *offsets = NULL;
+    uint64_t *draws = NULL;
+    uint64_t draws_capacity = 0;
+    uint64_t grp_num = 0;
+    uint64_t num_groups = 0;
+    uint64_t num_draws = 0;
+    uint64_t block_start = 0;
+    uint64_t block_groups = 0;
+    uint64_t block_draws = 0;
+    uint64_t draw_idx = 0;
+    off_t start_offset = 0;
+    long offset_idx = 0;
+    long ln_idx = 0;
+
+    in_line[LINE_LENGTH_VALUE] = '1';
+    if (fstat(fileno(in_file_ptr), &in_stat) == -1) {
+        fprintf(stderr, "Error: Could not stat input file (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    *res_ptr = new_offset_reservoir_ptr(1, select_offset_encoding(in_stat.st_size, kTrue));
+    (*res_ptr)->num_offsets = 0;
+
+    if ((sample_size_specified) && ((double) k * REPLACEMENT_DENSE_RATIO < (double) estimate_cstdio_line_groupings(in_file_ptr, in_stat.st_size, lines_per_offset))) {
+        res = new_replacement_reservoir(k);
+        if (!res) {
+            fprintf(stderr, "Error: Could not allocate memory for sample with replacement\n");
+            exit(EXIT_FAILURE);
+        }
+        while (fgets(in_line, LINE_LENGTH_VALUE + 1, in_file_ptr)) 
+            {
+                if ((++ln_idx) % lines_per_offset)
+                    continue;
+
+                if (++grp_num == replacement_reservoir_next(res))
+                    replacement_reservoir_take(res, &rng_global_state, (uint64_t) start_offset);
+                start_offset = ftell(in_file_ptr);
+            }
+        sample_stats.bytes_scanned += (unsigned long long) ftell(in_file_ptr);
+        sample_stats.records_seen += grp_num;
+        if (res->num_taken > 0) {
+            offsets = replacement_reservoir_sorted_offsets(res);
+            if (!offsets) {
+                fprintf(stderr, "Error: Could not allocate memory for sample with replacement\n");
+                exit(EXIT_FAILURE);
+            }
+            offset_reservoir_reserve(*res_ptr, k);
+            for (offset_idx = 0; offset_idx < k; ++offset_idx)
+                offset_reservoir_append(*res_ptr, (off_t) offsets[offset_idx]);
+        }
+        run_stats_peak(&sample_stats.reservoir_bytes, (sizeof(replacement_slot) + sizeof(uint64_t)) * k + offset_reservoir_bytes(*res_ptr));
+        free(offsets);
+        delete_replacement_reservoir(&res);
+    }
+    else {
+        /* as with the mapped input, the line-groupings are counted before they are drawn */
+        while (fgets(in_line, LINE_LENGTH_VALUE + 1, in_file_ptr)) 
+            {
+                if (!((++ln_idx) % lines_per_offset))
+                    num_groups++;
+            }
+        sample_stats.bytes_scanned += (unsigned long long) ftell(in_file_ptr);
+        if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
+            fprintf(stderr, "Error: Could not rewind input file pointer\n");
+            exit(EXIT_FAILURE);
+        }
+        ln_idx = 0;
+        num_draws = ((sample_size_specified) && (num_groups > 0)) ? (uint64_t) k : num_groups;
+        offset_reservoir_reserve(*res_ptr, (long) num_draws);
+        while (((num_draws > 0) || (draw_idx < block_draws)) && (fgets(in_line, LINE_LENGTH_VALUE + 1, in_file_ptr))) 
+            {
+                if ((++ln_idx) % lines_per_offset)
+                    continue;
+
+                if (grp_num == block_start + block_groups) {
+                    block_start = grp_num;
+                    block_groups = (num_groups - block_start < REPLACEMENT_BLOCK_SIZE) ? num_groups - block_start : REPLACEMENT_BLOCK_SIZE;
+                    block_draws = sample_replacement_block(&draws, &draws_capacity, block_groups, num_groups - block_start, num_draws);
+                    num_draws -= block_draws;
+                    draw_idx = 0;
+                }
+                for (; (draw_idx < block_draws) && (block_start + draws[draw_idx] == grp_num); ++draw_idx)
+                    offset_reservoir_append(*res_ptr, start_offset);
+                start_offset = ftell(in_file_ptr);
+                grp_num++;
+            }
+        free(draws);
+        sample_stats.bytes_scanned += (unsigned long long) ftell(in_file_ptr);
+        sample_stats.records_seen += num_groups;
+        run_stats_peak(&sample_stats.reservoir_bytes, sizeof(uint64_t) * draws_capacity + offset_reservoir_bytes(*res_ptr));
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Sample with replacement holds %ld draws\n", (*res_ptr)->num_offsets);
+    fprintf(stderr, "Debug: Leaving  --> sample_reservoir_draws_with_replacement_via_cstdio()\n");
+#endif
+}
+
+void print_offset_reservoir_draws(offset_reservoir *draws, const int lines_per_offset, const boolean preserve_order, const file_mmap *in_mmap, FILE *in_file_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_draws()\n");
+#endif
+
+    if (in_mmap)
+        print_offset_reservoir_sample_via_mmap(in_mmap, draws, lines_per_offset, preserve_order);
+    else if (preserve_order)
+        print_sorted_offset_reservoir_sample_via_cstdio(in_file_ptr, draws, lines_per_offset);
+    else
+        print_unsorted_offset_reservoir_sample_via_cstdio(in_file_ptr, draws, lines_per_offset);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_draws()\n");
+#endif
+}
+
+void shuffle_reservoir_offsets_via_fisher_yates(offset_reservoir **res_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> shuffle_reservoir_offsets_via_fisher_yates()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsShuffle);
+    long ln_idx = (*res_ptr)->num_offsets;
+    long shuf_idx = 0;
+    long rand_idx = 0;
+    
+    /* a packed index is shuffled by way of its ranks */
+    offset_reservoir_rank(*res_ptr);
+
+    /* cf. http://blog.codinghorror.com/the-danger-of-naivete/ for an interesting discussion about Fisher-Yates */
+    for (shuf_idx = ln_idx - 1; shuf_idx > 0; --shuf_idx) {
+        rand_idx = rng_bounded(&rng_global_state, shuf_idx + 1);
+        offset_reservoir_swap(*res_ptr, shuf_idx, rand_idx);
+    }
+
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> shuffle_reservoir_offsets_via_fisher_yates()\n");
+#endif    
+}
+
+void sort_offset_reservoir_ptr_offsets(offset_reservoir **res_ptr, const int num_threads) 
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sort_offset_reservoir_ptr_offsets()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsSort);
+    int err = 0;
+
+    /* 
+       offsets are non-negative, so they sort as unsigned keys; ranks into a packed index sort 
+       in the same order as the offsets they stand for
+    */
+    if ((*res_ptr)->offsets) {
+        if ((*res_ptr)->encoding == kOffsetEncodingWide)
+            err = radix_sort_uint64((uint64_t *) (*res_ptr)->offsets, (*res_ptr)->num_offsets, num_threads);
+        else
+            err = radix_sort_uint32((uint32_t *) (*res_ptr)->offsets, (*res_ptr)->num_offsets, num_threads);
+    }
+    if (err == -1) {
+        fprintf(stderr, "Error: Could not allocate memory for sorting offsets\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sort_offset_reservoir_ptr_offsets()\n");
+#endif
+}
+
+void sequential_sampler_init(sequential_sampler *s, const long n, const long N, rng_state *state)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sequential_sampler_init()\n");
+#endif
+
+    s->n = n;
+    s->N = N;
+    s->n_real = (double) n;
+    s->N_real = (double) N;
+    s->n_inv = (n > 0) ? 1.0 / n : 0.0;
+    s->qu1 = N - n + 1;
+    s->qu1_real = (double) s->qu1;
+    s->threshold = SEQUENTIAL_SAMPLER_ALPHA_INVERSE * n;
+    s->method_a = ((n >= N) || (s->threshold >= N)) ? kTrue : kFalse;
+    s->v_prime = ((!s->method_a) && (n > 0)) ? exp(log(algorithm_l_random_double(state)) * s->n_inv) : 0.0;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sequential_sampler_init()\n");
+#endif
+}
+
+long sequential_sampler_next_skip(sequential_sampler *s, rng_state *state)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sequential_sampler_next_skip()\n");
+#endif
+
+    long skip_length = 0;
+    long limit = 0;
+    long t = 0;
+    double n_min1_inv = 0.0;
+    double x = 0.0;
+    double v = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+    double top = 0.0;
+    double bottom = 0.0;
+    double quot = 0.0;
+    double N_real = 0.0;
+
+    if (s->n >= s->N) {
+        /* every line-grouping that is left is in the sample */
+        skip_length = 0;
+    }
+    else if ((!s->method_a) && (s->n > 1) && (s->threshold < s->N)) {
+        /* 
+           Method D -- the skip is drawn from a continuous approximation of its distribution
+           and accepted or rejected against the exact one, which rarely needs more than a
+           couple of random numbers; an accepted draw leaves v_prime as the variate that 
+           starts the next skip
+        */
+        n_min1_inv = 1.0 / (s->n_real - 1.0);
+        for (;;) {
+            for (;;) {
+                x = s->N_real * (1.0 - s->v_prime);
+                skip_length = (long) x;
+                if (skip_length < s->qu1)
+                    break;
+                s->v_prime = exp(log(algorithm_l_random_double(state)) * s->n_inv);
+            }
+            y1 = exp(log(algorithm_l_random_double(state) * s->N_real / s->qu1_real) * n_min1_inv);
+            s->v_prime = y1 * (1.0 - x / s->N_real) * (s->qu1_real / (s->qu1_real - skip_length));
+            if (s->v_prime <= 1.0)
+                break;
+            y2 = 1.0;
+            top = s->N_real - 1.0;
+            if (s->n - 1 > skip_length) {
+                bottom = s->N_real - s->n_real;
+                limit = s->N - skip_length;
+            }
+            else {
+                bottom = s->N_real - skip_length - 1.0;
+                limit = s->qu1;
+            }
+            for (t = s->N - 1; t >= limit; --t) {
+                y2 = (y2 * top) / bottom;
+                top -= 1.0;
+                bottom -= 1.0;
+            }
+            if (s->N_real / (s->N_real - x) >= y1 * exp(log(y2) * n_min1_inv)) {
+                s->v_prime = exp(log(algorithm_l_random_double(state)) * n_min1_inv);
+                break;
+            }
+            s->v_prime = exp(log(algorithm_l_random_double(state)) * s->n_inv);
+        }
+        s->n_inv = n_min1_inv;
+        s->qu1 -= skip_length;
+        s->qu1_real = (double) s->qu1;
+        s->threshold -= SEQUENTIAL_SAMPLER_ALPHA_INVERSE;
+    }
+    else if (s->n > 1) {
+        /* Method A -- once the sample is dense, walking the skip one line-grouping at a time is cheaper */
+        s->method_a = kTrue;
+        v = algorithm_l_random_double(state);
+        top = s->N_real - s->n_real;
+        N_real = s->N_real;
+        quot = top / N_real;
+        while (quot > v) {
+            skip_length++;
+            top -= 1.0;
+            N_real -= 1.0;
+            quot *= top / N_real;
+        }
+    }
+    else {
+        /* the last pick is uniform over what is left */
+        v = (s->method_a) ? algorithm_l_random_double(state) : s->v_prime;
+        skip_length = (long) (s->N_real * v);
+        if (skip_length >= s->N)
+            skip_length = s->N - 1;
+    }
+
+    s->N -= skip_length + 1;
+    s->N_real = (double) s->N;
+    s->n--;
+    s->n_real = (double) s->n;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sequential_sampler_next_skip()\n");
+#endif
+
+    return skip_length;
+}
+
+void print_sequential_sample_via_mmap(const file_mmap *in_mmap, const line_index *idx, const int lines_per_offset, const long k, const long num_groups)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_sequential_sample_via_mmap()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    sequential_sampler sampler;
+    long sample_size = (k < num_groups) ? k : num_groups;
+    long num_selected = 0;
+    long grp_idx = 0;
+    long skip_length = 0;
+    const char *map_stop = in_mmap->map + in_mmap->size;
+    const char *cursor = in_mmap->map;
+    const char *record_start = NULL;
+    const char *record_stop = NULL;
+    output_buffer *ob = NULL;
+    access_prefetch prefetch;
+    access_pattern pattern = kAccessSequential;
+    long prefetch_window = 0;
+    long *picks = NULL;
+    long num_drawn = 0;
+    long drawn_grp_idx = 0;
+    long num_counted = 0;
+
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* picks come out in ascending order, so they can be sent as byte ranges of the file */
+    output_buffer_set_source(ob, in_mmap->fd, in_mmap->map);
+    output_buffer_use_zero_copy(ob);
+
+    /* 
+       without an index, every byte up to the last pick is scanned, and the mapping stays 
+       sequential; with one, a sparse sample is read at random, and its picks are drawn a 
+       window ahead of the one being written out, so that their pages can be asked for
+    */
+    if (idx) {
+        pattern = access_policy_for_sample(in_mmap->size, sample_size, kTrue);
+        access_policy_apply(in_mmap->map, in_mmap->size, in_mmap->fd, pattern);
+        if ((pattern == kAccessRandom) && (sample_global_args.prefetch_window > 0)) {
+            prefetch_window = access_prefetch_window(sample_global_args.prefetch_window, sample_size);
+            picks = malloc(sizeof(long) * (prefetch_window + 1));
+            if (!picks) {
+                fprintf(stderr, "Error: Could not allocate memory for prefetch window\n");
+                exit(EXIT_FAILURE);
+            }
+            access_prefetch_init(&prefetch, in_mmap->map, in_mmap->size, in_mmap->fd);
+        }
+    }
+
+    /* 
+       each pick is written out when it is reached, jumping over skipped line-groupings
+       with the index, if there is one, or else with the scanner
+    */
+    sequential_sampler_init(&sampler, (sample_size > 0) ? sample_size : 0, (num_groups > 0) ? num_groups : 0, &rng_global_state);
+    for (num_selected = 0; num_selected < sample_size; ++num_selected) {
+        if (picks) {
+            for (; (num_drawn < sample_size) && (num_drawn <= num_selected + prefetch_window); ++num_drawn) {
+                drawn_grp_idx += sequential_sampler_next_skip(&sampler, &rng_global_state);
+                picks[num_drawn % (prefetch_window + 1)] = drawn_grp_idx;
+                access_prefetch_hint(&prefetch, line_index_offset(idx, (uint64_t) drawn_grp_idx * lines_per_offset));
+                drawn_grp_idx++;
+            }
+            if (num_drawn == sample_size)
+                access_prefetch_flush(&prefetch);
+            grp_idx = picks[num_selected % (prefetch_window + 1)];
+        }
+        else {
+            skip_length = sequential_sampler_next_skip(&sampler, &rng_global_state);
+            grp_idx += skip_length;
+        }
+        if (idx)
+            record_start = in_mmap->map + line_index_offset(idx, (uint64_t) grp_idx * lines_per_offset);
+        else if (skip_length > 0) {
+            record_start = newline_scan_nth(cursor, map_stop, skip_length * lines_per_offset);
+            if (!record_start)
+                break;
+            record_start++;
+        }
+        else
+            record_start = cursor;
+        record_stop = newline_scan_nth(record_start, map_stop, lines_per_offset);
+        if (!record_stop)
+            break;
+        record_stop++;
+        if (output_buffer_append_range(ob, record_start - in_mmap->map, record_stop - record_start) == -1) {
+            fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        cursor = record_stop;
+        grp_idx++;
+    }
+
+    /* 
+       a --total-records hint that is off would leave a sample that is not uniform, so the 
+       input past the last pick is counted and the run fails if the hint does not match
+    */
+    if ((!idx) && (num_selected < sample_size)) {
+        fprintf(stderr, "Error: Input has fewer line-groupings than the %ld given by --total-records\n", num_groups);
+        exit(EXIT_FAILURE);
+    }
+    if (!idx) {
+        num_counted = grp_idx + (long) (newline_scan_count(cursor, map_stop - cursor) / lines_per_offset);
+        if (num_counted != num_groups) {
+            fprintf(stderr, "Error: Input has %ld line-groupings, not the %ld given by --total-records\n", num_counted, num_groups);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (!idx) {
+        sample_stats.bytes_scanned += (unsigned long long) in_mmap->size;
+        sample_stats.records_seen += (unsigned long long) num_counted;
+    }
+    free(picks);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Emitted %llu records (%llu bytes) at %.2f MB/s\n", ob->records_written, ob->bytes_written, ob->bytes_written / 1e6 / (output_buffer_elapsed_seconds(ob) + 1e-9));
+#endif
+
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_sequential_sample_via_mmap()\n");
+#endif
+}
+
+void print_sequential_sample_via_stdin_stream(const int lines_per_offset, const long k, const long num_groups)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_sequential_sample_via_stdin_stream()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    sequential_sampler sampler;
+    long sample_size = (k < num_groups) ? k : num_groups;
+    long num_selected = 0;
+    long ln_idx = 0;
+    long grp_idx = 0;
+    long next_grp_idx = 0;
+    char *block = NULL;
+    ssize_t block_len = 0;
+    char *carry = NULL;
+    size_t carry_len = 0;
+    size_t carry_capacity = 0;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+    size_t grp_start = 0;
+    size_t grp_stop = 0;
+    long num_lines = 0;
+    output_buffer *ob = NULL;
+
+    fflush(stdout);
+
+    block = malloc(STDIN_STREAM_BLOCK_SIZE);
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if ((!block) || (!ob)) {
+        fprintf(stderr, "Error: Could not allocate memory for standard input block\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sequential_sampler_init(&sampler, sample_size, num_groups, &rng_global_state);
+    if (sample_size > 0)
+        next_grp_idx = sequential_sampler_next_skip(&sampler, &rng_global_state);
+
+    /* 
+       a picked line-grouping is written out as soon as its last newline is read, and
+       reading stops after the last pick; the head of a pick that runs past the end of 
+       a block is held back, so that a grouping without its final newline is left out
+    */
+    while ((num_selected < sample_size) && ((block_len = read(STDIN_FILENO, block, STDIN_STREAM_BLOCK_SIZE)) != 0)) 
+        {
+            if (block_len < 0) {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "Error: Could not read standard input (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            sample_stats.bytes_scanned += (unsigned long long) block_len;
+            scan_offset = 0;
+            grp_start = 0;
+            while ((scan_offset < (size_t) block_len) && (num_selected < sample_size)) 
+                {
+                    num_positions = newline_scan_positions(block + scan_offset, block_len - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+                    for (position_idx = 0; (position_idx < num_positions) && (num_selected < sample_size); ++position_idx) 
+                        {
+                            if ((++ln_idx) % lines_per_offset)
+                                continue;
+
+                            grp_stop = scan_offset + newline_positions[position_idx] + 1;
+                            if (grp_idx == next_grp_idx) {
+                                if (((carry_len > 0) && (output_buffer_append(ob, carry, carry_len) == -1)) || 
+                                    (output_buffer_append(ob, block + grp_start, grp_stop - grp_start) == -1)) {
+                                    fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+                                    exit(EXIT_FAILURE);
+                                }
+                                carry_len = 0;
+                                if (++num_selected < sample_size)
+                                    next_grp_idx = grp_idx + 1 + sequential_sampler_next_skip(&sampler, &rng_global_state);
+                            }
+                            grp_start = grp_stop;
+                            grp_idx++;
+                        }
+                    scan_offset += scanned;
+                }
+
+            if ((num_selected < sample_size) && (grp_idx == next_grp_idx) && (grp_start < (size_t) block_len)) {
+                if (carry_len + (block_len - grp_start) > carry_capacity) {
+                    carry_capacity = 2 * (carry_len + (block_len - grp_start));
+                    carry = realloc(carry, carry_capacity);
+                    if (!carry) {
+                        fprintf(stderr, "Error: Could not allocate memory for standard input block\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    run_stats_add(&sample_stats.reallocations, 1);
+                }
+                memcpy(carry + carry_len, block + grp_start, block_len - grp_start);
+                carry_len += block_len - grp_start;
+            }
+        }
+
+    /* 
+       as with a mapped file, the stream past the last pick is read through and counted, 
+       and a --total-records hint that does not match it fails the run
+    */
+    if (num_selected < sample_size) {
+        fprintf(stderr, "Error: Input has fewer line-groupings than the %ld given by --total-records\n", num_groups);
+        exit(EXIT_FAILURE);
+    }
+    num_lines = ln_idx + (long) newline_scan_count(block + grp_start, block_len - grp_start);
+    while ((block_len = read(STDIN_FILENO, block, STDIN_STREAM_BLOCK_SIZE)) != 0) {
+        if (block_len < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: Could not read standard input (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        sample_stats.bytes_scanned += (unsigned long long) block_len;
+        num_lines += (long) newline_scan_count(block, block_len);
+    }
+    if (num_lines / lines_per_offset != num_groups) {
+        fprintf(stderr, "Error: Input has %ld line-groupings, not the %ld given by --total-records\n", num_lines / lines_per_offset, num_groups);
+        exit(EXIT_FAILURE);
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    sample_stats.records_seen += (unsigned long long) (num_lines / lines_per_offset);
+
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+    free(carry);
+    free(block);
+
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_sequential_sample_via_stdin_stream()\n");
+#endif
+}
+
+void print_offset_reservoir_sample_via_mmap(const file_mmap *in_mmap, offset_reservoir *res_ptr, const int lines_per_offset, const boolean zero_copy)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_sample_via_mmap()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    long res_idx;
+    const char *map_stop = in_mmap->map + in_mmap->size;
+    const char *record_start = NULL;
+    const char *record_stop = NULL;
+    off_t record_offset = 0;
+    output_buffer *ob = NULL;
+    access_prefetch prefetch;
+    access_pattern pattern = access_policy_for_sample(in_mmap->size, res_ptr->num_offsets, zero_copy);
+    long prefetch_window = (pattern == kAccessRandom) ? access_prefetch_window(sample_global_args.prefetch_window, res_ptr->num_offsets) : 0;
+    long prefetch_idx = 0;
+
+    /* anything already queued by stdio must go out ahead of the sample */
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       sorted offsets are byte ranges of the input file in ascending order, which the kernel 
+       can move to a pipe or regular file without a copy through userspace
+    */
+    output_buffer_set_source(ob, in_mmap->fd, in_mmap->map);
+    if (zero_copy)
+        output_buffer_use_zero_copy(ob);
+
+    /* 
+       the pages of a sparse sample are read at random, and asked for a window of records 
+       ahead of the one being queued, so that the reads are under way before it gets there
+    */
+    access_policy_apply(in_mmap->map, in_mmap->size, in_mmap->fd, pattern);
+    access_prefetch_init(&prefetch, in_mmap->map, in_mmap->size, in_mmap->fd);
+
+    /* queue each whole line-grouping in one go */
+    for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
+        for (; (prefetch_window > 0) && (prefetch_idx < res_ptr->num_offsets) && (prefetch_idx <= res_idx + prefetch_window); ++prefetch_idx)
+            access_prefetch_hint(&prefetch, (uint64_t) offset_reservoir_get(res_ptr, prefetch_idx));
+        if ((prefetch_window > 0) && (prefetch_idx == res_ptr->num_offsets))
+            access_prefetch_flush(&prefetch);
+        record_offset = offset_reservoir_get(res_ptr, res_idx);
+        record_start = in_mmap->map + record_offset;
+        record_stop = newline_scan_nth(record_start, map_stop, lines_per_offset);
+        record_stop = (record_stop) ? record_stop + 1 : map_stop;
+        if (output_buffer_append_range(ob, record_offset, record_stop - record_start) == -1) {
+            fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Emitted %llu records (%llu bytes) at %.2f MB/s\n", ob->records_written, ob->bytes_written, ob->bytes_written / 1e6 / (output_buffer_elapsed_seconds(ob) + 1e-9));
+#endif
+
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_sample_via_mmap()\n");
+#endif
+}
+
+void print_offset_reservoir_sample_via_input_set(void *set_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean zero_copy, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_sample_via_input_set()\n");
+#endif
+
+    input_set *set = set_ptr;
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    long res_idx;
+    const file_mmap *in_mmap = NULL;
+    const char *map_stop = NULL;
+    const char *record_start = NULL;
+    const char *record_stop = NULL;
+    off_t record_offset = 0;
+    int file_idx = 0;
+    int current_file_idx = -1;
+    output_buffer *ob = NULL;
+    access_pattern pattern = (zero_copy) ? kAccessSequential : kAccessNormal;
+
+    /* files are written out from one at a time, with no use for more threads */
+    (void) num_threads;
+
+    /* 
+       a file's mapping comes and goes as the records move between files, so no window of 
+       records is read ahead, and a sparse sample is not marked random either -- without 
+       the window, that would leave each record to a blocking fault of its own
+    */
+
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       the file in use is always the most recently used, so it is never the mapping given 
+       up to make room for the next file -- and the output buffer sends out what it has 
+       queued from one file before it switches to the next
+    */
+    for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
+        record_offset = offset_reservoir_get(res_ptr, res_idx);
+        file_idx = input_set_file_index(set, record_offset);
+        in_mmap = input_set_mmap(set, file_idx);
+        if (file_idx != current_file_idx) {
+            if (output_buffer_set_source(ob, in_mmap->fd, in_mmap->map) == -1) {
+                fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            if ((zero_copy) && (current_file_idx == -1))
+                output_buffer_use_zero_copy(ob);
+            access_policy_apply(in_mmap->map, in_mmap->size, in_mmap->fd, pattern);
+            current_file_idx = file_idx;
+        }
+        record_offset -= set->bases[file_idx];
+        map_stop = in_mmap->map + in_mmap->size;
+        record_start = in_mmap->map + record_offset;
+        record_stop = newline_scan_nth(record_start, map_stop, lines_per_offset);
+        record_stop = (record_stop) ? record_stop + 1 : map_stop;
+        if (output_buffer_append_range(ob, record_offset, record_stop - record_start) == -1) {
+            fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_sample_via_input_set()\n");
+#endif
+}
+
+void print_offset_reservoir_sample_via_bgzf(void *bgzf_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_sample_via_bgzf()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+
+    /* 
+       records are copied out of inflated blocks held in the block cache, which a sample 
+       in file order goes through once, inflating each block it touches a single time
+    */
+    print_offset_reservoir_records(bgzf_ptr, read_bgzf_record, res_ptr, lines_per_offset, sorted, num_threads);
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_sample_via_bgzf()\n");
+#endif
+}
+
+const char * read_bgzf_record(void *bgzf_ptr, const uint64_t offset, const int lines_per_offset, char **scratch, size_t *scratch_capacity, size_t *record_len)
+{
+    bgzf_file *bgzf = bgzf_ptr;
+    const char *data = NULL;
+    const char *record_stop = NULL;
+    char *resized_scratch = NULL;
+    size_t data_len = 0;
+    size_t piece_len = 0;
+    size_t block_idx = bgzf_block_index(bgzf, offset >> 16);
+    size_t in_block_offset = (size_t) (offset & 0xffff);
+    long lines_left = lines_per_offset;
+
+    /* a record inside one cached block is handed back as it is; one that runs on past its block is copied out */
+    *record_len = 0;
+    while ((lines_left > 0) && (block_idx < bgzf->num_blocks)) {
+        data = bgzf_block_data(bgzf, block_idx, &data_len);
+        if (!data) {
+            fprintf(stderr, "Error: Could not inflate BGZF block at offset %llu (%s)\n", (unsigned long long) bgzf->blocks[block_idx].offset, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        record_stop = newline_scan_nth(data + in_block_offset, data + data_len, lines_left);
+        piece_len = ((record_stop) ? (size_t) (record_stop + 1 - data) : data_len) - in_block_offset;
+        if ((record_stop) && (*record_len == 0)) {
+            *record_len = piece_len;
+            return data + in_block_offset;
+        }
+        if (*record_len + piece_len > *scratch_capacity) {
+            *scratch_capacity = (*record_len + piece_len) * 2;
+            resized_scratch = realloc(*scratch, *scratch_capacity);
+            if (!resized_scratch) {
+                fprintf(stderr, "Error: Could not allocate memory for BGZF record\n");
+                exit(EXIT_FAILURE);
+            }
+            *scratch = resized_scratch;
+            run_stats_add(&sample_stats.reallocations, 1);
+        }
+        memcpy(*scratch + *record_len, data + in_block_offset, piece_len);
+        *record_len += piece_len;
+        if (record_stop)
+            break;
+        lines_left -= (long) newline_scan_count(data + in_block_offset, piece_len);
+        block_idx++;
+        in_block_offset = 0;
+    }
+
+    return *scratch;
+}
+
+const char * read_gzip_record(void *reader_ptr, const uint64_t offset, const int lines_per_offset, char **scratch, size_t *scratch_capacity, size_t *record_len)
+{
+    gzip_reader *reader = reader_ptr;
+    const char *data = NULL;
+    const char *record_stop = NULL;
+    char *resized_scratch = NULL;
+    size_t data_len = 0;
+    size_t piece_len = 0;
+    uint64_t position = offset;
+    long lines_left = lines_per_offset;
+
+    /* a record inside the reader's buffer is handed back as it is; one that runs past it is copied out */
+    *record_len = 0;
+    while (lines_left > 0) {
+        if (gzip_reader_data(reader, position, &data, &data_len) == -1) {
+            fprintf(stderr, "Error: Could not inflate gzip input (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (data_len == 0)
+            break;
+        record_stop = newline_scan_nth(data, data + data_len, lines_left);
+        piece_len = (record_stop) ? (size_t) (record_stop + 1 - data) : data_len;
+        if ((record_stop) && (*record_len == 0)) {
+            *record_len = piece_len;
+            return data;
+        }
+        if (*record_len + piece_len > *scratch_capacity) {
+            *scratch_capacity = (*record_len + piece_len) * 2;
+            resized_scratch = realloc(*scratch, *scratch_capacity);
+            if (!resized_scratch) {
+                fprintf(stderr, "Error: Could not allocate memory for gzip record\n");
+                exit(EXIT_FAILURE);
+            }
+            *scratch = resized_scratch;
+        }
+        memcpy(*scratch + *record_len, data, piece_len);
+        *record_len += piece_len;
+        if (record_stop)
+            break;
+        lines_left -= (long) newline_scan_count(data, piece_len);
+        position += piece_len;
+    }
+
+    return *scratch;
+}
+
+void print_offset_reservoir_sample_via_gzip(void *gz_ptr, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_sample_via_gzip()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    gzip_reader reader;
+
+    if (gzip_reader_init(&reader, gz_ptr) == -1) {
+        fprintf(stderr, "Error: Could not allocate memory for gzip inflation\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the reader goes forward through the data, resuming from a checkpoint to jump ahead */
+    print_offset_reservoir_records(&reader, read_gzip_record, res_ptr, lines_per_offset, sorted, num_threads);
+    gzip_reader_end(&reader);
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_sample_via_gzip()\n");
+#endif
+}
+
+void print_offset_reservoir_records(void *reader_ptr, offset_record_reader reader, offset_reservoir *res_ptr, const int lines_per_offset, const boolean sorted, const int num_threads)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_offset_reservoir_records()\n");
+#endif
+
+    long res_idx;
+    const char *record = NULL;
+    char *scratch = NULL;
+    size_t scratch_capacity = 0;
+    size_t record_len = 0;
+    uint64_t *sorted_offsets = NULL;
+    uint64_t offset = 0;
+    long num_sorted = 0;
+    long lo = 0;
+    long hi = 0;
+    long mid = 0;
+    record_arena *arena = NULL;
+    output_buffer *ob = NULL;
+
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* in sorted order, each record is written out as it is read */
+    if (sorted) {
+        for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
+            record = reader(reader_ptr, (uint64_t) offset_reservoir_get(res_ptr, res_idx), lines_per_offset, &scratch, &scratch_capacity, &record_len);
+            if (output_buffer_append(ob, record, record_len) == -1) {
+                fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    /* 
+       otherwise, the distinct offsets are read in sorted order all the same, and their 
+       records are held in an arena until they can be written out in sample order
+    */
+    else {
+        sorted_offsets = malloc(sizeof(uint64_t) * (res_ptr->num_offsets > 0 ? res_ptr->num_offsets : 1));
+        arena = new_record_arena(RECORD_ARENA_DEFAULT_CAPACITY, RECORD_ARENA_DEFAULT_SLOTS);
+        if ((!sorted_offsets) || (!arena)) {
+            fprintf(stderr, "Error: Could not allocate memory for sampled records\n");
+            exit(EXIT_FAILURE);
+        }
+        for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx)
+            sorted_offsets[res_idx] = (uint64_t) offset_reservoir_get(res_ptr, res_idx);
+        if (radix_sort_uint64(sorted_offsets, (size_t) res_ptr->num_offsets, num_threads) == -1) {
+            fprintf(stderr, "Error: Could not allocate memory for sorting offsets\n");
+            exit(EXIT_FAILURE);
+        }
+        for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx)
+            if ((num_sorted == 0) || (sorted_offsets[res_idx] != sorted_offsets[num_sorted - 1]))
+                sorted_offsets[num_sorted++] = sorted_offsets[res_idx];
+        for (res_idx = 0; res_idx < num_sorted; ++res_idx) {
+            record = reader(reader_ptr, sorted_offsets[res_idx], lines_per_offset, &scratch, &scratch_capacity, &record_len);
+            if ((record_arena_extend(arena, record, record_len) == -1) || (record_arena_commit(arena, res_idx, (uint64_t) res_idx) == -1)) {
+                fprintf(stderr, "Error: Could not allocate memory for sampled records\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
+            offset = (uint64_t) offset_reservoir_get(res_ptr, res_idx);
+            for (lo = 0, hi = num_sorted; lo < hi; ) {
+                mid = lo + (hi - lo) / 2;
+                if (sorted_offsets[mid] < offset)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            record = record_arena_record(arena, lo, &record_len);
+            if (output_buffer_append(ob, record, record_len) == -1) {
+                fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr) + arena->peak_capacity + sizeof(record_slot) * arena->slot_capacity);
+        delete_record_arena(&arena);
+        free(sorted_offsets);
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    free(scratch);
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_offset_reservoir_records()\n");
+#endif
+}
+
+void print_sorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_sorted_offset_reservoir_sample_via_cstdio()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    int idx;
+    char in_line[LINE_LENGTH_VALUE + 1];
+    char temp_line[LINE_LENGTH_VALUE + 1];
+    off_t previous_offset = 0;
+    size_t previous_line_length = 0;
+    long ln_idx = 0;
+    int temp_length = 0;
+    struct stat in_file_stat;
+
+    /* position the file pointer at the start of the file */
+    if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
+        fprintf(stderr, "Error: Could not rewind input file pointer\n");
+        exit(EXIT_FAILURE);
+    }
+    if (fstat(fileno(in_file_ptr), &in_file_stat) == 0)
+        access_policy_apply(NULL, 0, fileno(in_file_ptr), access_policy_for_sample((size_t) in_file_stat.st_size, res_ptr->num_offsets, kTrue));
+
+    for (idx = 0; idx < res_ptr->num_offsets; ++idx) {
+        /* 
+           we use SEEK_CUR to jump from wherever the file pointer is now, instead of 
+           from the start of the file -- we can do this because the offsets are in
+           sorted order
+        */
+        fseek(in_file_ptr, offset_reservoir_get(res_ptr, idx) - previous_offset - previous_line_length, SEEK_CUR);
+        for (ln_idx = 0; ln_idx < lines_per_offset; ++ln_idx) {
+            fgets(temp_line, LINE_LENGTH_VALUE + 1, in_file_ptr);
+            memcpy(in_line + temp_length, temp_line, strlen(temp_line));
+            temp_length += strlen(temp_line);
+        }
+        in_line[temp_length] = '\0';
+        fprintf(stdout, "%s", in_line);
+        sample_stats.output_bytes += temp_length;
+        previous_line_length = strlen(in_line);
+        previous_offset = offset_reservoir_get(res_ptr, idx);
+        temp_length = 0;
+    }
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_sorted_offset_reservoir_sample_via_cstdio()\n");
+#endif
+}
+
+void print_unsorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_unsorted_offset_reservoir_sample_via_cstdio()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    int idx;
+    long ln_idx = 0;
+    char in_line[LINE_LENGTH_VALUE + 1];
+    char temp_line[LINE_LENGTH_VALUE + 1];
+    int temp_length = 0;
+    struct stat in_file_stat;
+    access_prefetch prefetch;
+    access_pattern pattern = kAccessNormal;
+    long prefetch_window = 0;
+    long prefetch_idx = 0;
+
+    /* position the file pointer at the start of the file */
+    if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
+        fprintf(stderr, "Error: Could not rewind input file pointer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* as with a mapped file, the pages of a sparse sample are asked for ahead of their reads */
+    if (fstat(fileno(in_file_ptr), &in_file_stat) == 0) {
+        pattern = access_policy_for_sample((size_t) in_file_stat.st_size, res_ptr->num_offsets, kFalse);
+        access_policy_apply(NULL, 0, fileno(in_file_ptr), pattern);
+        access_prefetch_init(&prefetch, NULL, (size_t) in_file_stat.st_size, fileno(in_file_ptr));
+        prefetch_window = (pattern == kAccessRandom) ? access_prefetch_window(sample_global_args.prefetch_window, res_ptr->num_offsets) : 0;
+    }
+
+    for (idx = 0; idx < res_ptr->num_offsets; ++idx) {
+        for (; (prefetch_window > 0) && (prefetch_idx < res_ptr->num_offsets) && (prefetch_idx <= idx + prefetch_window); ++prefetch_idx)
+            access_prefetch_hint(&prefetch, (uint64_t) offset_reservoir_get(res_ptr, prefetch_idx));
+        if ((prefetch_window > 0) && (prefetch_idx == res_ptr->num_offsets))
+            access_prefetch_flush(&prefetch);
+        /* 
+           we use SEEK_SET to jump from the start of the file, as the offsets are unsorted
+        */
+        fseek(in_file_ptr, offset_reservoir_get(res_ptr, idx), SEEK_SET);
+        for (ln_idx = 0; ln_idx < lines_per_offset; ++ln_idx) {
+            fgets(temp_line, LINE_LENGTH_VALUE + 1, in_file_ptr);
+            memcpy(in_line + temp_length, temp_line, strlen(temp_line));
+            temp_length += strlen(temp_line);
+        }
+        in_line[temp_length] = '\0';
+        fprintf(stdout, "%s", in_line);
+        sample_stats.output_bytes += temp_length;
+        temp_length = 0;
+    }
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr));
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_unsorted_offset_reservoir_sample_via_cstdio()\n");
+#endif
+}
+
+void sample_records_via_stdin_stream(record_arena *arena, const long k, const int lines_per_offset, const boolean keep_all)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_records_via_stdin_stream()\n");
+#endif
+
+    char *block = NULL;
+    ssize_t block_len = 0;
+    size_t newline_positions[NEWLINE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+    size_t grp_start = 0;
+    size_t grp_stop = 0;
+    long ln_idx = 0;
+    long grp_idx = 0;
+    long next_grp_idx = 0;
+    long slot_idx = 0;
+    double w = 0.0;
+    boolean keep_grp = ((keep_all) || (k > 0)) ? kTrue : kFalse;
+
+    block = malloc(STDIN_STREAM_BLOCK_SIZE);
+    if (!block) {
+        fprintf(stderr, "Error: Could not allocate memory for standard input block\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* 
+       the keep-or-skip decision for a line-grouping is made when it starts, so that the 
+       bytes of a skipped grouping are never copied, and those of a kept one are copied 
+       into the arena a block at a time until its last newline turns up
+    */
+    while ((block_len = read(STDIN_FILENO, block, STDIN_STREAM_BLOCK_SIZE)) != 0) 
+        {
+            if (block_len < 0) {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "Error: Could not read standard input (%s)\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            sample_stats.bytes_scanned += (unsigned long long) block_len;
+            scan_offset = 0;
+            grp_start = 0;
+            while (scan_offset < (size_t) block_len) 
+                {
+                    num_positions = newline_scan_positions(block + scan_offset, block_len - scan_offset, newline_positions, NEWLINE_POSITION_BATCH_SIZE, &scanned);
+                    for (position_idx = 0; position_idx < num_positions; ++position_idx) 
+                        {
+                            if ((++ln_idx) % lines_per_offset)
+                                continue;
+
+                            grp_stop = scan_offset + newline_positions[position_idx] + 1;
+                            if (keep_grp) {
+                                if ((keep_all) || (grp_idx < k))
+                                    slot_idx = grp_idx;
+                                else {
+                                    slot_idx = rng_bounded_modulo(&rng_global_state, k);
+                                    w = algorithm_l_next_weight(&rng_global_state, w, k);
+                                    next_grp_idx = algorithm_l_next_index(&rng_global_state, grp_idx, w);
+                                }
+                                if ((record_arena_extend(arena, block + grp_start, grp_stop - grp_start) == -1) || 
+                                    (record_arena_commit(arena, slot_idx, grp_idx) == -1)) {
+                                    fprintf(stderr, "Error: Could not allocate memory for record arena\n");
+                                    exit(EXIT_FAILURE);
+                                }
+                            }
+                            grp_start = grp_stop;
+                            grp_idx++;
+
+                            /* once the reservoir is full, draw the first skip */
+                            if ((!keep_all) && (grp_idx == k)) {
+                                w = algorithm_l_initial_weight(&rng_global_state, k);
+                                next_grp_idx = algorithm_l_next_index(&rng_global_state, grp_idx - 1, w);
+                            }
+                            keep_grp = ((keep_all) || (grp_idx < k) || (grp_idx == next_grp_idx)) ? kTrue : kFalse;
+                        }
+                    scan_offset += scanned;
+                }
+
+            /* a kept line-grouping that runs past the end of the block carries over to the next read */
+            if ((keep_grp) && (grp_start < (size_t) block_len)) {
+                if (record_arena_extend(arena, block + grp_start, block_len - grp_start) == -1) {
+                    fprintf(stderr, "Error: Could not allocate memory for record arena\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+    /* as with a mapped file, a line-grouping without its final newline is left out */
+    record_arena_discard(arena);
+    free(block);
+    sample_stats.records_seen += (unsigned long long) grp_idx;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Record arena holds %ld records of mean length %.1f bytes in %zu bytes (peak %zu bytes, %lu compactions) for k = %ld\n", 
+            arena->num_slots, 
+            (arena->num_slots > 0) ? (double) arena->live_bytes / arena->num_slots : 0.0, 
+            arena->size, 
+            arena->peak_capacity, 
+            arena->compactions, 
+            (keep_all) ? arena->num_slots : k);
+    fprintf(stderr, "Debug: Leaving  --> sample_records_via_stdin_stream()\n");
+#endif
+}
+
+offset_reservoir * new_record_arena_slot_reservoir_ptr(const record_arena *arena)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_record_arena_slot_reservoir_ptr()\n");
+#endif
+
+    offset_reservoir *res = NULL;
+    long slot_idx = 0;
+
+    /* the offsets of a streamed sample are arena slot numbers, so the reservoir shuffle and sort routines apply as-is */
+    res = new_offset_reservoir_ptr((arena->num_slots > 0) ? arena->num_slots : 1, select_offset_encoding((off_t) arena->num_slots, kFalse));
+    res->num_offsets = arena->num_slots;
+    for (slot_idx = 0; slot_idx < arena->num_slots; ++slot_idx)
+        offset_reservoir_set(res, slot_idx, slot_idx);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_record_arena_slot_reservoir_ptr()\n");
+#endif
+
+    return res;
+}
+
+void print_record_arena_sample(const record_arena *arena, const offset_reservoir *res_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_record_arena_sample()\n");
+#endif
+
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsEmit);
+    long res_idx;
+    const char *record = NULL;
+    size_t record_len = 0;
+    output_buffer *ob = NULL;
+
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (res_idx = 0; res_idx < res_ptr->num_offsets; ++res_idx) {
+        record = record_arena_record(arena, (long) offset_reservoir_get(res_ptr, res_idx), &record_len);
+        if (output_buffer_append(ob, record, record_len) == -1) {
+            fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (output_buffer_flush(ob) == -1) {
+        fprintf(stderr, "Error: Could not write sample to standard output (%s)\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    for (idx = 0; idx < res_ptr->num_offsets; ++idx) {
-        /* 
-           we use SEEK_CUR to jump from wherever the file pointer is now, instead of 
-           from the start of the file -- we can do this because the offsets are in
-           sorted order
-        */
-        fseek(in_file_ptr, res_ptr->offsets[idx] - previous_offset - previous_line_length, SEEK_CUR);
-        for (ln_idx = 0; ln_idx < lines_per_offset; ++ln_idx) {
-            fgets(temp_line, LINE_LENGTH_VALUE + 1, in_file_ptr);
-            memcpy(in_line + temp_length, temp_line, strlen(temp_line));
-            temp_length += strlen(temp_line);
-        }
-        in_line[temp_length] = '\0';
-        fprintf(stdout, "%s", in_line);
-        previous_line_length = strlen(in_line);
-        previous_offset = res_ptr->offsets[idx];
-        temp_length = 0;
-    }
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+    run_stats_peak(&sample_stats.reservoir_bytes, offset_reservoir_bytes(res_ptr) + arena->peak_capacity + sizeof(record_slot) * arena->slot_capacity);
+    run_stats_leave(&sample_stats, previous_phase);
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> print_sorted_offset_reservoir_sample_via_cstdio()\n");
+    fprintf(stderr, "Debug: Leaving  --> print_record_arena_sample()\n");
 #endif
 }
 
-void print_unsorted_offset_reservoir_sample_via_cstdio(FILE *in_file_ptr, offset_reservoir *res_ptr, const int lines_per_offset)
+void shuffle_records_via_external_buckets(const int in_fd, const int lines_per_offset, const size_t max_memory)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> print_unsorted_offset_reservoir_sample_via_cstdio()\n");
+    fprintf(stderr, "Debug: Entering --> shuffle_records_via_external_buckets()\n");
 #endif
 
-    int idx;
-    long ln_idx = 0;
-    char in_line[LINE_LENGTH_VALUE + 1];
-    char temp_line[LINE_LENGTH_VALUE + 1];
-    int temp_length = 0;
+    run_stats_phase previous_phase = run_stats_enter(&sample_stats, kRunStatsShuffle);
+    const char *temp_dir = getenv("TMPDIR");
+    output_buffer *ob = NULL;
 
-    /* position the file pointer at the start of the file */
-    if (fseek(in_file_ptr, 0, SEEK_SET) == -1) {
-        fprintf(stderr, "Error: Could not rewind input file pointer\n");
+    if ((!temp_dir) || (temp_dir[0] == '\0'))
+        temp_dir = "/tmp";
+
+    fflush(stdout);
+
+    ob = new_output_buffer(STDOUT_FILENO, OUTPUT_BUFFER_DEFAULT_CAPACITY);
+    if (!ob) {
+        fprintf(stderr, "Error: Could not allocate output buffer\n");
         exit(EXIT_FAILURE);
     }
-
-    for (idx = 0; idx < res_ptr->num_offsets; ++idx) {
-        /* 
-           we use SEEK_SET to jump from the start of the file, as the offsets are unsorted
-        */
-        fseek(in_file_ptr, res_ptr->offsets[idx], SEEK_SET);
-        for (ln_idx = 0; ln_idx < lines_per_offset; ++ln_idx) {
-            fgets(temp_line, LINE_LENGTH_VALUE + 1, in_file_ptr);
-            memcpy(in_line + temp_length, temp_line, strlen(temp_line));
-            temp_length += strlen(temp_line);
-        }
-        in_line[temp_length] = '\0';
-        fprintf(stdout, "%s", in_line);
-        temp_length = 0;
+    if ((external_shuffle(in_fd, ob, lines_per_offset, max_memory, temp_dir, &rng_global_state) == -1) || 
+        (output_buffer_flush(ob) == -1)) {
+        fprintf(stderr, "Error: Could not shuffle input within memory budget, using temporary directory [%s] (%s)\n", temp_dir, strerror(errno));
+        exit(EXIT_FAILURE);
     }
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> print_unsorted_offset_reservoir_sample_via_cstdio()\n");
+    fprintf(stderr, "Debug: Emitted %llu records (%llu bytes) at %.2f MB/s\n", ob->records_written, ob->bytes_written, ob->bytes_written / 1e6 / (output_buffer_elapsed_seconds(ob) + 1e-9));
+#endif
+
+    sample_stats.output_bytes += ob->bytes_written;
+    delete_output_buffer(&ob);
+
+    run_stats_leave(&sample_stats, previous_phase);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> shuffle_records_via_external_buckets()\n");
 #endif
 }
 
@@ -669,6 +4487,10 @@ FILE * new_file_ptr(const char *in_fn)
         exit(EXIT_FAILURE);
     }
 
+    /* a file is opened to be scanned; the printers advise it again for writing the sample out */
+    if (file_ptr)
+        access_policy_apply(NULL, 0, fileno(file_ptr), kAccessSequential);
+
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> new_file_ptr()\n");
 #endif
@@ -676,6 +4498,114 @@ FILE * new_file_ptr(const char *in_fn)
     return file_ptr;
 }
 
+input_set * new_input_set(char **filenames, const int num_files)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_input_set()\n");
+#endif
+
+    input_set *set = NULL;
+    struct stat file_stat;
+    int file_idx = 0;
+
+    set = calloc(1, sizeof(input_set));
+    if (set) {
+        set->bases = malloc(sizeof(off_t) * num_files);
+        set->sizes = malloc(sizeof(off_t) * num_files);
+        set->mappings = calloc(num_files, sizeof(file_mmap *));
+        set->last_used = calloc(num_files, sizeof(unsigned long));
+        set->mapped = malloc(sizeof(int) * INPUT_SET_MAX_MAPPINGS);
+    }
+    if ((!set) || (!set->bases) || (!set->sizes) || (!set->mappings) || (!set->last_used) || (!set->mapped)) {
+        fprintf(stderr, "Error: Could not allocate memory for input file set\n");
+        exit(EXIT_FAILURE);
+    }
+    set->num_files = num_files;
+    set->filenames = filenames;
+    set->max_mapped = INPUT_SET_MAX_MAPPINGS;
+
+    /* files are only stat'ed here -- each is mapped when it is first needed */
+    for (file_idx = 0; file_idx < num_files; ++file_idx) {
+        if (stat(filenames[file_idx], &file_stat) == -1) {
+            fprintf(stderr, "Error: Could not open input file [%s] (%s)\n", filenames[file_idx], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        set->bases[file_idx] = set->total_size;
+        set->sizes[file_idx] = file_stat.st_size;
+        set->total_size += file_stat.st_size;
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_input_set()\n");
+#endif
+
+    return set;
+}
+
+void delete_input_set(input_set **set_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> delete_input_set()\n");
+#endif
+
+    int mapped_idx = 0;
+
+    for (mapped_idx = 0; mapped_idx < (*set_ptr)->num_mapped; ++mapped_idx)
+        delete_file_mmap(&((*set_ptr)->mappings[(*set_ptr)->mapped[mapped_idx]]));
+    free((*set_ptr)->mapped);
+    free((*set_ptr)->last_used);
+    free((*set_ptr)->mappings);
+    free((*set_ptr)->sizes);
+    free((*set_ptr)->bases);
+    free(*set_ptr);
+    *set_ptr = NULL;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> delete_input_set()\n");
+#endif
+}
+
+const file_mmap * input_set_mmap(input_set *set, const int file_idx)
+{
+    int mapped_idx = 0;
+    int oldest_idx = 0;
+
+    set->last_used[file_idx] = ++set->clock;
+    if (set->mappings[file_idx])
+        return set->mappings[file_idx];
+
+    /* give up the least recently used mapping, if there is no room for another */
+    if (set->num_mapped == set->max_mapped) {
+        for (mapped_idx = 1; mapped_idx < set->num_mapped; ++mapped_idx)
+            if (set->last_used[set->mapped[mapped_idx]] < set->last_used[set->mapped[oldest_idx]])
+                oldest_idx = mapped_idx;
+        delete_file_mmap(&(set->mappings[set->mapped[oldest_idx]]));
+        set->mapped[oldest_idx] = set->mapped[--set->num_mapped];
+    }
+    set->mappings[file_idx] = new_file_mmap(set->filenames[file_idx]);
+    set->mapped[set->num_mapped++] = file_idx;
+
+    return set->mappings[file_idx];
+}
+
+int input_set_file_index(const input_set *set, const off_t offset)
+{
+    int lo = 0;
+    int hi = set->num_files - 1;
+    int mid = 0;
+
+    /* the last file starting at or before the offset -- an empty file shares its start with the next one */
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (set->bases[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
 void delete_file_ptr(FILE **file_ptr)
 {
 #ifdef DEBUG
@@ -733,6 +4663,9 @@ file_mmap * new_file_mmap(const char *in_fn)
         exit(EXIT_FAILURE);
     }
 
+    /* as with a file pointer, the mapping is scanned first, for deep readahead */
+    access_policy_apply(mmap_ptr->map, mmap_ptr->size, mmap_ptr->fd, kAccessSequential);
+
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> new_file_mmap()\n");
 #endif
@@ -758,6 +4691,79 @@ void delete_file_mmap(file_mmap **mmap_ptr)
 #endif
 }
 
+size_t parse_byte_count(const char *arg)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> parse_byte_count()\n");
+#endif
+
+    char *suffix = NULL;
+    unsigned long long count = 0;
+    unsigned long long scale = 1;
+    size_t num_bytes = 0;
+
+    /* a count of bytes, with an optional binary suffix -- zero means the argument could not be read */
+    errno = 0;
+    count = strtoull(arg, &suffix, 10);
+    if ((errno == 0) && (suffix != arg) && (arg[0] != '-')) {
+        switch (*suffix) {
+        case 'T': case 't':
+            scale <<= 10;
+            /* fall through */
+        case 'G': case 'g':
+            scale <<= 10;
+            /* fall through */
+        case 'M': case 'm':
+            scale <<= 10;
+            /* fall through */
+        case 'K': case 'k':
+            scale <<= 10;
+            suffix++;
+            break;
+        default:
+            break;
+        }
+        if ((*suffix == '\0') && (count <= SIZE_MAX / scale))
+            num_bytes = (size_t) (count * scale);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> parse_byte_count()\n");
+#endif
+
+    return num_bytes;
+}
+
+int parse_byte_range(const char *arg, size_t *start, size_t *stop)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> parse_byte_range()\n");
+#endif
+
+    const char *separator = strchr(arg, ':');
+    char *start_arg = NULL;
+    int result = -1;
+
+    /* start:end, where either count may be 0 -- which parse_byte_count() takes as unreadable -- and end may be left out */
+    if ((separator) && ((start_arg = malloc(separator - arg + 1)))) {
+        memcpy(start_arg, arg, separator - arg);
+        start_arg[separator - arg] = '\0';
+        *start = (strcmp(start_arg, "0") == 0) ? 0 : parse_byte_count(start_arg);
+        if ((*start != 0) || (strcmp(start_arg, "0") == 0)) {
+            *stop = (*(separator + 1) == '\0') ? SIZE_MAX : parse_byte_count(separator + 1);
+            if (*stop > *start)
+                result = 0;
+        }
+        free(start_arg);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> parse_byte_range()\n");
+#endif
+
+    return result;
+}
+
 void initialize_globals()
 {
 #ifdef DEBUG
@@ -773,8 +4779,30 @@ void initialize_globals()
     sample_global_args.cstdio = kFalse;
     sample_global_args.k = 0;
     sample_global_args.lines_per_offset = 1;
+    sample_global_args.num_threads = 1;
+    sample_global_args.build_index = kFalse;
+    sample_global_args.ignore_index = kFalse;
     sample_global_args.rng_seed_value = 1;
     sample_global_args.rng_seed_specified = kFalse;
+    sample_global_args.total_records = 0;
+    sample_global_args.total_records_specified = kFalse;
+    sample_global_args.max_memory = 0;
+    sample_global_args.max_memory_specified = kFalse;
+    sample_global_args.checkpoint_span = GZIP_INDEX_DEFAULT_SPAN;
+    sample_global_args.weight.kind = kWeightNone;
+    sample_global_args.weight.column = 0;
+    sample_global_args.stratify_column = 0;
+    sample_global_args.allocation = kStratumAllocationFixed;
+    sample_global_args.byte_range_start = 0;
+    sample_global_args.byte_range_stop = SIZE_MAX;
+    sample_global_args.byte_range_specified = kFalse;
+    sample_global_args.state_filename = NULL;
+    sample_global_args.stats = kFalse;
+    sample_global_args.stats_json = kFalse;
+    sample_global_args.prefetch_window = ACCESS_PREFETCH_DEFAULT_WINDOW;
+    sample_global_args.merged_filename = NULL;
+    sample_global_args.drop_cache = kFalse;
+    sample_global_args.rng = kRngMt19937;
     sample_global_args.filenames = NULL;
     sample_global_args.num_filenames = 0;
 
@@ -783,6 +4811,57 @@ void initialize_globals()
 #endif
 }
 
+void print_sample_stats()
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> print_sample_stats()\n");
+#endif
+
+    sample_stats.rng_draws += rng_num_draws(&rng_global_state);
+    run_stats_report(&sample_stats, stderr);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> print_sample_stats()\n");
+#endif
+}
+
+void release_input_pages()
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> release_input_pages()\n");
+#endif
+
+    int filename_idx = 0;
+    int fd = -1;
+
+    /* 
+       this runs at exit, and not as each mapping is let go, as a file that is mapped, 
+       unmapped and mapped again within a run would otherwise be read from disk twice
+    */
+    if (sample_global_args.merge_states) {
+        fd = (sample_global_args.merged_filename) ? open(sample_global_args.merged_filename, O_RDONLY) : -1;
+        if (fd != -1) {
+            access_policy_release(fd);
+            close(fd);
+        }
+        free(sample_global_args.merged_filename);
+        sample_global_args.merged_filename = NULL;
+    }
+    for (filename_idx = 0; (!sample_global_args.merge_states) && (filename_idx < sample_global_args.num_filenames); ++filename_idx) {
+        if (strcmp(sample_global_args.filenames[filename_idx], "-") == 0)
+            continue;
+        fd = open(sample_global_args.filenames[filename_idx], O_RDONLY);
+        if (fd == -1)
+            continue;
+        access_policy_release(fd);
+        close(fd);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> release_input_pages()\n");
+#endif
+}
+
 void parse_command_line_options(int argc, char **argv)
 {
 #ifdef DEBUG
@@ -800,6 +4879,8 @@ void parse_command_line_options(int argc, char **argv)
     int sample_type_flags = 0;
     int io_type_flags = 0;
     int sample_size_flag = kFalse;
+    int filename_idx = 0;
+    char *prefetch_stop = NULL;
 
     opterr = 0; /* disable error reporting by GNU getopt */
     initialize_globals();
@@ -860,6 +4941,16 @@ void parse_command_line_options(int argc, char **argv)
                     sample_global_args.mmap = kFalse;
                     io_type_flags++;
                     break;
+                case 't':
+		    if (optarg) {
+			sample_global_args.num_threads = atoi(optarg);
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Threads option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
                 case 'd':
 		    if (optarg) {
 			sample_global_args.rng_seed_value = atoi(optarg);
@@ -871,6 +4962,145 @@ void parse_command_line_options(int argc, char **argv)
 			print_usage(stderr);
 			exit(EXIT_FAILURE);
 		    }
+                case 'g':
+		    if ((optarg) && (rng_kind_from_name(optarg, &sample_global_args.rng) == 0))
+			break;
+		    else {
+			fprintf(stderr, "Error: RNG option is specified, but its value is not one of mt19937, mt19937-block, xoshiro256, pcg64 or philox\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'N':
+		    if (optarg) {
+			sample_global_args.total_records = atol(optarg);
+			sample_global_args.total_records_specified = kTrue;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Total records option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'S':
+		    if (optarg) {
+			sample_global_args.checkpoint_span = parse_byte_count(optarg);
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Checkpoint span option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'w':
+		    if (optarg) {
+			sample_global_args.weight.kind = kWeightColumn;
+			sample_global_args.weight.column = atoi(optarg);
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Weight column option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'W':
+		    if ((optarg) && (strcmp(optarg, "length") == 0)) {
+			sample_global_args.weight.kind = kWeightLength;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Weight option is specified, but its value is not length\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'f':
+		    if (optarg) {
+			sample_global_args.stratify_column = atoi(optarg);
+			if (sample_global_args.stratify_column < 1) {
+			    print_usage(stderr);
+			    exit(EXIT_FAILURE);
+			}
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Stratify column option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'A':
+		    if ((optarg) && (strcmp(optarg, "fixed") == 0)) {
+			sample_global_args.allocation = kStratumAllocationFixed;
+			break;
+		    }
+		    else if ((optarg) && (strcmp(optarg, "proportional") == 0)) {
+			sample_global_args.allocation = kStratumAllocationProportional;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Allocation option is specified, but its value is not one of fixed or proportional\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'B':
+		    if ((optarg) && (parse_byte_range(optarg, &sample_global_args.byte_range_start, &sample_global_args.byte_range_stop) == 0)) {
+			sample_global_args.byte_range_specified = kTrue;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Byte range option is specified, but its value is not of the form start:end, with start before end\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'T':
+		    if (optarg) {
+			sample_global_args.state_filename = optarg;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Save state option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'Q':
+		    if ((!optarg) || (strcmp(optarg, "json") == 0)) {
+			sample_global_args.stats = kTrue;
+			sample_global_args.stats_json = (optarg) ? kTrue : kFalse;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Stats option is specified, but its value is not json\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'P':
+		    errno = 0;
+		    if ((optarg) && (optarg[0] >= '0') && (optarg[0] <= '9')) {
+			sample_global_args.prefetch_window = strtol(optarg, &prefetch_stop, 10);
+			if ((errno == 0) && (*prefetch_stop == '\0'))
+			    break;
+		    }
+		    fprintf(stderr, "Error: Prefetch option is specified, but its value is not a count of records\n");
+		    print_usage(stderr);
+		    exit(EXIT_FAILURE);
+                case 'D':
+                    sample_global_args.drop_cache = kTrue;
+                    break;
+                case 'M':
+		    if (optarg) {
+			sample_global_args.max_memory = parse_byte_count(optarg);
+			sample_global_args.max_memory_specified = kTrue;
+			break;
+		    }
+		    else {
+			fprintf(stderr, "Error: Memory budget option is specified, but its value is unspecified\n");
+			print_usage(stderr);
+			exit(EXIT_FAILURE);
+		    }
+                case 'b':
+                    sample_global_args.build_index = kTrue;
+                    break;
+                case 'n':
+                    sample_global_args.ignore_index = kTrue;
+                    break;
                 case 'v':
                     print_version(stdout);
                     exit(EXIT_SUCCESS);
@@ -904,14 +5134,71 @@ void parse_command_line_options(int argc, char **argv)
         (sample_type_flags > 1) ||
         (io_type_flags > 1) ||
         (sample_global_args.lines_per_offset < 1) ||
+        (sample_global_args.num_threads < 1) ||
         (sample_global_args.k < 1) ||
-        (sample_global_args.num_filenames != 1) ||
-        (sample_global_args.rng_seed_value < 1))
+        (sample_global_args.num_filenames < 1) ||
+        (sample_global_args.checkpoint_span < 1) ||
+        ((sample_global_args.weight.kind == kWeightColumn) && (sample_global_args.weight.column < 1)) ||
+        (sample_global_args.rng_seed_value < 1) ||
+        ((sample_global_args.total_records_specified) && (sample_global_args.total_records < 1)))
         {
             print_usage(stderr);
             exit(EXIT_FAILURE);
         }
 
+    if (sample_global_args.num_filenames > 1) {
+        for (filename_idx = 0; filename_idx < sample_global_args.num_filenames; ++filename_idx) {
+            if (strcmp(sample_global_args.filenames[filename_idx], "-") == 0) {
+                fprintf(stderr, "Error: Standard input cannot be sampled along with other input files\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if ((sample_global_args.cstdio) || (sample_global_args.hybrid) || (sample_global_args.max_memory_specified)) {
+            fprintf(stderr, "Error: Several input files can only be sampled with --mmap, and without --max-memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((sample_global_args.weight.kind != kWeightNone) || (sample_global_args.stratify_column > 0)) {
+        if ((sample_global_args.weight.kind != kWeightNone) && (sample_global_args.stratify_column > 0)) {
+            fprintf(stderr, "Error: A sample cannot be both weighted and stratified\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((!sample_global_args.sample_size_specified) || (sample_global_args.sample_with_replacement)) {
+            fprintf(stderr, "Error: A weighted or stratified sample is drawn without replacement, and needs a sample size\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((sample_global_args.num_filenames > 1) || (strcmp(sample_global_args.filenames[0], "-") == 0) || (sample_global_args.cstdio) || (sample_global_args.hybrid)) {
+            fprintf(stderr, "Error: A weighted or stratified sample is drawn from one input file, with --mmap\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((sample_global_args.byte_range_specified) || (sample_global_args.state_filename) || (sample_global_args.merge_states)) {
+        if ((sample_global_args.weight.kind != kWeightNone) || (sample_global_args.stratify_column > 0) || (sample_global_args.sample_with_replacement)) {
+            fprintf(stderr, "Error: A sharded, saved or merged sample is drawn without replacement, and is neither weighted nor stratified\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((sample_global_args.merge_states) && ((sample_global_args.byte_range_specified) || (sample_global_args.state_filename))) {
+            fprintf(stderr, "Error: Saved samples are merged whole, and the merge cannot itself be saved\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((!sample_global_args.merge_states) && ((sample_global_args.num_filenames > 1) || (strcmp(sample_global_args.filenames[0], "-") == 0) || (sample_global_args.cstdio) || (sample_global_args.hybrid) || (sample_global_args.max_memory_specified))) {
+            fprintf(stderr, "Error: A sharded or saved sample is drawn from one input file, with --mmap, and without --max-memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((sample_global_args.max_memory_specified) && ((sample_global_args.sample_size_specified) || (sample_global_args.preserve_order) || (sample_global_args.sample_with_replacement))) {
+        fprintf(stderr, "Error: A memory budget applies to a whole-input shuffle, without --sample-size, --preserve-order or --sample-with-replacement\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((sample_global_args.max_memory_specified) && (sample_global_args.max_memory < EXTERNAL_SHUFFLE_MINIMUM_MEMORY)) {
+        fprintf(stderr, "Error: Memory budget must be at least %d bytes\n", EXTERNAL_SHUFFLE_MINIMUM_MEMORY);
+        exit(EXIT_FAILURE);
+    }
+
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> parse_command_line_options()\n");
 #endif
@@ -927,11 +5214,13 @@ void print_usage(FILE *stream)
             "%s\n" \
             "  version: %s\n" \
             "  author:  %s\n" \
+            "%s" \
             "%s\n", 
             name, 
             version,
             authors,
-            usage);
+            usage,
+            usage_flags);
 
 #ifdef DEBUG
     fprintf(stderr, "Debug: Leaving  --> print_usage()\n");
@@ -0,0 +1,101 @@
+/*
+   access_policy.c
+
+   Access-pattern hints and readahead for input files; see access_policy.h.
+*/
+
+#include "access_policy.h"
+
+void access_policy_apply(const char *map, const size_t size, const int fd, const access_pattern pattern)
+{
+    int madvice = MADV_NORMAL;
+    int fadvice = POSIX_FADV_NORMAL;
+
+    if (pattern == kAccessSequential) {
+        madvice = MADV_SEQUENTIAL;
+        fadvice = POSIX_FADV_SEQUENTIAL;
+    }
+    else if (pattern == kAccessRandom) {
+        madvice = MADV_RANDOM;
+        fadvice = POSIX_FADV_RANDOM;
+    }
+
+    /* the mapping and the descriptor are advised apart, as zero-copy output reads through the descriptor */
+    if ((map) && (size > 0))
+        madvise((void *) map, size, madvice);
+    if (fd >= 0)
+        posix_fadvise(fd, 0, 0, fadvice);
+}
+
+access_pattern access_policy_for_sample(const size_t size, const long num_records, const int sorted)
+{
+    if ((num_records > 0) && (size / (size_t) num_records >= ACCESS_SPARSE_BYTES_PER_RECORD))
+        return kAccessRandom;
+
+    return (sorted) ? kAccessSequential : kAccessNormal;
+}
+
+void access_policy_release(const int fd)
+{
+    if (fd >= 0)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+long access_prefetch_window(const long window, const long num_records)
+{
+    if (window <= 0)
+        return 0;
+
+    return (window < num_records) ? window : num_records;
+}
+
+void access_prefetch_init(access_prefetch *pf, const char *map, const size_t size, const int fd)
+{
+    memset(pf, 0, sizeof(access_prefetch));
+    pf->map = map;
+    pf->size = size;
+    pf->fd = fd;
+    pf->page_size = (size_t) sysconf(_SC_PAGESIZE);
+}
+
+void access_prefetch_hint(access_prefetch *pf, const uint64_t offset)
+{
+    size_t start = 0;
+    size_t stop = 0;
+    size_t run_start = 0;
+    size_t run_stop = 0;
+
+    if (offset >= pf->size)
+        return;
+    start = (size_t) offset / pf->page_size * pf->page_size;
+    stop = ((size_t) offset + ACCESS_PREFETCH_RECORD_SPAN + pf->page_size - 1) / pf->page_size * pf->page_size;
+    if (stop > pf->size)
+        stop = pf->size;
+
+    /* a record on or next to the pages already asked for widens the run, up to its limit */
+    if ((pf->run_stop > pf->run_start) && (start <= pf->run_stop) && (stop >= pf->run_start)) {
+        run_start = (pf->run_start < start) ? pf->run_start : start;
+        run_stop = (pf->run_stop > stop) ? pf->run_stop : stop;
+        if (run_stop - run_start <= ACCESS_PREFETCH_MAX_RUN) {
+            pf->run_start = run_start;
+            pf->run_stop = run_stop;
+            return;
+        }
+    }
+    access_prefetch_flush(pf);
+    pf->run_start = start;
+    pf->run_stop = stop;
+}
+
+void access_prefetch_flush(access_prefetch *pf)
+{
+    if (pf->run_stop <= pf->run_start)
+        return;
+
+    if (pf->map)
+        madvise((void *) (pf->map + pf->run_start), pf->run_stop - pf->run_start, MADV_WILLNEED);
+    else if (pf->fd >= 0)
+        posix_fadvise(pf->fd, (off_t) pf->run_start, (off_t) (pf->run_stop - pf->run_start), POSIX_FADV_WILLNEED);
+    pf->run_start = 0;
+    pf->run_stop = 0;
+}
@@ -0,0 +1,35 @@
+/*
+   algorithm_l.c
+
+   Skip-ahead reservoir sampling draws; see algorithm_l.h.
+*/
+
+#include "algorithm_l.h"
+
+double algorithm_l_random_double(rng_state *state)
+{
+    double u = 0.0;
+
+    do {
+        u = rng_double(state);
+    } while ((u <= 0.0) || (u >= 1.0));
+
+    return u;
+}
+
+double algorithm_l_initial_weight(rng_state *state, const long k)
+{
+    return exp(log(algorithm_l_random_double(state)) / k);
+}
+
+double algorithm_l_next_weight(rng_state *state, const double w, const long k)
+{
+    return w * exp(log(algorithm_l_random_double(state)) / k);
+}
+
+long algorithm_l_next_index(rng_state *state, const long idx, const double w)
+{
+    double skip_length = floor(log(algorithm_l_random_double(state)) / log1p(-w));
+
+    return (skip_length < (double) (LONG_MAX - idx - 1)) ? idx + (long) skip_length + 1 : LONG_MAX;
+}
@@ -0,0 +1,278 @@
+/*
+   bgzf.c
+
+   Block table, parallel-safe block inflation and a block cache for BGZF
+   input; see bgzf.h for the layout and virtual offsets.
+*/
+
+#include "bgzf.h"
+
+static uint32_t bgzf_read_uint16(const unsigned char *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8);
+}
+
+static uint32_t bgzf_read_uint32(const unsigned char *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* the size of the block starting at data, from its BC subfield, or 0 if there is no such subfield */
+static size_t bgzf_block_size(const unsigned char *data, const size_t len)
+{
+    size_t extra_len = 0;
+    size_t field_idx = 0;
+    size_t field_len = 0;
+
+    if ((len < BGZF_HEADER_SIZE) || (data[0] != 0x1f) || (data[1] != 0x8b) || (data[2] != 8) || (!(data[3] & 4)))
+        return 0;
+    extra_len = bgzf_read_uint16(data + 10);
+    if (12 + extra_len > len)
+        return 0;
+    for (field_idx = 12; field_idx + 4 <= 12 + extra_len; field_idx += 4 + field_len) {
+        field_len = bgzf_read_uint16(data + field_idx + 2);
+        if ((data[field_idx] == 'B') && (data[field_idx + 1] == 'C') && (field_len == 2))
+            return (size_t) bgzf_read_uint16(data + field_idx + 4) + 1;
+    }
+
+    return 0;
+}
+
+int bgzf_is_bgzf(const char *data, const size_t len)
+{
+    return (bgzf_block_size((const unsigned char *) data, len) > 0) ? 1 : 0;
+}
+
+int bgzf_detect(const char *fn)
+{
+    char header[BGZF_HEADER_SIZE];
+    ssize_t header_len = 0;
+    int fd = -1;
+
+    fd = open(fn, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    header_len = read(fd, header, BGZF_HEADER_SIZE);
+    close(fd);
+    if (header_len < 0)
+        return -1;
+
+    return bgzf_is_bgzf(header, (size_t) header_len);
+}
+
+bgzf_file * bgzf_open(const char *fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> bgzf_open()\n");
+#endif
+
+    bgzf_file *bgzf = NULL;
+    struct stat s;
+    const unsigned char *data = NULL;
+    bgzf_block *resized_blocks = NULL;
+    size_t blocks_capacity = 1024;
+    size_t position = 0;
+    size_t block_size = 0;
+    int saved_errno = 0;
+
+    bgzf = calloc(1, sizeof(bgzf_file));
+    if (!bgzf)
+        return NULL;
+    bgzf->fd = open(fn, O_RDONLY);
+    if ((bgzf->fd == -1) || (fstat(bgzf->fd, &s) == -1))
+        goto fail;
+    bgzf->size = (size_t) s.st_size;
+    if (bgzf->size == 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+    bgzf->map = mmap(NULL, bgzf->size, PROT_READ, MAP_SHARED, bgzf->fd, 0);
+    if (bgzf->map == MAP_FAILED) {
+        bgzf->map = NULL;
+        goto fail;
+    }
+    bgzf->blocks = malloc(sizeof(bgzf_block) * blocks_capacity);
+    if (!bgzf->blocks)
+        goto fail;
+
+    /* only the headers and trailers are read, so the table costs a page or two per thousand blocks */
+    data = (const unsigned char *) bgzf->map;
+    for (position = 0; position < bgzf->size; position += block_size) {
+        block_size = bgzf_block_size(data + position, bgzf->size - position);
+        if ((block_size < BGZF_HEADER_SIZE + 8) || (block_size > bgzf->size - position)) {
+            errno = EINVAL;
+            goto fail;
+        }
+        if (bgzf->num_blocks == blocks_capacity) {
+            blocks_capacity *= 2;
+            resized_blocks = realloc(bgzf->blocks, sizeof(bgzf_block) * blocks_capacity);
+            if (!resized_blocks)
+                goto fail;
+            bgzf->blocks = resized_blocks;
+        }
+        bgzf->blocks[bgzf->num_blocks].offset = position;
+        bgzf->blocks[bgzf->num_blocks].compressed_size = (uint32_t) block_size;
+        bgzf->blocks[bgzf->num_blocks].inflated_size = bgzf_read_uint32(data + position + block_size - 4);
+        if (bgzf->blocks[bgzf->num_blocks].inflated_size > BGZF_MAX_BLOCK_SIZE) {
+            errno = EINVAL;
+            goto fail;
+        }
+        bgzf->inflated_size += bgzf->blocks[bgzf->num_blocks].inflated_size;
+        bgzf->num_blocks++;
+    }
+    if (bgzf_inflater_init(&bgzf->inflater) == -1)
+        goto fail;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: BGZF file has %zu blocks, %llu bytes inflated\n", bgzf->num_blocks, (unsigned long long) bgzf->inflated_size);
+    fprintf(stderr, "Debug: Leaving  --> bgzf_open()\n");
+#endif
+
+    return bgzf;
+
+fail:
+    saved_errno = errno;
+    bgzf_close(&bgzf);
+    errno = saved_errno;
+
+    return NULL;
+}
+
+void bgzf_close(bgzf_file **bgzf_ptr)
+{
+    bgzf_file *bgzf = *bgzf_ptr;
+    int cache_idx = 0;
+
+    if (!bgzf)
+        return;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: BGZF block cache had %lu hits and %lu misses\n", bgzf->cache_hits, bgzf->cache_misses);
+#endif
+
+    for (cache_idx = 0; cache_idx < bgzf->num_cached; ++cache_idx)
+        free(bgzf->cache[cache_idx].data);
+    bgzf_inflater_end(&bgzf->inflater);
+    free(bgzf->blocks);
+    if (bgzf->map)
+        munmap(bgzf->map, bgzf->size);
+    if (bgzf->fd != -1)
+        close(bgzf->fd);
+    free(bgzf);
+    *bgzf_ptr = NULL;
+}
+
+int bgzf_inflater_init(bgzf_inflater *inflater)
+{
+    memset(inflater, 0, sizeof(bgzf_inflater));
+
+    /* blocks are inflated as raw deflate streams, as their gzip headers are parsed here */
+    if (inflateInit2(&inflater->stream, -15) != Z_OK) {
+        errno = ENOMEM;
+        return -1;
+    }
+    inflater->initialized = 1;
+
+    return 0;
+}
+
+void bgzf_inflater_end(bgzf_inflater *inflater)
+{
+    if (inflater->initialized)
+        inflateEnd(&inflater->stream);
+    inflater->initialized = 0;
+}
+
+int bgzf_inflate_block(bgzf_inflater *inflater, const bgzf_file *bgzf, const size_t block_idx, char *out, size_t *out_len)
+{
+    const bgzf_block *block = &bgzf->blocks[block_idx];
+    const unsigned char *data = (const unsigned char *) bgzf->map + block->offset;
+    size_t header_len = 12 + bgzf_read_uint16(data + 10);
+    int err = Z_OK;
+
+    *out_len = 0;
+    if (block->inflated_size == 0)
+        return 0;
+    if (inflateReset(&inflater->stream) != Z_OK) {
+        errno = EIO;
+        return -1;
+    }
+    inflater->stream.next_in = (unsigned char *) data + header_len;
+    inflater->stream.avail_in = (uInt) (block->compressed_size - header_len - 8);
+    inflater->stream.next_out = (unsigned char *) out;
+    inflater->stream.avail_out = BGZF_MAX_BLOCK_SIZE;
+    err = inflate(&inflater->stream, Z_FINISH);
+    if ((err != Z_STREAM_END) ||
+        (inflater->stream.total_out != block->inflated_size) ||
+        (crc32(crc32(0L, Z_NULL, 0), (const unsigned char *) out, block->inflated_size) != bgzf_read_uint32(data + block->compressed_size - 8))) {
+        errno = EIO;
+        return -1;
+    }
+    *out_len = block->inflated_size;
+
+    return 0;
+}
+
+const char * bgzf_block_data(bgzf_file *bgzf, const size_t block_idx, size_t *len)
+{
+    bgzf_cache_entry *entry = NULL;
+    int cache_idx = 0;
+    int oldest_idx = 0;
+
+    for (cache_idx = 0; cache_idx < bgzf->num_cached; ++cache_idx) {
+        if (bgzf->cache[cache_idx].block_idx == block_idx) {
+            bgzf->cache[cache_idx].last_used = ++bgzf->clock;
+            bgzf->cache_hits++;
+            *len = bgzf->cache[cache_idx].length;
+            return bgzf->cache[cache_idx].data;
+        }
+        if (bgzf->cache[cache_idx].last_used < bgzf->cache[oldest_idx].last_used)
+            oldest_idx = cache_idx;
+    }
+
+    /* a miss takes a free slot while there is one, and otherwise the least recently used */
+    bgzf->cache_misses++;
+    if (bgzf->num_cached < BGZF_CACHE_BLOCKS) {
+        entry = &bgzf->cache[bgzf->num_cached];
+        entry->data = malloc(BGZF_MAX_BLOCK_SIZE);
+        if (!entry->data)
+            return NULL;
+        bgzf->num_cached++;
+    }
+    else
+        entry = &bgzf->cache[oldest_idx];
+    entry->block_idx = block_idx;
+    entry->last_used = ++bgzf->clock;
+    if (bgzf_inflate_block(&bgzf->inflater, bgzf, block_idx, entry->data, &entry->length) == -1) {
+        entry->block_idx = (size_t) -1;
+        return NULL;
+    }
+    *len = entry->length;
+
+    return entry->data;
+}
+
+size_t bgzf_block_index(const bgzf_file *bgzf, const uint64_t compressed_offset)
+{
+    size_t lo = 0;
+    size_t hi = bgzf->num_blocks;
+    size_t mid = 0;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (bgzf->blocks[mid].offset < compressed_offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+size_t bgzf_next_data_block(const bgzf_file *bgzf, size_t block_idx)
+{
+    while ((block_idx < bgzf->num_blocks) && (bgzf->blocks[block_idx].inflated_size == 0))
+        block_idx++;
+
+    return block_idx;
+}
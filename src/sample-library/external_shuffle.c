@@ -0,0 +1,339 @@
+/*
+   external_shuffle.c
+
+   Bucketed whole-input shuffle within a memory budget; see external_shuffle.h.
+*/
+
+#include "external_shuffle.h"
+#include "newline_scan.h"
+#include "offset_arena.h"
+
+#define EXTERNAL_SHUFFLE_POSITION_BATCH_SIZE 4096
+
+typedef struct external_shuffle_pass external_shuffle_pass;
+typedef struct external_shuffle_bucket external_shuffle_bucket;
+
+/*
+   line-groupings read so far and not yet shuffled or scattered -- starts[] holds
+   the start of each complete line-grouping in data, and grp_start the start of
+   the line-grouping that is still being read
+*/
+struct external_shuffle_pass {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t *starts;
+    size_t num_records;
+    size_t starts_capacity;
+    size_t scanned;
+    size_t grp_start;
+    long ln_idx;
+};
+
+struct external_shuffle_bucket {
+    int fd;
+    char *buf;
+    size_t length;
+    off_t bytes;
+};
+
+static void * external_shuffle_grow(void *block, size_t *capacity, const size_t bytes)
+{
+    size_t new_capacity = (*capacity > 0) ? *capacity : EXTERNAL_SHUFFLE_READ_SIZE;
+    void *grown_block = NULL;
+
+    if (bytes <= *capacity)
+        return block;
+    while (new_capacity < bytes)
+        new_capacity *= 2;
+    grown_block = (block) ? offset_arena_resize(block, *capacity, new_capacity) : offset_arena_reserve(new_capacity);
+    if (grown_block)
+        *capacity = new_capacity;
+
+    return grown_block;
+}
+
+static void * external_shuffle_shrink(void *block, size_t *capacity, const size_t bytes)
+{
+    void *shrunk_block = NULL;
+
+    if ((!block) || (bytes >= *capacity))
+        return block;
+    shrunk_block = offset_arena_resize(block, *capacity, bytes);
+    if (!shrunk_block)
+        return block;
+    *capacity = bytes;
+
+    return shrunk_block;
+}
+
+static int external_shuffle_write_all(const int fd, const char *data, size_t len)
+{
+    ssize_t written = 0;
+
+    while (len > 0) {
+        written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
+static int external_shuffle_open_bucket(const char *temp_dir)
+{
+    char *bucket_fn = NULL;
+    int fd = -1;
+
+    bucket_fn = malloc(strlen(temp_dir) + sizeof("/sample.XXXXXX"));
+    if (!bucket_fn) {
+        errno = ENOMEM;
+        return -1;
+    }
+    sprintf(bucket_fn, "%s/sample.XXXXXX", temp_dir);
+
+    /* the file is unlinked straight away, so that it goes when it is closed, however we exit */
+    fd = mkstemp(bucket_fn);
+    if (fd != -1)
+        unlink(bucket_fn);
+    free(bucket_fn);
+
+    return fd;
+}
+
+static int external_shuffle_bucket_append(external_shuffle_bucket *bucket, const size_t buffer_size, const char *data, const size_t len)
+{
+    if (bucket->length + len > buffer_size) {
+        if (external_shuffle_write_all(bucket->fd, bucket->buf, bucket->length) == -1)
+            return -1;
+        bucket->length = 0;
+    }
+    if (len >= buffer_size) {
+        if (external_shuffle_write_all(bucket->fd, data, len) == -1)
+            return -1;
+    }
+    else {
+        memcpy(bucket->buf + bucket->length, data, len);
+        bucket->length += len;
+    }
+    bucket->bytes += len;
+
+    return 0;
+}
+
+static int external_shuffle_scan(external_shuffle_pass *pass, const int lines_per_offset)
+{
+    size_t newline_positions[EXTERNAL_SHUFFLE_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scanned = 0;
+    size_t *grown_starts = NULL;
+
+    while (pass->scanned < pass->length) {
+        num_positions = newline_scan_positions(pass->data + pass->scanned, pass->length - pass->scanned, newline_positions, EXTERNAL_SHUFFLE_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; position_idx < num_positions; ++position_idx) {
+            if ((++pass->ln_idx) % lines_per_offset)
+                continue;
+            if ((pass->num_records + 1) * sizeof(size_t) > pass->starts_capacity) {
+                grown_starts = external_shuffle_grow(pass->starts, &pass->starts_capacity, (pass->num_records + 1) * sizeof(size_t));
+                if (!grown_starts)
+                    return -1;
+                pass->starts = grown_starts;
+            }
+            pass->starts[pass->num_records++] = pass->grp_start;
+            pass->grp_start = pass->scanned + newline_positions[position_idx] + 1;
+        }
+        pass->scanned += scanned;
+    }
+
+    return 0;
+}
+
+static int external_shuffle_scatter(external_shuffle_pass *pass, external_shuffle_bucket *buckets, const int num_buckets, const size_t buffer_size, rng_state *state)
+{
+    size_t record_idx = 0;
+    size_t record_stop = 0;
+    int bucket_idx = 0;
+
+    for (record_idx = 0; record_idx < pass->num_records; ++record_idx) {
+        record_stop = (record_idx + 1 < pass->num_records) ? pass->starts[record_idx + 1] : pass->grp_start;
+        bucket_idx = (int) rng_bounded_modulo(state, num_buckets);
+        if (external_shuffle_bucket_append(&buckets[bucket_idx], buffer_size, pass->data + pass->starts[record_idx], record_stop - pass->starts[record_idx]) == -1)
+            return -1;
+    }
+
+    /* slide the unfinished line-grouping down to the start of the block */
+    memmove(pass->data, pass->data + pass->grp_start, pass->length - pass->grp_start);
+    pass->length -= pass->grp_start;
+    pass->scanned -= pass->grp_start;
+    pass->grp_start = 0;
+    pass->num_records = 0;
+
+    return 0;
+}
+
+static int external_shuffle_emit(external_shuffle_pass *pass, output_buffer *ob, const int lines_per_offset, rng_state *state)
+{
+    size_t shuf_idx = 0;
+    size_t rand_idx = 0;
+    size_t temp_start = 0;
+    const char *record_start = NULL;
+    const char *record_stop = NULL;
+
+    for (shuf_idx = pass->num_records; shuf_idx > 1; --shuf_idx) {
+        rand_idx = (size_t) rng_bounded(state, shuf_idx);
+        temp_start = pass->starts[shuf_idx - 1];
+        pass->starts[shuf_idx - 1] = pass->starts[rand_idx];
+        pass->starts[rand_idx] = temp_start;
+    }
+    for (shuf_idx = 0; shuf_idx < pass->num_records; ++shuf_idx) {
+        record_start = pass->data + pass->starts[shuf_idx];
+        record_stop = newline_scan_nth(record_start, pass->data + pass->grp_start, lines_per_offset) + 1;
+        if (output_buffer_append(ob, record_start, record_stop - record_start) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int external_shuffle_stream(const int in_fd, const off_t in_size, output_buffer *ob, const int lines_per_offset, const size_t max_memory, const char *temp_dir, rng_state *state, const int depth)
+{
+    external_shuffle_pass pass;
+    external_shuffle_bucket *buckets = NULL;
+    int num_buckets = 0;
+    int bucket_idx = 0;
+    size_t buffer_size = 0;
+    size_t buffer_budget = max_memory / 8;
+    size_t record_budget = max_memory - buffer_budget;
+    double bytes_per_input_byte = 0.0;
+    ssize_t read_len = 0;
+    char *grown_data = NULL;
+    int err = 0;
+
+    memset(&pass, 0, sizeof(pass));
+
+    for (;;) {
+        grown_data = external_shuffle_grow(pass.data, &pass.capacity, pass.length + EXTERNAL_SHUFFLE_READ_SIZE);
+        if (!grown_data)
+            goto fail;
+        pass.data = grown_data;
+        read_len = read(in_fd, pass.data + pass.length, EXTERNAL_SHUFFLE_READ_SIZE);
+        if (read_len < 0) {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+        if (read_len == 0)
+            break;
+        pass.length += read_len;
+        if (external_shuffle_scan(&pass, lines_per_offset) == -1)
+            goto fail;
+
+        /*
+           once the line-groupings read so far outgrow the budget, set up buckets -- enough
+           that each should come to half the budget, going by the bookkeeping cost per
+           input byte so far, or as many as we can buffer, if the input size is unknown
+        */
+        if ((!buckets) && (depth < EXTERNAL_SHUFFLE_MAX_DEPTH) && (pass.length + pass.num_records * sizeof(size_t) > record_budget)) {
+            bytes_per_input_byte = (double) (pass.length + pass.num_records * sizeof(size_t)) / pass.length;
+            num_buckets = (in_size > 0) ? (int) (2.0 * in_size * bytes_per_input_byte / record_budget) + 1 : EXTERNAL_SHUFFLE_MAX_BUCKETS;
+            if (num_buckets > EXTERNAL_SHUFFLE_MAX_BUCKETS)
+                num_buckets = EXTERNAL_SHUFFLE_MAX_BUCKETS;
+            if ((size_t) num_buckets > buffer_budget / EXTERNAL_SHUFFLE_BUCKET_BUFFER_MINIMUM)
+                num_buckets = (int) (buffer_budget / EXTERNAL_SHUFFLE_BUCKET_BUFFER_MINIMUM);
+            if (num_buckets < 2)
+                num_buckets = 2;
+            buffer_size = buffer_budget / num_buckets;
+            if (buffer_size > EXTERNAL_SHUFFLE_BUCKET_BUFFER_SIZE)
+                buffer_size = EXTERNAL_SHUFFLE_BUCKET_BUFFER_SIZE;
+            buckets = calloc(num_buckets, sizeof(external_shuffle_bucket));
+            if (!buckets)
+                goto fail;
+            for (bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx)
+                buckets[bucket_idx].fd = -1;
+            for (bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+                buckets[bucket_idx].fd = external_shuffle_open_bucket(temp_dir);
+                buckets[bucket_idx].buf = malloc(buffer_size);
+                if ((buckets[bucket_idx].fd == -1) || (!buckets[bucket_idx].buf))
+                    goto fail;
+            }
+        }
+        if (buckets) {
+            if (external_shuffle_scatter(&pass, buckets, num_buckets, buffer_size, state) == -1)
+                goto fail;
+            /* what was read before the buckets were set up is scattered now, and its memory handed back */
+            if (pass.length < EXTERNAL_SHUFFLE_READ_SIZE) {
+                pass.data = external_shuffle_shrink(pass.data, &pass.capacity, 2 * EXTERNAL_SHUFFLE_READ_SIZE);
+                pass.starts = external_shuffle_shrink(pass.starts, &pass.starts_capacity, EXTERNAL_SHUFFLE_READ_SIZE);
+            }
+        }
+    }
+
+    if (!buckets) {
+        if (external_shuffle_emit(&pass, ob, lines_per_offset, state) == -1)
+            goto fail;
+    }
+    else {
+        /* the read block is not needed while the buckets are shuffled, one after the other */
+        offset_arena_release(pass.data, pass.capacity);
+        offset_arena_release(pass.starts, pass.starts_capacity);
+        memset(&pass, 0, sizeof(pass));
+        for (bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+            if (external_shuffle_write_all(buckets[bucket_idx].fd, buckets[bucket_idx].buf, buckets[bucket_idx].length) == -1)
+                goto fail;
+            free(buckets[bucket_idx].buf);
+            buckets[bucket_idx].buf = NULL;
+        }
+        for (bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+            if ((lseek(buckets[bucket_idx].fd, 0, SEEK_SET) == -1) ||
+                (external_shuffle_stream(buckets[bucket_idx].fd, buckets[bucket_idx].bytes, ob, lines_per_offset, max_memory, temp_dir, state, depth + 1) == -1))
+                goto fail;
+            close(buckets[bucket_idx].fd);
+            buckets[bucket_idx].fd = -1;
+        }
+        free(buckets);
+    }
+
+    offset_arena_release(pass.data, pass.capacity);
+    offset_arena_release(pass.starts, pass.starts_capacity);
+
+    return 0;
+
+ fail:
+    err = (errno) ? errno : ENOMEM;
+    if (buckets) {
+        for (bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+            if (buckets[bucket_idx].fd != -1)
+                close(buckets[bucket_idx].fd);
+            free(buckets[bucket_idx].buf);
+        }
+        free(buckets);
+    }
+    offset_arena_release(pass.data, pass.capacity);
+    offset_arena_release(pass.starts, pass.starts_capacity);
+    errno = err;
+
+    return -1;
+}
+
+int external_shuffle(const int in_fd, output_buffer *ob, const int lines_per_offset, const size_t max_memory, const char *temp_dir, rng_state *state)
+{
+    struct stat in_stat;
+    off_t in_size = 0;
+
+    if ((lines_per_offset < 1) || (max_memory < EXTERNAL_SHUFFLE_MINIMUM_MEMORY)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* the size of a pipe is not known, which leaves the bucket count at its maximum */
+    if ((fstat(in_fd, &in_stat) == 0) && (S_ISREG(in_stat.st_mode)))
+        in_size = in_stat.st_size - lseek(in_fd, 0, SEEK_CUR);
+
+    return external_shuffle_stream(in_fd, in_size, ob, lines_per_offset, max_memory, temp_dir, state, 0);
+}
@@ -0,0 +1,628 @@
+/*
+   gzip_index.c
+
+   Checkpointed inflation of plain gzip input, its sidecar, and a reader
+   that resumes inflation at the checkpoint nearest a requested offset;
+   see gzip_index.h for the layout.
+*/
+
+#include "gzip_index.h"
+
+/* zlib counts input in 32-bit lengths, so a large mapping is fed to it in pieces */
+#define GZIP_INPUT_PIECE_SIZE 1073741824
+
+static size_t gzip_member_header_size(const unsigned char *data, const size_t len)
+{
+    size_t position = 10;
+    unsigned int flags = 0;
+
+    if ((len < 10) || (data[0] != 0x1f) || (data[1] != 0x8b) || (data[2] != 8) || (data[3] & 0xe0))
+        return 0;
+    flags = data[3];
+    if (flags & 4) {
+        if (position + 2 > len)
+            return 0;
+        position += 2 + ((size_t) data[position] | ((size_t) data[position + 1] << 8));
+    }
+    if (flags & 8) {
+        while ((position < len) && (data[position]))
+            position++;
+        position++;
+    }
+    if (flags & 16) {
+        while ((position < len) && (data[position]))
+            position++;
+        position++;
+    }
+    if (flags & 2)
+        position += 2;
+
+    return (position <= len) ? position : 0;
+}
+
+static uint32_t gzip_read_uint32(const unsigned char *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void gzip_feed(z_stream *stream, const gzip_file *gz, const uint64_t in)
+{
+    uint64_t left = gz->size - in;
+
+    stream->next_in = (unsigned char *) gz->map + in;
+    stream->avail_in = (uInt) ((left > GZIP_INPUT_PIECE_SIZE) ? GZIP_INPUT_PIECE_SIZE : left);
+}
+
+/*
+   moves in past the trailer of a member and the header of the next, returning 1 at the
+   end of the input -- which, as for gzip itself, may be padded out with zeros
+*/
+static int gzip_next_member(const gzip_file *gz, uint64_t *in)
+{
+    const unsigned char *data = (const unsigned char *) gz->map;
+    size_t header_len = 0;
+    uint64_t position = 0;
+
+    *in += 8;
+    if (*in > gz->size) {
+        errno = EIO;
+        return -1;
+    }
+    if (*in == gz->size)
+        return 1;
+    header_len = gzip_member_header_size(data + *in, gz->size - *in);
+    if (header_len == 0) {
+        for (position = *in; (position < gz->size) && (data[position] == 0); ++position)
+            ;
+        if (position == gz->size)
+            return 1;
+        errno = EIO;
+        return -1;
+    }
+    *in += header_len;
+
+    return 0;
+}
+
+static int gzip_add_checkpoint(gzip_file *gz, const uint64_t out, const uint64_t in, const int bits, const unsigned char *window, const size_t window_pos)
+{
+    gzip_checkpoint *resized_checkpoints = NULL;
+    gzip_checkpoint *checkpoint = NULL;
+    size_t left = GZIP_INDEX_WINDOW_SIZE - window_pos;
+
+    if (gz->num_checkpoints == gz->checkpoint_capacity) {
+        gz->checkpoint_capacity = (gz->checkpoint_capacity) ? 2 * gz->checkpoint_capacity : 16;
+        resized_checkpoints = realloc(gz->checkpoints, sizeof(gzip_checkpoint) * gz->checkpoint_capacity);
+        if (!resized_checkpoints)
+            return -1;
+        gz->checkpoints = resized_checkpoints;
+    }
+    checkpoint = &gz->checkpoints[gz->num_checkpoints++];
+    checkpoint->out = out;
+    checkpoint->in = in;
+    checkpoint->bits = (uint32_t) bits;
+    checkpoint->reserved = 0;
+
+    /* the window is circular, so its oldest byte is the one at window_pos */
+    memcpy(checkpoint->window, window + window_pos, left);
+    memcpy(checkpoint->window + left, window, window_pos);
+
+    return 0;
+}
+
+int gzip_is_gzip(const char *data, const size_t len)
+{
+    return (gzip_member_header_size((const unsigned char *) data, len) > 0) ? 1 : 0;
+}
+
+int gzip_detect(const char *fn)
+{
+    char header[GZIP_READER_BUFFER_SIZE];
+    ssize_t header_len = 0;
+    int fd = -1;
+
+    fd = open(fn, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    header_len = read(fd, header, sizeof(header));
+    close(fd);
+    if (header_len < 0)
+        return -1;
+
+    return gzip_is_gzip(header, (size_t) header_len);
+}
+
+gzip_file * gzip_open(const char *fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> gzip_open()\n");
+#endif
+
+    gzip_file *gz = NULL;
+    int saved_errno = 0;
+
+    gz = calloc(1, sizeof(gzip_file));
+    if (!gz)
+        return NULL;
+    gz->fd = open(fn, O_RDONLY);
+    if ((gz->fd == -1) || (fstat(gz->fd, &gz->s) == -1))
+        goto fail;
+    gz->size = (size_t) gz->s.st_size;
+    if (gz->size == 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+    gz->map = mmap(NULL, gz->size, PROT_READ, MAP_SHARED, gz->fd, 0);
+    if (gz->map == MAP_FAILED) {
+        gz->map = NULL;
+        goto fail;
+    }
+    if (!gzip_is_gzip(gz->map, gz->size)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> gzip_open()\n");
+#endif
+
+    return gz;
+
+fail:
+    saved_errno = errno;
+    gzip_close(&gz);
+    errno = saved_errno;
+
+    return NULL;
+}
+
+void gzip_close(gzip_file **gz_ptr)
+{
+    gzip_file *gz = *gz_ptr;
+
+    if (!gz)
+        return;
+
+    free(gz->checkpoints);
+    if (gz->map)
+        munmap(gz->map, gz->size);
+    if (gz->fd != -1)
+        close(gz->fd);
+    free(gz);
+    *gz_ptr = NULL;
+}
+
+int gzip_scan(gzip_file *gz, const uint64_t span, gzip_consumer consume, void *arg)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> gzip_scan()\n");
+#endif
+
+    const unsigned char *data = (const unsigned char *) gz->map;
+    z_stream stream;
+    unsigned char *window = NULL;
+    size_t window_pos = 0;
+    size_t produced = 0;
+    uint64_t in = 0;
+    uint64_t out = 0;
+    uint64_t last_out = 0;
+    uint64_t member_out = 0;
+    uLong crc = 0;
+    int status = 0;
+    int err = 0;
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -15) != Z_OK) {
+        errno = ENOMEM;
+        return -1;
+    }
+    window = calloc(1, GZIP_INDEX_WINDOW_SIZE);
+    if (!window) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+    gz->num_checkpoints = 0;
+    gz->span = span;
+
+    /* deflate data is inflated raw, with member headers and trailers handled here */
+    in = gzip_member_header_size(data, gz->size);
+    if ((in == 0) || (gzip_add_checkpoint(gz, 0, in, 0, window, 0) == -1)) {
+        err = (in == 0) ? EINVAL : ENOMEM;
+        goto cleanup;
+    }
+    crc = crc32(0L, Z_NULL, 0);
+    gzip_feed(&stream, gz, in);
+
+    for (;;) {
+        if (stream.avail_in == 0) {
+            in = (uint64_t) ((char *) stream.next_in - gz->map);
+            if (in < gz->size)
+                gzip_feed(&stream, gz, in);
+        }
+        if (window_pos == GZIP_INDEX_WINDOW_SIZE)
+            window_pos = 0;
+        stream.next_out = window + window_pos;
+        stream.avail_out = (uInt) (GZIP_INDEX_WINDOW_SIZE - window_pos);
+
+        /* inflate stops at the end of each deflate block, where a checkpoint can go */
+        status = inflate(&stream, Z_BLOCK);
+        if ((status != Z_OK) && (status != Z_STREAM_END) && ((status != Z_BUF_ERROR) || ((size_t) ((char *) stream.next_in - gz->map) >= gz->size))) {
+            err = EIO;
+            goto cleanup;
+        }
+        produced = (GZIP_INDEX_WINDOW_SIZE - window_pos) - stream.avail_out;
+        if (produced > 0) {
+            crc = crc32(crc, window + window_pos, (uInt) produced);
+            if (consume)
+                consume(arg, out, (const char *) window + window_pos, produced);
+            out += produced;
+            member_out += produced;
+            window_pos += produced;
+        }
+
+        if (status == Z_STREAM_END) {
+            in = (uint64_t) ((char *) stream.next_in - gz->map);
+            if ((in + 8 > gz->size) || (gzip_read_uint32(data + in) != (uint32_t) crc) || (gzip_read_uint32(data + in + 4) != (uint32_t) member_out)) {
+                err = EIO;
+                goto cleanup;
+            }
+            status = gzip_next_member(gz, &in);
+            if (status == -1) {
+                err = errno;
+                goto cleanup;
+            }
+            if (status == 1)
+                break;
+            if (inflateReset(&stream) != Z_OK) {
+                err = EIO;
+                goto cleanup;
+            }
+            crc = crc32(0L, Z_NULL, 0);
+            member_out = 0;
+            gzip_feed(&stream, gz, in);
+            if (out - last_out >= span) {
+                if (gzip_add_checkpoint(gz, out, in, 0, window, window_pos) == -1) {
+                    err = ENOMEM;
+                    goto cleanup;
+                }
+                last_out = out;
+            }
+            continue;
+        }
+
+        /* past a block that is not the member's last, with the next block's header not yet read */
+        if ((stream.data_type & 128) && (!(stream.data_type & 64)) && (out - last_out >= span)) {
+            if (gzip_add_checkpoint(gz, out, (uint64_t) ((char *) stream.next_in - gz->map), stream.data_type & 7, window, window_pos) == -1) {
+                err = ENOMEM;
+                goto cleanup;
+            }
+            last_out = out;
+        }
+    }
+    gz->inflated_size = out;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: gzip input has %llu bytes inflated, with %zu checkpoints\n", (unsigned long long) gz->inflated_size, gz->num_checkpoints);
+#endif
+
+ cleanup:
+    inflateEnd(&stream);
+    free(window);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> gzip_scan()\n");
+#endif
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+size_t gzip_checkpoint_index(const gzip_file *gz, const uint64_t out)
+{
+    size_t lo = 0;
+    size_t hi = gz->num_checkpoints;
+    size_t mid = 0;
+
+    /* the last checkpoint at or before out; the first is always at 0 */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (gz->checkpoints[mid].out <= out)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo > 0) ? lo - 1 : 0;
+}
+
+char * gzip_index_sidecar_name(const char *in_fn)
+{
+    char *index_fn = NULL;
+
+    index_fn = malloc(strlen(in_fn) + strlen(GZIP_INDEX_SUFFIX) + 1);
+    if (!index_fn)
+        return NULL;
+    strcpy(index_fn, in_fn);
+    strcat(index_fn, GZIP_INDEX_SUFFIX);
+
+    return index_fn;
+}
+
+int gzip_index_write(const gzip_file *gz, const char *index_fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> gzip_index_write()\n");
+#endif
+
+    gzip_index_header header;
+    char *tmp_fn = NULL;
+    FILE *tmp_file = NULL;
+    int tmp_fd = -1;
+    int tmp_created = 0;
+    int err = 0;
+
+    tmp_fn = malloc(strlen(index_fn) + 8);
+    if (!tmp_fn) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+
+    /* as with the line index, a reader never sees a partial sidecar */
+    strcpy(tmp_fn, index_fn);
+    strcat(tmp_fn, ".XXXXXX");
+    tmp_fd = mkstemp(tmp_fn);
+    if (tmp_fd == -1) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_created = 1;
+    fchmod(tmp_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    tmp_file = fdopen(tmp_fd, "wb");
+    if (!tmp_file) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_fd = -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GZIP_INDEX_MAGIC, sizeof(GZIP_INDEX_MAGIC));
+    header.version = GZIP_INDEX_VERSION;
+    header.window_size = GZIP_INDEX_WINDOW_SIZE;
+    header.file_size = gz->size;
+    header.file_mtime_sec = gz->s.st_mtim.tv_sec;
+    header.file_mtime_nsec = gz->s.st_mtim.tv_nsec;
+    header.inflated_size = gz->inflated_size;
+    header.span = gz->span;
+    header.num_checkpoints = gz->num_checkpoints;
+    if ((fwrite(&header, sizeof(header), 1, tmp_file) != 1) ||
+        (fwrite(gz->checkpoints, sizeof(gzip_checkpoint), gz->num_checkpoints, tmp_file) != gz->num_checkpoints) ||
+        (fflush(tmp_file) == EOF)) {
+        err = errno;
+        goto cleanup;
+    }
+    if (fclose(tmp_file) == EOF) {
+        tmp_file = NULL;
+        err = errno;
+        goto cleanup;
+    }
+    tmp_file = NULL;
+    if (rename(tmp_fn, index_fn) == -1)
+        err = errno;
+
+ cleanup:
+    if (tmp_file)
+        fclose(tmp_file);
+    if (tmp_fd != -1)
+        close(tmp_fd);
+    if ((err) && (tmp_created))
+        unlink(tmp_fn);
+    free(tmp_fn);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> gzip_index_write()\n");
+#endif
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int gzip_index_read(gzip_file *gz, const char *index_fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> gzip_index_read()\n");
+#endif
+
+    gzip_index_header header;
+    gzip_checkpoint *checkpoints = NULL;
+    struct stat index_stat;
+    FILE *index_file = NULL;
+    int err = 0;
+
+    index_file = fopen(index_fn, "rb");
+    if ((!index_file) || (fstat(fileno(index_file), &index_stat) == -1)) {
+        err = errno;
+        goto cleanup;
+    }
+    if (fread(&header, sizeof(header), 1, index_file) != 1) {
+        err = EINVAL;
+        goto cleanup;
+    }
+
+    /* reject sidecars of some other file, or of an older version of this one */
+    if ((memcmp(header.magic, GZIP_INDEX_MAGIC, sizeof(GZIP_INDEX_MAGIC)) != 0) ||
+        (header.version != GZIP_INDEX_VERSION) ||
+        (header.window_size != GZIP_INDEX_WINDOW_SIZE) ||
+        (header.file_size != (uint64_t) gz->s.st_size) ||
+        (header.file_mtime_sec != (int64_t) gz->s.st_mtim.tv_sec) ||
+        (header.file_mtime_nsec != (int64_t) gz->s.st_mtim.tv_nsec) ||
+        (header.num_checkpoints == 0) ||
+        ((uint64_t) index_stat.st_size != sizeof(header) + header.num_checkpoints * sizeof(gzip_checkpoint))) {
+        err = ESTALE;
+        goto cleanup;
+    }
+    checkpoints = malloc(sizeof(gzip_checkpoint) * header.num_checkpoints);
+    if (!checkpoints) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+    if (fread(checkpoints, sizeof(gzip_checkpoint), header.num_checkpoints, index_file) != header.num_checkpoints) {
+        err = EIO;
+        goto cleanup;
+    }
+    free(gz->checkpoints);
+    gz->checkpoints = checkpoints;
+    gz->num_checkpoints = gz->checkpoint_capacity = header.num_checkpoints;
+    gz->inflated_size = header.inflated_size;
+    gz->span = header.span;
+    checkpoints = NULL;
+
+ cleanup:
+    if (index_file)
+        fclose(index_file);
+    free(checkpoints);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> gzip_index_read()\n");
+#endif
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int gzip_reader_init(gzip_reader *reader, const gzip_file *gz)
+{
+    memset(reader, 0, sizeof(gzip_reader));
+    reader->gz = gz;
+    reader->buf = malloc(GZIP_READER_BUFFER_SIZE);
+    if ((!reader->buf) || (inflateInit2(&reader->stream, -15) != Z_OK)) {
+        free(reader->buf);
+        reader->buf = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    reader->initialized = 1;
+
+    return 0;
+}
+
+void gzip_reader_end(gzip_reader *reader)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: gzip reader resumed from a checkpoint %lu times\n", reader->restarts);
+#endif
+
+    if (reader->initialized)
+        inflateEnd(&reader->stream);
+    reader->initialized = 0;
+    free(reader->buf);
+    reader->buf = NULL;
+}
+
+static int gzip_reader_restart(gzip_reader *reader, const size_t checkpoint_idx)
+{
+    const gzip_file *gz = reader->gz;
+    const gzip_checkpoint *checkpoint = &gz->checkpoints[checkpoint_idx];
+    const unsigned char *data = (const unsigned char *) gz->map;
+
+    /* a checkpoint partway into a byte primes the inflater with that byte's remaining bits */
+    if ((inflateReset(&reader->stream) != Z_OK) ||
+        ((checkpoint->bits > 0) && (inflatePrime(&reader->stream, (int) checkpoint->bits, data[checkpoint->in - 1] >> (8 - checkpoint->bits)) != Z_OK)) ||
+        ((checkpoint->out > 0) && (inflateSetDictionary(&reader->stream, checkpoint->window, GZIP_INDEX_WINDOW_SIZE) != Z_OK))) {
+        errno = EIO;
+        return -1;
+    }
+    gzip_feed(&reader->stream, gz, checkpoint->in);
+    reader->out = checkpoint->out;
+    reader->buf_start = checkpoint->out;
+    reader->buf_len = 0;
+    reader->positioned = 1;
+    reader->restarts++;
+
+    return 0;
+}
+
+static int gzip_reader_fill(gzip_reader *reader)
+{
+    const gzip_file *gz = reader->gz;
+    size_t produced = 0;
+    uint64_t in = 0;
+    int status = 0;
+
+    reader->buf_start = reader->out;
+    reader->buf_len = 0;
+    while ((reader->buf_len < GZIP_READER_BUFFER_SIZE) && (reader->out < gz->inflated_size)) {
+        if (reader->stream.avail_in == 0) {
+            in = (uint64_t) ((char *) reader->stream.next_in - gz->map);
+            if (in < gz->size)
+                gzip_feed(&reader->stream, gz, in);
+        }
+        reader->stream.next_out = (unsigned char *) reader->buf + reader->buf_len;
+        reader->stream.avail_out = (uInt) (GZIP_READER_BUFFER_SIZE - reader->buf_len);
+        status = inflate(&reader->stream, Z_NO_FLUSH);
+        produced = (GZIP_READER_BUFFER_SIZE - reader->buf_len) - reader->stream.avail_out;
+        reader->buf_len += produced;
+        reader->out += produced;
+        if (status == Z_STREAM_END) {
+            in = (uint64_t) ((char *) reader->stream.next_in - gz->map);
+            status = gzip_next_member(gz, &in);
+            if (status == -1)
+                return -1;
+            if (status == 1)
+                break;
+            if (inflateReset(&reader->stream) != Z_OK) {
+                errno = EIO;
+                return -1;
+            }
+            gzip_feed(&reader->stream, gz, in);
+        }
+        else if ((status != Z_OK) && ((status != Z_BUF_ERROR) || ((size_t) ((char *) reader->stream.next_in - gz->map) >= gz->size))) {
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int gzip_reader_data(gzip_reader *reader, const uint64_t offset, const char **data, size_t *len)
+{
+    const gzip_file *gz = reader->gz;
+    size_t checkpoint_idx = 0;
+
+    *data = NULL;
+    *len = 0;
+    if (offset >= gz->inflated_size)
+        return 0;
+
+    /* carry on from where the reader is, unless the nearest checkpoint is closer */
+    if ((!reader->positioned) || (offset < reader->buf_start) || (offset >= reader->buf_start + reader->buf_len)) {
+        checkpoint_idx = gzip_checkpoint_index(gz, offset);
+        if ((!reader->positioned) || (reader->out > offset) || (reader->out < gz->checkpoints[checkpoint_idx].out))
+            if (gzip_reader_restart(reader, checkpoint_idx) == -1)
+                return -1;
+        do {
+            if (gzip_reader_fill(reader) == -1)
+                return -1;
+        } while ((reader->buf_len > 0) && (offset >= reader->buf_start + reader->buf_len));
+        if (reader->buf_len == 0) {
+            errno = EIO;
+            return -1;
+        }
+    }
+    *data = reader->buf + (offset - reader->buf_start);
+    *len = reader->buf_len - (size_t) (offset - reader->buf_start);
+
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*
+   libsample.c
+
+   Reentrant sampling contexts, for embedding; see libsample.h for the
+   interface. The sampling follows sample's standard input path: Li's
+   Algorithm L decides whether to keep each line-grouping as it starts,
+   and kept line-groupings are copied into a record arena. The skips are
+   drawn with the same algorithm_l.c as sample's own, so that a seed gives
+   the same sample either way.
+*/
+
+#include <time.h>
+
+#include "libsample.h"
+#include "algorithm_l.h"
+
+#define SAMPLE_CTX_POSITION_BATCH_SIZE 4096
+
+struct sample_ctx {
+    sample_options options;
+    rng_state rng;
+    record_arena *arena;
+    uint64_t *order;
+    long num_order;
+    long next_order;
+    long ln_idx;
+    long grp_idx;
+    long next_grp_idx;
+    double w;
+    int keep_all;
+    int keep_grp;
+    int finished;
+    int failed;
+};
+
+static pthread_once_t sample_ctx_scan_once = PTHREAD_ONCE_INIT;
+
+static void sample_ctx_scan_init(void)
+{
+    newline_scan_init();
+}
+
+void sample_options_init(sample_options *options)
+{
+    options->k = 0;
+    options->lines_per_offset = 1;
+    options->with_replacement = 0;
+    options->preserve_order = 0;
+    options->rng = kRngMt19937;
+    options->seed = (uint64_t) time(NULL);
+}
+
+sample_ctx * new_sample_ctx(const sample_options *options, sample_status *status)
+{
+    sample_ctx *ctx = NULL;
+
+    if ((!options) || (options->k < 0) || (options->lines_per_offset < 1) || ((int) options->rng < (int) kRngMt19937) || ((int) options->rng > (int) kRngPhilox) || 
+        ((options->rng == kRngMt19937) && ((options->seed & 0xffffffff) == 0))) {
+        if (status)
+            *status = kSampleErrorArgument;
+        return NULL;
+    }
+    pthread_once(&sample_ctx_scan_once, sample_ctx_scan_init);
+
+    ctx = calloc(1, sizeof(sample_ctx));
+    if (ctx)
+        ctx->arena = new_record_arena(RECORD_ARENA_DEFAULT_CAPACITY, RECORD_ARENA_DEFAULT_SLOTS);
+    if ((!ctx) || (!ctx->arena)) {
+        free(ctx);
+        if (status)
+            *status = kSampleErrorMemory;
+        return NULL;
+    }
+    ctx->options = *options;
+    rng_seed(&ctx->rng, options->rng, options->seed);
+
+    /* a shuffle, or a draw with replacement, keeps every line-grouping */
+    ctx->keep_all = ((options->k == 0) || (options->with_replacement));
+    ctx->keep_grp = 1;
+    if (status)
+        *status = kSampleOk;
+
+    return ctx;
+}
+
+void delete_sample_ctx(sample_ctx **ctx_ptr)
+{
+    if (*ctx_ptr) {
+        delete_record_arena(&((*ctx_ptr)->arena));
+        free((*ctx_ptr)->order);
+        free(*ctx_ptr);
+        *ctx_ptr = NULL;
+    }
+}
+
+sample_status sample_feed(sample_ctx *ctx, const char *buf, const size_t len)
+{
+    size_t newline_positions[SAMPLE_CTX_POSITION_BATCH_SIZE];
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+    size_t grp_start = 0;
+    size_t grp_stop = 0;
+    long slot_idx = 0;
+    const long k = ctx->options.k;
+    const int lines_per_offset = ctx->options.lines_per_offset;
+
+    if ((ctx->finished) || (ctx->failed))
+        return kSampleErrorState;
+    if ((!buf) && (len > 0))
+        return kSampleErrorArgument;
+
+    /*
+       as with standard input, whether to keep a line-grouping is settled when it starts,
+       and a kept one that runs past the end of this piece is finished by the next
+    */
+    while (scan_offset < len) {
+        num_positions = newline_scan_positions(buf + scan_offset, len - scan_offset, newline_positions, SAMPLE_CTX_POSITION_BATCH_SIZE, &scanned);
+        for (position_idx = 0; position_idx < num_positions; ++position_idx) {
+            if ((++ctx->ln_idx) % lines_per_offset)
+                continue;
+
+            grp_stop = scan_offset + newline_positions[position_idx] + 1;
+            if (ctx->keep_grp) {
+                if ((ctx->keep_all) || (ctx->grp_idx < k))
+                    slot_idx = ctx->grp_idx;
+                else {
+                    slot_idx = rng_bounded_modulo(&ctx->rng, k);
+                    ctx->w = algorithm_l_next_weight(&ctx->rng, ctx->w, k);
+                    ctx->next_grp_idx = algorithm_l_next_index(&ctx->rng, ctx->grp_idx, ctx->w);
+                }
+                if ((record_arena_extend(ctx->arena, buf + grp_start, grp_stop - grp_start) == -1) ||
+                    (record_arena_commit(ctx->arena, slot_idx, ctx->grp_idx) == -1)) {
+                    ctx->failed = 1;
+                    return kSampleErrorMemory;
+                }
+            }
+            grp_start = grp_stop;
+            ctx->grp_idx++;
+
+            /* once the reservoir is full, draw the first skip */
+            if ((!ctx->keep_all) && (ctx->grp_idx == k)) {
+                ctx->w = algorithm_l_initial_weight(&ctx->rng, k);
+                ctx->next_grp_idx = algorithm_l_next_index(&ctx->rng, ctx->grp_idx - 1, ctx->w);
+            }
+            ctx->keep_grp = ((ctx->keep_all) || (ctx->grp_idx < k) || (ctx->grp_idx == ctx->next_grp_idx));
+        }
+        scan_offset += scanned;
+    }
+    if ((ctx->keep_grp) && (grp_start < len)) {
+        if (record_arena_extend(ctx->arena, buf + grp_start, len - grp_start) == -1) {
+            ctx->failed = 1;
+            return kSampleErrorMemory;
+        }
+    }
+
+    return kSampleOk;
+}
+
+sample_status sample_feed_fd(sample_ctx *ctx, const int fd)
+{
+    char *block = NULL;
+    ssize_t block_len = 0;
+    sample_status status = kSampleOk;
+
+    if ((ctx->finished) || (ctx->failed))
+        return kSampleErrorState;
+    block = malloc(SAMPLE_FEED_READ_SIZE);
+    if (!block)
+        return kSampleErrorMemory;
+
+    while ((status == kSampleOk) && ((block_len = read(fd, block, SAMPLE_FEED_READ_SIZE)) != 0)) {
+        if (block_len < 0) {
+            if (errno == EINTR)
+                continue;
+            ctx->failed = 1;
+            status = kSampleErrorIO;
+            break;
+        }
+        status = sample_feed(ctx, block, (size_t) block_len);
+    }
+    free(block);
+
+    return status;
+}
+
+sample_status sample_feed_file(sample_ctx *ctx, const char *filename)
+{
+    int fd = -1;
+    struct stat s;
+    void *map = NULL;
+    sample_status status = kSampleOk;
+
+    if ((ctx->finished) || (ctx->failed))
+        return kSampleErrorState;
+    if (!filename)
+        return kSampleErrorArgument;
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return kSampleErrorIO;
+    if (fstat(fd, &s) == -1) {
+        close(fd);
+        return kSampleErrorIO;
+    }
+
+    /* a regular file is mapped for the length of the call; anything else is read */
+    if ((!S_ISREG(s.st_mode)) || (s.st_size == 0)) {
+        status = sample_feed_fd(ctx, fd);
+        close(fd);
+        return status;
+    }
+    map = mmap(NULL, (size_t) s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return kSampleErrorIO;
+    madvise(map, (size_t) s.st_size, MADV_SEQUENTIAL);
+    status = sample_feed(ctx, map, (size_t) s.st_size);
+    munmap(map, (size_t) s.st_size);
+
+    return status;
+}
+
+sample_status sample_finish(sample_ctx *ctx)
+{
+    record_arena *arena = ctx->arena;
+    long num_slots = 0;
+    long order_idx = 0;
+    long rand_idx = 0;
+    uint64_t swap = 0;
+
+    if (ctx->failed)
+        return kSampleErrorState;
+    if (ctx->finished)
+        return kSampleOk;
+    ctx->finished = 1;
+
+    /* a line-grouping without its final newline is left out */
+    record_arena_discard(arena);
+    if (ctx->options.preserve_order)
+        record_arena_sort_by_sequence(arena);
+    num_slots = arena->num_slots;
+
+    /* the order in which slots are handed out is drawn as the command-line tool draws it */
+    ctx->num_order = ((ctx->options.with_replacement) && (num_slots > 0) && (ctx->options.k > 0)) ? ctx->options.k : num_slots;
+    ctx->order = malloc(sizeof(uint64_t) * (ctx->num_order > 0 ? ctx->num_order : 1));
+    if (!ctx->order) {
+        ctx->failed = 1;
+        return kSampleErrorMemory;
+    }
+    if ((ctx->options.with_replacement) && (num_slots > 0)) {
+        for (order_idx = 0; order_idx < ctx->num_order; ++order_idx)
+            ctx->order[order_idx] = rng_bounded(&ctx->rng, num_slots);
+    }
+    else {
+        for (order_idx = 0; order_idx < ctx->num_order; ++order_idx)
+            ctx->order[order_idx] = (uint64_t) order_idx;
+        if (ctx->options.k == 0) {
+            for (order_idx = ctx->num_order - 1; order_idx > 0; --order_idx) {
+                rand_idx = rng_bounded(&ctx->rng, order_idx + 1);
+                swap = ctx->order[order_idx];
+                ctx->order[order_idx] = ctx->order[rand_idx];
+                ctx->order[rand_idx] = swap;
+            }
+        }
+    }
+    if ((ctx->options.preserve_order) && (radix_sort_uint64(ctx->order, ctx->num_order, 1) == -1)) {
+        ctx->failed = 1;
+        return kSampleErrorMemory;
+    }
+
+    return kSampleOk;
+}
+
+sample_status sample_next_record(sample_ctx *ctx, const char **record, size_t *len)
+{
+    sample_status status = kSampleOk;
+
+    if ((!record) || (!len))
+        return kSampleErrorArgument;
+    if ((!ctx->finished) && ((status = sample_finish(ctx)) != kSampleOk))
+        return status;
+    if (ctx->failed)
+        return kSampleErrorState;
+    if (ctx->next_order == ctx->num_order)
+        return kSampleEnd;
+
+    *record = record_arena_record(ctx->arena, (long) ctx->order[ctx->next_order++], len);
+
+    return kSampleOk;
+}
+
+long sample_num_records(const sample_ctx *ctx)
+{
+    return (ctx->finished) ? ctx->num_order : ctx->arena->num_slots;
+}
+
+const char * sample_status_string(const sample_status status)
+{
+    switch (status) {
+    case kSampleOk:
+        return "success";
+    case kSampleEnd:
+        return "no more records";
+    case kSampleErrorArgument:
+        return "invalid argument";
+    case kSampleErrorMemory:
+        return "out of memory";
+    case kSampleErrorIO:
+        return "input error";
+    case kSampleErrorState:
+        return "context is finished or failed";
+    default:
+        break;
+    }
+
+    return "unknown status";
+}
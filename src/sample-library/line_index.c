@@ -0,0 +1,224 @@
+/*
+   line_index.c
+
+   Builds, validates and maps the persistent line index sidecar. Building
+   costs one pass of the newline scanner over the input; afterwards, line
+   start offsets can be looked up directly from the mapped index, so that
+   repeated sampling runs on an unchanged input skip their indexing pass.
+*/
+
+#include "line_index.h"
+#include "newline_scan.h"
+
+#define LINE_INDEX_BATCH_SIZE 65536
+
+char * line_index_sidecar_name(const char *in_fn)
+{
+    char *index_fn = NULL;
+
+    index_fn = malloc(strlen(in_fn) + strlen(LINE_INDEX_SUFFIX) + 1);
+    if (!index_fn)
+        return NULL;
+    strcpy(index_fn, in_fn);
+    strcat(index_fn, LINE_INDEX_SUFFIX);
+
+    return index_fn;
+}
+
+int line_index_build(const char *in_map, const size_t in_size, const struct stat *in_stat, const char *index_fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> line_index_build()\n");
+#endif
+
+    line_index_header header;
+    size_t *positions = NULL;
+    uint64_t *offsets = NULL;
+    size_t num_positions = 0;
+    size_t position_idx = 0;
+    size_t scan_offset = 0;
+    size_t scanned = 0;
+    uint64_t line_start = 0;
+    char *tmp_fn = NULL;
+    FILE *tmp_file = NULL;
+    int tmp_fd = -1;
+    int tmp_created = 0;
+    int err = 0;
+
+    positions = malloc(sizeof(size_t) * LINE_INDEX_BATCH_SIZE);
+    offsets = malloc(sizeof(uint64_t) * LINE_INDEX_BATCH_SIZE);
+    tmp_fn = malloc(strlen(index_fn) + 8);
+    if ((!positions) || (!offsets) || (!tmp_fn)) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+
+    /* write to a temporary file and rename it into place, so a reader never sees a partial index */
+    strcpy(tmp_fn, index_fn);
+    strcat(tmp_fn, ".XXXXXX");
+    tmp_fd = mkstemp(tmp_fn);
+    if (tmp_fd == -1) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_created = 1;
+    fchmod(tmp_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    tmp_file = fdopen(tmp_fd, "wb");
+    if (!tmp_file) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_fd = -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINE_INDEX_MAGIC, sizeof(LINE_INDEX_MAGIC));
+    header.version = LINE_INDEX_VERSION;
+    header.offset_width = sizeof(uint64_t);
+    header.file_size = in_size;
+    header.file_mtime_sec = in_stat->st_mtim.tv_sec;
+    header.file_mtime_nsec = in_stat->st_mtim.tv_nsec;
+    if (fwrite(&header, sizeof(header), 1, tmp_file) != 1) {
+        err = errno;
+        goto cleanup;
+    }
+
+    /* each newline closes the line that started just past the previous one */
+    while (scan_offset < in_size) {
+        num_positions = newline_scan_positions(in_map + scan_offset, in_size - scan_offset, positions, LINE_INDEX_BATCH_SIZE, &scanned);
+        for (position_idx = 0; position_idx < num_positions; ++position_idx) {
+            offsets[position_idx] = line_start;
+            line_start = scan_offset + positions[position_idx] + 1;
+        }
+        if ((num_positions > 0) && (fwrite(offsets, sizeof(uint64_t), num_positions, tmp_file) != num_positions)) {
+            err = errno;
+            goto cleanup;
+        }
+        header.num_lines += num_positions;
+        scan_offset += scanned;
+    }
+
+    if ((fseek(tmp_file, 0, SEEK_SET) == -1) || (fwrite(&header, sizeof(header), 1, tmp_file) != 1) || (fflush(tmp_file) == EOF)) {
+        err = errno;
+        goto cleanup;
+    }
+    if (fclose(tmp_file) == EOF) {
+        tmp_file = NULL;
+        err = errno;
+        goto cleanup;
+    }
+    tmp_file = NULL;
+    if (rename(tmp_fn, index_fn) == -1)
+        err = errno;
+
+ cleanup:
+    if (tmp_file)
+        fclose(tmp_file);
+    if (tmp_fd != -1)
+        close(tmp_fd);
+    if ((err) && (tmp_created))
+        unlink(tmp_fn);
+    free(tmp_fn);
+    free(offsets);
+    free(positions);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> line_index_build()\n");
+#endif
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+line_index * line_index_open(const char *index_fn, const struct stat *in_stat)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> line_index_open()\n");
+#endif
+
+    line_index *idx = NULL;
+    struct stat index_stat;
+    const line_index_header *header = NULL;
+    int err = 0;
+
+    idx = malloc(sizeof(line_index));
+    if (!idx)
+        return NULL;
+    idx->map = MAP_FAILED;
+
+    idx->fd = open(index_fn, O_RDONLY);
+    if ((idx->fd == -1) || (fstat(idx->fd, &index_stat) == -1)) {
+        err = errno;
+        goto error;
+    }
+    idx->size = index_stat.st_size;
+    if (idx->size < sizeof(line_index_header)) {
+        err = EINVAL;
+        goto error;
+    }
+    idx->map = mmap(NULL, idx->size, PROT_READ, MAP_SHARED, idx->fd, 0);
+    if (idx->map == MAP_FAILED) {
+        err = errno;
+        goto error;
+    }
+
+    /* reject indices of some other file, or of an older version of this one */
+    header = (const line_index_header *) idx->map;
+    if ((memcmp(header->magic, LINE_INDEX_MAGIC, sizeof(LINE_INDEX_MAGIC)) != 0) ||
+        (header->version != LINE_INDEX_VERSION) ||
+        (header->offset_width != sizeof(uint64_t)) ||
+        (header->file_size != (uint64_t) in_stat->st_size) ||
+        (header->file_mtime_sec != (int64_t) in_stat->st_mtim.tv_sec) ||
+        (header->file_mtime_nsec != (int64_t) in_stat->st_mtim.tv_nsec) ||
+        (idx->size != sizeof(line_index_header) + header->num_lines * header->offset_width)) {
+        err = ESTALE;
+        goto error;
+    }
+    idx->header = header;
+    idx->offsets = (const uint64_t *) (idx->map + sizeof(line_index_header));
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> line_index_open()\n");
+#endif
+
+    return idx;
+
+ error:
+    if (idx->map != MAP_FAILED)
+        munmap(idx->map, idx->size);
+    if (idx->fd != -1)
+        close(idx->fd);
+    free(idx);
+    errno = err;
+
+    return NULL;
+}
+
+void line_index_close(line_index **idx_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> line_index_close()\n");
+#endif
+
+    munmap((*idx_ptr)->map, (*idx_ptr)->size);
+    close((*idx_ptr)->fd);
+    free(*idx_ptr);
+    *idx_ptr = NULL;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> line_index_close()\n");
+#endif
+}
+
+uint64_t line_index_num_lines(const line_index *idx)
+{
+    return idx->header->num_lines;
+}
+
+off_t line_index_offset(const line_index *idx, const uint64_t line_idx)
+{
+    return (off_t) idx->offsets[line_idx];
+}
@@ -35,20 +35,42 @@
    Any feedback is very welcome. For any question, comments,       
    see http://www.math.keio.ac.jp/matumoto/emt.html or email       
    matumoto@math.keio.ac.jp                                        
+
+   ------
+
+   The generator state lives in an mt19937_state, so that independent
+   streams (one per worker thread, say) can be run side by side with the
+   *_r calls. The original calls operate on mt19937_global_state.
 */
 
 #include "mt19937.h"
 
-unsigned long mt[MT19937_N] = {0};
-int mti = MT19937_N + 1;
+mt19937_state mt19937_global_state = { {0}, MT19937_N + 1 };
 
 /* initializing the array with a NONZERO seed */
 void mt19937_seed_rng(unsigned long seed)
+{
+    mt19937_seed_rng_r(&mt19937_global_state, seed);
+}
+
+double mt19937_generate_random_double()
+{
+    return mt19937_generate_random_double_r(&mt19937_global_state);
+}
+
+unsigned long mt19937_generate_random_ulong()
+{
+    return mt19937_generate_random_ulong_r(&mt19937_global_state);
+}
+
+void mt19937_seed_rng_r(mt19937_state *state, unsigned long seed)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> mt19937_seed_rng()\n");
+    fprintf(stderr, "Debug: Entering --> mt19937_seed_rng_r()\n");
 #endif
 
+    unsigned long *mt = state->mt;
+
     /* 
        setting initial seeds to mt[N] using
        the generator Line 25 of Table 1 in
@@ -56,81 +78,48 @@ void mt19937_seed_rng(unsigned long seed)
        Vol. 2 (2nd Ed.), pp102]
     */
     mt[0]= seed & 0xffffffff;
-    for (mti = 1; mti < MT19937_N; ++mti)
-        mt[mti] = (69069 * mt[mti - 1]) & 0xffffffff;
+    for (state->mti = 1; state->mti < MT19937_N; ++state->mti)
+        mt[state->mti] = (69069 * mt[state->mti - 1]) & 0xffffffff;
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> mt19937_seed_rng()\n");
+    fprintf(stderr, "Debug: Leaving  --> mt19937_seed_rng_r()\n");
 #endif
 }
 
-double mt19937_generate_random_double()
+double mt19937_generate_random_double_r(mt19937_state *state)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> mt19937_generate_random_double()\n");
+    fprintf(stderr, "Debug: Entering --> mt19937_generate_random_double_r()\n");
 #endif
 
-    unsigned long y;
-    static unsigned long mag01[2] = {0x0, MT19937_MATRIX_A};
-    /* mag01[x] = x * MT19937_MATRIX_A  for x=0,1 */
-
-    if (mti >= MT19937_N) 
-        { 
-            /* generate N words at one time */
-            int kk;
-            
-            /* if mt19937_seed_rng() has not been called, a default initial seed is used */
-            if (mti == MT19937_N + 1)   
-                mt19937_seed_rng(4357); 
-
-            for (kk = 0;kk < MT19937_N - MT19937_M; ++kk) 
-                {
-                    y = (mt[kk] & MT19937_UPPER_MASK) | (mt[kk+1] & MT19937_LOWER_MASK);
-                    mt[kk] = mt[kk + MT19937_M] ^ (y >> 1) ^ mag01[y & 0x1];
-                }
-            
-            for (;kk < MT19937_N - 1; ++kk) 
-                {
-                    y = (mt[kk] & MT19937_UPPER_MASK) | (mt[kk + 1] & MT19937_LOWER_MASK);
-                    mt[kk] = mt[kk + (MT19937_M - MT19937_N)] ^ (y >> 1) ^ mag01[y & 0x1];
-                }
-            y = (mt[MT19937_N - 1] & MT19937_UPPER_MASK) | (mt[0] & MT19937_LOWER_MASK);
-            mt[MT19937_N - 1] = mt[MT19937_M - 1] ^ (y >> 1) ^ mag01[y & 0x1];
-
-            mti = 0;
-        }
-  
-    y = mt[mti++];
-    y ^= MT19937_SHIFT_U(y);
-    y ^= MT19937_SHIFT_S(y) & MT19937_MASK_B;
-    y ^= MT19937_SHIFT_T(y) & MT19937_MASK_C;
-    y ^= MT19937_SHIFT_L(y);
+    unsigned long y = mt19937_generate_random_ulong_r(state);
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> mt19937_generate_random_double()\n");
+    fprintf(stderr, "Debug: Leaving  --> mt19937_generate_random_double_r()\n");
 #endif
 
     return (double) y / (unsigned long) 0xffffffff;
 }
 
-unsigned long mt19937_generate_random_ulong()
+unsigned long mt19937_generate_random_ulong_r(mt19937_state *state)
 {
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Entering --> mt19937_generate_random_ulong()\n");
+    fprintf(stderr, "Debug: Entering --> mt19937_generate_random_ulong_r()\n");
 #endif
 
+    unsigned long *mt = state->mt;
     unsigned long y;
-    static unsigned long mag01[2] = {0x0, MT19937_MATRIX_A};
+    static const unsigned long mag01[2] = {0x0, MT19937_MATRIX_A};
     /* mag01[x] = x * MT19937_MATRIX_A  for x=0,1 */
 
-    if (mti >= MT19937_N) 
+    if (state->mti >= MT19937_N) 
         { 
             /* generate N words at one time */
             int kk;
             
-            /* if mt19937_seed_rng() has not been called, a default initial seed is used */
-            if (mti == MT19937_N + 1)   
-                mt19937_seed_rng(4357); 
+            /* if mt19937_seed_rng_r() has not been called, a default initial seed is used */
+            if (state->mti == MT19937_N + 1)   
+                mt19937_seed_rng_r(state, 4357); 
 
             for (kk = 0;kk < MT19937_N - MT19937_M; ++kk) 
                 {
@@ -146,17 +135,17 @@ unsigned long mt19937_generate_random_ulong()
             y = (mt[MT19937_N - 1] & MT19937_UPPER_MASK) | (mt[0] & MT19937_LOWER_MASK);
             mt[MT19937_N - 1] = mt[MT19937_M - 1] ^ (y >> 1) ^ mag01[y & 0x1];
 
-            mti = 0;
+            state->mti = 0;
         }
   
-    y = mt[mti++];
+    y = mt[state->mti++];
     y ^= MT19937_SHIFT_U(y);
     y ^= MT19937_SHIFT_S(y) & MT19937_MASK_B;
     y ^= MT19937_SHIFT_T(y) & MT19937_MASK_C;
     y ^= MT19937_SHIFT_L(y);
 
 #ifdef DEBUG
-    fprintf(stderr, "Debug: Leaving  --> mt19937_generate_random_ulong()\n");
+    fprintf(stderr, "Debug: Leaving  --> mt19937_generate_random_ulong_r()\n");
 #endif
 
     return y;
@@ -0,0 +1,269 @@
+/*
+   newline_scan.c
+
+   Vectorized record-boundary scanner. Each kernel compares a full vector of
+   input bytes against '\n', reduces the comparison to a bitmask, and walks the
+   set bits of that mask, so that a 64-byte stretch without a newline costs a
+   single compare rather than 64 byte tests.
+
+   Kernels are compiled with per-function target attributes, so that the
+   library itself still builds for (and runs on) a baseline x86-64 host; the
+   widest kernel the CPU supports is selected on first use.
+*/
+
+#include <stdint.h>
+#include "newline_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEWLINE_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*newline_scan_positions_fn)(const char *, size_t, size_t *, size_t, size_t *);
+typedef const char * (*newline_scan_nth_fn)(const char *, const char *, long);
+typedef size_t (*newline_scan_count_fn)(const char *, size_t);
+
+static newline_scan_positions_fn newline_scan_positions_impl = NULL;
+static newline_scan_nth_fn newline_scan_nth_impl = NULL;
+static newline_scan_count_fn newline_scan_count_impl = NULL;
+static const char *newline_scan_impl_name = "scalar";
+
+static size_t newline_scan_positions_scalar(const char *buf, size_t len, size_t *positions, size_t capacity, size_t *scanned)
+{
+    const char *cursor = buf;
+    const char *stop = buf + len;
+    const char *nl = NULL;
+    size_t count = 0;
+
+    while ((count < capacity) && (cursor < stop)) {
+        nl = memchr(cursor, '\n', stop - cursor);
+        if (!nl) {
+            cursor = stop;
+            break;
+        }
+        positions[count++] = nl - buf;
+        cursor = nl + 1;
+    }
+    *scanned = cursor - buf;
+
+    return count;
+}
+
+static const char * newline_scan_nth_scalar(const char *start, const char *stop, long n)
+{
+    const char *nl = NULL;
+
+    while (start < stop) {
+        nl = memchr(start, '\n', stop - start);
+        if ((!nl) || (--n == 0))
+            break;
+        start = nl + 1;
+        nl = NULL;
+    }
+
+    return nl;
+}
+
+static size_t newline_scan_count_scalar(const char *buf, size_t len)
+{
+    const char *stop = buf + len;
+    const char *nl = NULL;
+    size_t count = 0;
+
+    while ((buf < stop) && ((nl = memchr(buf, '\n', stop - buf)) != NULL)) {
+        count++;
+        buf = nl + 1;
+    }
+
+    return count;
+}
+
+#ifdef NEWLINE_SCAN_X86
+
+/*
+   Stamps out the positions/nth/count kernels for one vector width; MASK_FN
+   must return a bitmask with bit i set when p[i] == '\n'.
+*/
+#define NEWLINE_SCAN_KERNELS(SUFFIX, WIDTH, TARGET, MASK_FN)            \
+    __attribute__((target(TARGET)))                                     \
+    static size_t newline_scan_positions_##SUFFIX(const char *buf, size_t len, size_t *positions, size_t capacity, size_t *scanned) \
+    {                                                                   \
+        size_t idx = 0;                                                 \
+        size_t count = 0;                                               \
+        uint64_t mask = 0;                                              \
+                                                                        \
+        while (idx + (WIDTH) <= len) {                                  \
+            mask = MASK_FN(buf + idx);                                  \
+            if ((size_t) __builtin_popcountll(mask) > capacity - count) \
+                break;                                                  \
+            while (mask) {                                              \
+                positions[count++] = idx + __builtin_ctzll(mask);       \
+                mask &= mask - 1;                                       \
+            }                                                           \
+            idx += (WIDTH);                                             \
+        }                                                               \
+        for (; (idx < len) && (count < capacity); ++idx)                \
+            if (buf[idx] == '\n')                                       \
+                positions[count++] = idx;                               \
+        *scanned = idx;                                                 \
+                                                                        \
+        return count;                                                   \
+    }                                                                   \
+                                                                        \
+    __attribute__((target(TARGET)))                                     \
+    static const char * newline_scan_nth_##SUFFIX(const char *start, const char *stop, long n) \
+    {                                                                   \
+        uint64_t mask = 0;                                              \
+        long count = 0;                                                 \
+                                                                        \
+        while (start + (WIDTH) <= stop) {                               \
+            mask = MASK_FN(start);                                      \
+            count = __builtin_popcountll(mask);                         \
+            if (count >= n) {                                           \
+                while (--n)                                             \
+                    mask &= mask - 1;                                   \
+                return start + __builtin_ctzll(mask);                   \
+            }                                                           \
+            n -= count;                                                 \
+            start += (WIDTH);                                           \
+        }                                                               \
+                                                                        \
+        return newline_scan_nth_scalar(start, stop, n);                 \
+    }                                                                   \
+                                                                        \
+    __attribute__((target(TARGET)))                                     \
+    static size_t newline_scan_count_##SUFFIX(const char *buf, size_t len) \
+    {                                                                   \
+        size_t idx = 0;                                                 \
+        size_t count = 0;                                               \
+                                                                        \
+        for (; idx + (WIDTH) <= len; idx += (WIDTH))                    \
+            count += __builtin_popcountll(MASK_FN(buf + idx));          \
+                                                                        \
+        return count + newline_scan_count_scalar(buf + idx, len - idx); \
+    }
+
+__attribute__((target("sse2,popcnt")))
+static inline uint64_t newline_scan_mask_sse2(const char *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    return (uint64_t) (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+__attribute__((target("avx2,popcnt,bmi")))
+static inline uint64_t newline_scan_mask_avx2(const char *p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    return (uint64_t) (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt,bmi")))
+static inline uint64_t newline_scan_mask_avx512(const char *p)
+{
+    __m512i v = _mm512_loadu_si512((const void *) p);
+    return (uint64_t) _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'));
+}
+
+NEWLINE_SCAN_KERNELS(sse2, 16, "sse2,popcnt", newline_scan_mask_sse2)
+NEWLINE_SCAN_KERNELS(avx2, 32, "avx2,popcnt,bmi", newline_scan_mask_avx2)
+NEWLINE_SCAN_KERNELS(avx512, 64, "avx512f,avx512bw,popcnt,bmi", newline_scan_mask_avx512)
+
+#endif /* NEWLINE_SCAN_X86 */
+
+void newline_scan_init()
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> newline_scan_init()\n");
+#endif
+
+    const char *forced = getenv("SAMPLE_NEWLINE_SCAN");
+    int widest = 3;
+
+    newline_scan_positions_impl = newline_scan_positions_scalar;
+    newline_scan_nth_impl = newline_scan_nth_scalar;
+    newline_scan_count_impl = newline_scan_count_scalar;
+    newline_scan_impl_name = "scalar";
+
+    if (forced) {
+        if (strcmp(forced, "scalar") == 0)
+            widest = 0;
+        else if (strcmp(forced, "sse2") == 0)
+            widest = 1;
+        else if (strcmp(forced, "avx2") == 0)
+            widest = 2;
+    }
+
+#ifdef NEWLINE_SCAN_X86
+    __builtin_cpu_init();
+    if ((widest >= 3) && (__builtin_cpu_supports("avx512bw")) && (__builtin_cpu_supports("popcnt"))) {
+        newline_scan_positions_impl = newline_scan_positions_avx512;
+        newline_scan_nth_impl = newline_scan_nth_avx512;
+        newline_scan_count_impl = newline_scan_count_avx512;
+        newline_scan_impl_name = "avx512";
+    }
+    else if ((widest >= 2) && (__builtin_cpu_supports("avx2")) && (__builtin_cpu_supports("popcnt"))) {
+        newline_scan_positions_impl = newline_scan_positions_avx2;
+        newline_scan_nth_impl = newline_scan_nth_avx2;
+        newline_scan_count_impl = newline_scan_count_avx2;
+        newline_scan_impl_name = "avx2";
+    }
+    else if ((widest >= 1) && (__builtin_cpu_supports("sse2")) && (__builtin_cpu_supports("popcnt"))) {
+        newline_scan_positions_impl = newline_scan_positions_sse2;
+        newline_scan_nth_impl = newline_scan_nth_sse2;
+        newline_scan_count_impl = newline_scan_count_sse2;
+        newline_scan_impl_name = "sse2";
+    }
+#else
+    (void) widest;
+#endif
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Selected newline scanner [%s]\n", newline_scan_impl_name);
+    fprintf(stderr, "Debug: Leaving  --> newline_scan_init()\n");
+#endif
+}
+
+const char * newline_scan_name()
+{
+    if (!newline_scan_positions_impl)
+        newline_scan_init();
+
+    return newline_scan_impl_name;
+}
+
+/*
+   Writes the positions (relative to buf) of up to capacity newlines found in
+   buf[0..len), in ascending order, and returns how many were written. On
+   return, *scanned holds the number of bytes examined, so that a caller whose
+   capacity was exhausted can resume the scan at buf + *scanned.
+*/
+size_t newline_scan_positions(const char *buf, size_t len, size_t *positions, size_t capacity, size_t *scanned)
+{
+    if (!newline_scan_positions_impl)
+        newline_scan_init();
+
+    return newline_scan_positions_impl(buf, len, positions, capacity, scanned);
+}
+
+/*
+   Returns a pointer to the n-th (1-based) newline in [start, stop), or NULL
+   when there are fewer than n newlines left in the range.
+*/
+const char * newline_scan_nth(const char *start, const char *stop, long n)
+{
+    if (!newline_scan_nth_impl)
+        newline_scan_init();
+
+    if ((n < 1) || (start >= stop))
+        return NULL;
+
+    return newline_scan_nth_impl(start, stop, n);
+}
+
+size_t newline_scan_count(const char *buf, size_t len)
+{
+    if (!newline_scan_count_impl)
+        newline_scan_init();
+
+    return newline_scan_count_impl(buf, len);
+}
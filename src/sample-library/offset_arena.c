@@ -0,0 +1,73 @@
+/*
+   offset_arena.c
+
+   Page-mapped blocks for reservoir offset arrays; see offset_arena.h.
+*/
+
+#include "offset_arena.h"
+
+static size_t offset_arena_round(const size_t bytes)
+{
+    static size_t page_size = 0;
+
+    if (page_size == 0)
+        page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    return (bytes > 0) ? (bytes + page_size - 1) / page_size * page_size : page_size;
+}
+
+static void offset_arena_advise(void *block, const size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+    /* a hint only -- without transparent huge pages, the block is simply made of small pages */
+    if (bytes >= OFFSET_ARENA_HUGE_PAGE_SIZE)
+        madvise(block, bytes, MADV_HUGEPAGE);
+#else
+    (void) block;
+    (void) bytes;
+#endif
+}
+
+void * offset_arena_reserve(const size_t bytes)
+{
+    size_t mapped_bytes = offset_arena_round(bytes);
+    void *block = NULL;
+
+    block = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED)
+        return NULL;
+    offset_arena_advise(block, mapped_bytes);
+
+    return block;
+}
+
+void * offset_arena_resize(void *block, const size_t old_bytes, const size_t new_bytes)
+{
+    size_t old_mapped_bytes = offset_arena_round(old_bytes);
+    size_t new_mapped_bytes = offset_arena_round(new_bytes);
+    void *resized_block = NULL;
+
+    if (old_mapped_bytes == new_mapped_bytes)
+        return block;
+
+#ifdef __linux__
+    resized_block = mremap(block, old_mapped_bytes, new_mapped_bytes, MREMAP_MAYMOVE);
+    if (resized_block == MAP_FAILED)
+        return NULL;
+#else
+    resized_block = offset_arena_reserve(new_bytes);
+    if (!resized_block)
+        return NULL;
+    memcpy(resized_block, block, (old_mapped_bytes < new_mapped_bytes) ? old_mapped_bytes : new_mapped_bytes);
+    munmap(block, old_mapped_bytes);
+#endif
+    offset_arena_advise(resized_block, new_mapped_bytes);
+
+    return resized_block;
+}
+
+void offset_arena_release(void *block, const size_t bytes)
+{
+    if (block)
+        munmap(block, offset_arena_round(bytes));
+}
@@ -0,0 +1,279 @@
+/*
+   output_buffer.c
+
+   Buffered bulk emitter for sampled records. Rather than handing stdio one
+   character at a time, callers append whole records, and the buffer goes
+   out to the file descriptor in large write(2) calls.
+
+   When a zero-copy backend is active, records queued as input file ranges
+   are instead moved by the kernel; a backend that the kernel turns down
+   partway through (e.g., EXDEV from copy_file_range across filesystems) is
+   swapped for the next one down, ending with write(2) from the mapping.
+*/
+
+#include "output_buffer.h"
+
+static int output_buffer_write_fully(const int fd, const char *data, size_t len)
+{
+    ssize_t written = 0;
+
+    while (len > 0) {
+        written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
+static int output_buffer_copy(output_buffer *ob, const char *data, const size_t len)
+{
+    /* large records go straight out, after whatever is already queued */
+    if (len >= ob->capacity / 2) {
+        if (output_buffer_flush(ob) == -1)
+            return -1;
+        if (output_buffer_write_fully(ob->fd, data, len) == -1)
+            return -1;
+        ob->bytes_written += len;
+        return 0;
+    }
+
+    if (ob->length + len > ob->capacity)
+        if (output_buffer_flush(ob) == -1)
+            return -1;
+
+    memcpy(ob->buf + ob->length, data, len);
+    ob->length += len;
+
+    return 0;
+}
+
+static int output_buffer_fallback_errno(const int err)
+{
+    return ((err == EINVAL) || (err == ENOSYS) || (err == EXDEV) || (err == EBADF) || (err == EOPNOTSUPP));
+}
+
+static int output_buffer_flush_range(output_buffer *ob)
+{
+    ssize_t moved = 0;
+#ifdef __linux__
+    loff_t in_offset = 0;
+    struct iovec iov;
+#endif
+
+    while (ob->pending_length > 0) {
+        switch (ob->backend) {
+#ifdef __linux__
+        case kOutputBackendSplice:
+            in_offset = ob->pending_offset;
+            moved = splice(ob->in_fd, &in_offset, ob->fd, NULL, ob->pending_length, SPLICE_F_MORE);
+            break;
+        case kOutputBackendVmsplice:
+            iov.iov_base = (void *) (ob->in_map + ob->pending_offset);
+            iov.iov_len = ob->pending_length;
+            moved = vmsplice(ob->fd, &iov, 1, 0);
+            break;
+        case kOutputBackendCopyFileRange:
+            in_offset = ob->pending_offset;
+            moved = copy_file_range(ob->in_fd, &in_offset, ob->fd, NULL, ob->pending_length, 0);
+            break;
+#endif
+        default:
+            moved = write(ob->fd, ob->in_map + ob->pending_offset, ob->pending_length);
+            break;
+        }
+        if (moved < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((ob->backend != kOutputBackendWrite) && (output_buffer_fallback_errno(errno))) {
+                ob->backend = ((ob->backend == kOutputBackendSplice) && (ob->in_map)) ? kOutputBackendVmsplice : kOutputBackendWrite;
+                continue;
+            }
+            return -1;
+        }
+        if (moved == 0) {
+            /* the input came up short (it may have been truncated under us), so stop trusting the kernel path */
+            if (ob->backend == kOutputBackendWrite) {
+                errno = EIO;
+                return -1;
+            }
+            ob->backend = kOutputBackendWrite;
+            continue;
+        }
+        ob->pending_offset += moved;
+        ob->pending_length -= moved;
+        ob->bytes_written += moved;
+    }
+
+    return 0;
+}
+
+output_buffer * new_output_buffer(const int fd, const size_t capacity)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_output_buffer()\n");
+#endif
+
+    output_buffer *ob = NULL;
+    void *buf = NULL;
+    int err = 0;
+
+    ob = malloc(sizeof(output_buffer));
+    if (!ob)
+        return NULL;
+
+    err = posix_memalign(&buf, OUTPUT_BUFFER_ALIGNMENT, capacity);
+    if (err) {
+        free(ob);
+        errno = err;
+        return NULL;
+    }
+
+    ob->fd = fd;
+    ob->buf = buf;
+    ob->capacity = capacity;
+    ob->length = 0;
+    ob->bytes_written = 0;
+    ob->records_written = 0;
+    ob->backend = kOutputBackendWrite;
+    ob->in_fd = -1;
+    ob->in_map = NULL;
+    ob->pending_offset = 0;
+    ob->pending_length = 0;
+    gettimeofday(&ob->start_time, NULL);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_output_buffer()\n");
+#endif
+
+    return ob;
+}
+
+void delete_output_buffer(output_buffer **ob_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> delete_output_buffer()\n");
+#endif
+
+    free((*ob_ptr)->buf);
+    (*ob_ptr)->buf = NULL;
+    free(*ob_ptr);
+    *ob_ptr = NULL;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> delete_output_buffer()\n");
+#endif
+}
+
+int output_buffer_append(output_buffer *ob, const char *data, const size_t len)
+{
+    ob->records_written++;
+
+    if (ob->pending_length > 0)
+        if (output_buffer_flush_range(ob) == -1)
+            return -1;
+
+    return output_buffer_copy(ob, data, len);
+}
+
+int output_buffer_append_range(output_buffer *ob, const off_t offset, const size_t len)
+{
+    ob->records_written++;
+
+    if (ob->backend == kOutputBackendWrite)
+        return output_buffer_copy(ob, ob->in_map + offset, len);
+
+    /* sorted samples often abut one another, in which case one call moves them all */
+    if ((ob->pending_length > 0) && (ob->pending_offset + (off_t) ob->pending_length == offset)) {
+        ob->pending_length += len;
+        return 0;
+    }
+
+    if (output_buffer_flush(ob) == -1)
+        return -1;
+    ob->pending_offset = offset;
+    ob->pending_length = len;
+
+    return 0;
+}
+
+int output_buffer_flush(output_buffer *ob)
+{
+    if (ob->length > 0) {
+        if (output_buffer_write_fully(ob->fd, ob->buf, ob->length) == -1)
+            return -1;
+        ob->bytes_written += ob->length;
+        ob->length = 0;
+    }
+
+    return output_buffer_flush_range(ob);
+}
+
+int output_buffer_set_source(output_buffer *ob, const int in_fd, const char *in_map)
+{
+    /* a range still queued from the previous source goes out before the switch */
+    if ((ob->pending_length > 0) && ((in_fd != ob->in_fd) || (in_map != ob->in_map)))
+        if (output_buffer_flush(ob) == -1)
+            return -1;
+    ob->in_fd = in_fd;
+    ob->in_map = in_map;
+
+    return 0;
+}
+
+output_backend output_buffer_use_zero_copy(output_buffer *ob)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> output_buffer_use_zero_copy()\n");
+#endif
+
+#ifdef __linux__
+    struct stat out_stat;
+    int out_flags = 0;
+
+    if ((ob->in_fd >= 0) && (fstat(ob->fd, &out_stat) == 0)) {
+        out_flags = fcntl(ob->fd, F_GETFL);
+        if (S_ISFIFO(out_stat.st_mode))
+            ob->backend = kOutputBackendSplice;
+        else if ((S_ISREG(out_stat.st_mode)) && (out_flags != -1) && (!(out_flags & O_APPEND)))
+            ob->backend = kOutputBackendCopyFileRange;
+    }
+#endif
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Output backend is [%s]\n", output_buffer_backend_name(ob->backend));
+    fprintf(stderr, "Debug: Leaving  --> output_buffer_use_zero_copy()\n");
+#endif
+
+    return ob->backend;
+}
+
+const char * output_buffer_backend_name(const output_backend backend)
+{
+    switch (backend) {
+    case kOutputBackendSplice:
+        return "splice";
+    case kOutputBackendVmsplice:
+        return "vmsplice";
+    case kOutputBackendCopyFileRange:
+        return "copy_file_range";
+    default:
+        break;
+    }
+
+    return "write";
+}
+
+double output_buffer_elapsed_seconds(const output_buffer *ob)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double) (now.tv_sec - ob->start_time.tv_sec) + (double) (now.tv_usec - ob->start_time.tv_usec) / 1e6;
+}
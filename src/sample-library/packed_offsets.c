@@ -0,0 +1,143 @@
+/*
+   packed_offsets.c
+
+   Frame-of-reference packing of offset runs; see packed_offsets.h for the
+   layout.
+*/
+
+#include "packed_offsets.h"
+
+static int packed_offsets_reserve_words(packed_offsets *po, const size_t num_words)
+{
+    uint64_t *resized_words = NULL;
+    size_t new_capacity = po->word_capacity;
+
+    /* one spare word lets a read straddle the last word without a bounds check */
+    if (po->num_words + num_words + 1 <= po->word_capacity)
+        return 0;
+    while (po->num_words + num_words + 1 > new_capacity)
+        new_capacity *= 2;
+    resized_words = realloc(po->words, sizeof(uint64_t) * new_capacity);
+    if (!resized_words)
+        return -1;
+    memset(resized_words + po->word_capacity, 0, sizeof(uint64_t) * (new_capacity - po->word_capacity));
+    po->words = resized_words;
+    po->word_capacity = new_capacity;
+
+    return 0;
+}
+
+static int packed_offsets_encode_block(packed_offsets *po)
+{
+    packed_offsets_block *resized_blocks = NULL;
+    packed_offsets_block *block = NULL;
+    uint64_t base = po->pending[0];
+    uint64_t span = 0;
+    uint64_t delta = 0;
+    uint64_t bit = 0;
+    uint64_t shift = 0;
+    unsigned int width = 0;
+    size_t value_idx = 0;
+
+    for (value_idx = 1; value_idx < PACKED_OFFSETS_BLOCK_SIZE; ++value_idx)
+        if (po->pending[value_idx] < base)
+            base = po->pending[value_idx];
+    for (value_idx = 0; value_idx < PACKED_OFFSETS_BLOCK_SIZE; ++value_idx)
+        if (po->pending[value_idx] - base > span)
+            span = po->pending[value_idx] - base;
+    width = (span > 0) ? 64 - __builtin_clzll(span) : 0;
+
+    if (po->num_blocks + 2 > po->block_capacity) {
+        resized_blocks = realloc(po->blocks, sizeof(packed_offsets_block) * po->block_capacity * 2);
+        if (!resized_blocks)
+            return -1;
+        po->blocks = resized_blocks;
+        po->block_capacity *= 2;
+    }
+    if (packed_offsets_reserve_words(po, (width * PACKED_OFFSETS_BLOCK_SIZE + 63) / 64) == -1)
+        return -1;
+
+    block = &po->blocks[po->num_blocks];
+    block->base = base;
+    bit = block->bit_start;
+    for (value_idx = 0; (width > 0) && (value_idx < PACKED_OFFSETS_BLOCK_SIZE); ++value_idx) {
+        delta = po->pending[value_idx] - base;
+        shift = bit & 63;
+        po->words[bit >> 6] |= delta << shift;
+        if (shift + width > 64)
+            po->words[(bit >> 6) + 1] |= delta >> (64 - shift);
+        bit += width;
+    }
+    block[1].bit_start = bit;
+    po->num_words = (bit + 63) / 64;
+    po->num_blocks++;
+    po->num_pending = 0;
+
+    return 0;
+}
+
+packed_offsets * new_packed_offsets()
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_packed_offsets()\n");
+#endif
+
+    packed_offsets *po = NULL;
+
+    po = malloc(sizeof(packed_offsets));
+    if (!po)
+        return NULL;
+
+    po->word_capacity = 1024;
+    po->block_capacity = 64;
+    po->words = calloc(po->word_capacity, sizeof(uint64_t));
+    po->blocks = malloc(sizeof(packed_offsets_block) * po->block_capacity);
+    if ((!po->words) || (!po->blocks)) {
+        free(po->words);
+        free(po->blocks);
+        free(po);
+        return NULL;
+    }
+    po->blocks[0].bit_start = 0;
+    po->num_words = 0;
+    po->num_blocks = 0;
+    po->num_pending = 0;
+    po->num_values = 0;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_packed_offsets()\n");
+#endif
+
+    return po;
+}
+
+void delete_packed_offsets(packed_offsets **po_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> delete_packed_offsets()\n");
+#endif
+
+    free((*po_ptr)->words);
+    free((*po_ptr)->blocks);
+    free(*po_ptr);
+    *po_ptr = NULL;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> delete_packed_offsets()\n");
+#endif
+}
+
+int packed_offsets_append(packed_offsets *po, const uint64_t value)
+{
+    po->pending[po->num_pending++] = value;
+    po->num_values++;
+    if (po->num_pending == PACKED_OFFSETS_BLOCK_SIZE)
+        return packed_offsets_encode_block(po);
+
+    return 0;
+}
+
+size_t packed_offsets_bytes(const packed_offsets *po)
+{
+    return sizeof(packed_offsets) + sizeof(uint64_t) * po->word_capacity + sizeof(packed_offsets_block) * po->block_capacity;
+}
@@ -0,0 +1,223 @@
+/*
+   radix_sort.c
+
+   LSD radix sort of unsigned keys; see radix_sort.h.
+*/
+
+#include "radix_sort.h"
+#include "offset_arena.h"
+
+typedef struct radix_sort_task radix_sort_task;
+
+struct radix_sort_task {
+    const void *src;
+    void *dst;
+    size_t start;
+    size_t stop;
+    int key_bytes;
+    unsigned int shift;
+    size_t counts[RADIX_SORT_NUM_BUCKETS];
+    size_t digit_counts[sizeof(uint64_t)][RADIX_SORT_NUM_BUCKETS];
+};
+
+/*
+   Stamps out the counting and scattering kernels for one key type; a
+   scatter expects task->counts to hold the first output position of each
+   bucket, and leaves it holding the one past the last.
+*/
+#define RADIX_SORT_KERNELS(SUFFIX, TYPE)                                \
+    static void radix_sort_count_digits_##SUFFIX(radix_sort_task *task) \
+    {                                                                   \
+        const TYPE *keys = task->src;                                   \
+        size_t key_idx = 0;                                             \
+        size_t digit_idx = 0;                                           \
+        TYPE key = 0;                                                   \
+                                                                        \
+        for (key_idx = task->start; key_idx < task->stop; ++key_idx) {  \
+            key = keys[key_idx];                                        \
+            for (digit_idx = 0; digit_idx < sizeof(TYPE); ++digit_idx)  \
+                task->digit_counts[digit_idx][(key >> (digit_idx * RADIX_SORT_DIGIT_BITS)) & (RADIX_SORT_NUM_BUCKETS - 1)]++; \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void radix_sort_count_##SUFFIX(radix_sort_task *task)        \
+    {                                                                   \
+        const TYPE *keys = task->src;                                   \
+        size_t key_idx = 0;                                             \
+                                                                        \
+        for (key_idx = task->start; key_idx < task->stop; ++key_idx)    \
+            task->counts[(keys[key_idx] >> task->shift) & (RADIX_SORT_NUM_BUCKETS - 1)]++; \
+    }                                                                   \
+                                                                        \
+    static void radix_sort_scatter_##SUFFIX(radix_sort_task *task)      \
+    {                                                                   \
+        const TYPE *src = task->src;                                    \
+        TYPE *dst = task->dst;                                          \
+        size_t key_idx = 0;                                             \
+        TYPE key = 0;                                                   \
+                                                                        \
+        for (key_idx = task->start; key_idx < task->stop; ++key_idx) {  \
+            key = src[key_idx];                                         \
+            dst[task->counts[(key >> task->shift) & (RADIX_SORT_NUM_BUCKETS - 1)]++] = key; \
+        }                                                               \
+    }
+
+RADIX_SORT_KERNELS(uint32, uint32_t)
+RADIX_SORT_KERNELS(uint64, uint64_t)
+
+static void * radix_sort_count_digits_worker(void *task_ptr)
+{
+    radix_sort_task *task = task_ptr;
+
+    memset(task->digit_counts, 0, sizeof(task->digit_counts));
+    if (task->key_bytes == sizeof(uint32_t))
+        radix_sort_count_digits_uint32(task);
+    else
+        radix_sort_count_digits_uint64(task);
+
+    return NULL;
+}
+
+static void * radix_sort_count_worker(void *task_ptr)
+{
+    radix_sort_task *task = task_ptr;
+
+    memset(task->counts, 0, sizeof(task->counts));
+    if (task->key_bytes == sizeof(uint32_t))
+        radix_sort_count_uint32(task);
+    else
+        radix_sort_count_uint64(task);
+
+    return NULL;
+}
+
+static void * radix_sort_scatter_worker(void *task_ptr)
+{
+    radix_sort_task *task = task_ptr;
+
+    if (task->key_bytes == sizeof(uint32_t))
+        radix_sort_scatter_uint32(task);
+    else
+        radix_sort_scatter_uint64(task);
+
+    return NULL;
+}
+
+static void radix_sort_run_workers(radix_sort_task *tasks, const int num_tasks, void * (*worker)(void *))
+{
+    pthread_t threads[num_tasks];
+    int started[num_tasks];
+    int task_idx = 0;
+
+    /* a task whose thread cannot be started is run on this one instead */
+    for (task_idx = 1; task_idx < num_tasks; ++task_idx)
+        started[task_idx] = (pthread_create(&threads[task_idx], NULL, worker, &tasks[task_idx]) == 0);
+    worker(&tasks[0]);
+    for (task_idx = 1; task_idx < num_tasks; ++task_idx) {
+        if (started[task_idx])
+            pthread_join(threads[task_idx], NULL);
+        else
+            worker(&tasks[task_idx]);
+    }
+}
+
+static int radix_sort(void *keys, const size_t num_keys, const int key_bytes, const int num_threads)
+{
+    radix_sort_task *tasks = NULL;
+    void *scratch = NULL;
+    void *src = keys;
+    void *dst = NULL;
+    void *swap = NULL;
+    size_t digit_totals[RADIX_SORT_NUM_BUCKETS];
+    size_t position = 0;
+    size_t bucket_idx = 0;
+    int num_tasks = 1;
+    int task_idx = 0;
+    int digit_idx = 0;
+    int constant_digit = 0;
+
+    if (num_keys < 2)
+        return 0;
+
+    if ((num_threads > 1) && (num_keys >= RADIX_SORT_PARALLEL_MINIMUM))
+        num_tasks = num_threads;
+    tasks = malloc(sizeof(radix_sort_task) * num_tasks);
+    scratch = offset_arena_reserve(num_keys * key_bytes);
+    if ((!tasks) || (!scratch)) {
+        free(tasks);
+        offset_arena_release(scratch, num_keys * key_bytes);
+        errno = ENOMEM;
+        return -1;
+    }
+    dst = scratch;
+    for (task_idx = 0; task_idx < num_tasks; ++task_idx) {
+        tasks[task_idx].key_bytes = key_bytes;
+        tasks[task_idx].start = num_keys / num_tasks * task_idx;
+        tasks[task_idx].stop = (task_idx == num_tasks - 1) ? num_keys : num_keys / num_tasks * (task_idx + 1);
+        tasks[task_idx].src = src;
+    }
+
+    /* one pass counts every digit, which tells us the digits that are the same in every key */
+    radix_sort_run_workers(tasks, num_tasks, radix_sort_count_digits_worker);
+
+    for (digit_idx = 0; digit_idx < key_bytes; ++digit_idx) {
+        constant_digit = 0;
+        for (bucket_idx = 0; bucket_idx < RADIX_SORT_NUM_BUCKETS; ++bucket_idx) {
+            digit_totals[bucket_idx] = 0;
+            for (task_idx = 0; task_idx < num_tasks; ++task_idx)
+                digit_totals[bucket_idx] += tasks[task_idx].digit_counts[digit_idx][bucket_idx];
+            if (digit_totals[bucket_idx] == num_keys)
+                constant_digit = 1;
+        }
+        if (constant_digit)
+            continue;
+
+        for (task_idx = 0; task_idx < num_tasks; ++task_idx) {
+            tasks[task_idx].src = src;
+            tasks[task_idx].dst = dst;
+            tasks[task_idx].shift = digit_idx * RADIX_SORT_DIGIT_BITS;
+        }
+
+        /*
+           a lone task can use the totals as they are; otherwise each slice counts its own keys,
+           and slices write their share of a bucket in slice order, which keeps the sort stable
+        */
+        if (num_tasks == 1)
+            for (bucket_idx = 0, position = 0; bucket_idx < RADIX_SORT_NUM_BUCKETS; ++bucket_idx) {
+                tasks[0].counts[bucket_idx] = position;
+                position += digit_totals[bucket_idx];
+            }
+        else {
+            radix_sort_run_workers(tasks, num_tasks, radix_sort_count_worker);
+            for (bucket_idx = 0, position = 0; bucket_idx < RADIX_SORT_NUM_BUCKETS; ++bucket_idx)
+                for (task_idx = 0; task_idx < num_tasks; ++task_idx) {
+                    digit_totals[bucket_idx] = tasks[task_idx].counts[bucket_idx];
+                    tasks[task_idx].counts[bucket_idx] = position;
+                    position += digit_totals[bucket_idx];
+                }
+        }
+        radix_sort_run_workers(tasks, num_tasks, radix_sort_scatter_worker);
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != keys)
+        memcpy(keys, src, num_keys * key_bytes);
+
+    offset_arena_release(scratch, num_keys * key_bytes);
+    free(tasks);
+
+    return 0;
+}
+
+int radix_sort_uint32(uint32_t *keys, const size_t num_keys, const int num_threads)
+{
+    return radix_sort(keys, num_keys, sizeof(uint32_t), num_threads);
+}
+
+int radix_sort_uint64(uint64_t *keys, const size_t num_keys, const int num_threads)
+{
+    return radix_sort(keys, num_keys, sizeof(uint64_t), num_threads);
+}
@@ -0,0 +1,226 @@
+/*
+   record_arena.c
+
+   Slab-style storage for the record contents of a streamed sample; see
+   record_arena.h for the layout.
+*/
+
+#include "record_arena.h"
+
+typedef struct record_arena_extent record_arena_extent;
+
+struct record_arena_extent {
+    size_t offset;
+    long slot_idx;
+};
+
+static int record_arena_extent_compare(const void *extent1, const void *extent2)
+{
+    size_t offset1 = ((const record_arena_extent *) extent1)->offset;
+    size_t offset2 = ((const record_arena_extent *) extent2)->offset;
+
+    return (offset1 > offset2) - (offset1 < offset2);
+}
+
+static int record_slot_sequence_compare(const void *slot1, const void *slot2)
+{
+    uint64_t sequence1 = ((const record_slot *) slot1)->sequence;
+    uint64_t sequence2 = ((const record_slot *) slot2)->sequence;
+
+    return (sequence1 > sequence2) - (sequence1 < sequence2);
+}
+
+static int record_arena_reserve(record_arena *arena, const size_t len)
+{
+    char *resized_data = NULL;
+    size_t new_capacity = arena->capacity;
+    size_t garbage = 0;
+
+    if (arena->size + len <= arena->capacity)
+        return 0;
+
+    /* reclaim the space of replaced records before asking for more memory */
+    garbage = arena->pending_start - arena->live_bytes;
+    if ((garbage >= arena->live_bytes) && (garbage >= RECORD_ARENA_COMPACTION_MINIMUM)) {
+        if (record_arena_compact(arena) == -1)
+            return -1;
+        if (arena->size + len <= arena->capacity)
+            return 0;
+    }
+
+    while (arena->size + len > new_capacity)
+        new_capacity *= 2;
+    resized_data = realloc(arena->data, new_capacity);
+    if (!resized_data)
+        return -1;
+    arena->data = resized_data;
+    arena->capacity = new_capacity;
+    if (arena->capacity > arena->peak_capacity)
+        arena->peak_capacity = arena->capacity;
+
+    return 0;
+}
+
+record_arena * new_record_arena(const size_t capacity, const long slot_capacity)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> new_record_arena()\n");
+#endif
+
+    record_arena *arena = NULL;
+
+    arena = malloc(sizeof(record_arena));
+    if (!arena)
+        return NULL;
+
+    arena->data = malloc(capacity > 0 ? capacity : 1);
+    arena->slots = malloc(sizeof(record_slot) * (slot_capacity > 0 ? slot_capacity : 1));
+    if ((!arena->data) || (!arena->slots)) {
+        free(arena->data);
+        free(arena->slots);
+        free(arena);
+        return NULL;
+    }
+    arena->size = 0;
+    arena->capacity = (capacity > 0) ? capacity : 1;
+    arena->pending_start = 0;
+    arena->live_bytes = 0;
+    arena->peak_capacity = arena->capacity;
+    arena->num_slots = 0;
+    arena->slot_capacity = (slot_capacity > 0) ? slot_capacity : 1;
+    arena->compactions = 0;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> new_record_arena()\n");
+#endif
+
+    return arena;
+}
+
+void delete_record_arena(record_arena **arena_ptr)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> delete_record_arena()\n");
+#endif
+
+    free((*arena_ptr)->data);
+    free((*arena_ptr)->slots);
+    free(*arena_ptr);
+    *arena_ptr = NULL;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> delete_record_arena()\n");
+#endif
+}
+
+int record_arena_extend(record_arena *arena, const char *data, const size_t len)
+{
+    if (record_arena_reserve(arena, len) == -1)
+        return -1;
+    memcpy(arena->data + arena->size, data, len);
+    arena->size += len;
+
+    return 0;
+}
+
+int record_arena_commit(record_arena *arena, const long slot_idx, const uint64_t sequence)
+{
+    record_slot *slot = NULL;
+    record_slot *resized_slots = NULL;
+    size_t len = arena->size - arena->pending_start;
+
+    if (slot_idx == arena->num_slots) {
+        if (arena->num_slots == arena->slot_capacity) {
+            resized_slots = realloc(arena->slots, sizeof(record_slot) * arena->slot_capacity * 2);
+            if (!resized_slots)
+                return -1;
+            arena->slots = resized_slots;
+            arena->slot_capacity *= 2;
+        }
+        arena->num_slots++;
+        slot = &arena->slots[slot_idx];
+        slot->offset = arena->pending_start;
+        slot->capacity = len;
+    }
+    else {
+        slot = &arena->slots[slot_idx];
+        arena->live_bytes -= slot->length;
+        if (len <= slot->capacity) {
+            /* the replacement fits where the old record was, so the tail is handed back */
+            memcpy(arena->data + slot->offset, arena->data + arena->pending_start, len);
+            arena->size = arena->pending_start;
+        }
+        else {
+            slot->offset = arena->pending_start;
+            slot->capacity = len;
+        }
+    }
+    slot->length = len;
+    slot->sequence = sequence;
+    arena->live_bytes += len;
+    arena->pending_start = arena->size;
+
+    return 0;
+}
+
+void record_arena_discard(record_arena *arena)
+{
+    arena->size = arena->pending_start;
+}
+
+int record_arena_compact(record_arena *arena)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> record_arena_compact()\n");
+#endif
+
+    record_arena_extent *extents = NULL;
+    size_t write_offset = 0;
+    size_t pending_len = arena->size - arena->pending_start;
+    long extent_idx = 0;
+    record_slot *slot = NULL;
+
+    extents = malloc(sizeof(record_arena_extent) * (arena->num_slots > 0 ? arena->num_slots : 1));
+    if (!extents)
+        return -1;
+    for (extent_idx = 0; extent_idx < arena->num_slots; ++extent_idx) {
+        extents[extent_idx].offset = arena->slots[extent_idx].offset;
+        extents[extent_idx].slot_idx = extent_idx;
+    }
+    qsort(extents, arena->num_slots, sizeof(record_arena_extent), record_arena_extent_compare);
+
+    /* slide live records down in address order, then the partly-read record behind them */
+    for (extent_idx = 0; extent_idx < arena->num_slots; ++extent_idx) {
+        slot = &arena->slots[extents[extent_idx].slot_idx];
+        if (slot->offset != write_offset)
+            memmove(arena->data + write_offset, arena->data + slot->offset, slot->length);
+        slot->offset = write_offset;
+        slot->capacity = slot->length;
+        write_offset += slot->length;
+    }
+    if ((pending_len > 0) && (arena->pending_start != write_offset))
+        memmove(arena->data + write_offset, arena->data + arena->pending_start, pending_len);
+    arena->pending_start = write_offset;
+    arena->size = write_offset + pending_len;
+    arena->compactions++;
+
+    free(extents);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> record_arena_compact()\n");
+#endif
+
+    return 0;
+}
+
+void record_arena_sort_by_sequence(record_arena *arena)
+{
+    qsort(arena->slots, arena->num_slots, sizeof(record_slot), record_slot_sequence_compare);
+}
+
+const char * record_arena_record(const record_arena *arena, const long slot_idx, size_t *len)
+{
+    *len = arena->slots[slot_idx].length;
+
+    return arena->data + arena->slots[slot_idx].offset;
+}
@@ -0,0 +1,59 @@
+/*
+   record_fields.c
+
+   Tab-delimited columns of a record; see record_fields.h.
+*/
+
+#include "record_fields.h"
+
+const char * record_field(const char *record, const char *stop, const int column, size_t *field_len)
+{
+    const char *field = record;
+    const char *cursor = record;
+    int field_idx = 1;
+
+    if (column < 1)
+        return NULL;
+
+    /* columns are rarely more than a few bytes wide, so a byte loop beats repeated memchr calls */
+    for (cursor = record; (cursor < stop) && (*cursor != '\n'); ++cursor) {
+        if (*cursor != '\t')
+            continue;
+        if (field_idx == column)
+            break;
+        field = cursor + 1;
+        field_idx++;
+    }
+    if (field_idx != column)
+        return NULL;
+    *field_len = (size_t) (cursor - field);
+
+    return field;
+}
+
+int record_field_double(const char *record, const char *stop, const int column, double *value)
+{
+    char number[RECORD_FIELD_NUMBER_MAX_LENGTH];
+    const char *field = NULL;
+    char *number_stop = NULL;
+    size_t field_len = 0;
+
+    /* 
+       strtod() would read past the column (and the record) through leading whitespace, 
+       so the column is copied out and terminated first
+    */
+    field = record_field(record, stop, column, &field_len);
+    if ((!field) || (field_len == 0) || (field_len >= RECORD_FIELD_NUMBER_MAX_LENGTH)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(number, field, field_len);
+    number[field_len] = '\0';
+    *value = strtod(number, &number_stop);
+    if ((number_stop != number + field_len) || (!isfinite(*value))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+   replacement_reservoir.c
+
+   One-slot reservoirs with skip-ahead, for sampling with replacement in one
+   pass; see replacement_reservoir.h.
+*/
+
+#include "replacement_reservoir.h"
+
+/* the number of the record that next takes a slot last taken by record n */
+static uint64_t replacement_slot_next(rng_state *state, const uint64_t n)
+{
+    double u = 0.0;
+    double next = 0.0;
+
+    do {
+        u = rng_double(state);
+    } while (u <= 0.0);
+    next = floor((double) n / u) + 1.0;
+
+    return (next < 18446744073709551615.0) ? (uint64_t) next : UINT64_MAX;
+}
+
+static void replacement_slot_sift_down(replacement_slot *slots, const long num_slots, long slot_idx)
+{
+    replacement_slot slot = slots[slot_idx];
+    long child_idx = 0;
+
+    for (child_idx = 2 * slot_idx + 1; child_idx < num_slots; child_idx = 2 * slot_idx + 1) {
+        if ((child_idx + 1 < num_slots) && (slots[child_idx + 1].next < slots[child_idx].next))
+            child_idx++;
+        if (slot.next <= slots[child_idx].next)
+            break;
+        slots[slot_idx] = slots[child_idx];
+        slot_idx = child_idx;
+    }
+    slots[slot_idx] = slot;
+}
+
+replacement_reservoir * new_replacement_reservoir(const long k)
+{
+    replacement_reservoir *res = NULL;
+    long slot_idx = 0;
+
+    if (k <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    res = calloc(1, sizeof(replacement_reservoir));
+    if (!res)
+        return NULL;
+    res->slots = malloc(sizeof(replacement_slot) * k);
+    if (!res->slots) {
+        free(res);
+        errno = ENOMEM;
+        return NULL;
+    }
+    res->k = k;
+
+    /* every slot takes the first record, so the heap starts out level */
+    for (slot_idx = 0; slot_idx < k; ++slot_idx) {
+        res->slots[slot_idx].next = 1;
+        res->slots[slot_idx].offset = 0;
+    }
+
+    return res;
+}
+
+void delete_replacement_reservoir(replacement_reservoir **res_ptr)
+{
+    replacement_reservoir *res = *res_ptr;
+
+    if (!res)
+        return;
+
+    free(res->slots);
+    free(res);
+    *res_ptr = NULL;
+}
+
+void replacement_reservoir_take(replacement_reservoir *res, rng_state *state, const uint64_t offset)
+{
+    const uint64_t n = res->slots[0].next;
+
+    /* every slot waiting on this record takes it, and draws the record it waits on next */
+    while (res->slots[0].next == n) {
+        res->slots[0].offset = offset;
+        res->slots[0].next = replacement_slot_next(state, n);
+        replacement_slot_sift_down(res->slots, res->k, 0);
+    }
+    res->num_taken++;
+}
+
+uint64_t * replacement_reservoir_sorted_offsets(const replacement_reservoir *res)
+{
+    uint64_t *offsets = NULL;
+    long slot_idx = 0;
+
+    offsets = malloc(sizeof(uint64_t) * res->k);
+    if (!offsets) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* sorting the slots' offsets brings each record's draws together */
+    for (slot_idx = 0; slot_idx < res->k; ++slot_idx)
+        offsets[slot_idx] = res->slots[slot_idx].offset;
+    if (radix_sort_uint64(offsets, (size_t) res->k, 1) == -1) {
+        free(offsets);
+        return NULL;
+    }
+
+    return offsets;
+}
+
+uint64_t replacement_binomial(rng_state *state, const uint64_t n, const double p)
+{
+    double pmf = 0.0;
+    double cdf = 0.0;
+    double u = 0.0;
+    uint64_t x = 0;
+
+    if ((n == 0) || (p <= 0.0))
+        return 0;
+    if (p >= 1.0)
+        return n;
+
+    /*
+       inversion from 0 takes about as many steps as the mean; a mean so large that P(0) 
+       would underflow is split into halves
+    */
+    if (-((double) n) * log1p(-p) > 512.0)
+        return replacement_binomial(state, n / 2, p) + replacement_binomial(state, n - n / 2, p);
+    pmf = exp((double) n * log1p(-p));
+    cdf = pmf;
+    u = rng_double(state);
+    while ((u >= cdf) && (x < n)) {
+        pmf *= ((double) (n - x) / (double) (x + 1)) * (p / (1.0 - p));
+        x++;
+        cdf += pmf;
+        if (pmf < DBL_MIN)
+            break;
+    }
+
+    return x;
+}
+
+int replacement_sorted_draws(rng_state *state, const uint64_t num_groups, const uint64_t num_draws, uint64_t *draws)
+{
+    uint64_t draw_idx = 0;
+
+    if ((num_groups == 0) && (num_draws > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (draw_idx = 0; draw_idx < num_draws; ++draw_idx)
+        draws[draw_idx] = rng_bounded(state, num_groups);
+
+    return (num_draws > 1) ? radix_sort_uint64(draws, (size_t) num_draws, 1) : 0;
+}
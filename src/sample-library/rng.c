@@ -0,0 +1,374 @@
+/*
+   rng.c
+
+   Pluggable pseudorandom number generators; see rng.h.
+
+   cf. http://prng.di.unimi.it/xoshiro256starstar.c for xoshiro256** and its
+   jump function, http://www.pcg-random.org/ for PCG64, and Salmon et al.,
+   "Parallel random numbers: as easy as 1, 2, 3"
+   (http://dx.doi.org/10.1145/2063384.2063405) for Philox.
+*/
+
+#include "rng.h"
+
+#define RNG_PCG64_MULTIPLIER_HI 0x2360ed051fc65da4ULL
+#define RNG_PCG64_MULTIPLIER_LO 0x4385df649fccf645ULL
+#define RNG_PHILOX_M0 0xd2511f53U
+#define RNG_PHILOX_M1 0xcd9e8d57U
+#define RNG_PHILOX_W0 0x9e3779b9U
+#define RNG_PHILOX_W1 0xbb67ae85U
+#define RNG_PHILOX_ROUNDS 10
+#define RNG_PHILOX_STREAM_DOMAIN 0
+#define RNG_PHILOX_RECORD_DOMAIN 1
+
+rng_state rng_global_state = { kRngMt19937, { { {0}, MT19937_N + 1 } }, {0}, 0, 0, 0 };
+
+static const char *rng_names[] = { "mt19937", "mt19937-block", "xoshiro256", "pcg64", "philox" };
+
+static uint64_t rng_splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rng_rotate_left(const uint64_t x, const int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static void rng_refill_mt19937(rng_state *state)
+{
+    uint64_t hi = mt19937_generate_random_ulong_r(&state->u.mt);
+    uint64_t lo = mt19937_generate_random_ulong_r(&state->u.mt);
+
+    /* one word at a time, as other draws go straight to the generator */
+    state->buffer[0] = (hi << 32) | lo;
+    state->length = 1;
+}
+
+static void rng_refill_mt19937_block(rng_state *state)
+{
+    uint32_t *mt = state->u.mt_block;
+    uint32_t y = 0;
+    uint32_t hi = 0;
+    uint32_t lo = 0;
+    int kk = 0;
+
+    /* the twist of mt19937.c, with the conditional XOR turned into a mask */
+    for (kk = 0; kk < MT19937_N - MT19937_M; ++kk) {
+        y = (mt[kk] & MT19937_UPPER_MASK) | (mt[kk + 1] & MT19937_LOWER_MASK);
+        mt[kk] = mt[kk + MT19937_M] ^ (y >> 1) ^ (-(y & 0x1) & MT19937_MATRIX_A);
+    }
+    for (; kk < MT19937_N - 1; ++kk) {
+        y = (mt[kk] & MT19937_UPPER_MASK) | (mt[kk + 1] & MT19937_LOWER_MASK);
+        mt[kk] = mt[kk + (MT19937_M - MT19937_N)] ^ (y >> 1) ^ (-(y & 0x1) & MT19937_MATRIX_A);
+    }
+    y = (mt[MT19937_N - 1] & MT19937_UPPER_MASK) | (mt[0] & MT19937_LOWER_MASK);
+    mt[MT19937_N - 1] = mt[MT19937_M - 1] ^ (y >> 1) ^ (-(y & 0x1) & MT19937_MATRIX_A);
+
+    /* temper the whole vector, two words to a draw, in the order the Twister would hand them out */
+    for (kk = 0; kk < RNG_BUFFER_SIZE; ++kk) {
+        hi = mt[2 * kk];
+        hi ^= MT19937_SHIFT_U(hi);
+        hi ^= MT19937_SHIFT_S(hi) & MT19937_MASK_B;
+        hi ^= MT19937_SHIFT_T(hi) & MT19937_MASK_C;
+        hi ^= MT19937_SHIFT_L(hi);
+        lo = mt[2 * kk + 1];
+        lo ^= MT19937_SHIFT_U(lo);
+        lo ^= MT19937_SHIFT_S(lo) & MT19937_MASK_B;
+        lo ^= MT19937_SHIFT_T(lo) & MT19937_MASK_C;
+        lo ^= MT19937_SHIFT_L(lo);
+        state->buffer[kk] = ((uint64_t) hi << 32) | lo;
+    }
+    state->length = RNG_BUFFER_SIZE;
+}
+
+static inline uint64_t rng_step_xoshiro256(uint64_t *s)
+{
+    uint64_t result = rng_rotate_left(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotate_left(s[3], 45);
+
+    return result;
+}
+
+static void rng_refill_xoshiro256(rng_state *state)
+{
+    uint64_t s[4];
+    size_t idx = 0;
+
+    /* a local copy of the state stays in registers */
+    memcpy(s, state->u.xoshiro, sizeof(s));
+    for (idx = 0; idx < RNG_BUFFER_SIZE; ++idx)
+        state->buffer[idx] = rng_step_xoshiro256(s);
+    memcpy(state->u.xoshiro, s, sizeof(s));
+    state->length = RNG_BUFFER_SIZE;
+}
+
+static void rng_step_pcg64(rng_state *state)
+{
+    uint64_t hi = 0;
+    uint64_t lo = rng_multiply(state->u.pcg.state_lo, RNG_PCG64_MULTIPLIER_LO, &hi);
+
+    /* state = state * multiplier + increment, mod 2^128 */
+    hi += state->u.pcg.state_hi * RNG_PCG64_MULTIPLIER_LO + state->u.pcg.state_lo * RNG_PCG64_MULTIPLIER_HI;
+    lo += state->u.pcg.inc_lo;
+    hi += state->u.pcg.inc_hi + (lo < state->u.pcg.inc_lo);
+    state->u.pcg.state_hi = hi;
+    state->u.pcg.state_lo = lo;
+}
+
+static void rng_refill_pcg64(rng_state *state)
+{
+    uint64_t xored = 0;
+    unsigned int rotation = 0;
+    size_t idx = 0;
+
+    for (idx = 0; idx < RNG_BUFFER_SIZE; ++idx) {
+        rng_step_pcg64(state);
+        xored = state->u.pcg.state_hi ^ state->u.pcg.state_lo;
+        rotation = (unsigned int) (state->u.pcg.state_hi >> 58);
+        state->buffer[idx] = (xored >> rotation) | (xored << ((64 - rotation) & 63));
+    }
+    state->length = RNG_BUFFER_SIZE;
+}
+
+static void rng_seed_pcg64(rng_state *state, const uint64_t state_hi, const uint64_t state_lo, const uint64_t stream_hi, const uint64_t stream_lo)
+{
+    uint64_t lo = 0;
+
+    /* the increment is odd, and picks one of 2^127 streams */
+    state->u.pcg.inc_hi = (stream_hi << 1) | (stream_lo >> 63);
+    state->u.pcg.inc_lo = (stream_lo << 1) | 1;
+    state->u.pcg.state_hi = 0;
+    state->u.pcg.state_lo = 0;
+    rng_step_pcg64(state);
+    lo = state->u.pcg.state_lo + state_lo;
+    state->u.pcg.state_hi += state_hi + (lo < state_lo);
+    state->u.pcg.state_lo = lo;
+    rng_step_pcg64(state);
+}
+
+static void rng_refill_philox(rng_state *state)
+{
+    size_t idx = 0;
+
+    /* the stream's counters are kept apart from those of record keys by the high word */
+    for (idx = 0; idx < RNG_BUFFER_SIZE; idx += 2)
+        rng_philox4x32(state->u.philox.key, RNG_PHILOX_STREAM_DOMAIN, state->u.philox.counter++, state->buffer + idx);
+    state->length = RNG_BUFFER_SIZE;
+}
+
+void rng_seed(rng_state *state, const rng_kind kind, const uint64_t seed)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> rng_seed()\n");
+#endif
+
+    uint64_t x = seed;
+    uint64_t state_hi = 0;
+    uint64_t state_lo = 0;
+    uint64_t stream_hi = 0;
+    int idx = 0;
+
+    state->kind = kind;
+    state->length = 0;
+    state->next = 0;
+    state->num_drawn = 0;
+
+    switch (kind) {
+    case kRngMt19937Block:
+        /* seeded as mt19937.c seeds the Twister, so as to give the same sequence */
+        state->u.mt_block[0] = (uint32_t) seed;
+        for (idx = 1; idx < MT19937_N; ++idx)
+            state->u.mt_block[idx] = 69069 * state->u.mt_block[idx - 1];
+        break;
+    case kRngXoshiro256:
+        for (idx = 0; idx < 4; ++idx)
+            state->u.xoshiro[idx] = rng_splitmix64(&x);
+        break;
+    case kRngPcg64:
+        state_hi = rng_splitmix64(&x);
+        state_lo = rng_splitmix64(&x);
+        stream_hi = rng_splitmix64(&x);
+        rng_seed_pcg64(state, state_hi, state_lo, stream_hi, rng_splitmix64(&x));
+        break;
+    case kRngPhilox:
+        state->u.philox.key = rng_splitmix64(&x);
+        state->u.philox.counter = 0;
+        break;
+    default:
+        mt19937_seed_rng_r(&state->u.mt, (unsigned long) (seed & 0xffffffff));
+        break;
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> rng_seed()\n");
+#endif
+}
+
+void rng_split(rng_state *parent, rng_state *child)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> rng_split()\n");
+#endif
+
+    static const uint64_t jump[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t jumped[4] = { 0, 0, 0, 0 };
+    uint64_t state_hi = 0;
+    uint64_t state_lo = 0;
+    uint64_t stream_hi = 0;
+    int word_idx = 0;
+    int bit_idx = 0;
+    int idx = 0;
+
+    switch (parent->kind) {
+    case kRngXoshiro256:
+        /* the child takes over the parent's place in the sequence, and the parent jumps 2^128 draws ahead */
+        child->kind = kRngXoshiro256;
+        child->length = 0;
+        child->next = 0;
+        memcpy(child->u.xoshiro, parent->u.xoshiro, sizeof(parent->u.xoshiro));
+        for (word_idx = 0; word_idx < 4; ++word_idx)
+            for (bit_idx = 0; bit_idx < 64; ++bit_idx) {
+                if (jump[word_idx] & (1ULL << bit_idx))
+                    for (idx = 0; idx < 4; ++idx)
+                        jumped[idx] ^= parent->u.xoshiro[idx];
+                rng_step_xoshiro256(parent->u.xoshiro);
+            }
+        memcpy(parent->u.xoshiro, jumped, sizeof(jumped));
+        break;
+    case kRngPcg64:
+        /* the child gets a stream of its own */
+        state_hi = rng_next_u64(parent);
+        state_lo = rng_next_u64(parent);
+        stream_hi = rng_next_u64(parent);
+        child->kind = kRngPcg64;
+        child->length = 0;
+        child->next = 0;
+        rng_seed_pcg64(child, state_hi, state_lo, stream_hi, rng_next_u64(parent));
+        break;
+    case kRngMt19937Block:
+        rng_seed(child, kRngMt19937Block, rng_next_u64(parent) >> 32);
+        break;
+    case kRngPhilox:
+        /* record keys depend on the parent's key alone, so the child can stream from a key of its own */
+        child->kind = kRngPhilox;
+        child->length = 0;
+        child->next = 0;
+        child->u.philox.key = rng_next_u64(parent);
+        child->u.philox.counter = 0;
+        break;
+    default:
+        rng_seed(child, kRngMt19937, mt19937_generate_random_ulong_r(&parent->u.mt));
+        break;
+    }
+    child->num_drawn = 0;
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> rng_split()\n");
+#endif
+}
+
+void rng_refill(rng_state *state)
+{
+    switch (state->kind) {
+    case kRngMt19937Block:
+        rng_refill_mt19937_block(state);
+        break;
+    case kRngXoshiro256:
+        rng_refill_xoshiro256(state);
+        break;
+    case kRngPcg64:
+        rng_refill_pcg64(state);
+        break;
+    case kRngPhilox:
+        rng_refill_philox(state);
+        break;
+    default:
+        rng_refill_mt19937(state);
+        break;
+    }
+    state->next = 0;
+    state->num_drawn += state->length;
+}
+
+void rng_fill_u64(rng_state *state, uint64_t *values, size_t num_values)
+{
+    size_t num_copied = 0;
+
+    while (num_values > 0) {
+        if (state->next == state->length)
+            rng_refill(state);
+        num_copied = state->length - state->next;
+        if (num_copied > num_values)
+            num_copied = num_values;
+        memcpy(values, state->buffer + state->next, num_copied * sizeof(uint64_t));
+        state->next += num_copied;
+        values += num_copied;
+        num_values -= num_copied;
+    }
+}
+
+void rng_philox4x32(const uint64_t key, const uint64_t counter_hi, const uint64_t counter_lo, uint64_t *values)
+{
+    uint32_t c0 = (uint32_t) counter_lo;
+    uint32_t c1 = (uint32_t) (counter_lo >> 32);
+    uint32_t c2 = (uint32_t) counter_hi;
+    uint32_t c3 = (uint32_t) (counter_hi >> 32);
+    uint32_t k0 = (uint32_t) key;
+    uint32_t k1 = (uint32_t) (key >> 32);
+    uint64_t product0 = 0;
+    uint64_t product1 = 0;
+    int round_idx = 0;
+
+    for (round_idx = 0; round_idx < RNG_PHILOX_ROUNDS; ++round_idx) {
+        product0 = (uint64_t) RNG_PHILOX_M0 * c0;
+        product1 = (uint64_t) RNG_PHILOX_M1 * c2;
+        c0 = (uint32_t) (product1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) product1;
+        c2 = (uint32_t) (product0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) product0;
+        k0 += RNG_PHILOX_W0;
+        k1 += RNG_PHILOX_W1;
+    }
+    values[0] = ((uint64_t) c1 << 32) | c0;
+    values[1] = ((uint64_t) c3 << 32) | c2;
+}
+
+uint64_t rng_record_key(const rng_state *state, const uint64_t record_id)
+{
+    uint64_t values[2];
+
+    rng_philox4x32(state->u.philox.key, RNG_PHILOX_RECORD_DOMAIN, record_id, values);
+
+    return values[0];
+}
+
+int rng_kind_from_name(const char *name, rng_kind *kind)
+{
+    int kind_idx = 0;
+
+    for (kind_idx = 0; kind_idx < (int) (sizeof(rng_names) / sizeof(rng_names[0])); ++kind_idx)
+        if (strcmp(name, rng_names[kind_idx]) == 0) {
+            *kind = (rng_kind) kind_idx;
+            return 0;
+        }
+
+    return -1;
+}
+
+const char * rng_name(const rng_kind kind)
+{
+    return rng_names[kind];
+}
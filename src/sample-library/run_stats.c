@@ -0,0 +1,114 @@
+/*
+   run_stats.c
+
+   Per-phase times, page faults and counters for --stats; see run_stats.h.
+*/
+
+#include "run_stats.h"
+
+static const char *run_stats_phase_names[kRunStatsNumPhases] = { "setup", "scan", "shuffle", "sort", "emit" };
+
+static void run_stats_now(run_stats_interval *now)
+{
+    struct timespec wall;
+    struct rusage usage;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    getrusage(RUSAGE_SELF, &usage);
+    now->wall_seconds = (double) wall.tv_sec + (double) wall.tv_nsec / 1e9;
+    now->cpu_seconds = (double) usage.ru_utime.tv_sec + (double) usage.ru_utime.tv_usec / 1e6 + (double) usage.ru_stime.tv_sec + (double) usage.ru_stime.tv_usec / 1e6;
+    now->minor_faults = usage.ru_minflt;
+    now->major_faults = usage.ru_majflt;
+}
+
+/* charges what has passed since the last mark to the current phase, and marks now */
+static void run_stats_charge(run_stats *stats)
+{
+    run_stats_interval now;
+    run_stats_interval *charged = &stats->phases[stats->phase];
+
+    run_stats_now(&now);
+    charged->wall_seconds += now.wall_seconds - stats->mark.wall_seconds;
+    charged->cpu_seconds += now.cpu_seconds - stats->mark.cpu_seconds;
+    charged->minor_faults += now.minor_faults - stats->mark.minor_faults;
+    charged->major_faults += now.major_faults - stats->mark.major_faults;
+    stats->mark = now;
+}
+
+void run_stats_init(run_stats *stats, const int enabled, const int json)
+{
+    memset(stats, 0, sizeof(run_stats));
+    stats->enabled = enabled;
+    stats->json = json;
+    stats->phase = kRunStatsSetup;
+    if (enabled)
+        run_stats_now(&stats->mark);
+}
+
+run_stats_phase run_stats_enter(run_stats *stats, const run_stats_phase phase)
+{
+    run_stats_phase previous = stats->phase;
+
+    if ((!stats->enabled) || (phase == previous))
+        return previous;
+    run_stats_charge(stats);
+    stats->phase = phase;
+
+    return previous;
+}
+
+void run_stats_leave(run_stats *stats, const run_stats_phase previous)
+{
+    run_stats_enter(stats, previous);
+}
+
+const char * run_stats_phase_name(const run_stats_phase phase)
+{
+    return run_stats_phase_names[phase];
+}
+
+void run_stats_report(run_stats *stats, FILE *out)
+{
+    run_stats_interval total;
+    int phase_idx = 0;
+
+    if (!stats->enabled)
+        return;
+
+    run_stats_charge(stats);
+    memset(&total, 0, sizeof(run_stats_interval));
+    for (phase_idx = 0; phase_idx < kRunStatsNumPhases; ++phase_idx) {
+        total.wall_seconds += stats->phases[phase_idx].wall_seconds;
+        total.cpu_seconds += stats->phases[phase_idx].cpu_seconds;
+        total.minor_faults += stats->phases[phase_idx].minor_faults;
+        total.major_faults += stats->phases[phase_idx].major_faults;
+    }
+
+    if (stats->json) {
+        fprintf(out, "{\"phases\":{");
+        for (phase_idx = 0; phase_idx < kRunStatsNumPhases; ++phase_idx)
+            fprintf(out, "%s\"%s\":{\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f,\"minor_faults\":%ld,\"major_faults\":%ld}",
+                    (phase_idx > 0) ? "," : "", run_stats_phase_names[phase_idx],
+                    stats->phases[phase_idx].wall_seconds, stats->phases[phase_idx].cpu_seconds,
+                    stats->phases[phase_idx].minor_faults, stats->phases[phase_idx].major_faults);
+        fprintf(out, "},\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f,\"minor_faults\":%ld,\"major_faults\":%ld,"
+                "\"bytes_scanned\":%llu,\"records_seen\":%llu,\"rng_draws\":%llu,\"reallocations\":%llu,\"reservoir_bytes\":%llu,\"output_bytes\":%llu}\n",
+                total.wall_seconds, total.cpu_seconds, total.minor_faults, total.major_faults,
+                stats->bytes_scanned, stats->records_seen, stats->rng_draws, stats->reallocations, stats->reservoir_bytes, stats->output_bytes);
+    }
+    else {
+        fprintf(out, "%-10s %12s %12s %14s %14s\n", "phase", "wall_s", "cpu_s", "minor_faults", "major_faults");
+        for (phase_idx = 0; phase_idx < kRunStatsNumPhases; ++phase_idx)
+            fprintf(out, "%-10s %12.6f %12.6f %14ld %14ld\n", run_stats_phase_names[phase_idx],
+                    stats->phases[phase_idx].wall_seconds, stats->phases[phase_idx].cpu_seconds,
+                    stats->phases[phase_idx].minor_faults, stats->phases[phase_idx].major_faults);
+        fprintf(out, "%-10s %12.6f %12.6f %14ld %14ld\n", "total", total.wall_seconds, total.cpu_seconds, total.minor_faults, total.major_faults);
+        fprintf(out, "%-16s %llu\n", "bytes_scanned", stats->bytes_scanned);
+        fprintf(out, "%-16s %llu\n", "records_seen", stats->records_seen);
+        fprintf(out, "%-16s %llu\n", "rng_draws", stats->rng_draws);
+        fprintf(out, "%-16s %llu\n", "reallocations", stats->reallocations);
+        fprintf(out, "%-16s %llu\n", "reservoir_bytes", stats->reservoir_bytes);
+        fprintf(out, "%-16s %llu\n", "output_bytes", stats->output_bytes);
+    }
+    fflush(out);
+}
@@ -0,0 +1,418 @@
+/*
+   sample_state.c
+
+   Saved shard reservoirs; see sample_state.h for the layout.
+*/
+
+#include "sample_state.h"
+
+static size_t sample_state_encode_varint(uint64_t value, unsigned char *buf)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        buf[len++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (unsigned char) value;
+
+    return len;
+}
+
+static int sample_state_decode_varint(const unsigned char **cursor, const unsigned char *stop, uint64_t *value)
+{
+    int shift = 0;
+
+    *value = 0;
+    while ((*cursor < stop) && (shift < 64)) {
+        *value |= (uint64_t) (**cursor & 0x7f) << shift;
+        if (!(*((*cursor)++) & 0x80))
+            return 0;
+        shift += 7;
+    }
+
+    return -1;
+}
+
+static void sample_state_put(unsigned char **cursor, uint64_t value, const int num_bytes)
+{
+    int byte_idx = 0;
+
+    for (byte_idx = 0; byte_idx < num_bytes; ++byte_idx) {
+        *((*cursor)++) = (unsigned char) value;
+        value >>= 8;
+    }
+}
+
+static uint64_t sample_state_get(const unsigned char **cursor, const int num_bytes)
+{
+    uint64_t value = 0;
+    int byte_idx = 0;
+
+    for (byte_idx = 0; byte_idx < num_bytes; ++byte_idx)
+        value |= (uint64_t) *((*cursor)++) << (8 * byte_idx);
+
+    return value;
+}
+
+static void sample_state_encode_header(const sample_state_header *header, unsigned char *buf)
+{
+    unsigned char *cursor = buf;
+
+    memcpy(cursor, header->magic, sizeof(header->magic));
+    cursor += sizeof(header->magic);
+    sample_state_put(&cursor, header->version, 4);
+    sample_state_put(&cursor, header->rng_len, 4);
+    sample_state_put(&cursor, header->file_size, 8);
+    sample_state_put(&cursor, header->range_start, 8);
+    sample_state_put(&cursor, header->range_stop, 8);
+    sample_state_put(&cursor, (uint64_t) header->k, 8);
+    sample_state_put(&cursor, (uint64_t) header->num_groups, 8);
+    sample_state_put(&cursor, (uint64_t) header->num_offsets, 8);
+    sample_state_put(&cursor, header->lines_per_offset, 4);
+    sample_state_put(&cursor, header->keyed, 4);
+    sample_state_put(&cursor, header->filename_len, 8);
+    sample_state_put(&cursor, header->encoded_len, 8);
+}
+
+/* the fields after magic and version, which are read and checked first */
+static void sample_state_decode_header(const unsigned char *buf, sample_state_header *header)
+{
+    const unsigned char *cursor = buf;
+
+    header->rng_len = (uint32_t) sample_state_get(&cursor, 4);
+    header->file_size = sample_state_get(&cursor, 8);
+    header->range_start = sample_state_get(&cursor, 8);
+    header->range_stop = sample_state_get(&cursor, 8);
+    header->k = (int64_t) sample_state_get(&cursor, 8);
+    header->num_groups = (int64_t) sample_state_get(&cursor, 8);
+    header->num_offsets = (int64_t) sample_state_get(&cursor, 8);
+    header->lines_per_offset = (uint32_t) sample_state_get(&cursor, 4);
+    header->keyed = (uint32_t) sample_state_get(&cursor, 4);
+    header->filename_len = sample_state_get(&cursor, 8);
+    header->encoded_len = sample_state_get(&cursor, 8);
+}
+
+static size_t sample_state_encode_rng(const rng_state *rng, unsigned char *buf)
+{
+    unsigned char *cursor = buf;
+    size_t word_idx = 0;
+
+    sample_state_put(&cursor, (uint64_t) rng->kind, 4);
+    switch (rng->kind) {
+    case kRngMt19937:
+        sample_state_put(&cursor, (uint64_t) rng->u.mt.mti, 4);
+        for (word_idx = 0; word_idx < MT19937_N; ++word_idx)
+            sample_state_put(&cursor, (uint64_t) rng->u.mt.mt[word_idx], 4);
+        break;
+    case kRngMt19937Block:
+        for (word_idx = 0; word_idx < MT19937_N; ++word_idx)
+            sample_state_put(&cursor, rng->u.mt_block[word_idx], 4);
+        break;
+    case kRngXoshiro256:
+        for (word_idx = 0; word_idx < 4; ++word_idx)
+            sample_state_put(&cursor, rng->u.xoshiro[word_idx], 8);
+        break;
+    case kRngPcg64:
+        sample_state_put(&cursor, rng->u.pcg.state_hi, 8);
+        sample_state_put(&cursor, rng->u.pcg.state_lo, 8);
+        sample_state_put(&cursor, rng->u.pcg.inc_hi, 8);
+        sample_state_put(&cursor, rng->u.pcg.inc_lo, 8);
+        break;
+    case kRngPhilox:
+        sample_state_put(&cursor, rng->u.philox.key, 8);
+        sample_state_put(&cursor, rng->u.philox.counter, 8);
+        break;
+    }
+    sample_state_put(&cursor, rng->num_drawn, 8);
+    sample_state_put(&cursor, (uint64_t) (rng->length - rng->next), 4);
+    for (word_idx = rng->next; word_idx < rng->length; ++word_idx)
+        sample_state_put(&cursor, rng->buffer[word_idx], 8);
+
+    return (size_t) (cursor - buf);
+}
+
+static int sample_state_decode_rng(const unsigned char *buf, const size_t len, rng_state *rng)
+{
+    const unsigned char *cursor = buf;
+    const unsigned char *stop = buf + len;
+    size_t fields_len = 0;
+    size_t word_idx = 0;
+
+    if (len < 4)
+        return -1;
+    memset(rng, 0, sizeof(rng_state));
+    rng->kind = (rng_kind) sample_state_get(&cursor, 4);
+    switch (rng->kind) {
+    case kRngMt19937:
+        fields_len = 4 + 4 * MT19937_N;
+        break;
+    case kRngMt19937Block:
+        fields_len = 4 * MT19937_N;
+        break;
+    case kRngXoshiro256:
+    case kRngPcg64:
+        fields_len = 4 * 8;
+        break;
+    case kRngPhilox:
+        fields_len = 2 * 8;
+        break;
+    default:
+        return -1;
+    }
+    if ((size_t) (stop - cursor) < fields_len + 8 + 4)
+        return -1;
+
+    switch (rng->kind) {
+    case kRngMt19937:
+        rng->u.mt.mti = (int) sample_state_get(&cursor, 4);
+        for (word_idx = 0; word_idx < MT19937_N; ++word_idx)
+            rng->u.mt.mt[word_idx] = (unsigned long) sample_state_get(&cursor, 4);
+        if ((rng->u.mt.mti < 0) || (rng->u.mt.mti > MT19937_N + 1))
+            return -1;
+        break;
+    case kRngMt19937Block:
+        for (word_idx = 0; word_idx < MT19937_N; ++word_idx)
+            rng->u.mt_block[word_idx] = (uint32_t) sample_state_get(&cursor, 4);
+        break;
+    case kRngXoshiro256:
+        for (word_idx = 0; word_idx < 4; ++word_idx)
+            rng->u.xoshiro[word_idx] = sample_state_get(&cursor, 8);
+        break;
+    case kRngPcg64:
+        rng->u.pcg.state_hi = sample_state_get(&cursor, 8);
+        rng->u.pcg.state_lo = sample_state_get(&cursor, 8);
+        rng->u.pcg.inc_hi = sample_state_get(&cursor, 8);
+        rng->u.pcg.inc_lo = sample_state_get(&cursor, 8);
+        break;
+    case kRngPhilox:
+        rng->u.philox.key = sample_state_get(&cursor, 8);
+        rng->u.philox.counter = sample_state_get(&cursor, 8);
+        break;
+    }
+    rng->num_drawn = sample_state_get(&cursor, 8);
+    rng->length = (size_t) sample_state_get(&cursor, 4);
+    if ((rng->length > RNG_BUFFER_SIZE) || ((size_t) (stop - cursor) != 8 * rng->length))
+        return -1;
+    for (word_idx = 0; word_idx < rng->length; ++word_idx)
+        rng->buffer[word_idx] = sample_state_get(&cursor, 8);
+    rng->next = 0;
+
+    return 0;
+}
+
+void sample_state_header_init(sample_state_header *header)
+{
+    memset(header, 0, sizeof(sample_state_header));
+    memcpy(header->magic, SAMPLE_STATE_MAGIC, sizeof(SAMPLE_STATE_MAGIC));
+    header->version = SAMPLE_STATE_VERSION;
+}
+
+int sample_state_write(const char *state_fn, sample_state_header *header, const char *filename, const rng_state *rng, const uint64_t *offsets)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_state_write()\n");
+#endif
+
+    unsigned char header_buf[SAMPLE_STATE_HEADER_LENGTH];
+    unsigned char rng_buf[SAMPLE_STATE_RNG_MAX_LENGTH];
+    unsigned char varint[SAMPLE_STATE_VARINT_MAX_LENGTH];
+    size_t varint_len = 0;
+    int64_t offset_idx = 0;
+    uint64_t previous = 0;
+    char *tmp_fn = NULL;
+    FILE *tmp_file = NULL;
+    int tmp_fd = -1;
+    int tmp_created = 0;
+    int err = 0;
+
+    tmp_fn = malloc(strlen(state_fn) + 8);
+    if (!tmp_fn) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+
+    /* as with the sidecars, a reader never sees a partial state */
+    strcpy(tmp_fn, state_fn);
+    strcat(tmp_fn, ".XXXXXX");
+    tmp_fd = mkstemp(tmp_fn);
+    if (tmp_fd == -1) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_created = 1;
+    fchmod(tmp_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    tmp_file = fdopen(tmp_fd, "wb");
+    if (!tmp_file) {
+        err = errno;
+        goto cleanup;
+    }
+    tmp_fd = -1;
+
+    /* the encoded length is known once the offsets are out, so the header is written twice */
+    header->filename_len = strlen(filename);
+    header->rng_len = (uint32_t) sample_state_encode_rng(rng, rng_buf);
+    header->encoded_len = 0;
+    sample_state_encode_header(header, header_buf);
+    if ((fwrite(header_buf, 1, SAMPLE_STATE_HEADER_LENGTH, tmp_file) != SAMPLE_STATE_HEADER_LENGTH) ||
+        (fwrite(filename, 1, header->filename_len, tmp_file) != header->filename_len) ||
+        (fwrite(rng_buf, 1, header->rng_len, tmp_file) != header->rng_len)) {
+        err = errno;
+        goto cleanup;
+    }
+    for (offset_idx = 0; offset_idx < header->num_offsets; ++offset_idx) {
+        varint_len = sample_state_encode_varint(offsets[offset_idx] - previous, varint);
+        if (fwrite(varint, 1, varint_len, tmp_file) != varint_len) {
+            err = errno;
+            goto cleanup;
+        }
+        header->encoded_len += varint_len;
+        previous = offsets[offset_idx];
+    }
+    sample_state_encode_header(header, header_buf);
+    if ((fseek(tmp_file, 0, SEEK_SET) == -1) || (fwrite(header_buf, 1, SAMPLE_STATE_HEADER_LENGTH, tmp_file) != SAMPLE_STATE_HEADER_LENGTH) || (fflush(tmp_file) == EOF)) {
+        err = errno;
+        goto cleanup;
+    }
+    if (fclose(tmp_file) == EOF) {
+        tmp_file = NULL;
+        err = errno;
+        goto cleanup;
+    }
+    tmp_file = NULL;
+    if (rename(tmp_fn, state_fn) == -1)
+        err = errno;
+
+ cleanup:
+    if (tmp_file)
+        fclose(tmp_file);
+    if (tmp_fd != -1)
+        close(tmp_fd);
+    if ((err) && (tmp_created))
+        unlink(tmp_fn);
+    free(tmp_fn);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_state_write()\n");
+#endif
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+sample_state * sample_state_read(const char *state_fn)
+{
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Entering --> sample_state_read()\n");
+#endif
+
+    sample_state *state = NULL;
+    unsigned char header_buf[SAMPLE_STATE_HEADER_LENGTH];
+    unsigned char rng_buf[SAMPLE_STATE_RNG_MAX_LENGTH];
+    unsigned char *encoded = NULL;
+    const unsigned char *cursor = NULL;
+    FILE *state_file = NULL;
+    int64_t offset_idx = 0;
+    uint64_t delta = 0;
+    uint64_t previous = 0;
+    int err = 0;
+
+    state = calloc(1, sizeof(sample_state));
+    state_file = fopen(state_fn, "rb");
+    if ((!state) || (!state_file)) {
+        err = (state) ? errno : ENOMEM;
+        goto cleanup;
+    }
+
+    /* the version comes first, so that a state of another layout is named as such, and not misread */
+    if ((fread(header_buf, 1, sizeof(state->header.magic) + 4, state_file) != sizeof(state->header.magic) + 4) ||
+        (memcmp(header_buf, SAMPLE_STATE_MAGIC, sizeof(SAMPLE_STATE_MAGIC)) != 0)) {
+        err = EINVAL;
+        goto cleanup;
+    }
+    memcpy(state->header.magic, header_buf, sizeof(state->header.magic));
+    cursor = header_buf + sizeof(state->header.magic);
+    state->header.version = (uint32_t) sample_state_get(&cursor, 4);
+    if (state->header.version != SAMPLE_STATE_VERSION) {
+        err = ENOTSUP;
+        goto cleanup;
+    }
+    if (fread(header_buf + sizeof(state->header.magic) + 4, 1, SAMPLE_STATE_HEADER_LENGTH - sizeof(state->header.magic) - 4, state_file) != SAMPLE_STATE_HEADER_LENGTH - sizeof(state->header.magic) - 4) {
+        err = EINVAL;
+        goto cleanup;
+    }
+    sample_state_decode_header(header_buf + sizeof(state->header.magic) + 4, &state->header);
+    if ((state->header.rng_len > SAMPLE_STATE_RNG_MAX_LENGTH) ||
+        (state->header.num_offsets < 0) ||
+        (state->header.num_offsets > state->header.num_groups) ||
+        (state->header.range_stop > state->header.file_size) ||
+        (state->header.filename_len > 65536) ||
+        ((uint64_t) state->header.num_offsets > state->header.encoded_len) ||
+        (state->header.encoded_len > (uint64_t) state->header.num_offsets * SAMPLE_STATE_VARINT_MAX_LENGTH)) {
+        err = EINVAL;
+        goto cleanup;
+    }
+
+    state->filename = malloc(state->header.filename_len + 1);
+    state->offsets = malloc(sizeof(uint64_t) * (state->header.num_offsets > 0 ? state->header.num_offsets : 1));
+    encoded = malloc(state->header.encoded_len > 0 ? state->header.encoded_len : 1);
+    if ((!state->filename) || (!state->offsets) || (!encoded)) {
+        err = ENOMEM;
+        goto cleanup;
+    }
+    if ((fread(state->filename, 1, state->header.filename_len, state_file) != state->header.filename_len) ||
+        (fread(rng_buf, 1, state->header.rng_len, state_file) != state->header.rng_len) ||
+        (sample_state_decode_rng(rng_buf, state->header.rng_len, &state->rng) == -1) ||
+        (fread(encoded, 1, state->header.encoded_len, state_file) != state->header.encoded_len)) {
+        err = EINVAL;
+        goto cleanup;
+    }
+    state->filename[state->header.filename_len] = '\0';
+
+    cursor = encoded;
+    for (offset_idx = 0; offset_idx < state->header.num_offsets; ++offset_idx) {
+        if (sample_state_decode_varint(&cursor, encoded + state->header.encoded_len, &delta) == -1) {
+            err = EINVAL;
+            goto cleanup;
+        }
+        previous += delta;
+        if (previous >= state->header.file_size) {
+            err = EINVAL;
+            goto cleanup;
+        }
+        state->offsets[offset_idx] = previous;
+    }
+
+ cleanup:
+    if (state_file)
+        fclose(state_file);
+    free(encoded);
+    if (err)
+        delete_sample_state(&state);
+
+#ifdef DEBUG
+    fprintf(stderr, "Debug: Leaving  --> sample_state_read()\n");
+#endif
+
+    if (err)
+        errno = err;
+
+    return state;
+}
+
+void delete_sample_state(sample_state **state_ptr)
+{
+    sample_state *state = *state_ptr;
+
+    if (!state)
+        return;
+
+    free(state->filename);
+    free(state->offsets);
+    free(state);
+    *state_ptr = NULL;
+}
@@ -0,0 +1,146 @@
+/*
+   stratum_table.c
+
+   Open-addressing table of per-stratum offset reservoirs; see stratum_table.h.
+*/
+
+#include "stratum_table.h"
+
+stratum_table * new_stratum_table(const long max_offsets)
+{
+    stratum_table *table = NULL;
+
+    table = calloc(1, sizeof(stratum_table));
+    if (!table)
+        return NULL;
+    table->num_slots = STRATUM_TABLE_DEFAULT_SLOTS;
+    table->slots = calloc(table->num_slots, sizeof(uint32_t));
+    table->strata_capacity = STRATUM_TABLE_DEFAULT_SLOTS / 2;
+    table->strata = malloc(sizeof(stratum) * table->strata_capacity);
+    if ((!table->slots) || (!table->strata)) {
+        delete_stratum_table(&table);
+        errno = ENOMEM;
+        return NULL;
+    }
+    table->max_offsets = max_offsets;
+
+    return table;
+}
+
+void delete_stratum_table(stratum_table **table_ptr)
+{
+    stratum_table *table = *table_ptr;
+    size_t stratum_idx = 0;
+
+    if (!table)
+        return;
+
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx)
+        free(table->strata[stratum_idx].offsets);
+    free(table->strata);
+    free(table->slots);
+    free(table);
+    *table_ptr = NULL;
+}
+
+uint64_t stratum_key_hash(const char *key, const size_t key_len)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    size_t key_idx = 0;
+
+    /* FNV-1a -- keys are chromosome names, barcodes and the like, a few bytes to a few dozen */
+    for (key_idx = 0; key_idx < key_len; ++key_idx) {
+        hash ^= (unsigned char) key[key_idx];
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    /* the low bits pick the slot, so the high bits are folded down into them */
+    return hash ^ (hash >> 32);
+}
+
+static int stratum_table_grow(stratum_table *table)
+{
+    uint32_t *slots = NULL;
+    size_t num_slots = table->num_slots * 2;
+    size_t slot_idx = 0;
+    size_t stratum_idx = 0;
+
+    slots = calloc(num_slots, sizeof(uint32_t));
+    if (!slots) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (stratum_idx = 0; stratum_idx < table->num_strata; ++stratum_idx) {
+        for (slot_idx = table->strata[stratum_idx].hash & (num_slots - 1); slots[slot_idx]; slot_idx = (slot_idx + 1) & (num_slots - 1))
+            ;
+        slots[slot_idx] = (uint32_t) (stratum_idx + 1);
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+
+    return 0;
+}
+
+long stratum_table_index(stratum_table *table, const char *key, const size_t key_len)
+{
+    const uint64_t hash = stratum_key_hash(key, key_len);
+    stratum *resized_strata = NULL;
+    stratum *s = NULL;
+    size_t slot_idx = 0;
+
+    /* a slot holds a stratum's index plus one, so that zero marks it empty */
+    for (slot_idx = hash & (table->num_slots - 1); table->slots[slot_idx]; slot_idx = (slot_idx + 1) & (table->num_slots - 1)) {
+        s = &table->strata[table->slots[slot_idx] - 1];
+        if ((s->hash == hash) && (s->key_len == key_len) && (memcmp(s->key, key, key_len) == 0))
+            return (long) (table->slots[slot_idx] - 1);
+    }
+
+    if (table->num_strata == UINT32_MAX - 1) {
+        errno = ERANGE;
+        return -1;
+    }
+    if (table->num_strata == table->strata_capacity) {
+        resized_strata = realloc(table->strata, sizeof(stratum) * table->strata_capacity * 2);
+        if (!resized_strata) {
+            errno = ENOMEM;
+            return -1;
+        }
+        table->strata = resized_strata;
+        table->strata_capacity *= 2;
+    }
+    s = &table->strata[table->num_strata];
+    memset(s, 0, sizeof(stratum));
+    s->key = key;
+    s->key_len = key_len;
+    s->hash = hash;
+    table->slots[slot_idx] = (uint32_t) (++table->num_strata);
+
+    /* probes stay short while at most half the slots are taken */
+    if ((table->num_strata * 2 > table->num_slots) && (stratum_table_grow(table) == -1))
+        return -1;
+
+    return (long) (table->num_strata - 1);
+}
+
+int stratum_offsets_reserve(stratum_table *table, stratum *s, const long capacity)
+{
+    uint64_t *resized_offsets = NULL;
+    long new_capacity = (s->capacity > 0) ? s->capacity : STRATUM_OFFSETS_INITIAL_CAPACITY;
+
+    if (capacity <= s->capacity)
+        return 0;
+    while (new_capacity < capacity)
+        new_capacity *= 2;
+    if (new_capacity > table->max_offsets)
+        new_capacity = table->max_offsets;
+    resized_offsets = realloc(s->offsets, sizeof(uint64_t) * new_capacity);
+    if (!resized_offsets) {
+        errno = ENOMEM;
+        return -1;
+    }
+    s->offsets = resized_offsets;
+    s->capacity = new_capacity;
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+   libsample_check.c
+
+   Samples standard input through libsample, and writes the sampled records
+   to standard output, so that make check can compare them with what sample
+   writes for the same input, seed and options.
+
+   Usage: libsample-check [-k k] [-l lines-per-offset] [-d seed] [-g rng] [-r] [-p] < input
+
+   The options are those of sample, and k defaults to 0, a whole-input
+   shuffle. A failed call is reported on standard error, with its status.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libsample.h"
+
+static void check_fail(const char *call, const sample_status status)
+{
+    fprintf(stderr, "Error: %s failed (%s)\n", call, sample_status_string(status));
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    sample_options options;
+    sample_ctx *ctx = NULL;
+    sample_status status = kSampleOk;
+    const char *record = NULL;
+    size_t record_len = 0;
+    int opt = 0;
+
+    sample_options_init(&options);
+    options.seed = 1;
+    while ((opt = getopt(argc, argv, "k:l:d:g:rp")) != -1) {
+        switch (opt) {
+        case 'k':
+            options.k = atol(optarg);
+            break;
+        case 'l':
+            options.lines_per_offset = atoi(optarg);
+            break;
+        case 'd':
+            options.seed = (uint64_t) atol(optarg);
+            break;
+        case 'g':
+            if (rng_kind_from_name(optarg, &options.rng) == -1) {
+                fprintf(stderr, "Error: Unknown generator [%s]\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            options.with_replacement = 1;
+            break;
+        case 'p':
+            options.preserve_order = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: libsample-check [-k k] [-l lines-per-offset] [-d seed] [-g rng] [-r] [-p] < input\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ctx = new_sample_ctx(&options, &status);
+    if (!ctx)
+        check_fail("new_sample_ctx()", status);
+    if ((status = sample_feed_fd(ctx, STDIN_FILENO)) != kSampleOk)
+        check_fail("sample_feed_fd()", status);
+    while ((status = sample_next_record(ctx, &record, &record_len)) == kSampleOk) {
+        if (fwrite(record, 1, record_len, stdout) != record_len) {
+            fprintf(stderr, "Error: Could not write sample to standard output\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (status != kSampleEnd)
+        check_fail("sample_next_record()", status);
+    delete_sample_ctx(&ctx);
+
+    return EXIT_SUCCESS;
+}